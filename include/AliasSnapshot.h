@@ -0,0 +1,208 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// Binary snapshots of solved points-to results.
+//
+// A snapshot maps every node of the points-to graph that stands for a value
+// of the module to the points-to set of its representative, so that alias
+// queries can be answered without solving the constraints again.  Nodes are
+// named by a (kind, scope, slot) key: scope 0 holds the globals and
+// functions of the module in module order, and scope F+1 holds the arguments
+// and then the instructions of the F-th function, in order.  The kind tells
+// the pointer value itself from the memory object it allocates, and from the
+// return and vararg nodes of a function (keyed by the function's scope).
+//
+// Every scope also records a hash of its IR and the keys of the nodes its
+// constraints define, which is what an incremental solve needs to find the
+// part of the graph a changed function can reach.
+//
+// The file is laid out so that it can be mapped into memory and used in
+// place:
+//
+//   SnapshotHeader
+//   SnapshotScope Scopes[NumScopes]
+//   SnapshotKey Keys[NumKeys]           sorted by (Kind, Scope, Slot)
+//   uint32_t SetBegin[NumSets + 1]      offsets into Members
+//   uint32_t Members[NumMembers]        sorted key indices, NullObject removed
+//   uint32_t Defs[NumDefs]              key indices, by scope
+//   char Strings[StringBytes]           NUL-terminated scope names
+//
+// All fields are in the byte order of the machine that wrote the file.
+
+#ifndef ALIASSNAPSHOT_H_
+#define ALIASSNAPSHOT_H_
+
+#include "aliasAnalysis.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/System/DataTypes.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+static const char SnapshotMagic[8] = { 'L', 'U', 'P', 'A', 'P', 'T', 'S', 0 };
+static const uint32_t SnapshotVersion = 3;
+
+struct SnapshotHeader {
+	char Magic[8];
+	uint32_t Version;
+	// Hash of all the scope hashes; equal fingerprints mean equal modules.
+	uint32_t Fingerprint;
+	uint32_t NumScopes;
+	uint32_t NumKeys;
+	uint32_t NumSets;
+	uint32_t NumMembers;
+	uint32_t NumDefs;
+	uint32_t StringBytes;
+};
+
+struct SnapshotScope {
+	// Offset of the name in Strings.
+	uint32_t Name;
+	// Hash of the IR of the scope.
+	uint32_t Hash;
+	uint32_t Flags;
+	// Keys of the nodes defined by the constraints of the scope are
+	// Defs[DefBegin, DefEnd).
+	uint32_t DefBegin;
+	uint32_t DefEnd;
+};
+
+enum SnapshotScopeFlags {
+	// The defined nodes were recorded.
+	ScopeDefsKnown = 1,
+	// The scope has store constraints.
+	ScopeHasStores = 2
+};
+
+enum SnapshotKeyKind {
+	ValueKey, ObjectKey, ReturnKey, VarargKey,
+	// Special nodes and the saved object, by their index before the nodes
+	// are renumbered.
+	SpecialKey,
+	// Pointees without a key of their own, by node index in the run that
+	// wrote the snapshot.  They name no node of any other run.
+	UnstableKey
+};
+
+struct SnapshotKey {
+	uint32_t Kind;
+	uint32_t Scope;
+	uint32_t Slot;
+	// Points-to set of the node, or NoSet if it is not known.
+	uint32_t Set;
+};
+
+static const uint32_t NoSet = ~0U;
+
+bool operator<(const SnapshotKey &LHS, const SnapshotKey &RHS);
+
+/// ValueSlots - Assigns the stable (scope, slot) keys of a module's values,
+/// and hashes the IR of every scope.
+class ValueSlots {
+	std::vector<std::string> Scopes;
+	std::vector<uint32_t> Hashes;
+	std::vector<std::vector<Value *> > Values;
+	DenseMap<const Value *, std::pair<unsigned, unsigned> > Keys;
+	unsigned NumGlobals;
+	uint32_t Fingerprint;
+
+public:
+	explicit ValueSlots(Module *M);
+
+	/// getKey - Find the key of V, looking through constant casts and
+	/// getelementptrs the way Andersens does.  Returns false if V has no key.
+	bool getKey(const Value *V, unsigned &Scope, unsigned &Slot) const;
+
+	/// getValue - Return the value with the given key, or NULL.
+	Value *getValue(unsigned Scope, unsigned Slot) const;
+
+	/// getScope - Return the scope holding the body of F.
+	unsigned getScope(const Function *F) const;
+
+	/// getFunction - Return the function whose body is Scope.
+	Function *getFunction(unsigned Scope) const;
+
+	const std::vector<std::string> &getScopes() const {
+		return Scopes;
+	}
+	uint32_t getScopeHash(unsigned Scope) const {
+		return Hashes[Scope];
+	}
+	uint32_t getFingerprint() const {
+		return Fingerprint;
+	}
+};
+
+/// SnapshotFile - A snapshot mapped into memory.  The arrays point into the
+/// mapping and are valid until the file is closed.
+class SnapshotFile {
+	const char *Base;
+	size_t Size;
+
+	SnapshotFile(const SnapshotFile &); // DO NOT IMPLEMENT
+	void operator=(const SnapshotFile &); // DO NOT IMPLEMENT
+
+	bool isConsistent() const;
+
+public:
+	const SnapshotHeader *Header;
+	const SnapshotScope *Scopes;
+	const SnapshotKey *Keys;
+	const uint32_t *SetBegin;
+	const uint32_t *Members;
+	const uint32_t *Defs;
+	const char *Strings;
+
+	SnapshotFile();
+	~SnapshotFile();
+
+	/// open - Map the snapshot at Path.  Returns false and sets Error if the
+	/// file cannot be read or is not a valid snapshot.  Every offset, index
+	/// and count in a file that opens is within the file.
+	bool open(const std::string &Path, std::string &Error);
+	void close();
+
+	const char *getScopeName(unsigned Scope) const;
+
+	/// findKey - Return the index of Key in Keys, or ~0U.  The Set of Key is
+	/// ignored.
+	unsigned findKey(const SnapshotKey &Key) const;
+};
+
+/// SnapshotAA - Answers alias queries from a snapshot file mapped into
+/// memory.  Values the snapshot knows nothing about may alias anything.
+class SnapshotAA: public aliasAnalysis {
+	ValueSlots Slots;
+	SnapshotFile File;
+	// Scope of the snapshot for each scope of the module, or ~0U.
+	std::vector<unsigned> ScopeMap;
+
+	bool findSet(const Value *V, unsigned &Set) const;
+
+public:
+	SnapshotAA(Module *p, aliasAnalysis *a = 0);
+
+	/// open - Map the snapshot at Path.  Returns false and sets Error if the
+	/// file cannot be read or was not taken from this very module.
+	bool open(const std::string &Path, std::string &Error);
+
+	// Keep the two-value form of aliasAnalysis visible.
+	using aliasAnalysis::alias;
+	aliasResult alias(const Value *V1, unsigned V1Size, const Value *V2,
+			unsigned V2Size);
+};
+
+#endif /* ALIASSNAPSHOT_H_ */
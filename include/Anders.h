@@ -18,6 +18,9 @@
 #define ANDERS_H_
 
 #include "aliasAnalysis.h"
+#include "ExternalModels.h"
+#include "PointsToSet.h"
+#include "ThreadPool.h"
 #include "llvm/Support/CallSite.h"
 #include "llvm/Constants.h"
 #include "llvm/DerivedTypes.h"
@@ -27,9 +30,12 @@
 #include "llvm/Support/InstIterator.h"
 #include "llvm/Support/InstVisitor.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/System/Atomic.h"
+#include "llvm/System/DataTypes.h"
 #include "llvm/ADT/SparseBitVector.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include <algorithm>
 #include <set>
 #include <list>
@@ -44,26 +50,34 @@
 // order to disambiguate further than "points-to anything".
 #define FULL_UNIVERSAL 0
 
+class Steensgaard;
+
 //using namespace llvm;
 
 static const unsigned SelfRep = (unsigned) -1;
 static const unsigned Unvisited = (unsigned) -1;
+// End of a list of complex constraints.
+static const unsigned NoComplex = (unsigned) -1;
+// No successor being visited by a depth-first search.
+static const unsigned NoChild = (unsigned) -1;
+// A points-to set naming no object, or more than one, besides the null one.
+static const unsigned NoSingleton = (unsigned) -1;
 // Position of the function return node relative to the function node.
 static const unsigned CallReturnPos = 1;
 // Position of the function call node relative to the function node.
 static const unsigned CallFirstArgPos = 2;
 struct BitmapKeyInfo {
-	static inline SparseBitVector<> *getEmptyKey() {
-		return reinterpret_cast<SparseBitVector<> *>(-1);
+	static inline PointsToSet *getEmptyKey() {
+		return reinterpret_cast<PointsToSet *>(-1);
 	}
-	static inline SparseBitVector<> *getTombstoneKey() {
-		return reinterpret_cast<SparseBitVector<> *>(-2);
+	static inline PointsToSet *getTombstoneKey() {
+		return reinterpret_cast<PointsToSet *>(-2);
 	}
-	static unsigned getHashValue(const SparseBitVector<> *bitmap) {
+	static unsigned getHashValue(const PointsToSet *bitmap) {
 		return bitmap->getHashValue();
 	}
-	static bool isEqual(const SparseBitVector<> *LHS,
-			const SparseBitVector<> *RHS) {
+	static bool isEqual(const PointsToSet *LHS,
+			const PointsToSet *RHS) {
 		if (LHS == RHS)
 			return true;
 		else if (LHS == getEmptyKey() || RHS == getEmptyKey()
@@ -78,9 +92,193 @@ struct BitmapKeyInfo {
 	}
 };
 
+/// PointsToSetPool - Hash-consed storage for points-to sets.  Every distinct
+/// set is stored exactly once and named by an ID, ID 0 being the empty set.
+/// Interned sets are never modified; a union makes (or finds) another set,
+/// and the result of every union is remembered so that repeating it is a
+/// single hash lookup.  Most of the sets a solve makes are soon superseded,
+/// so the owner compacts the pool from time to time, keeping only the sets
+/// it still uses.
+class PointsToSetPool {
+	struct UnionKeyInfo {
+		static inline std::pair<unsigned, unsigned> getEmptyKey() {
+			return std::make_pair(~0U, ~0U);
+		}
+		static inline std::pair<unsigned, unsigned> getTombstoneKey() {
+			return std::make_pair(~0U - 1, ~0U - 1);
+		}
+		static unsigned getHashValue(const std::pair<unsigned, unsigned> &P) {
+			return P.first * 37U + P.second;
+		}
+		static bool isEqual(const std::pair<unsigned, unsigned> &LHS,
+				const std::pair<unsigned, unsigned> &RHS) {
+			return LHS == RHS;
+		}
+		static bool isPod() {
+			return true;
+		}
+	};
+
+	std::vector<PointsToSet *> Sets;
+	DenseMap<PointsToSet *, unsigned, BitmapKeyInfo> IDs;
+	DenseMap<std::pair<unsigned, unsigned>, unsigned, UnionKeyInfo> Unions;
+	unsigned UnionHits;
+	// Elements of all the stored sets, now and at most, the sets and
+	// elements freed by compact, and how often it ran.
+	uint64_t Bits;
+	uint64_t PeakBits;
+	unsigned PeakSets;
+	uint64_t FreedSets;
+	uint64_t FreedBits;
+	unsigned Compactions;
+
+public:
+	PointsToSetPool();
+	~PointsToSetPool();
+
+	/// clear - Drop every set except the empty one.
+	void clear();
+
+	/// compact - Free the sets whose IDs are not marked in Live, the empty
+	/// set aside, and number the others densely, keeping their order.  On
+	/// return Remap holds the new ID of every surviving old ID.  Remembered
+	/// unions survive if their operands and result all do.
+	void compact(const std::vector<bool> &Live, std::vector<unsigned> &Remap);
+
+	/// intern - Return the ID of the set equal to S, adding it if needed.
+	unsigned intern(const PointsToSet &S);
+
+	/// getUnion - Return the ID of the union of sets A and B.
+	unsigned getUnion(unsigned A, unsigned B);
+
+	/// get - Return the set with the given ID.  The set is shared by every
+	/// user of the ID and must not be modified.
+	PointsToSet *get(unsigned ID) const {
+		return Sets[ID];
+	}
+
+	unsigned getNumSets() const {
+		return Sets.size();
+	}
+	unsigned getNumUnions() const {
+		return Unions.size();
+	}
+	unsigned getNumUnionHits() const {
+		return UnionHits;
+	}
+	uint64_t getNumBits() const {
+		return Bits;
+	}
+	uint64_t getPeakBits() const {
+		return PeakBits;
+	}
+	unsigned getPeakSets() const {
+		return PeakSets;
+	}
+	uint64_t getNumFreedSets() const {
+		return FreedSets;
+	}
+	uint64_t getNumFreedBits() const {
+		return FreedBits;
+	}
+	unsigned getNumCompactions() const {
+		return Compactions;
+	}
+};
+
+/// OfflinePass - The offline optimizations run before solving, as the bits
+/// of a mask.
+enum OfflinePass {
+	OfflineHVN = 1, OfflineHU = 2, OfflineHCD = 4, AllOfflinePasses = 7
+};
+
+/// OfflineDecision - Whether an offline pass ran, and the estimates it was
+/// chosen on, in constraint visits.
+struct OfflineDecision {
+	const char *Pass;
+	bool Run;
+	// Work of the pass, and work it is expected to save the solver.
+	double Cost;
+	double Benefit;
+};
+
+/// OfflineTrial - One run of -anders-offline=benchmark, with a fixed set of
+/// offline passes.
+struct OfflineTrial {
+	// OfflinePass bits of the passes run.
+	unsigned Passes;
+	// Wall time of the offline passes, and of the whole run, in seconds.
+	double OfflineTime;
+	double TotalTime;
+	uint64_t NumPops;
+};
+
+/// SolverPhase - What one phase of the Andersens pipeline cost and did.
+struct SolverPhase {
+	const char *Name;
+	// Wall clock time, in seconds.
+	double WallTime;
+	// Growth of the peak resident set size, in kilobytes.
+	long PeakMemory;
+	// Representative nodes and constraints before and after the phase.
+	unsigned NodesBefore;
+	unsigned NodesAfter;
+	unsigned ConstraintsBefore;
+	unsigned ConstraintsAfter;
+	// Nodes united by the phase.
+	unsigned Unions;
+};
+
+/// SolverTelemetry - Per-phase costs of a run of Andersens, and the totals
+/// of its solve loop.
+class SolverTelemetry {
+public:
+	std::vector<SolverPhase> Phases;
+	uint64_t NumUnions;
+	// Nodes whose new points-to bits were pushed to their successors.
+	uint64_t NumPropagations;
+	uint64_t NumPops;
+	uint64_t NumRounds;
+	// Sum of the sizes of the points-to sets of the representatives.
+	uint64_t PointsToBits;
+	// Share of the constraints that are loads, stores or offset copies, and
+	// of the nodes that are address taken, when the offline passes were
+	// chosen, and the choices.
+	double ComplexRatio;
+	double AddressTakenRatio;
+	std::vector<OfflineDecision> Decisions;
+	double OfflineTime;
+	// With -anders-offline=benchmark, the runs with every combination of the
+	// offline passes.
+	std::vector<OfflineTrial> Trials;
+	// With -anders-shared-sets, the size of the pool at its peak and at the
+	// end of the solve, in sets and in set elements, and how often it was
+	// compacted.
+	unsigned PoolPeakSets;
+	uint64_t PoolPeakBits;
+	unsigned PoolSets;
+	uint64_t PoolBits;
+	unsigned PoolCompactions;
+
+	SolverTelemetry() {
+		clear();
+	}
+
+	void clear();
+
+	/// print - Print the phases as a table, followed by the totals.
+	void print(raw_ostream &OS) const;
+
+	/// printJSON - Print the phases and the totals as a JSON object.
+	void printJSON(raw_ostream &OS) const;
+};
+
 struct Node;
+struct SnapshotKey;
+class SnapshotFile;
+class ValueSlots;
 
-class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
+class Andersens: public aliasAnalysis {
 
 	/// Constraint - Objects of this structure are used to represent the various
 	/// constraints identified by the algorithm.  The constraints are 'copy',
@@ -171,23 +369,13 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 	public:
 		Value *Val;
 		SparseBitVector<> *Edges;
-		SparseBitVector<> *PointsTo;
-		SparseBitVector<> *OldPointsTo;
-		std::list<Constraint> Constraints;
+		PointsToSet *PointsTo;
+		PointsToSet *OldPointsTo;
+		// Complex constraints of the node: a list threaded through
+		// ComplexConstraints, from ComplexHead to ComplexTail.
+		unsigned ComplexHead;
+		unsigned ComplexTail;
 
-		// Pointer and location equivalence labels
-		unsigned PointerEquivLabel;
-		unsigned LocationEquivLabel;
-		// Predecessor edges, both real and implicit
-		SparseBitVector<> *PredEdges;
-		SparseBitVector<> *ImplicitPredEdges;
-		// Set of nodes that point to us, only use for location equivalence.
-		SparseBitVector<> *PointedToBy;
-		// Number of incoming edges, used during variable substitution to early
-		// free the points-to sets
-		unsigned NumInEdges;
-		// True if our points-to set is in the Set2PEClass map
-		bool StoredInHash;
 		// True if our node has no indirect constraints (complex or otherwise)
 		bool Direct;
 		// True if the node is address taken, *or* it is part of a group of nodes
@@ -195,6 +383,9 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 		// their arg nodes, which must be kept at the same position relative to
 		// their base function node.
 		bool AddressTaken;
+		// True if the demand-driven solver kept the constraints defining this
+		// node, so its points-to set is complete.
+		bool Demanded;
 
 		// Nodes in cycles (or in equivalence classes) are united together using a
 		// standard union-find representation with path compression.  NodeRep
@@ -205,12 +396,21 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 		// Used for work list prioritization.
 		unsigned Timestamp;
 
+		// IDs of PointsTo and OldPointsTo in the PointsToSetPool, when the
+		// solver shares points-to sets between nodes.
+		unsigned PointsToID;
+		unsigned OldPointsToID;
+
+		// The only object the solved points-to set of a representative names,
+		// the null object aside, or NoSingleton.  Alias queries on two such
+		// nodes compare it instead of the sets.
+		unsigned Singleton;
+
 		explicit Node(bool direct = true) :
-				Val(0), Edges(0), PointsTo(0), OldPointsTo(0), PointerEquivLabel(
-						0), LocationEquivLabel(0), PredEdges(0), ImplicitPredEdges(
-						0), PointedToBy(0), NumInEdges(0), StoredInHash(false), Direct(
-						direct), AddressTaken(false), NodeRep(SelfRep), Timestamp(
-						0) {
+				Val(0), Edges(0), PointsTo(0), OldPointsTo(0), ComplexHead(
+						NoComplex), ComplexTail(NoComplex), Direct(direct), AddressTaken(
+						false), Demanded(false), NodeRep(SelfRep), Timestamp(0), PointsToID(
+						0), OldPointsToID(0), Singleton(NoSingleton) {
 		}
 
 		Node *setValue(Value *V) {
@@ -252,6 +452,28 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 		}
 	};
 
+	// Node data only used by the offline optimizations, HVN and HU.  It
+	// lives in OfflineNodes, indexed like GraphNodes, while the constraints
+	// are optimized, and is freed before the graph is solved, all but the
+	// pointer equivalence labels.
+	struct OfflineNode {
+		// Predecessor edges, both real and implicit
+		SparseBitVector<> *PredEdges;
+		SparseBitVector<> *ImplicitPredEdges;
+		// Pointer equivalence label
+		unsigned PointerEquivLabel;
+		// Number of incoming edges, used during variable substitution to early
+		// free the points-to sets
+		unsigned NumInEdges;
+		// True if our points-to set is in the Set2PEClass map
+		bool StoredInHash;
+
+		OfflineNode() :
+				PredEdges(0), ImplicitPredEdges(0), PointerEquivLabel(0), NumInEdges(
+						0), StoredInHash(false) {
+		}
+	};
+
 	struct WorkListElement {
 		Node* node;
 		unsigned Timestamp;
@@ -268,8 +490,34 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 		}
 	};
 
-	// Priority-queue based work list specialized for Nodes.
+	// Work list interface of the sequential solver, with the counters used
+	// to compare the strategies.
 	class WorkList {
+	public:
+		// Nodes handed out, and entries thrown away because their node was
+		// already handed out or is no longer a representative.
+		unsigned Pops;
+		unsigned StalePops;
+
+		WorkList() :
+				Pops(0), StalePops(0) {
+		}
+		virtual ~WorkList() {
+		}
+
+		void clearCounters() {
+			Pops = StalePops = 0;
+		}
+
+		virtual void insert(Node* n) = 0;
+		// Return the next node to process, or 0 if the round is over.
+		virtual Node* pop() = 0;
+		virtual bool empty() = 0;
+	};
+
+	// Priority-queue based work list specialized for Nodes: the least
+	// recently fired node goes first.
+	class LRFWorkList: public WorkList {
 		std::priority_queue<WorkListElement> Q;
 
 	public:
@@ -288,8 +536,10 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 				Node* INode = x.node;
 
 				if (INode->isRep() && INode->Timestamp == x.Timestamp) {
+					++Pops;
 					return (x.node);
 				}
+				++StalePops;
 			}
 			return (0);
 		}
@@ -299,11 +549,94 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 		}
 	};
 
+	// Work list that sweeps the graph in topological order.  Pending nodes
+	// are kept in a bitmap, so a node is never queued twice; a node queued
+	// behind the sweep waits for the next one.  The same list serves as the
+	// current and the next work list, and the solver gives it a new order,
+	// from the condensation of the copy-edge graph, before every sweep.
+	class SweepWorkList: public WorkList {
+		Node *Nodes;
+		std::vector<unsigned> Order;
+		std::vector<bool> Dirty;
+		unsigned Pos;
+		unsigned NumDirty;
+
+	public:
+		SweepWorkList() :
+				Nodes(0), Pos(0), NumDirty(0) {
+		}
+
+		/// init - Empty the list, which will hold nodes of Base[0, Size).
+		void init(Node *Base, unsigned Size) {
+			Nodes = Base;
+			Order.clear();
+			Dirty.assign(Size, false);
+			Pos = 0;
+			NumDirty = 0;
+		}
+
+		/// setOrder - Start a new sweep over NewOrder, which holds every
+		/// representative.  Pending nodes that are no longer
+		/// representatives are dropped.
+		void setOrder(std::vector<unsigned> &NewOrder) {
+			Order.swap(NewOrder);
+			Pos = 0;
+			for (unsigned i = 0, e = Dirty.size(); i != e; ++i)
+				if (Dirty[i] && !Nodes[i].isRep()) {
+					Dirty[i] = false;
+					--NumDirty;
+					++StalePops;
+				}
+		}
+
+		void insert(Node* n) {
+			unsigned Index = n - Nodes;
+			if (!Dirty[Index]) {
+				Dirty[Index] = true;
+				++NumDirty;
+			}
+		}
+
+		Node* pop() {
+			while (Pos < Order.size()) {
+				unsigned Index = Order[Pos++];
+				if (!Dirty[Index])
+					continue;
+				Dirty[Index] = false;
+				--NumDirty;
+				if (Nodes[Index].isRep()) {
+					++Pops;
+					return &Nodes[Index];
+				}
+				++StalePops;
+			}
+			return (0);
+		}
+
+		bool empty() {
+			return NumDirty == 0;
+		}
+	};
+
 	/// GraphNodes - This vector is populated as part of the object
 	/// identification stage of the analysis, which populates this vector with a
 	/// node for each memory object and fills in the ValueNodes map.
 	std::vector<Node> GraphNodes;
 
+	/// OfflineNodes - The offline optimization data of GraphNodes, only
+	/// during OptimizeConstraints.
+	std::vector<OfflineNode> OfflineNodes;
+
+	/// PointerEquivLabels - The pointer equivalence labels the last offline
+	/// pass gave the nodes.  They outlive OfflineNodes, until
+	/// UnitePointerEquivalences has used them.
+	std::vector<unsigned> PointerEquivLabels;
+
+	/// ComplexConstraints - The load, store and offset copy constraints of
+	/// every node while solving, each node's in a list linked by ComplexNext.
+	std::vector<Constraint> ComplexConstraints;
+	std::vector<unsigned> ComplexNext;
+
 	/// ValueNodes - This map indicates the Node that a particular Value* is
 	/// represented by.  This contains entries for all pointers.
 	DenseMap<Value*, unsigned> ValueNodes;
@@ -326,14 +659,70 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 	/// identified by the program.
 	std::vector<Constraint> Constraints;
 
-	// Map from graph node to maximum K value that is allowed (for functions,
-	// this is equivalent to the number of arguments + CallFirstArgPos)
+	// Map from graph node to the number of nodes, itself included, that an
+	// offset K can reach from it.  For functions, this is the function node
+	// and its return, vararg and argument nodes; for a field of an object,
+	// the fields from it to the end of the object.
 	std::map<unsigned, unsigned> MaxK;
 
+	// The most field nodes an object gets: -anders-max-fields with
+	// -anders-field-sensitive, and 1 without.
+	unsigned MaxFields;
+	// The constant getelementptrs into a field past the first, which have a
+	// node of their own to point to the field from.
+	std::vector<ConstantExpr *> FieldAddresses;
+	// The struct types an object may be reached as, or through, other than
+	// by the fields of its type, which make the objects of them, and those
+	// holding them, keep a single node.
+	DenseSet<const Type *> FieldUnsafeTypes;
+
+	// The index every node had before ClumpAddressTaken renumbered it, by
+	// its new index, and the other way around.  Empty until then.
+	std::vector<unsigned> ClumpedFrom;
+	std::vector<unsigned> ClumpedTo;
+
+	/// getSavedNode - Return the node of the saved object, which is
+	/// SavedObject until ClumpAddressTaken moves it.
+	unsigned getSavedNode() const {
+		if (ClumpedTo.empty())
+			return SavedObject;
+		return ClumpedTo[SavedObject];
+	}
+
+	// A function that passes one of its arguments on to a lock function or
+	// to another lock wrapper.  With -anders-clone-wrappers every direct
+	// call of a wrapper gets a clone of its nodes and constraints, so that
+	// what the wrapper sees in that call does not mix with its other calls.
+	struct LockWrapper {
+		// The nodes of the wrapper are [First, End).
+		unsigned First;
+		unsigned End;
+		// The nodes, by index from First, the clones share with the wrapper
+		// rather than copy: the function node and the memory objects.
+		std::vector<bool> Shared;
+		// First node of each clone, in the order of the calls.
+		std::vector<unsigned> Clones;
+	};
+	std::map<Function *, LockWrapper> LockWrappers;
+	// The wrapper a call calls, and the first node of the clone made for the
+	// call.
+	DenseMap<const Instruction *, std::pair<const LockWrapper *, unsigned> >
+			CallClones;
+
+	// Functions that return memory they allocate and hand to nobody else.
+	// Every direct call of one gets a heap object of its own, which holds
+	// what the objects the wrapper returns hold, so that the objects of
+	// different callers do not alias.
+	DenseSet<const Function *> AllocWrappers;
+
 	/// This enum defines the GraphNodes indices that correspond to important
 	/// fixed sets.
 	enum {
-		UniversalSet = 0, NullPtr = 1, NullObject = 2, NumberSpecialNodes
+		UniversalSet = 0, NullPtr = 1, NullObject = 2, NumberSpecialNodes,
+		// The node after them holds what the calls of SavesArg models save
+		// away, for the ReturnsSaved ones to read.  The solver treats it as
+		// any other object.
+		SavedObject = NumberSpecialNodes
 	};
 	// Stack for Tarjan's
 	std::stack<unsigned> SCCStack;
@@ -341,16 +730,68 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 	std::vector<unsigned> Node2DFS;
 	// Map from Graph Node to Deleted from graph.
 	std::vector<bool> Node2Deleted;
-	// Same as Node Maps, but implemented as std::map because it is faster to
-	// clear
-	std::map<unsigned, unsigned> Tarjan2DFS;
-	std::map<unsigned, bool> Tarjan2Deleted;
+	// Same as Node Maps, for the lazy cycle searches of the solver.  Every
+	// entry is stamped with the search that wrote it, so a new search clears
+	// them all in constant time; use tarjanDFS and tarjanDeleted to read them.
+	std::vector<unsigned> Tarjan2DFS;
+	std::vector<bool> Tarjan2Deleted;
+	std::vector<unsigned> Tarjan2Epoch;
+	unsigned TarjanEpoch;
 	// Current DFS number
 	unsigned DFSNumber;
 
+	// Frame of the iterative depth-first searches: the node and its DFS
+	// number, the edge set being walked and the position in it, and the
+	// successor being visited, if any.  While the work list solver runs, the
+	// frozen row of the node is walked before the edge set.
+	struct DFSFrame {
+		unsigned Node;
+		unsigned DFS;
+		// Walking the implicit predecessor edges (HVN and HU only).
+		bool Implicit;
+		const SparseBitVector<> *Edges;
+		SparseBitVector<>::iterator It;
+		const unsigned *Row;
+		const unsigned *RowEnd;
+		unsigned Child;
+
+		DFSFrame(unsigned N, unsigned D, const SparseBitVector<> *E) :
+				Node(N), DFS(D), Implicit(false), Edges(E), It(E->begin()), Row(
+						0), RowEnd(0), Child(NoChild) {
+		}
+
+		/// next - Set Target to the next successor, or return false if
+		/// there is none left.
+		bool next(unsigned &Target) {
+			if (Row != RowEnd) {
+				Target = *Row++;
+				return true;
+			}
+			if (It == Edges->end())
+				return false;
+			Target = *It;
+			++It;
+			return true;
+		}
+	};
+
+	// The copy edges of the work list solver, frozen into compressed sparse
+	// rows: the row of node N is EdgeTargets[EdgeBegin[N], EdgeEnd[N]).
+	// Rows only shrink in place.  The edges added while solving go to
+	// Node::Edges, and FoldEdges moves them into new rows now and then.
+	// Empty outside of SolveWorkList.
+	std::vector<unsigned> EdgeBegin;
+	std::vector<unsigned> EdgeEnd;
+	std::vector<unsigned> EdgeTargets;
+	// Edges added to Node::Edges since the last FoldEdges.
+	unsigned NumOverflowEdges;
+
 	// Work lists.
-	WorkList w1, w2;
+	LRFWorkList w1, w2;
+	SweepWorkList Sweep;
 	WorkList *CurrWL, *NextWL; // "current" and "next" work lists
+	// Rounds of the sequential solver.
+	unsigned NumRounds;
 
 	// Offline variable substitution related things
 
@@ -370,7 +811,7 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 	// Current pointer equivalence class number
 	unsigned PEClass;
 	// Mapping from points-to sets to equivalence classes
-	typedef DenseMap<SparseBitVector<> *, unsigned, BitmapKeyInfo> BitVectorMap;
+	typedef DenseMap<PointsToSet *, unsigned, BitmapKeyInfo> BitVectorMap;
 	BitVectorMap Set2PEClass;
 	// Mapping from pointer equivalences to the representative node.  -1 if we
 	// have no representative node for this pointer equivalence class yet.
@@ -387,42 +828,158 @@ class Andersens: public aliasAnalysis, private InstVisitor<Andersens> {
 	// Whether to use SDT (UniteNodes can use it during solving, but not before)
 	bool SDTActive;
 
+	// Cycle detection counters of the work list solver: nodes united through
+	// SDT, lazy cycle searches, and nodes they united.
+	unsigned NumHCDUnited;
+	unsigned NumLCDSearches;
+	unsigned NumLCDUnited;
+
+	// Interned points-to sets.  When SharingPointsTo is set, the PointsTo and
+	// OldPointsTo of every node are owned by this pool and only change through
+	// AddToPointsTo, MarkPropagated, ResetOldPointsTo and CommitWave.
+	PointsToSetPool PointsToSets;
+	bool SharingPointsTo;
+	// Sets in the pool after it was last compacted.
+	unsigned PoolLiveSets;
+
+	// True while only the constraints needed by the lock operands have been
+	// solved.
+	bool DemandDriven;
+
+	// Snapshot of a previous run, used to solve incrementally.  When it is
+	// set, CollectConstraints records for every snapshot scope the nodes its
+	// constraints define and whether it has stores.  SnapshotError tells
+	// why the last run could not use it, if it could not.
+	std::string SnapshotPath;
+	std::string SnapshotError;
+	std::vector<std::vector<unsigned> > ScopeDefs;
+	std::vector<bool> ScopeStores;
+
+	// With -anders-lock-projection, the objects that may hold a lock.  After
+	// solving, the points-to sets of the representatives are cut down to
+	// their lock objects, LockMembers[LockBegin[N], LockBegin[N + 1]) in
+	// order, and freed.  LockOnly tells the sets that held nothing else.
+	std::vector<bool> LockObjects;
+	std::vector<unsigned> LockBegin;
+	std::vector<unsigned> LockMembers;
+	std::vector<bool> LockOnly;
+	bool LockProjected;
+
+	// Models of the external functions, loaded by the first run, and the
+	// models of the declarations of the module.
+	ExternalModels Models;
+	DenseMap<const Function *, ExternalModel> FunctionModels;
+
+	// Costs of the phases run so far, and the start of the current phase.
+	SolverTelemetry Telemetry;
+	double PhaseStartTime;
+	long PhaseStartMemory;
+	uint64_t PhaseStartUnions;
+
+	// The offline passes of the benchmark trial being run, or ~0U outside
+	// the trials.
+	unsigned TrialPasses;
+
+	// The solver chosen with setWaveSolver: 0 for the work list solver, 1
+	// for the wave solver, or ~0U for the one -anders-solver names.
+	unsigned SolverChoice;
+
+	// The offline passes chosen with setOfflinePasses, or ~0U for those
+	// -anders-offline and -anders-hcd choose.
+	unsigned PassChoice;
+
+	// Budget of Analyze: when building, optimizing and solving the
+	// constraints runs for longer than -anders-time-budget or the process
+	// grows larger than -anders-memory-budget, the analysis is abandoned at
+	// the next check and the queries are answered by Fallback, a Steensgaard
+	// analysis chained to AA.
+	double BudgetStartTime;
+	bool OverBudget;
+	Steensgaard *Fallback;
+
 public:
 
 	Andersens(Module *p, aliasAnalysis *a = 0) :
-			aliasAnalysis(p, a) {
+			aliasAnalysis(p, a), MaxFields(1), NumOverflowEdges(0), FirstRefNode(
+					0), FirstAdrNode(0), NumHCDUnited(0), NumLCDSearches(0), NumLCDUnited(
+					0), SharingPointsTo(
+					false), PoolLiveSets(0), DemandDriven(false), LockProjected(
+					false), TrialPasses(~0U), SolverChoice(~0U), PassChoice(
+					~0U), BudgetStartTime(0), OverBudget(false), Fallback(0) {
+	}
+	~Andersens();
+
+	/// setSnapshot - Solve incrementally from the snapshot at Path, if it was
+	/// taken from an earlier version of the module.  A snapshot only has keys
+	/// for the values of the module, so with one set the objects keep a
+	/// single field, and neither the calls of allocation wrappers nor those
+	/// of lock wrappers are cloned: the answers are those of a run with
+	/// -anders-field-sensitive, -anders-clone-allocators and
+	/// -anders-clone-wrappers turned off, whether the snapshot is used or
+	/// not.
+	void setSnapshot(const std::string &Path) {
+		SnapshotPath = Path;
 	}
 
-	void runOnModule() {
-		DEBUG(errs() << "run on module in anders" << "\n");
-		IdentifyObjects(*program);
-		CollectConstraints(*program);
-#undef DEBUG_TYPE
-#define DEBUG_TYPE "anders-aa-constraints"
-		DEBUG(PrintConstraints());
-#undef DEBUG_TYPE
-#define DEBUG_TYPE "anders-aa"
-		SolveConstraints();
-		DEBUG(PrintPointsToGraph());
-
-		// Free the constraints list, as we don't need it to respond to alias
-		// requests.
-		std::vector<Constraint>().swap(Constraints);
-		//These are needed for Print() (-analyze in opt)
-		//ObjectNodes.clear();
-		//ReturnNodes.clear();
-		//VarargNodes.clear();
+	/// getSnapshotError - Return why the last run solved the whole program
+	/// rather than from the snapshot, or an empty string if it used it.
+	const std::string &getSnapshotError() const {
+		return SnapshotError;
+	}
 
-		//PrintPointsToGraph();
+	/// setWaveSolver - Solve with the wave propagation solver if Wave is
+	/// set, or with the work list solver, whatever -anders-solver says.
+	void setWaveSolver(bool Wave) {
+		SolverChoice = Wave;
+	}
 
+	/// setOfflinePasses - Run the offline passes of the OfflinePass mask
+	/// Passes before solving, whatever -anders-offline and -anders-hcd say.
+	void setOfflinePasses(unsigned Passes) {
+		PassChoice = Passes;
 	}
 
+	void runOnModule();
+
 	//------------------------------------------------
 	// Implement the AliasAnalysis API
 	//
+	// Keep the two-value form of aliasAnalysis visible.
+	using aliasAnalysis::alias;
 	aliasResult alias(const Value *V1, unsigned V1Size, const Value *V2,
 			unsigned V2Size);
 
+	/// contextAlias - Like alias, but a value of a lock wrapper is taken in
+	/// the clone of the wrapper made for the given call, if there is one.
+	aliasResult contextAlias(const Value *V1, const Instruction *Context1,
+			const Value *V2, const Instruction *Context2);
+
+	/// contextAliasBatch - Like contextAlias for each value of V2, finding
+	/// the representative of V1 once.
+	void contextAliasBatch(const Value *V1, const Instruction *Context1,
+			const std::vector<const Value*> &V2, const Instruction *Context2,
+			std::vector<aliasResult> &Results);
+
+	/// getPointsTo - The solved points-to set of V in Context, the null
+	/// object aside, or its lock objects once they have been projected.
+	bool getPointsTo(const Value *V, const Instruction *Context,
+			std::vector<unsigned> &Objects);
+
+	/// writeSnapshot - Write the solved points-to sets to Path in the format
+	/// of AliasSnapshot.h.  Returns false and sets Error on failure.
+	bool writeSnapshot(const std::string &Path, std::string &Error);
+
+	/// getTelemetry - Return the costs of the phases of the last run.
+	const SolverTelemetry &getTelemetry() const {
+		return Telemetry;
+	}
+
+	/// ranOutOfBudget - Return true if the last run gave up solving and
+	/// answers from Steensgaard's analysis instead.
+	bool ranOutOfBudget() const {
+		return Fallback != 0;
+	}
+
 private:
 
 	unsigned getNode(Value *V) {
@@ -451,6 +1008,14 @@ private:
 		return I->second;
 	}
 
+	/// getModel - Return the model of the external function F, or NULL if
+	/// it has none.
+	const ExternalModel *getModel(const Function *F) const {
+		DenseMap<const Function*, ExternalModel>::const_iterator I =
+				FunctionModels.find(F);
+		return I == FunctionModels.end() ? 0 : &I->second;
+	}
+
 	/// getReturnNode - Return the node representing the return value for the
 	/// specified function.
 	unsigned getReturnNode(Function *F) const {
@@ -484,7 +1049,13 @@ private:
 	void CollectConstraints(Module &M);
 	bool AnalyzeUsesOfFunction(Value *);
 	void CreateConstraintGraph();
+	void AddComplexConstraint(unsigned NodeIndex, const Constraint &C);
+	unsigned EraseComplexConstraint(Node *N, unsigned Prev, unsigned Index);
+	void SpliceComplexConstraints(Node *First, Node *Second);
 	void OptimizeConstraints();
+	unsigned ChooseOfflinePasses();
+	void RunOfflineTrials();
+	void FreeOfflineNodes();
 	unsigned FindEquivalentNode(unsigned, unsigned);
 	void ClumpAddressTaken();
 	void RewriteConstraints();
@@ -494,17 +1065,111 @@ private:
 	void Search(unsigned Node);
 	void UnitePointerEquivalences();
 	void SolveConstraints();
+	void Analyze();
+	void FindMemoryNodes(std::vector<bool> &InMemory);
+	void FindMemoryClasses(std::vector<unsigned> &Through,
+			std::vector<unsigned> &ClassOf);
+	bool SliceConstraints(Module &M);
+	void RecordScopeConstraints(unsigned Scope, unsigned Begin);
+	bool ApplyBaseline(std::string &Error);
+	void CollectNodeKeys(const ValueSlots &Slots,
+			std::vector<std::pair<SnapshotKey, unsigned> > &Out);
+	bool getNodeForKey(const SnapshotFile &File, const ValueSlots &Slots,
+			unsigned Index, unsigned &NodeIndex);
+	void ResetAnalysis();
+	void SolveWorkList();
+	void BeginPhase(const char *Name);
+	void EndPhase();
+	bool OutOfBudget();
+	void FallBackToSteensgaard(const char *Phase);
+	unsigned CloneLockWrappers(Module &M, unsigned NumObjects);
+	void FindFieldUnsafeTypes(Module &M);
+	void FindFieldUnsafeCasts(Constant *C, SmallPtrSet<Constant *, 32> &Visited);
+	void CheckFieldCast(User *Cast);
+	bool isFollowedAddress(User *Cast) const;
+	bool isFieldUnsafe(const Type *T) const;
+	unsigned countFields(Value *Object) const;
+	void NumberObject(Value *Object, unsigned &NumObjects);
+	void NumberFieldAddresses(Constant *C, unsigned &NumObjects);
+	void FindAllocWrappers(Module &M);
+	bool returnsFreshObjects(Function *F) const;
+	bool isCaptured(Value *V) const;
+	const LockWrapper *findCallClone(const Instruction *Call,
+			unsigned &Base) const;
+	static unsigned getCloneNode(unsigned NodeIndex, const LockWrapper &W,
+			unsigned Base);
+	unsigned getContextNode(const Value *V, const Instruction *Context);
+	aliasResult queryPointsTo(const Value *V1, const Instruction *Context1,
+			const Value *V2, const Instruction *Context2);
+	bool pointsToDisjoint(unsigned Rep1, unsigned Rep2);
+	bool isMustAlias(const Value *V1, const Instruction *Context1,
+			const Value *V2, const Instruction *Context2);
+	const GlobalVariable *getStartOfGlobal(const Value *V,
+			const Instruction *Context);
+	void FindSingletons();
+	void TagLockObjects(Module &M);
+	void ProjectLocks();
+	bool locksIntersect(unsigned N1, unsigned N2) const;
+	unsigned CountRepNodes() const;
+	void SharePointsToSets();
+	void CompactPointsToSets();
+	bool AddToPointsTo(Node *N, const PointsToSet &Bits, unsigned BitsID);
+	void MarkPropagated(Node *N, const PointsToSet &Bits);
+	void ResetOldPointsTo(Node *N);
+	void ReleasePointsTo(Node *N);
 	bool QueryNode(unsigned Node);
+	DFSFrame EdgeFrame(unsigned NodeIndex, unsigned DFS) const;
+	void FoldEdges();
+	void ReleaseEdgeRows();
+	void clearTarjan();
+	unsigned &tarjanDFS(unsigned Node) {
+		if (Tarjan2Epoch[Node] != TarjanEpoch) {
+			Tarjan2Epoch[Node] = TarjanEpoch;
+			Tarjan2DFS[Node] = 0;
+			Tarjan2Deleted[Node] = false;
+		}
+		return Tarjan2DFS[Node];
+	}
+	std::vector<bool>::reference tarjanDeleted(unsigned Node) {
+		tarjanDFS(Node);
+		return Tarjan2Deleted[Node];
+	}
+	void CollapseLazyCycles(std::queue<unsigned> &TarjanWL);
+	void OrderSweep();
 	void Condense(unsigned Node);
 	void HUValNum(unsigned Node);
+	bool HUVisit(unsigned NodeIndex);
+	void HUMergePred(unsigned NodeIndex, unsigned Pred);
 	void HVNValNum(unsigned Node);
 	unsigned getNodeForConstantPointer(Constant *C);
 	unsigned getNodeForConstantPointerTarget(Constant *C);
 	void AddGlobalInitializerConstraints(unsigned, Constant *C);
 
-	void AddConstraintsForNonInternalLinkage(Function *F);
-	void AddConstraintsForCall(CallSite CS, Function *F);
-	bool AddConstraintsForExternalCall(CallSite CS, Function *F);
+	// Wave propagation solver.
+	struct WavePropagateTask;
+	struct WaveComplexTask;
+	friend struct WavePropagateTask;
+	friend struct WaveComplexTask;
+	void SolveWave();
+	void FindComponents(std::vector<unsigned> &Roots,
+			std::vector<std::vector<unsigned> > &Cycles);
+	void CollapseCyclesWave(std::vector<unsigned> &Topo);
+	void CanonicalizeEdges(unsigned NodeIndex);
+	void PropagateWave(unsigned NodeIndex,
+			const std::vector<std::vector<unsigned> > &Preds,
+			std::vector<PointsToSet> &Delta);
+	void CommitWave(unsigned NodeIndex, const PointsToSet &Delta);
+	void ResolveComplexWave(unsigned NodeIndex, const PointsToSet &Delta,
+			std::vector<std::pair<unsigned, unsigned> > &NewEdges,
+			std::vector<std::pair<unsigned, unsigned> > &NewMembers) const;
+	unsigned getMaxK(unsigned NodeIndex) const;
+	unsigned getFieldNode(unsigned NodeIndex, unsigned K) const;
+
+	// Constraint collection, one function at a time.
+	class FunctionConstraints;
+	struct CollectTask;
+	friend class FunctionConstraints;
+	friend struct CollectTask;
 
 	void PrintNode(const Node *N) const;
 	void PrintConstraints() const;
@@ -512,34 +1177,6 @@ private:
 	void PrintLabels() const;
 	void PrintPointsToGraph() const;
 
-	//===------------------------------------------------------------------===//
-	// Instruction visitation methods for adding constraints
-	//
-	friend class InstVisitor<Andersens> ;
-	void visitReturnInst(ReturnInst &RI);
-	void visitExtractValueInst(ExtractValueInst &EEI);
-	void visitInsertValueInst(InsertValueInst &IVI);
-	void visitInvokeInst(InvokeInst &II) {
-		visitCallSite(CallSite(&II));
-	}
-	void visitCallInst(CallInst &CI) {
-		visitCallSite(CallSite(&CI));
-	}
-	void visitCallSite(CallSite CS);
-	void visitAllocaInst(AllocaInst &AI);
-	void visitLoadInst(LoadInst &LI);
-	void visitStoreInst(StoreInst &SI);
-	void visitGetElementPtrInst(GetElementPtrInst &GEP);
-	void visitPHINode(PHINode &PN);
-	void visitCastInst(CastInst &CI);
-	void visitICmpInst(ICmpInst &ICI) {
-	} // NOOP!
-	void visitFCmpInst(FCmpInst &ICI) {
-	} // NOOP!
-	void visitSelectInst(SelectInst &SI);
-	void visitVAArg(VAArgInst &I);
-	void visitInstruction(Instruction &I);
-
 	//===------------------------------------------------------------------===//
 	// Implement Analyize interface
 	//
@@ -0,0 +1,96 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// Models of the pointer effects of external functions.
+//
+// Andersens cannot see the bodies of library functions, so what a call to
+// one does to pointers comes from a model: the built-in ones of
+// ExternalModels.def, and those of a model file loaded at startup, which
+// override them.  Names are looked up once per declaration of the module,
+// in a hash table of the exact names and then among the name prefixes.
+
+#ifndef EXTERNALMODELS_H_
+#define EXTERNALMODELS_H_
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CallSite.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+/// ExternalModel - What a call to an external function does to pointers.
+struct ExternalModel {
+	enum EffectKind {
+		// Nothing any pointer can point to changes.
+		NoEffect,
+		// The result is argument Arg0.
+		ReturnsArg,
+		// *Arg0 = *Arg1, as memcpy does; the result, if any, is Arg0.
+		CopiesThrough,
+		// The result points to a new object made by the call.
+		Allocates,
+		// Arg0 is saved away, where ReturnsSaved calls find it; the result, if
+		// any, may be anything saved, as with strtok.
+		SavesArg,
+		// The result may be anything saved by SavesArg calls, or otherwise
+		// escaped to the outside.
+		ReturnsSaved
+	};
+
+	EffectKind Effect;
+	unsigned Arg0;
+	unsigned Arg1;
+
+	ExternalModel() :
+			Effect(NoEffect), Arg0(0), Arg1(0) {
+	}
+	ExternalModel(EffectKind E, unsigned A0, unsigned A1) :
+			Effect(E), Arg0(A0), Arg1(A1) {
+	}
+
+	/// fits - Return true if CS has the pointer arguments the effect uses.
+	bool fits(CallSite CS) const;
+};
+
+class ExternalModels {
+	StringMap<ExternalModel> Exact;
+	// Models of the names ending in '*', by the rest of the name.  Later
+	// entries override earlier ones.
+	std::vector<std::pair<std::string, ExternalModel> > Prefixes;
+
+public:
+	/// addBuiltins - Add the models of ExternalModels.def.
+	void addBuiltins();
+
+	/// add - Add the model of Name, replacing any earlier one.
+	void add(StringRef Name, const ExternalModel &Model);
+
+	/// load - Add the models of the file at Path.  Returns false and sets
+	/// Error if it cannot be read or has a malformed line.
+	bool load(const std::string &Path, std::string &Error);
+
+	/// lookup - Return the model of the function called Name, or NULL.
+	const ExternalModel *lookup(StringRef Name) const;
+
+	bool empty() const {
+		return Exact.empty() && Prefixes.empty();
+	}
+};
+
+#endif /* EXTERNALMODELS_H_ */
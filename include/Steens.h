@@ -0,0 +1,135 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// Steensgaard's unification-based points-to analysis.
+//
+// Memory locations are grouped into equivalence classes, and every class
+// points to at most one other class.  An assignment p = q unifies what p and
+// q point to instead of adding a subset edge, so the whole program is
+// analyzed in one pass over its instructions and nearly linear time.  The
+// answers are coarser than those of Andersens, which falls back to this
+// analysis when it runs out of its budget.
+//
+// The program is modeled the way Andersens models it: the analysis is field
+// and context insensitive, calls to external functions follow the models of
+// Andersens or are ignored, and the arguments of functions that can be called
+// from outside point to the universal class.
+
+#ifndef STEENS_H_
+#define STEENS_H_
+
+#include "aliasAnalysis.h"
+#include "ExternalModels.h"
+#include "llvm/Constants.h"
+#include "llvm/Instructions.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/InstVisitor.h"
+#include <utility>
+#include <vector>
+
+class Steensgaard: public aliasAnalysis, public InstVisitor<Steensgaard> {
+	static const unsigned None = ~0U;
+
+	/// Class - An equivalence class of memory locations.
+	struct Class {
+		unsigned Parent;
+		unsigned Rank;
+		// Class of what the locations point to, or None.
+		unsigned Pointee;
+		// Signature of the functions among the locations, or None.
+		unsigned Signature;
+		// Whether a global, a stack object or a function is in the class.
+		bool HasObjects;
+
+		Class() :
+				Parent(None), Rank(0), Pointee(None), Signature(None), HasObjects(
+						false) {
+		}
+	};
+
+	std::vector<Class> Classes;
+	// Classes of what the return value and the arguments of the functions of
+	// a signature point to, the return value first.  Missing slots are None.
+	std::vector<std::vector<unsigned> > Signatures;
+	// Class of what each pointer value points to.
+	DenseMap<const Value *, unsigned> Targets;
+	// Class of the memory of each global, function and alloca.
+	DenseMap<const Value *, unsigned> Objects;
+	// Pairs of classes still to be unified.
+	std::vector<std::pair<unsigned, unsigned> > Pending;
+	// The class of the locations nothing is known about.  It points to
+	// itself.
+	unsigned Universal;
+	// Models of the external functions, if any.
+	const ExternalModels *Models;
+
+	unsigned makeClass();
+	unsigned find(unsigned C);
+	void unify(unsigned C1, unsigned C2);
+	unsigned getPointee(unsigned C);
+	unsigned getSlot(unsigned C, unsigned Slot);
+	unsigned getObject(const Value *V);
+	unsigned getTarget(Value *V);
+	unsigned getConstantTarget(Constant *C);
+	bool findTarget(const Value *V, unsigned &C);
+	void addInitializer(unsigned Object, Constant *C);
+	void addFunction(Function *F);
+	void addCall(CallSite CS);
+	void addExternalCall(CallSite CS, const ExternalModel &Model);
+
+	//===------------------------------------------------------------------===//
+	// Instruction visitation methods for unifying classes
+	//
+	friend class InstVisitor<Steensgaard>;
+	void visitAllocaInst(AllocaInst &AI);
+	void visitLoadInst(LoadInst &LI);
+	void visitStoreInst(StoreInst &SI);
+	void visitGetElementPtrInst(GetElementPtrInst &GEP);
+	void visitPHINode(PHINode &PN);
+	void visitCastInst(CastInst &CI);
+	void visitSelectInst(SelectInst &SI);
+	void visitReturnInst(ReturnInst &RI);
+	void visitVAArgInst(VAArgInst &VI);
+	void visitExtractValueInst(ExtractValueInst &EVI);
+	void visitInsertValueInst(InsertValueInst &IVI);
+	void visitCallInst(CallInst &CI) {
+		addCall(CallSite(&CI));
+	}
+	void visitInvokeInst(InvokeInst &II) {
+		addCall(CallSite(&II));
+	}
+	void visitInstruction(Instruction &I) {
+	}
+
+public:
+	Steensgaard(Module *p, aliasAnalysis *a = 0,
+			const ExternalModels *m = 0) :
+			aliasAnalysis(p, a), Universal(None), Models(m) {
+	}
+
+	void runOnModule();
+
+	// Keep the two-value form of aliasAnalysis visible.
+	using aliasAnalysis::alias;
+	aliasResult alias(const Value *V1, unsigned V1Size, const Value *V2,
+			unsigned V2Size);
+
+	/// getNumClasses - Return the number of equivalence classes left.
+	unsigned getNumClasses() const;
+};
+
+#endif /* STEENS_H_ */
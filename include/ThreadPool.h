@@ -0,0 +1,87 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include "llvm/System/Atomic.h"
+#include <pthread.h>
+#include <vector>
+
+/// ThreadPool - A fixed set of pthread workers used to run data-parallel
+/// phases of the analysis.  Work is handed out in chunks of a range
+/// [0, NumItems); the calling thread takes part in the work and run() only
+/// returns once every chunk is done, so each call behaves like a parallel
+/// for-loop followed by a barrier.
+class ThreadPool {
+public:
+	/// Task - The body of a parallel loop.  run() is called once per chunk
+	/// with the chunk number and the item range it covers.  Chunk numbers
+	/// and ranges do not depend on the number of threads, so results stored
+	/// per chunk can be merged in a deterministic order.
+	class Task {
+	public:
+		virtual ~Task() {
+		}
+		virtual void run(unsigned Chunk, unsigned Begin, unsigned End) = 0;
+	};
+
+	/// Create a pool running NumThreads threads in total (including the
+	/// caller).  Zero means one thread per online processor.
+	explicit ThreadPool(unsigned NumThreads = 0);
+	~ThreadPool();
+
+	unsigned getNumThreads() const {
+		return Workers.size() + 1;
+	}
+
+	/// Number of chunks run() will split NumItems into.
+	static unsigned getNumChunks(unsigned NumItems, unsigned ChunkSize) {
+		return (NumItems + ChunkSize - 1) / ChunkSize;
+	}
+
+	/// Run T over [0, NumItems) in chunks of ChunkSize items and wait for all
+	/// of them to finish.
+	void run(Task &T, unsigned NumItems, unsigned ChunkSize);
+
+	/// Number of processors currently online.
+	static unsigned getHardwareConcurrency();
+
+private:
+	static void *workerMain(void *Pool);
+	void workerLoop();
+	void drain();
+
+	std::vector<pthread_t> Workers;
+	pthread_mutex_t Lock;
+	pthread_cond_t WorkReady;
+	pthread_cond_t WorkDone;
+
+	// State of the loop being run, protected by Lock except NextChunk.
+	Task *Current;
+	unsigned NumItems;
+	unsigned ChunkSize;
+	unsigned NumChunks;
+	volatile llvm::sys::cas_flag NextChunk;
+	unsigned Generation;
+	unsigned Active;
+	bool ShuttingDown;
+
+	ThreadPool(const ThreadPool &); // DO NOT IMPLEMENT
+	void operator=(const ThreadPool &); // DO NOT IMPLEMENT
+};
+
+#endif /* THREADPOOL_H_ */
@@ -19,6 +19,8 @@
 
 #include "llvm/Module.h"
 #include "llvm/Value.h"
+#include "llvm/System/DataTypes.h"
+#include <vector>
 
 
 using namespace llvm;
@@ -64,10 +66,60 @@ public:
 	  return alias(V1, UnknownSize, V2, UnknownSize);
 	}
 
-};
-
-
+	/// contextAlias - Like alias, but V1 and V2 are values of the functions
+	/// called by Context1 and Context2, and are only considered in those
+	/// calls.  A null context stands for every call.  Analyses that do not
+	/// tell calls apart answer as alias does.
+	virtual aliasResult contextAlias(const Value *V1,
+	                                 const Instruction *Context1,
+	                                 const Value *V2,
+	                                 const Instruction *Context2);
+
+	/// contextAliasBatch - Set Results[i] to contextAlias(V1, Context1,
+	/// V2[i], Context2) for every value of V2.  Analyses that can look at V1
+	/// once for all of them override this.
+	virtual void contextAliasBatch(const Value *V1,
+	                               const Instruction *Context1,
+	                               const std::vector<const Value*> &V2,
+	                               const Instruction *Context2,
+	                               std::vector<aliasResult> &Results);
+
+	/// getPointsTo - Set Objects to the numbers of the abstract objects V may
+	/// point to when taken in the call Context, in increasing order, such
+	/// that two values alias unless their objects are disjoint.  Returns
+	/// false if the analysis cannot describe V that way, which is what
+	/// analyses that do not compute points-to sets always do.
+	virtual bool getPointsTo(const Value *V, const Instruction *Context,
+	                         std::vector<unsigned> &Objects);
 
+};
 
+/// getAddressPath - Return the pointer V is computed from by casts and
+/// getelementptrs with constant indices, and set Path to the indices those
+/// add, trailing zeros left out.  Equal bases and paths mean equal
+/// addresses.  If V is taken in the call Context, an argument of the
+/// function called is followed to the value the call passes.  Returns NULL
+/// if V is computed in a way the path cannot express.
+const Value *getAddressPath(const Value *V, std::vector<int64_t> &Path,
+                            const Instruction *Context = 0);
+
+/// isPerInstanceObject - Return true if V is an object with an instance in
+/// every call or every thread: an alloca, or a thread-local global.  Equal
+/// paths into it, even from one place, may name different addresses.
+bool isPerInstanceObject(const Value *V);
+
+/// getPathAlias - Answer the query of V1 in Context1 and V2 in Context2
+/// from the objects they are constant paths into, when both objects are
+/// globals or allocas, and return true; return false if that tells nothing.
+/// This is the rule every analysis and the alias cache answer such queries
+/// by:
+///   - different objects do not overlap;
+///   - paths into the same object that stay within bounds and part ways
+///     after the first index name different parts of it;
+///   - equal paths into the same object name the same address, unless it
+///     is a per-instance object, for which nothing is known.
+bool getPathAlias(const Value *V1, const Instruction *Context1,
+                  const Value *V2, const Instruction *Context2,
+                  aliasAnalysis::aliasResult &Result);
 
 #endif /* ALIASANALYSIS_H_ */
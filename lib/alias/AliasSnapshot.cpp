@@ -0,0 +1,589 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// This file writes and reads the binary points-to snapshots described in
+// AliasSnapshot.h.
+
+#include "../../include/AliasSnapshot.h"
+#include "../../include/Anders.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+//                               Value Keys
+//===----------------------------------------------------------------------===//
+
+static uint32_t hashBytes(uint32_t Hash, const void *Data, size_t Length) {
+  // FNV-1a
+  const unsigned char *P = static_cast<const unsigned char *>(Data);
+  for (size_t i = 0; i != Length; ++i) {
+    Hash ^= P[i];
+    Hash *= 16777619U;
+  }
+  return Hash;
+}
+
+static uint32_t hashString(uint32_t Hash, StringRef S) {
+  Hash = hashBytes(Hash, S.data(), S.size());
+  return hashBytes(Hash, "", 1);
+}
+
+static uint32_t hashUnsigned(uint32_t Hash, unsigned Value) {
+  return hashBytes(Hash, &Value, sizeof(Value));
+}
+
+ValueSlots::ValueSlots(Module *M) : NumGlobals(0) {
+  std::string IR;
+  raw_string_ostream OS(IR);
+
+  // Scope 0: the globals and the functions.
+  Scopes.push_back("");
+  Values.resize(1);
+  for (Module::global_iterator I = M->global_begin(), E = M->global_end();
+       I != E; ++I) {
+    Keys[I] = std::make_pair(0U, (unsigned) Values[0].size());
+    Values[0].push_back(I);
+    OS << *I << '\n';
+  }
+  NumGlobals = Values[0].size();
+  for (Module::iterator F = M->begin(), E = M->end(); F != E; ++F) {
+    Keys[F] = std::make_pair(0U, (unsigned) Values[0].size());
+    Values[0].push_back(F);
+    OS << F->getName() << '\n';
+  }
+  Hashes.push_back(hashString(2166136261U, OS.str()));
+
+  for (Module::iterator F = M->begin(), E = M->end(); F != E; ++F) {
+    unsigned Scope = Scopes.size();
+    Scopes.push_back(F->getNameStr());
+    Values.resize(Scope + 1);
+    std::vector<Value *> &Slots = Values[Scope];
+    for (Function::arg_iterator I = F->arg_begin(), E = F->arg_end();
+         I != E; ++I) {
+      Keys[I] = std::make_pair(Scope, (unsigned) Slots.size());
+      Slots.push_back(I);
+    }
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+      Keys[&*I] = std::make_pair(Scope, (unsigned) Slots.size());
+      Slots.push_back(&*I);
+    }
+
+    IR.clear();
+    OS << *F;
+    Hashes.push_back(hashString(2166136261U, OS.str()));
+  }
+
+  Fingerprint = 2166136261U;
+  for (unsigned i = 0, e = Hashes.size(); i != e; ++i)
+    Fingerprint = hashUnsigned(Fingerprint, Hashes[i]);
+}
+
+bool ValueSlots::getKey(const Value *V, unsigned &Scope,
+                        unsigned &Slot) const {
+  while (const ConstantExpr *CE = dyn_cast<ConstantExpr>(V)) {
+    if (CE->getOpcode() != Instruction::GetElementPtr
+        && CE->getOpcode() != Instruction::BitCast)
+      return false;
+    V = CE->getOperand(0);
+  }
+
+  DenseMap<const Value *, std::pair<unsigned, unsigned> >::const_iterator I =
+    Keys.find(V);
+  if (I == Keys.end())
+    return false;
+  Scope = I->second.first;
+  Slot = I->second.second;
+  return true;
+}
+
+Value *ValueSlots::getValue(unsigned Scope, unsigned Slot) const {
+  if (Scope >= Values.size() || Slot >= Values[Scope].size())
+    return NULL;
+  return Values[Scope][Slot];
+}
+
+unsigned ValueSlots::getScope(const Function *F) const {
+  unsigned Scope, Slot;
+  getKey(F, Scope, Slot);
+  return Slot - NumGlobals + 1;
+}
+
+Function *ValueSlots::getFunction(unsigned Scope) const {
+  if (Scope == 0 || Scope >= Values.size())
+    return NULL;
+  return cast<Function>(Values[0][NumGlobals + Scope - 1]);
+}
+
+bool operator<(const SnapshotKey &LHS, const SnapshotKey &RHS) {
+  if (LHS.Kind != RHS.Kind)
+    return LHS.Kind < RHS.Kind;
+  if (LHS.Scope != RHS.Scope)
+    return LHS.Scope < RHS.Scope;
+  return LHS.Slot < RHS.Slot;
+}
+
+//===----------------------------------------------------------------------===//
+//                                 Writer
+//===----------------------------------------------------------------------===//
+
+template<typename T>
+static void writeArray(raw_ostream &OS, const std::vector<T> &V) {
+  if (!V.empty())
+    OS.write(reinterpret_cast<const char *>(&V[0]), V.size() * sizeof(T));
+}
+
+static SnapshotKey makeKey(unsigned Kind, unsigned Scope, unsigned Slot) {
+  SnapshotKey Key;
+  Key.Kind = Kind;
+  Key.Scope = Scope;
+  Key.Slot = Slot;
+  Key.Set = NoSet;
+  return Key;
+}
+
+/// CollectNodeKeys - List the key of every node that has one.
+void Andersens::CollectNodeKeys(const ValueSlots &Slots,
+                       std::vector<std::pair<SnapshotKey, unsigned> > &Out) {
+  unsigned Scope, Slot;
+  for (unsigned i = 0; i < NumberSpecialNodes; ++i)
+    Out.push_back(std::make_pair(makeKey(SpecialKey, 0, i), i));
+  Out.push_back(std::make_pair(makeKey(SpecialKey, 0, SavedObject),
+                               getSavedNode()));
+  for (DenseMap<Value*, unsigned>::iterator I = ValueNodes.begin(),
+       E = ValueNodes.end(); I != E; ++I)
+    if (Slots.getKey(I->first, Scope, Slot))
+      Out.push_back(std::make_pair(makeKey(ValueKey, Scope, Slot), I->second));
+  for (DenseMap<Value*, unsigned>::iterator I = ObjectNodes.begin(),
+       E = ObjectNodes.end(); I != E; ++I)
+    if (Slots.getKey(I->first, Scope, Slot))
+      Out.push_back(std::make_pair(makeKey(ObjectKey, Scope, Slot), I->second));
+  for (DenseMap<Function*, unsigned>::iterator I = ReturnNodes.begin(),
+       E = ReturnNodes.end(); I != E; ++I)
+    Out.push_back(std::make_pair(makeKey(ReturnKey, Slots.getScope(I->first),
+                                         0), I->second));
+  for (DenseMap<Function*, unsigned>::iterator I = VarargNodes.begin(),
+       E = VarargNodes.end(); I != E; ++I)
+    Out.push_back(std::make_pair(makeKey(VarargKey, Slots.getScope(I->first),
+                                         0), I->second));
+}
+
+/// getNodeForKey - Find the node named by key Index of File.  Returns false
+/// if the module has no such node.
+bool Andersens::getNodeForKey(const SnapshotFile &File,
+                              const ValueSlots &Slots, unsigned Index,
+                              unsigned &NodeIndex) {
+  if (Index >= File.Header->NumKeys)
+    return false;
+  const SnapshotKey &Key = File.Keys[Index];
+  if (Key.Kind == SpecialKey) {
+    NodeIndex = Key.Slot == SavedObject ? getSavedNode() : Key.Slot;
+    return Key.Slot <= SavedObject;
+  }
+
+  DenseMap<Value*, unsigned>::iterator I;
+  DenseMap<Function*, unsigned>::iterator F;
+  switch (Key.Kind) {
+  case ValueKey:
+    I = ValueNodes.find(Slots.getValue(Key.Scope, Key.Slot));
+    if (I == ValueNodes.end())
+      return false;
+    NodeIndex = I->second;
+    return true;
+  case ObjectKey:
+    I = ObjectNodes.find(Slots.getValue(Key.Scope, Key.Slot));
+    if (I == ObjectNodes.end())
+      return false;
+    NodeIndex = I->second;
+    return true;
+  case ReturnKey:
+    F = ReturnNodes.find(Slots.getFunction(Key.Scope));
+    if (F == ReturnNodes.end())
+      return false;
+    NodeIndex = F->second;
+    return true;
+  case VarargKey:
+    F = VarargNodes.find(Slots.getFunction(Key.Scope));
+    if (F == VarargNodes.end())
+      return false;
+    NodeIndex = F->second;
+    return true;
+  }
+  return false;
+}
+
+/// writeSnapshot - Write the solved points-to sets to Path.  Returns false
+/// and sets Error if the file cannot be written.
+bool Andersens::writeSnapshot(const std::string &Path, std::string &Error) {
+  if (Fallback) {
+    Error = "solving ran out of its budget";
+    return false;
+  }
+  if (LockProjected) {
+    Error = "the points-to sets were cut down to the lock objects";
+    return false;
+  }
+
+  ValueSlots Slots(program);
+  unsigned NumNodes = GraphNodes.size();
+
+  std::vector<std::pair<SnapshotKey, unsigned> > Entries;
+  CollectNodeKeys(Slots, Entries);
+
+  // Only the demanded nodes have complete points-to sets.
+  std::vector<bool> Known(Entries.size(), true);
+  if (DemandDriven)
+    for (unsigned i = 0, e = Entries.size(); i != e; ++i)
+      Known[i] = GraphNodes[Entries[i].second].Demanded;
+
+  // Pointees without a key of their own, such as the callees of inline asm,
+  // are named by their node index, which no other run can look up.
+  std::vector<bool> HasKey(NumNodes, false);
+  for (unsigned i = 0, e = Entries.size(); i != e; ++i)
+    HasKey[Entries[i].second] = true;
+  for (unsigned i = 0, e = Entries.size(); i != e; ++i) {
+    if (!Known[i])
+      continue;
+    PointsToSet *Bits = GraphNodes[FindNode(Entries[i].second)].PointsTo;
+    if (Bits == NULL)
+      continue;
+    for (PointsToSet::iterator bi = Bits->begin(); bi != Bits->end();
+         ++bi)
+      if (!HasKey[*bi]) {
+        HasKey[*bi] = true;
+        Entries.push_back(std::make_pair(makeKey(UnstableKey, 0, *bi), *bi));
+        Known.push_back(false);
+      }
+  }
+
+  std::vector<SnapshotKey> Keys(Entries.size());
+  for (unsigned i = 0, e = Entries.size(); i != e; ++i)
+    Keys[i] = Entries[i].first;
+  std::sort(Keys.begin(), Keys.end());
+  std::vector<unsigned> NodeKey(NumNodes, ~0U);
+  for (unsigned i = 0, e = Entries.size(); i != e; ++i)
+    NodeKey[Entries[i].second] = std::lower_bound(Keys.begin(), Keys.end(),
+                                                  Entries[i].first)
+                                 - Keys.begin();
+
+  // Number the distinct points-to sets of the representatives.
+  DenseMap<unsigned, unsigned> Rep2Set;
+  DenseMap<PointsToSet *, unsigned, BitmapKeyInfo> Bits2Set;
+  std::vector<uint32_t> SetBegin;
+  std::vector<uint32_t> Members;
+  for (unsigned i = 0, e = Entries.size(); i != e; ++i) {
+    if (!Known[i])
+      continue;
+    SnapshotKey &Key = Keys[NodeKey[Entries[i].second]];
+    unsigned Rep = FindNode(Entries[i].second);
+    DenseMap<unsigned, unsigned>::iterator R = Rep2Set.find(Rep);
+    if (R != Rep2Set.end()) {
+      Key.Set = R->second;
+      continue;
+    }
+
+    PointsToSet Empty;
+    PointsToSet *Bits = GraphNodes[Rep].PointsTo;
+    if (Bits == NULL)
+      Bits = &Empty;
+    DenseMap<PointsToSet *, unsigned, BitmapKeyInfo>::iterator S =
+      Bits2Set.find(Bits);
+    if (S != Bits2Set.end()) {
+      Key.Set = S->second;
+    } else {
+      Key.Set = SetBegin.size();
+      SetBegin.push_back(Members.size());
+      for (PointsToSet::iterator bi = Bits->begin(); bi != Bits->end();
+           ++bi)
+        if (*bi != NullObject)
+          Members.push_back(NodeKey[*bi]);
+      std::sort(Members.begin() + SetBegin.back(), Members.end());
+      // The empty set is local; every other set outlives this function.
+      if (Bits != &Empty)
+        Bits2Set[Bits] = Key.Set;
+    }
+    Rep2Set[Rep] = Key.Set;
+  }
+  SetBegin.push_back(Members.size());
+
+  const std::vector<std::string> &ScopeNames = Slots.getScopes();
+  std::vector<SnapshotScope> Scopes(ScopeNames.size());
+  std::vector<uint32_t> Defs;
+  std::string Strings;
+  for (unsigned i = 0, e = ScopeNames.size(); i != e; ++i) {
+    SnapshotScope &Scope = Scopes[i];
+    Scope.Name = Strings.size();
+    Strings += ScopeNames[i];
+    Strings += '\0';
+    Scope.Hash = Slots.getScopeHash(i);
+    Scope.Flags = 0;
+    Scope.DefBegin = Defs.size();
+    if (i < ScopeDefs.size()) {
+      Scope.Flags |= ScopeDefsKnown;
+      if (ScopeStores[i])
+        Scope.Flags |= ScopeHasStores;
+      for (unsigned j = 0, je = ScopeDefs[i].size(); j != je; ++j) {
+        unsigned Def = NodeKey[ScopeDefs[i][j]];
+        if (Def == ~0U || Keys[Def].Kind == UnstableKey)
+          Scope.Flags &= ~ScopeDefsKnown;
+        else
+          Defs.push_back(Def);
+      }
+    }
+    Scope.DefEnd = Defs.size();
+  }
+
+  SnapshotHeader Header;
+  memcpy(Header.Magic, SnapshotMagic, sizeof(Header.Magic));
+  Header.Version = SnapshotVersion;
+  Header.Fingerprint = Slots.getFingerprint();
+  Header.NumScopes = Scopes.size();
+  Header.NumKeys = Keys.size();
+  Header.NumSets = SetBegin.size() - 1;
+  Header.NumMembers = Members.size();
+  Header.NumDefs = Defs.size();
+  Header.StringBytes = Strings.size();
+
+  raw_fd_ostream OS(Path.c_str(), Error, raw_fd_ostream::F_Binary);
+  if (!Error.empty())
+    return false;
+  OS.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  writeArray(OS, Scopes);
+  writeArray(OS, Keys);
+  writeArray(OS, SetBegin);
+  writeArray(OS, Members);
+  writeArray(OS, Defs);
+  OS << Strings;
+  OS.close();
+  if (OS.has_error()) {
+    OS.clear_error();
+    Error = "error writing " + Path;
+    return false;
+  }
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+//                                 Reader
+//===----------------------------------------------------------------------===//
+
+SnapshotFile::SnapshotFile()
+  : Base(0), Size(0), Header(0), Scopes(0), Keys(0), SetBegin(0), Members(0),
+    Defs(0), Strings(0) {
+}
+
+SnapshotFile::~SnapshotFile() {
+  close();
+}
+
+void SnapshotFile::close() {
+  if (Base)
+    munmap(const_cast<char *>(Base), Size);
+  Base = 0;
+  Size = 0;
+  Header = 0;
+}
+
+bool SnapshotFile::open(const std::string &Path, std::string &Error) {
+  close();
+
+  int FD = ::open(Path.c_str(), O_RDONLY);
+  if (FD < 0) {
+    Error = "cannot open " + Path;
+    return false;
+  }
+  struct stat Stat;
+  if (fstat(FD, &Stat) != 0 || Stat.st_size < (off_t) sizeof(SnapshotHeader)) {
+    ::close(FD);
+    Error = Path + " is not a points-to snapshot";
+    return false;
+  }
+  void *Map = mmap(0, Stat.st_size, PROT_READ, MAP_PRIVATE, FD, 0);
+  ::close(FD);
+  if (Map == MAP_FAILED) {
+    Error = "cannot map " + Path;
+    return false;
+  }
+  Base = static_cast<const char *>(Map);
+  Size = Stat.st_size;
+  Header = reinterpret_cast<const SnapshotHeader *>(Base);
+
+  if (memcmp(Header->Magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0
+      || Header->Version != SnapshotVersion) {
+    close();
+    Error = Path + " is not a points-to snapshot of this version";
+    return false;
+  }
+
+  uint64_t Expected = sizeof(SnapshotHeader)
+    + (uint64_t) Header->NumScopes * sizeof(SnapshotScope)
+    + (uint64_t) Header->NumKeys * sizeof(SnapshotKey)
+    + ((uint64_t) Header->NumSets + 1) * sizeof(uint32_t)
+    + (uint64_t) Header->NumMembers * sizeof(uint32_t)
+    + (uint64_t) Header->NumDefs * sizeof(uint32_t)
+    + Header->StringBytes;
+  if (Expected != Size) {
+    close();
+    Error = Path + " is truncated";
+    return false;
+  }
+
+  Scopes = reinterpret_cast<const SnapshotScope *>(Base
+                                                   + sizeof(SnapshotHeader));
+  Keys = reinterpret_cast<const SnapshotKey *>(Scopes + Header->NumScopes);
+  SetBegin = reinterpret_cast<const uint32_t *>(Keys + Header->NumKeys);
+  Members = SetBegin + Header->NumSets + 1;
+  Defs = Members + Header->NumMembers;
+  Strings = reinterpret_cast<const char *>(Defs + Header->NumDefs);
+  if (!isConsistent()) {
+    close();
+    Error = Path + " is corrupt";
+    return false;
+  }
+  return true;
+}
+
+/// isConsistent - Check that the arrays of the mapped file only refer to
+/// each other within their bounds, so that a damaged or stale file is
+/// rejected rather than read out of bounds.
+bool SnapshotFile::isConsistent() const {
+  const SnapshotHeader &H = *Header;
+  if (H.StringBytes != 0 && Strings[H.StringBytes - 1] != 0)
+    return false;
+  for (unsigned i = 0; i != H.NumScopes; ++i)
+    if (Scopes[i].Name >= H.StringBytes
+        || Scopes[i].DefBegin > Scopes[i].DefEnd
+        || Scopes[i].DefEnd > H.NumDefs)
+      return false;
+  for (unsigned i = 0; i != H.NumKeys; ++i) {
+    if (Keys[i].Set != NoSet && Keys[i].Set >= H.NumSets)
+      return false;
+    // findKey searches the keys, so they must be sorted.
+    if (i != 0 && Keys[i] < Keys[i - 1])
+      return false;
+  }
+  if (SetBegin[0] != 0 || SetBegin[H.NumSets] != H.NumMembers)
+    return false;
+  for (unsigned i = 0; i != H.NumSets; ++i)
+    if (SetBegin[i] > SetBegin[i + 1])
+      return false;
+  for (unsigned i = 0; i != H.NumMembers; ++i)
+    if (Members[i] >= H.NumKeys)
+      return false;
+  for (unsigned i = 0; i != H.NumDefs; ++i)
+    if (Defs[i] >= H.NumKeys)
+      return false;
+  return true;
+}
+
+const char *SnapshotFile::getScopeName(unsigned Scope) const {
+  unsigned Name = Scopes[Scope].Name;
+  return Name < Header->StringBytes ? Strings + Name : "";
+}
+
+unsigned SnapshotFile::findKey(const SnapshotKey &Key) const {
+  const SnapshotKey *End = Keys + Header->NumKeys;
+  const SnapshotKey *I = std::lower_bound(Keys, End, Key);
+  if (I == End || I->Kind != Key.Kind || I->Scope != Key.Scope
+      || I->Slot != Key.Slot)
+    return ~0U;
+  return I - Keys;
+}
+
+SnapshotAA::SnapshotAA(Module *p, aliasAnalysis *a)
+  : aliasAnalysis(p, a), Slots(p) {
+}
+
+bool SnapshotAA::open(const std::string &Path, std::string &Error) {
+  if (!File.open(Path, Error))
+    return false;
+  if (File.Header->Fingerprint != Slots.getFingerprint()) {
+    File.close();
+    Error = Path + " was taken from a different module";
+    return false;
+  }
+
+  // Match the scopes by name, so a function keeps its keys even if the
+  // functions around it were numbered differently.
+  StringMap<unsigned> ScopeByName;
+  for (unsigned i = 1; i < File.Header->NumScopes; ++i)
+    ScopeByName[File.getScopeName(i)] = i;
+
+  const std::vector<std::string> &Scopes = Slots.getScopes();
+  ScopeMap.assign(Scopes.size(), ~0U);
+  ScopeMap[0] = 0;
+  for (unsigned i = 1, e = Scopes.size(); i != e; ++i) {
+    StringMap<unsigned>::iterator I = ScopeByName.find(Scopes[i]);
+    if (I != ScopeByName.end())
+      ScopeMap[i] = I->second;
+  }
+  return true;
+}
+
+/// findSet - Find the points-to set of V in the snapshot.
+bool SnapshotAA::findSet(const Value *V, unsigned &Set) const {
+  unsigned Scope, Slot;
+  if (!Slots.getKey(V, Scope, Slot) || ScopeMap[Scope] == ~0U)
+    return false;
+
+  unsigned Index = File.findKey(makeKey(ValueKey, ScopeMap[Scope], Slot));
+  if (Index == ~0U || File.Keys[Index].Set >= File.Header->NumSets)
+    return false;
+  Set = File.Keys[Index].Set;
+  return true;
+}
+
+aliasAnalysis::aliasResult SnapshotAA::alias(const Value *V1, unsigned V1Size,
+                                             const Value *V2, unsigned V2Size) {
+  if (File.Header == NULL)
+    return MayAlias;
+
+  // Null never aliases anything, as in Andersens.
+  if (isa<ConstantPointerNull>(V1) || isa<UndefValue>(V1)
+      || isa<ConstantPointerNull>(V2) || isa<UndefValue>(V2))
+    return NoAlias;
+
+  unsigned S1, S2;
+  if (findSet(V1, S1) && findSet(V2, S2)) {
+    const uint32_t *Members = File.Members;
+    const uint32_t *I1 = Members + File.SetBegin[S1];
+    const uint32_t *E1 = Members + File.SetBegin[S1 + 1];
+    const uint32_t *I2 = Members + File.SetBegin[S2];
+    const uint32_t *E2 = Members + File.SetBegin[S2 + 1];
+    bool Intersect = false;
+    while (I1 < E1 && I2 < E2 && !Intersect) {
+      if (*I1 < *I2)
+        ++I1;
+      else if (*I2 < *I1)
+        ++I2;
+      else
+        Intersect = true;
+    }
+    if (!Intersect)
+      return NoAlias;
+  }
+
+  if (AA)
+    return AA->alias(V1, V1Size, V2, V2Size);
+  return MayAlias;
+}
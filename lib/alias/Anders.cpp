@@ -56,11 +56,246 @@
 // The return node for a function is always located at getNode(F) +
 // CallReturnPos. The arguments start at getNode(F) + CallArgPos.
 //
+#define DEBUG_TYPE "anders-aa"
 #include "../../include/Anders.h"
+#include "../../include/AliasSnapshot.h"
+#include "../../include/Steens.h"
+#include "llvm/Operator.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/GetElementPtrTypeIterator.h"
+#include "llvm/Support/MathExtras.h"
+#include <sys/resource.h>
+#include <sys/time.h>
+
+namespace {
+enum SolverKind {
+  WorkListSolver, WaveSolver
+};
+
+cl::opt<SolverKind>
+AndersSolver("anders-solver",
+             cl::desc("Choose the Andersens constraint solver:"),
+             cl::init(WorkListSolver),
+             cl::values(
+               clEnumValN(WorkListSolver, "worklist",
+                          "Sequential work list solver (default)"),
+               clEnumValN(WaveSolver, "wave",
+                          "Parallel wave propagation solver"),
+               clEnumValEnd));
+
+cl::opt<unsigned>
+AndersThreads("anders-threads",
+              cl::desc("Number of threads used by the wave solver and "
+                       "parallel constraint collection (0 = one per "
+                       "processor)"),
+              cl::init(0));
+
+cl::opt<bool>
+AndersParallelCollect("anders-parallel-collect",
+                      cl::desc("Collect the constraints of the functions in "
+                               "parallel"),
+                      cl::init(false));
+
+cl::opt<bool>
+AndersSharedSets("anders-shared-sets",
+                 cl::desc("Hash-cons the points-to sets built by the "
+                          "Andersens solver"),
+                 cl::init(false));
+
+cl::opt<bool>
+AndersDemand("anders-demand",
+             cl::desc("Only solve the constraints the lock operands "
+                      "depend on; other values may alias anything"),
+             cl::init(false));
+
+cl::opt<unsigned>
+AndersDemandBudget("anders-demand-budget",
+                   cl::desc("Solve the whole program when the demand-driven "
+                            "slice keeps more than this percentage of the "
+                            "constraints"),
+                   cl::init(50));
+
+cl::opt<bool>
+AndersCloneWrappers("anders-clone-wrappers",
+                    cl::desc("Give every direct call of a lock wrapper a "
+                             "copy of its constraints"),
+                    cl::init(false));
+
+cl::opt<unsigned>
+AndersCloneBudget("anders-clone-budget",
+                  cl::desc("Largest number of nodes the copies of the lock "
+                           "wrappers may add"),
+                  cl::init(100000));
+
+cl::opt<std::string>
+AndersExternModels("anders-extern-models",
+                   cl::desc("Load models of external functions from "
+                            "<filename>, on top of the built-in ones"),
+                   cl::value_desc("filename"), cl::init(""));
+
+cl::opt<bool>
+AndersStrictExternals("anders-strict-externals",
+                      cl::desc("Let external functions without a model make "
+                               "their arguments and result point to "
+                               "anything"),
+                      cl::init(false));
+
+cl::opt<bool>
+AndersCloneAllocators("anders-clone-allocators",
+                      cl::desc("Give every call of an allocation wrapper a "
+                               "heap object of its own"),
+                      cl::init(true));
+
+cl::list<std::string>
+AndersAllocWrappers("anders-alloc-wrappers",
+                    cl::desc("Functions to take for allocation wrappers "
+                             "besides those found"),
+                    cl::value_desc("function"), cl::CommaSeparated);
+
+cl::opt<bool>
+AndersLockProjection("anders-lock-projection",
+                     cl::desc("Cut the solved points-to sets down to the "
+                              "objects that may hold a lock"),
+                     cl::init(false));
+
+cl::list<std::string>
+AndersLockTypes("anders-lock-types",
+                cl::desc("Named types to take for locks besides the pthread "
+                         "ones"),
+                cl::value_desc("type"), cl::CommaSeparated);
+
+cl::opt<bool>
+AndersFieldSensitive("anders-field-sensitive",
+                     cl::desc("Give the fields of struct objects nodes of "
+                              "their own"),
+                     cl::init(false));
+
+cl::opt<unsigned>
+AndersMaxFields("anders-max-fields",
+                cl::desc("Keep the objects with more fields than this "
+                         "field-insensitive (default 16)"),
+                cl::init(16));
+
+cl::opt<bool>
+AndersHCD("anders-hcd",
+          cl::desc("Collapse the cycles found offline by hybrid cycle "
+                   "detection while solving"),
+          cl::init(true));
+
+enum OfflineMode {
+  AllOffline, AdaptiveOffline, BenchmarkOffline
+};
+
+cl::opt<OfflineMode>
+AndersOffline("anders-offline",
+              cl::desc("Choose which offline optimizations run before "
+                       "solving:"),
+              cl::init(AllOffline),
+              cl::values(
+                clEnumValN(AllOffline, "all",
+                           "HVN, HU and, with -anders-hcd, HCD (default)"),
+                clEnumValN(AdaptiveOffline, "adaptive",
+                           "Those a cost model expects to pay off"),
+                clEnumValN(BenchmarkOffline, "benchmark",
+                           "Time every combination, then run as adaptive"),
+                clEnumValEnd));
+
+cl::opt<double>
+AndersHVNYield("anders-hvn-yield", cl::Hidden,
+               cl::desc("Share of the copy constraints the offline cost "
+                        "model expects HVN to remove"),
+               cl::init(0.3));
+
+cl::opt<double>
+AndersHUYield("anders-hu-yield", cl::Hidden,
+              cl::desc("Share of the copy constraints left by HVN the "
+                       "offline cost model expects HU to remove"),
+              cl::init(0.3));
+
+cl::opt<double>
+AndersHCDYield("anders-hcd-yield", cl::Hidden,
+               cl::desc("Share of the complex constraints the offline cost "
+                        "model expects HCD to spare the solver"),
+               cl::init(0.1));
+
+enum LCDMode {
+  NoLCD, BatchedLCD, EagerLCD
+};
+
+cl::opt<LCDMode>
+AndersLCD("anders-lcd",
+          cl::desc("Choose when the work list solver looks for the cycles "
+                   "found by lazy cycle detection:"),
+          cl::init(BatchedLCD),
+          cl::values(
+            clEnumValN(NoLCD, "off", "Never"),
+            clEnumValN(BatchedLCD, "batched",
+                       "Once per round, for all candidates (default)"),
+            clEnumValN(EagerLCD, "eager",
+                       "Right after the node that found the candidates"),
+            clEnumValEnd));
+
+cl::opt<bool>
+AndersCSREdges("anders-csr-edges",
+               cl::desc("Freeze the copy edges of the work list solver into "
+                        "compressed sparse rows"),
+               cl::init(true));
+
+cl::opt<unsigned>
+AndersTimeBudget("anders-time-budget",
+                 cl::desc("Give up the analysis after this many seconds and "
+                          "answer from Steensgaard's analysis instead "
+                          "(0 = no limit)"),
+                 cl::init(0));
+
+cl::opt<unsigned>
+AndersMemoryBudget("anders-memory-budget",
+                   cl::desc("Give up the analysis once the process has used "
+                            "this many megabytes and answer from "
+                            "Steensgaard's analysis instead (0 = no limit)"),
+                   cl::init(0));
+
+enum WorkListKind {
+  LRFWorkListKind, SweepWorkListKind
+};
+
+cl::opt<WorkListKind>
+AndersWorkList("anders-worklist",
+               cl::desc("Choose the work list of the work list solver:"),
+               cl::init(LRFWorkListKind),
+               cl::values(
+                 clEnumValN(LRFWorkListKind, "lrf",
+                            "Least recently fired node first (default)"),
+                 clEnumValN(SweepWorkListKind, "topo",
+                            "Topological sweeps over the condensed graph"),
+                 clEnumValEnd));
+}
+
+// Number of nodes handed to a thread at a time by the wave solver.
+static const unsigned WaveChunkSize = 64;
+
+// Number of functions handed to a thread at a time by constraint collection.
+static const unsigned CollectChunkSize = 16;
+
+// Number of work list pops, or of roots of an offline pass, between two
+// checks of the budget.
+static const unsigned BudgetCheckInterval = 1024;
 
+// Edges added while solving, in percent of the frozen ones, that make the
+// work list solver fold them into the rows at the end of a round.
+static const unsigned FoldEdgesPercent = 25;
 
+// Stands in for the missing edge sets of the depth-first searches.
+static const SparseBitVector<> NoEdges;
 
+static const SparseBitVector<> *edgesOrNone(const SparseBitVector<> *Edges) {
+  return Edges ? Edges : &NoEdges;
+}
 
+static double getWallTime();
+static long getPeakMemory();
 
 
 
@@ -78,20 +313,114 @@ volatile sys::cas_flag Andersens::Node::Counter;
 //                  AliasAnalysis Interface Implementation
 //===----------------------------------------------------------------------===//
 
-aliasAnalysis::aliasResult Andersens::alias(const Value *V1, unsigned V1Size,
-                                            const Value *V2, unsigned V2Size) {
-  Node *N1 = &GraphNodes[FindNode(getNode(const_cast<Value*>(V1)))];
-  Node *N2 = &GraphNodes[FindNode(getNode(const_cast<Value*>(V2)))];
+Andersens::~Andersens() {
+  delete Fallback;
+}
 
-  // Check to see if the two pointers are known to not alias.  They don't alias
-  // if their points-to sets do not intersect.
-  if (!N1->intersectsIgnoring(N2, NullObject)){
-//    errs() << (int) NoAlias << "\n";
-    return NoAlias;
-    }
+void Andersens::runOnModule() {
+  DEBUG(errs() << "run on module in anders" << "\n");
+  DemandDriven = AndersDemand;
+  delete Fallback;
+  Fallback = 0;
+  Telemetry.clear();
+  if (Models.empty()) {
+    Models.addBuiltins();
+    std::string Error;
+    if (!AndersExternModels.empty() && !Models.load(AndersExternModels, Error))
+      errs() << "warning: " << Error << "\n";
+  }
+  if (AndersOffline == BenchmarkOffline)
+    RunOfflineTrials();
+  Analyze();
+}
+
+/// Analyze - Build and solve the constraints of the program.  The budget
+/// covers every phase, so the analysis falls back to Steensgaard's from
+/// whichever phase runs out of it.
+void Andersens::Analyze() {
+  BudgetStartTime = getWallTime();
+  OverBudget = false;
+  BeginPhase("IdentifyObjects");
+  IdentifyObjects(*program);
+  EndPhase();
+  if (OutOfBudget()) {
+    FallBackToSteensgaard("IdentifyObjects");
+    return;
+  }
+  BeginPhase("CollectConstraints");
+  CollectConstraints(*program);
+  EndPhase();
+  if (OutOfBudget()) {
+    FallBackToSteensgaard("CollectConstraints");
+    return;
+  }
+#undef DEBUG_TYPE
+#define DEBUG_TYPE "anders-aa-constraints"
+  DEBUG(PrintConstraints());
+#undef DEBUG_TYPE
+#define DEBUG_TYPE "anders-aa"
+  SnapshotError.clear();
+  if (!SnapshotPath.empty()) {
+    BeginPhase("ApplyBaseline");
+    if (!ApplyBaseline(SnapshotError) && SnapshotError.empty())
+      SnapshotError = "the snapshot cannot be used";
+    EndPhase();
+    if (!SnapshotError.empty())
+      DEBUG(errs() << "Snapshot " << SnapshotPath << " not used: "
+                   << SnapshotError << "\n");
+  }
+  if (DemandDriven) {
+    BeginPhase("SliceConstraints");
+    if (!SliceConstraints(*program))
+      DemandDriven = false;
+    EndPhase();
+  }
+  if (OutOfBudget()) {
+    FallBackToSteensgaard("SliceConstraints");
+    return;
+  }
+  SolveConstraints();
+  if (OverBudget) {
+    FallBackToSteensgaard("SolveConstraints");
+    return;
+  }
+  DEBUG(PrintPointsToGraph());
+  if (!LockObjects.empty()) {
+    BeginPhase("ProjectLocks");
+    ProjectLocks();
+    EndPhase();
+  }
+
+  // Free the constraints list, as we don't need it to respond to alias
+  // requests.
+  std::vector<Constraint>().swap(Constraints);
+  //These are needed for Print() (-analyze in opt)
+  //ObjectNodes.clear();
+  //ReturnNodes.clear();
+  //VarargNodes.clear();
+}
 
-//    errs() << (int) AliasAnalysis::alias(V1, V1Size, V2, V2Size) << "\n";
+/// FallBackToSteensgaard - Drop what the analysis built so far, Phase
+/// having run out of the budget, and answer from Steensgaard's analysis: a
+/// partial solution is of no use.
+void Andersens::FallBackToSteensgaard(const char *Phase) {
+  DEBUG(errs() << Phase << " ran out of the budget, falling back to "
+               << "Steensgaard\n");
+  ResetAnalysis();
+  DemandDriven = false;
+  BeginPhase("Steensgaard");
+  Fallback = new Steensgaard(program, AA, &Models);
+  Fallback->runOnModule();
+  EndPhase();
+}
 
+aliasAnalysis::aliasResult Andersens::alias(const Value *V1, unsigned V1Size,
+                                            const Value *V2, unsigned V2Size) {
+  aliasResult Result = Fallback ? MayAlias : queryPointsTo(V1, NULL, V2, NULL);
+  if (Fallback)
+    return Fallback->alias(V1, V1Size, V2, V2Size);
+  if (Result != MayAlias)
+    return Result;
 
   if(AA)
 	  return AA->alias(V1, V1Size, V2, V2Size);
@@ -99,6 +428,189 @@ aliasAnalysis::aliasResult Andersens::alias(const Value *V1, unsigned V1Size,
 	  return MayAlias;
 }
 
+aliasAnalysis::aliasResult
+Andersens::contextAlias(const Value *V1, const Instruction *Context1,
+                        const Value *V2, const Instruction *Context2) {
+  aliasResult Result =
+    Fallback ? MayAlias : queryPointsTo(V1, Context1, V2, Context2);
+  if (Fallback)
+    return Fallback->contextAlias(V1, Context1, V2, Context2);
+  if (Result != MayAlias)
+    return Result;
+
+  if (AA)
+    return AA->contextAlias(V1, Context1, V2, Context2);
+  return MayAlias;
+}
+
+/// contextAliasBatch - Answer contextAlias(V1, Context1, V2[i], Context2) for
+/// every i, looking V1 up once.  In a demand-driven solve, where every value
+/// is checked against the slice, and after falling back to Steensgaard, the
+/// queries are asked one by one.
+void Andersens::contextAliasBatch(const Value *V1, const Instruction *Context1,
+                                  const std::vector<const Value*> &V2,
+                                  const Instruction *Context2,
+                                  std::vector<aliasResult> &Results) {
+  if (Fallback || DemandDriven) {
+    aliasAnalysis::contextAliasBatch(V1, Context1, V2, Context2, Results);
+    return;
+  }
+
+  Results.resize(V2.size());
+  unsigned Rep1 = FindNode(getContextNode(V1, Context1));
+  for (unsigned i = 0, e = V2.size(); i != e; ++i) {
+    unsigned Rep2 = FindNode(getContextNode(V2[i], Context2));
+    if (pointsToDisjoint(Rep1, Rep2))
+      Results[i] = NoAlias;
+    else if (isMustAlias(V1, Context1, V2[i], Context2))
+      Results[i] = MustAlias;
+    else if (AA)
+      Results[i] = AA->contextAlias(V1, Context1, V2[i], Context2);
+    else
+      Results[i] = MayAlias;
+  }
+}
+
+/// getPointsTo - Set Objects to what V points to in Context, in increasing
+/// order.  queryPointsTo answers NoAlias exactly when these are disjoint,
+/// except for a value whose set was projected with objects other than locks
+/// in it, or one outside the demand-driven slice; false is returned for
+/// those, and while the queries go to the fallback analysis.
+bool Andersens::getPointsTo(const Value *V, const Instruction *Context,
+                            std::vector<unsigned> &Objects) {
+  if (Fallback)
+    return false;
+  unsigned NodeIndex = getContextNode(V, Context);
+  if (DemandDriven && !GraphNodes[NodeIndex].Demanded)
+    return false;
+  unsigned Rep = FindNode(NodeIndex);
+  Objects.clear();
+  if (LockProjected) {
+    if (!LockOnly[Rep])
+      return false;
+    Objects.assign(LockMembers.begin() + LockBegin[Rep],
+                   LockMembers.begin() + LockBegin[Rep + 1]);
+    return true;
+  }
+  Node *N = &GraphNodes[Rep];
+  if (N->PointsTo)
+    for (PointsToSet::iterator bi = N->PointsTo->begin(),
+         be = N->PointsTo->end(); bi != be; ++bi)
+      if (*bi != NullObject)
+        Objects.push_back(*bi);
+  return true;
+}
+
+/// queryPointsTo - Answer an alias query from the points-to sets of V1 in
+/// Context1 and of V2 in Context2: NoAlias if they do not intersect,
+/// MustAlias if both name the same address of a global, and MayAlias
+/// otherwise.
+aliasAnalysis::aliasResult
+Andersens::queryPointsTo(const Value *V1, const Instruction *Context1,
+                         const Value *V2, const Instruction *Context2) {
+  // Values outside the demand-driven slice may have incomplete points-to
+  // sets, so only their address paths tell anything.  The slice is not grown
+  // here: that would solve again under the answers already given.
+  if (DemandDriven &&
+      (!GraphNodes[getContextNode(V1, Context1)].Demanded ||
+       !GraphNodes[getContextNode(V2, Context2)].Demanded)) {
+    DEBUG(errs() << "Query outside the demand slice\n");
+    aliasResult Result;
+    if (getPathAlias(V1, Context1, V2, Context2, Result))
+      return Result;
+    return MayAlias;
+  }
+
+  unsigned Rep1 = FindNode(getContextNode(V1, Context1));
+  unsigned Rep2 = FindNode(getContextNode(V2, Context2));
+  if (pointsToDisjoint(Rep1, Rep2))
+    return NoAlias;
+  if (isMustAlias(V1, Context1, V2, Context2))
+    return MustAlias;
+  return MayAlias;
+}
+
+/// pointsToDisjoint - Return true if the representatives Rep1 and Rep2
+/// point to no object in common, the null object aside.  Two sets of a
+/// single object each are compared without walking them, and a single
+/// object is looked up in the other set.  Projected sets that do not
+/// intersect tell nothing if both sets also held objects without locks.
+bool Andersens::pointsToDisjoint(unsigned Rep1, unsigned Rep2) {
+  Node *N1 = &GraphNodes[Rep1];
+  Node *N2 = &GraphNodes[Rep2];
+  if (N1->Singleton != NoSingleton && N2->Singleton != NoSingleton)
+    return N1->Singleton != N2->Singleton;
+  if (LockProjected)
+    return (LockOnly[Rep1] || LockOnly[Rep2]) && !locksIntersect(Rep1, Rep2);
+  if (N2->Singleton != NoSingleton)
+    return !N1->PointsTo->test(N2->Singleton);
+  if (N1->Singleton != NoSingleton)
+    return !N2->PointsTo->test(N1->Singleton);
+  return !N1->intersectsIgnoring(N2, NullObject);
+}
+
+/// isMustAlias - Return true if V1 in Context1 and V2 in Context2 name the
+/// same address.  Paths into globals and allocas are left to getPathAlias,
+/// which the alias cache answers by too.  Otherwise it is known if they are
+/// computed from the same pointer by the same constant path, or from two
+/// pointers to the start of the same global.  Allocas and thread-local
+/// globals are left out: they may have several live instances, in
+/// different threads or in recursive calls.
+bool Andersens::isMustAlias(const Value *V1, const Instruction *Context1,
+                            const Value *V2, const Instruction *Context2) {
+  aliasResult Result;
+  if (getPathAlias(V1, Context1, V2, Context2, Result))
+    return Result == MustAlias;
+
+  std::vector<int64_t> Path1, Path2;
+  const Value *Base1 = getAddressPath(V1, Path1);
+  const Value *Base2 = getAddressPath(V2, Path2);
+  if (Base1 == NULL || Base2 == NULL || Path1 != Path2)
+    return false;
+  if (Base1 == Base2 && Context1 == Context2 && !isPerInstanceObject(Base1))
+    return true;
+
+  const GlobalVariable *GV = getStartOfGlobal(Base1, Context1);
+  return GV != NULL && GV == getStartOfGlobal(Base2, Context2);
+}
+
+/// getStartOfGlobal - Return the global V points to the start of, or NULL if
+/// that is not known.  V is either the global itself, or a pointer to the
+/// type of the global whose points-to set names nothing but the global.
+/// Thread-local globals are never returned.
+const GlobalVariable *
+Andersens::getStartOfGlobal(const Value *V, const Instruction *Context) {
+  if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(V))
+    return GV->isThreadLocal() ? NULL : GV;
+
+  unsigned NodeIndex = getContextNode(V, Context);
+  if (DemandDriven && !GraphNodes[NodeIndex].Demanded)
+    return NULL;
+  Node *N = &GraphNodes[FindNode(NodeIndex)];
+  if (N->Singleton == NoSingleton)
+    return NULL;
+  const GlobalVariable *GV =
+    dyn_cast_or_null<GlobalVariable>(GraphNodes[N->Singleton].getValue());
+  if (GV == NULL || GV->isThreadLocal() || V->getType() != GV->getType())
+    return NULL;
+  return GV;
+}
+
+/// getContextNode - Return the node of V in the clone of its function made
+/// for the call Context, or the node of V itself if there is no such clone.
+unsigned Andersens::getContextNode(const Value *V,
+                                   const Instruction *Context) {
+  unsigned NodeIndex = getNode(const_cast<Value*>(V));
+  unsigned Base;
+  const LockWrapper *W = Context ? findCallClone(Context, Base) : NULL;
+  if (W == NULL)
+    return NodeIndex;
+  // The clones are laid out by the indices from before the renumbering.
+  if (ClumpedFrom.empty())
+    return getCloneNode(NodeIndex, *W, Base);
+  return ClumpedTo[getCloneNode(ClumpedFrom[NodeIndex], *W, Base)];
+}
+
 
 
 
@@ -115,6 +627,16 @@ aliasAnalysis::aliasResult Andersens::alias(const Value *V1, unsigned V1Size,
 //                       Object Identification Phase
 //===----------------------------------------------------------------------===//
 
+/// isLockFunction - Return true if F is one of the lock functions whose
+/// operands LUPA asks about.
+static bool isLockFunction(const Function *F) {
+  if (F == NULL)
+    return false;
+  StringRef Name = F->getName();
+  return Name.startswith("pthread_mutex_") || Name == "rw_lock"
+      || Name == "rw_unlock";
+}
+
 /// IdentifyObjects - This stage scans the program, adding an entry to the
 /// GraphNodes list for each memory object in the program (global stack or
 /// heap), and populates the ValueNodes and ObjectNodes maps for these objects.
@@ -135,13 +657,49 @@ void Andersens::IdentifyObjects(Module &M) {
   assert(NumObjects == NullObject && "Something changed!");
   ++NumObjects;
 
+  // Object #3 holds what external functions save away.
+  assert(NumObjects == SavedObject && "Something changed!");
+  ++NumObjects;
+
+  // Look up the models of the external functions once, so that the
+  // collection of the constraints only reads them.
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+    if (F->isDeclaration())
+      if (const ExternalModel *Model = Models.lookup(F->getName()))
+        FunctionModels[F] = *Model;
+
+  FindAllocWrappers(M);
+
+  // A snapshot has no keys for the fields past the first, so incremental
+  // solving does without them.
+  MaxFields = 1;
+  if (AndersFieldSensitive && SnapshotPath.empty() && AndersMaxFields > 1)
+    MaxFields = AndersMaxFields;
+  if (MaxFields > 1)
+    FindFieldUnsafeTypes(M);
+
   // Add all the globals first.
   for (Module::global_iterator I = M.global_begin(), E = M.global_end();
        I != E; ++I) {
-    ObjectNodes[I] = NumObjects++;
+    NumberObject(I, NumObjects);
     ValueNodes[I] = NumObjects++;
   }
 
+  // The constant addresses of fields need nodes to point to the fields from.
+  // They are added before the functions, so that no lock wrapper clones them.
+  if (MaxFields > 1) {
+    for (Module::global_iterator I = M.global_begin(), E = M.global_end();
+         I != E; ++I)
+      if (I->hasInitializer())
+        NumberFieldAddresses(I->getInitializer(), NumObjects);
+    for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+      for (inst_iterator II = inst_begin(F), IE = inst_end(F); II != IE; ++II)
+        for (User::op_iterator OI = II->op_begin(), OE = II->op_end();
+             OI != OE; ++OI)
+          if (Constant *C = dyn_cast<Constant>(*OI))
+            NumberFieldAddresses(C, NumObjects);
+  }
+
   // Add nodes for all of the functions and the instructions inside of them.
   for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F) {
     // The function itself is a memory object.
@@ -171,7 +729,7 @@ void Andersens::IdentifyObjects(Module &M) {
       if (isa<PointerType>(II->getType())) {
         ValueNodes[&*II] = NumObjects++;
         if (AllocaInst *AI = dyn_cast<AllocaInst>(&*II))
-          ObjectNodes[AI] = NumObjects++;
+          NumberObject(AI, NumObjects);
       }
 
       // Calls to inline asm need to be added as well because the callee isn't
@@ -181,26 +739,1199 @@ void Andersens::IdentifyObjects(Module &M) {
         if (isa<InlineAsm>(Callee))
           ValueNodes[Callee] = NumObjects++;
       }
+
+      // Memory copies need a node for the values they copy, one per field,
+      // and allocations and calls of allocation wrappers one for the object
+      // they make.  It is made here so that the constraints of the functions
+      // can be collected in parallel without adding nodes.
+      Function *Callee = NULL;
+      if (CallInst *CI = dyn_cast<CallInst>(&*II))
+        Callee = CI->getCalledFunction();
+      else if (InvokeInst *Invoke = dyn_cast<InvokeInst>(&*II))
+        Callee = Invoke->getCalledFunction();
+      if (const ExternalModel *Model = Callee ? getModel(Callee) : NULL) {
+        if (Model->Effect == ExternalModel::CopiesThrough) {
+          ObjectNodes[&*II] = NumObjects;
+          NumObjects += MaxFields;
+        } else if (Model->Effect == ExternalModel::Allocates &&
+                   isa<PointerType>(II->getType())) {
+          NumberObject(&*II, NumObjects);
+        }
+      } else if (AllocWrappers.count(Callee) &&
+                 isa<PointerType>(II->getType())) {
+        ObjectNodes[&*II] = NumObjects++;
+      }
     }
   }
 
+  NumObjects = CloneLockWrappers(M, NumObjects);
+
   // Now that we know how many objects to create, make them all now!
   GraphNodes.resize(NumObjects);
+  TagLockObjects(M);
 }
 
+//===----------------------------------------------------------------------===//
+//                            Field Sensitivity
+//===----------------------------------------------------------------------===//
+//
+// With -anders-field-sensitive, an object whose type is known gets one node
+// per field of its flattened type: nested structs are laid out in place and
+// the elements of an array share the fields of one element.  The nodes of an
+// object are consecutive, and the MaxK of each is the number of fields from
+// it to the end of the object, so a getelementptr selecting field K becomes
+// the offset copy A = B + K.  An offset past the last field stays on the
+// field it starts from.  Objects with more than -anders-max-fields fields,
+// and heap objects whose type cannot be told from their one cast, keep a
+// single node.
+//
+// The offsets are only right for an object reached as its own type, or as
+// a type it starts with.  A pointer to a struct cast to another struct, or
+// cast to a byte pointer that is then moved, stored or passed on where it
+// cannot be followed, may reach any field of whatever holds that struct,
+// as container_of does.  Such struct types are found before the objects are
+// numbered, and every object of one, or holding one, keeps a single node.
+
+/// getNumFields - Return the number of fields of the flattened type T.
+static unsigned getNumFields(const Type *T) {
+  if (const StructType *ST = dyn_cast<StructType>(T)) {
+    unsigned Fields = 0;
+    for (unsigned i = 0, e = ST->getNumElements(); i != e; ++i)
+      Fields += getNumFields(ST->getElementType(i));
+    return Fields ? Fields : 1;
+  }
+  if (const ArrayType *AT = dyn_cast<ArrayType>(T))
+    return getNumFields(AT->getElementType());
+  return 1;
+}
+
+/// getFieldOffset - Return the field of the flattened type the indices of
+/// the getelementptr GEP select, counted from the one its operand points to.
+static unsigned getFieldOffset(User *GEP) {
+  unsigned Offset = 0;
+  for (gep_type_iterator GTI = gep_type_begin(GEP), E = gep_type_end(GEP);
+       GTI != E; ++GTI)
+    if (const StructType *ST = dyn_cast<StructType>(*GTI)) {
+      unsigned Index = cast<ConstantInt>(GTI.getOperand())->getZExtValue();
+      for (unsigned i = 0; i != Index; ++i)
+        Offset += getNumFields(ST->getElementType(i));
+    }
+  return Offset;
+}
+
+/// hasStruct - Return true if T is a struct, or an array of them.
+static bool hasStruct(const Type *T) {
+  while (const ArrayType *AT = dyn_cast<ArrayType>(T))
+    T = AT->getElementType();
+  return isa<StructType>(T);
+}
+
+/// startsWith - Return true if an object of type T starts with one of type
+/// Prefix, so that the fields of a Prefix at its address are its own.
+static bool startsWith(const Type *T, const Type *Prefix) {
+  while (T != Prefix) {
+    if (const StructType *ST = dyn_cast<StructType>(T)) {
+      if (ST->getNumElements() == 0)
+        return false;
+      T = ST->getElementType(0);
+    } else if (const ArrayType *AT = dyn_cast<ArrayType>(T)) {
+      T = AT->getElementType();
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// getPointee - Return the type the pointer V points to.
+static const Type *getPointee(const Value *V) {
+  return cast<PointerType>(V->getType())->getElementType();
+}
+
+/// isPointerCast - Return true if V is a bitcast of a pointer, as an
+/// instruction or a constant expression.
+static bool isPointerCast(const Value *V) {
+  const Operator *Op = dyn_cast<Operator>(V);
+  return Op && Op->getOpcode() == Instruction::BitCast
+      && isa<PointerType>(Op->getType());
+}
+
+/// FindFieldUnsafeTypes - Fill FieldUnsafeTypes from the pointer casts of
+/// the module, in the instructions and in the constants.
+void Andersens::FindFieldUnsafeTypes(Module &M) {
+  SmallPtrSet<Constant *, 32> Visited;
+  for (Module::global_iterator I = M.global_begin(), E = M.global_end();
+       I != E; ++I)
+    if (I->hasInitializer())
+      FindFieldUnsafeCasts(I->getInitializer(), Visited);
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+    for (inst_iterator II = inst_begin(F), IE = inst_end(F); II != IE; ++II) {
+      if (isPointerCast(&*II))
+        CheckFieldCast(&*II);
+      for (User::op_iterator OI = II->op_begin(), OE = II->op_end();
+           OI != OE; ++OI)
+        if (Constant *C = dyn_cast<Constant>(*OI))
+          FindFieldUnsafeCasts(C, Visited);
+    }
+}
+
+/// FindFieldUnsafeCasts - Check the pointer casts among the constant
+/// expressions of C.
+void Andersens::FindFieldUnsafeCasts(Constant *C,
+                                     SmallPtrSet<Constant *, 32> &Visited) {
+  if (isa<GlobalValue>(C) || !Visited.insert(C))
+    return;
+  for (User::op_iterator OI = C->op_begin(), OE = C->op_end(); OI != OE; ++OI)
+    if (Constant *Op = dyn_cast<Constant>(*OI))
+      FindFieldUnsafeCasts(Op, Visited);
+  if (isPointerCast(C))
+    CheckFieldCast(C);
+}
+
+/// CheckFieldCast - Add to FieldUnsafeTypes the struct types the pointer
+/// cast Cast reaches other than by their fields.
+void Andersens::CheckFieldCast(User *Cast) {
+  const Type *From = getPointee(Cast->getOperand(0));
+  const Type *To = getPointee(Cast);
+  if (From == To)
+    return;
+
+  if (hasStruct(To)) {
+    // Go back through the byte pointers to the struct the address was
+    // last typed as, noting whether it was moved on the way.
+    Value *V = Cast->getOperand(0);
+    bool Moved = false;
+    while (!hasStruct(getPointee(V))) {
+      if (isPointerCast(V)) {
+        V = cast<User>(V)->getOperand(0);
+      } else if (GEPOperator *GEP = dyn_cast<GEPOperator>(V)) {
+        Moved |= !GEP->hasAllZeroIndices();
+        V = GEP->getPointerOperand();
+      } else {
+        break;
+      }
+    }
+    const Type *Origin = getPointee(V);
+    if (Moved)
+      FieldUnsafeTypes.insert(To);
+    if (hasStruct(Origin) && !startsWith(Origin, To)
+        && !startsWith(To, Origin)) {
+      FieldUnsafeTypes.insert(Origin);
+      FieldUnsafeTypes.insert(To);
+    }
+  } else if (hasStruct(From) && !isFollowedAddress(Cast)) {
+    FieldUnsafeTypes.insert(From);
+  }
+}
+
+/// isFollowedAddress - Return true if the struct address Cast turns into a
+/// byte pointer is only used unmoved, by loads and stores through it, by
+/// comparisons and by external calls, or cast back to a struct, which
+/// CheckFieldCast checks on its own.
+bool Andersens::isFollowedAddress(User *Cast) const {
+  SmallPtrSet<Value *, 16> Visited;
+  std::vector<Value *> WorkList(1, Cast);
+  while (!WorkList.empty()) {
+    Value *V = WorkList.back();
+    WorkList.pop_back();
+    if (!Visited.insert(V))
+      continue;
+    for (Value::use_iterator UI = V->use_begin(), UE = V->use_end();
+         UI != UE; ++UI) {
+      User *U = *UI;
+      if (GEPOperator *GEP = dyn_cast<GEPOperator>(U)) {
+        if (!GEP->hasAllZeroIndices())
+          return false;
+        WorkList.push_back(GEP);
+      } else if (isPointerCast(U)) {
+        if (!hasStruct(getPointee(U)))
+          WorkList.push_back(U);
+      } else if (isa<PHINode>(U) || isa<SelectInst>(U)) {
+        WorkList.push_back(U);
+      } else if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+        if (SI->getOperand(0) == V)
+          return false;
+      } else if (isa<CallInst>(U) || isa<InvokeInst>(U)) {
+        CallSite CS(cast<Instruction>(U));
+        Function *F = CS.getCalledFunction();
+        if (CS.getCalledValue() == V || F == NULL || !F->isDeclaration())
+          return false;
+        // memcpy and its kin return their destination as it is; what else
+        // returns an argument may return it moved, and what is saved away
+        // comes back from other calls.
+        const ExternalModel *Model = getModel(F);
+        if (Model && Model->Effect == ExternalModel::CopiesThrough)
+          WorkList.push_back(U);
+        else if (Model && Model->Effect == ExternalModel::ReturnsArg
+                 && !U->use_empty())
+          return false;
+        else if (Model && Model->Effect == ExternalModel::SavesArg)
+          return false;
+      } else if (!isa<LoadInst>(U) && !isa<ICmpInst>(U)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// isFieldUnsafe - Return true if T is, or holds, a struct type of
+/// FieldUnsafeTypes.
+bool Andersens::isFieldUnsafe(const Type *T) const {
+  if (FieldUnsafeTypes.count(T))
+    return true;
+  if (const StructType *ST = dyn_cast<StructType>(T)) {
+    for (unsigned i = 0, e = ST->getNumElements(); i != e; ++i)
+      if (isFieldUnsafe(ST->getElementType(i)))
+        return true;
+  } else if (const ArrayType *AT = dyn_cast<ArrayType>(T)) {
+    return isFieldUnsafe(AT->getElementType());
+  }
+  return false;
+}
 
+/// countFields - Return the number of nodes the object made by the global,
+/// alloca or allocation Object gets.
+unsigned Andersens::countFields(Value *Object) const {
+  if (MaxFields == 1)
+    return 1;
+  const Type *T = NULL;
+  if (GlobalVariable *GV = dyn_cast<GlobalVariable>(Object))
+    T = GV->getType()->getElementType();
+  else if (AllocaInst *AI = dyn_cast<AllocaInst>(Object))
+    T = AI->getAllocatedType();
+  else if (Object->hasOneUse())
+    if (BitCastInst *BC = dyn_cast<BitCastInst>(*Object->use_begin()))
+      T = cast<PointerType>(BC->getType())->getElementType();
+  if (T == NULL || isFieldUnsafe(T))
+    return 1;
+  unsigned Fields = getNumFields(T);
+  return Fields > MaxFields ? 1 : Fields;
+}
 
+/// NumberObject - Give the object made by Object its nodes, starting at
+/// NumObjects.
+void Andersens::NumberObject(Value *Object, unsigned &NumObjects) {
+  unsigned Fields = countFields(Object);
+  ObjectNodes[Object] = NumObjects;
+  if (Fields > 1)
+    for (unsigned i = 0; i != Fields; ++i)
+      MaxK[NumObjects + i] = Fields - i;
+  NumObjects += Fields;
+}
+
+/// NumberFieldAddresses - Give a node to every constant getelementptr in C
+/// that selects a field past the first.
+void Andersens::NumberFieldAddresses(Constant *C, unsigned &NumObjects) {
+  if (isa<GlobalValue>(C))
+    return;
+  for (User::op_iterator OI = C->op_begin(), OE = C->op_end(); OI != OE; ++OI)
+    if (Constant *Op = dyn_cast<Constant>(*OI))
+      NumberFieldAddresses(Op, NumObjects);
+
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(C);
+  if (CE && CE->getOpcode() == Instruction::GetElementPtr
+      && getFieldOffset(CE) > 0 && !ValueNodes.count(CE)) {
+    ValueNodes[CE] = NumObjects++;
+    FieldAddresses.push_back(CE);
+  }
+}
 
+/// getFieldNode - Return the node K fields past NodeIndex, or NodeIndex if
+/// its object ends before.
+unsigned Andersens::getFieldNode(unsigned NodeIndex, unsigned K) const {
+  return K < getMaxK(NodeIndex) ? NodeIndex + K : NodeIndex;
+}
 
+// Named types of the locks LUPA checks.
+static const char *const LockTypeNames[] = {
+  "union.pthread_mutex_t", "union.pthread_rwlock_t",
+  "struct.pthread_mutex_t", "struct.pthread_rwlock_t"
+};
+
+/// holdsLock - Return true if an object of type T may hold a lock: if T is
+/// one of LockTypes, contains one, or has bytes or opaque parts a lock could
+/// be kept in.
+static bool holdsLock(const Type *T, const std::set<const Type *> &LockTypes,
+                      std::map<const Type *, bool> &Cache) {
+  if (LockTypes.count(T) || isa<OpaqueType>(T))
+    return true;
+  std::map<const Type *, bool>::iterator I = Cache.find(T);
+  if (I != Cache.end())
+    return I->second;
+
+  bool Holds = false;
+  if (const StructType *ST = dyn_cast<StructType>(T)) {
+    for (unsigned i = 0, e = ST->getNumElements(); i != e && !Holds; ++i)
+      Holds = holdsLock(ST->getElementType(i), LockTypes, Cache);
+  } else if (const ArrayType *AT = dyn_cast<ArrayType>(T)) {
+    Holds = AT->getElementType()->isIntegerTy(8)
+        || holdsLock(AT->getElementType(), LockTypes, Cache);
+  }
+  Cache[T] = Holds;
+  return Holds;
+}
+
+/// TagLockObjects - With -anders-lock-projection, record which object nodes
+/// may hold a lock, going by the types of the globals and allocas.  Heap
+/// objects have no type to go by and are kept, as is the universal set.
+void Andersens::TagLockObjects(Module &M) {
+  LockObjects.clear();
+  if (!AndersLockProjection)
+    return;
+
+  std::set<const Type *> LockTypes;
+  for (unsigned i = 0; i != array_lengthof(LockTypeNames); ++i)
+    if (const Type *T = M.getTypeByName(LockTypeNames[i]))
+      LockTypes.insert(T);
+  for (unsigned i = 0, e = AndersLockTypes.size(); i != e; ++i)
+    if (const Type *T = M.getTypeByName(AndersLockTypes[i]))
+      LockTypes.insert(T);
+  // Without a lock type no object could be told from the others.
+  if (LockTypes.empty()) {
+    DEBUG(errs() << "No lock types, the points-to sets are kept whole\n");
+    return;
+  }
+
+  LockObjects.assign(GraphNodes.size(), false);
+  LockObjects[UniversalSet] = true;
+  std::map<const Type *, bool> Cache;
+  unsigned NumLocks = 0;
+  for (DenseMap<Value*, unsigned>::iterator I = ObjectNodes.begin(),
+       E = ObjectNodes.end(); I != E; ++I) {
+    bool Holds = true;
+    if (GlobalVariable *GV = dyn_cast<GlobalVariable>(I->first))
+      Holds = holdsLock(GV->getType()->getElementType(), LockTypes, Cache);
+    else if (AllocaInst *AI = dyn_cast<AllocaInst>(I->first))
+      Holds = holdsLock(AI->getAllocatedType(), LockTypes, Cache);
+    // The fields of an object go with it.
+    for (unsigned i = 0, e = std::max(getMaxK(I->second), 1U); i != e; ++i)
+      LockObjects[I->second + i] = Holds;
+    NumLocks += Holds;
+  }
+  DEBUG(errs() << "Lock objects: " << NumLocks << " of " << ObjectNodes.size()
+               << "\n");
+}
+
+/// stripAddressing - Look through the casts and getelementptrs V is computed
+/// by.
+static Value *stripAddressing(Value *V) {
+  while (true) {
+    if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(V))
+      V = GEP->getOperand(0);
+    else if (BitCastInst *BC = dyn_cast<BitCastInst>(V))
+      V = BC->getOperand(0);
+    else
+      return V;
+  }
+}
+
+/// locksArgument - Return true if F passes one of its arguments, or an
+/// address computed from one, to a lock function or to one of Wrappers.
+static bool locksArgument(Function *F, const std::set<Function *> &Wrappers) {
+  for (inst_iterator II = inst_begin(F), E = inst_end(F); II != E; ++II) {
+    Function *Callee = NULL;
+    if (CallInst *CI = dyn_cast<CallInst>(&*II))
+      Callee = CI->getCalledFunction();
+    else if (InvokeInst *Invoke = dyn_cast<InvokeInst>(&*II))
+      Callee = Invoke->getCalledFunction();
+    if (!isLockFunction(Callee) && !Wrappers.count(Callee))
+      continue;
+    for (unsigned i = 0, e = II->getNumOperands(); i != e; ++i)
+      if (isa<Argument>(stripAddressing(II->getOperand(i))))
+        return true;
+  }
+  return false;
+}
+
+static bool smallerWrapper(const std::pair<unsigned, Function *> &LHS,
+                           const std::pair<unsigned, Function *> &RHS) {
+  return LHS.first < RHS.first;
+}
+
+/// CloneLockWrappers - Find the lock wrappers of M and give the direct calls
+/// of the smallest ones clones of their nodes, numbered from NumObjects on,
+/// until -anders-clone-budget nodes have been added.  Returns the new number
+/// of nodes.  The constraints of the clones are added by CollectConstraints.
+unsigned Andersens::CloneLockWrappers(Module &M, unsigned NumObjects) {
+  LockWrappers.clear();
+  CallClones.clear();
+  // The nodes of the clones have no keys in a snapshot, so incremental
+  // solving does without them.
+  if (!AndersCloneWrappers || !SnapshotPath.empty())
+    return NumObjects;
+
+  // Functions calling a wrapper with an argument are wrappers too.
+  std::set<Function *> Wrappers;
+  for (bool Changed = true; Changed; ) {
+    Changed = false;
+    for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+      if (!F->isDeclaration() && !Wrappers.count(F)
+          && locksArgument(F, Wrappers)) {
+        Wrappers.insert(F);
+        Changed = true;
+      }
+  }
+  if (Wrappers.empty())
+    return NumObjects;
+
+  // The nodes of a function run up to the first node of the next one.
+  std::map<Function *, std::vector<Instruction *> > Calls;
+  Function *Prev = NULL;
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F) {
+    if (Prev)
+      LockWrappers[Prev].End = ValueNodes[F];
+    Prev = Wrappers.count(F) ? &*F : NULL;
+    if (Prev)
+      LockWrappers[Prev].First = ValueNodes[F];
+
+    for (inst_iterator II = inst_begin(F), IE = inst_end(F); II != IE; ++II) {
+      Function *Callee = NULL;
+      if (CallInst *CI = dyn_cast<CallInst>(&*II))
+        Callee = CI->getCalledFunction();
+      else if (InvokeInst *Invoke = dyn_cast<InvokeInst>(&*II))
+        Callee = Invoke->getCalledFunction();
+      if (Wrappers.count(Callee))
+        Calls[Callee].push_back(&*II);
+    }
+  }
+  if (Prev)
+    LockWrappers[Prev].End = NumObjects;
+
+  std::vector<std::pair<unsigned, Function *> > BySize;
+  for (std::map<Function *, LockWrapper>::iterator I = LockWrappers.begin(),
+       E = LockWrappers.end(); I != E; ++I) {
+    LockWrapper &W = I->second;
+    W.Shared.assign(W.End - W.First, false);
+    W.Shared[0] = true;
+    for (inst_iterator II = inst_begin(I->first), IE = inst_end(I->first);
+         II != IE; ++II) {
+      DenseMap<Value*, unsigned>::iterator Object = ObjectNodes.find(&*II);
+      if (Object != ObjectNodes.end())
+        for (unsigned i = 0, e = std::max(getMaxK(Object->second), 1U);
+             i != e; ++i)
+          W.Shared[Object->second - W.First + i] = true;
+    }
+    BySize.push_back(std::make_pair(W.End - W.First, I->first));
+  }
+  std::stable_sort(BySize.begin(), BySize.end(), smallerWrapper);
+
+  unsigned Added = 0, NumCalls = 0;
+  for (unsigned i = 0, e = BySize.size(); i != e; ++i) {
+    LockWrapper &W = LockWrappers[BySize[i].second];
+    std::vector<Instruction *> &WrapperCalls = Calls[BySize[i].second];
+    for (unsigned c = 0, ce = WrapperCalls.size(); c != ce; ++c) {
+      if (Added + BySize[i].first > AndersCloneBudget)
+        break;
+      W.Clones.push_back(NumObjects);
+      CallClones[WrapperCalls[c]] = std::make_pair(&W, NumObjects);
+      NumObjects += BySize[i].first;
+      Added += BySize[i].first;
+      ++NumCalls;
+    }
+  }
+
+  DEBUG(errs() << "Lock wrappers: " << Wrappers.size() << " found, "
+               << NumCalls << " calls cloned, " << Added << " nodes added\n");
+  return NumObjects;
+}
+
+/// FindAllocWrappers - Find the allocation wrappers of M: the functions given
+/// with -anders-alloc-wrappers, which are trusted, and with
+/// -anders-clone-allocators the functions returnsFreshObjects approves of.
+void Andersens::FindAllocWrappers(Module &M) {
+  AllocWrappers.clear();
+  // Whether a call has a heap object of its own depends on the body of the
+  // callee, which incremental solving does not look at.
+  if (!SnapshotPath.empty())
+    return;
+
+  for (unsigned i = 0, e = AndersAllocWrappers.size(); i != e; ++i) {
+    Function *F = M.getFunction(AndersAllocWrappers[i]);
+    if (F && !F->isDeclaration() && isa<PointerType>(F->getReturnType()))
+      AllocWrappers.insert(F);
+  }
+
+  // Functions returning what a wrapper returns are wrappers too.
+  if (AndersCloneAllocators)
+    for (bool Changed = true; Changed; ) {
+      Changed = false;
+      for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+        if (!F->isDeclaration() && isa<PointerType>(F->getReturnType())
+            && !AllocWrappers.count(F) && returnsFreshObjects(F)) {
+          AllocWrappers.insert(F);
+          Changed = true;
+        }
+    }
+
+  DEBUG(errs() << "Allocation wrappers: " << AllocWrappers.size()
+               << " found\n");
+}
+
+/// returnsFreshObjects - Return true if every value F returns is null or the
+/// result of an allocation, or of a call of an allocation wrapper, that
+/// nothing but the return captures.  The values are followed through casts,
+/// getelementptrs, phis and selects.
+bool Andersens::returnsFreshObjects(Function *F) const {
+  std::vector<Value *> WorkList;
+  for (Function::iterator BB = F->begin(), E = F->end(); BB != E; ++BB)
+    if (ReturnInst *RI = dyn_cast<ReturnInst>(BB->getTerminator()))
+      WorkList.push_back(RI->getReturnValue());
+
+  std::set<Value *> Visited;
+  bool Allocates = false;
+  while (!WorkList.empty()) {
+    Value *V = WorkList.back();
+    WorkList.pop_back();
+    if (V == NULL || !Visited.insert(V).second)
+      continue;
+
+    if (isa<ConstantPointerNull>(V))
+      continue;
+    if (isa<BitCastInst>(V) || isa<GetElementPtrInst>(V)) {
+      WorkList.push_back(cast<Instruction>(V)->getOperand(0));
+    } else if (PHINode *PN = dyn_cast<PHINode>(V)) {
+      for (unsigned i = 0, e = PN->getNumIncomingValues(); i != e; ++i)
+        WorkList.push_back(PN->getIncomingValue(i));
+    } else if (SelectInst *SI = dyn_cast<SelectInst>(V)) {
+      WorkList.push_back(SI->getTrueValue());
+      WorkList.push_back(SI->getFalseValue());
+    } else if (isa<CallInst>(V) || isa<InvokeInst>(V)) {
+      Function *Callee = CallSite(cast<Instruction>(V)).getCalledFunction();
+      const ExternalModel *Model = Callee ? getModel(Callee) : NULL;
+      if (!(Model && Model->Effect == ExternalModel::Allocates)
+          && !AllocWrappers.count(Callee))
+        return false;
+      if (isCaptured(V))
+        return false;
+      Allocates = true;
+    } else {
+      return false;
+    }
+  }
+  return Allocates;
+}
+
+/// isCaptured - Return true if the pointer V, or one computed from it, may
+/// be kept anywhere but in the return value of its function: stored, or
+/// passed to a call that may keep it.
+bool Andersens::isCaptured(Value *V) const {
+  std::vector<Value *> WorkList(1, V);
+  std::set<Value *> Visited;
+  while (!WorkList.empty()) {
+    Value *P = WorkList.back();
+    WorkList.pop_back();
+    if (!Visited.insert(P).second)
+      continue;
+
+    for (Value::use_iterator UI = P->use_begin(), E = P->use_end(); UI != E;
+         ++UI) {
+      User *U = *UI;
+      if (isa<BitCastInst>(U) || isa<GetElementPtrInst>(U) ||
+          isa<PHINode>(U) || isa<SelectInst>(U)) {
+        WorkList.push_back(U);
+      } else if (isa<ReturnInst>(U) || isa<LoadInst>(U) || isa<ICmpInst>(U)) {
+        continue;
+      } else if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+        // Storing through the pointer is fine, storing the pointer is not.
+        if (SI->getOperand(0) == P)
+          return true;
+      } else if (isa<CallInst>(U) || isa<InvokeInst>(U)) {
+        CallSite CS(cast<Instruction>(U));
+        Function *Callee = CS.getCalledFunction();
+        const ExternalModel *Model = Callee ? getModel(Callee) : NULL;
+        if (CS.getCalledValue() == P || Model == NULL
+            || Model->Effect != ExternalModel::NoEffect)
+          return true;
+      } else {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/// findCallClone - Return the wrapper Call calls if it has a clone for the
+/// call, setting Base to the first node of the clone, or NULL.
+const Andersens::LockWrapper *
+Andersens::findCallClone(const Instruction *Call, unsigned &Base) const {
+  DenseMap<const Instruction *,
+           std::pair<const LockWrapper *, unsigned> >::const_iterator I =
+    CallClones.find(Call);
+  if (I == CallClones.end())
+    return NULL;
+  Base = I->second.second;
+  return I->second.first;
+}
+
+/// getCloneNode - Return the node standing for NodeIndex in the clone of W
+/// starting at Base.  Nodes outside W, and the nodes the clones share with
+/// W, stand for themselves.
+unsigned Andersens::getCloneNode(unsigned NodeIndex, const LockWrapper &W,
+                                 unsigned Base) {
+  if (NodeIndex < W.First || NodeIndex >= W.End
+      || W.Shared[NodeIndex - W.First])
+    return NodeIndex;
+  return Base + (NodeIndex - W.First);
+}
+
+
+
+
+
+
+
+
+
+
+//===----------------------------------------------------------------------===//
+//                      Demand-Driven Constraint Slicing
+//===----------------------------------------------------------------------===//
+//
+// LUPA only asks about the operands of the lock functions, so with
+// -anders-demand only the constraints those operands depend on are solved.
+// The slice is built backwards from the operand nodes: a node needs every
+// copy, load and address-of constraint that defines it, and a copy or a load
+// needs its source.  What a load reads, and what defines a node living in
+// memory (an object or a field of one), depends on stores whose targets are
+// only known after solving.  A cheap unification pass over the constraints,
+// in the manner of Steensgaard, splits the objects into classes that no
+// pointer can straddle, and gives every load and store the class it goes
+// through.  A load, or a node living in memory, then needs the memory nodes
+// and the stores of its own class only.
+//
+// A slice keeping more than -anders-demand-budget percent of the constraints
+// saves too little to be worth it, and the whole program is solved instead.
+// That is decided once, before any query; a later query about a value
+// outside the slice is answered MayAlias rather than solving again, which
+// would renumber the nodes under the answers already given.
+
+/// NeedNode - Add N to the slice if it is not already there.
+static void NeedNode(unsigned N, std::vector<bool> &Needed,
+                     std::vector<unsigned> &WorkList) {
+  if (Needed[N])
+    return;
+  Needed[N] = true;
+  WorkList.push_back(N);
+}
+
+// The memory class of a constraint that reads or writes no memory, and the
+// pointee class of a class whose members point to nothing yet.
+static const unsigned NoClass = ~0U;
+
+namespace {
+/// MemoryClasses - Equivalence classes of nodes, each with the class of what
+/// its members may point to.  Two nodes whose pointees may overlap end up
+/// with the same pointee class.
+class MemoryClasses {
+  std::vector<unsigned> Rep;
+  std::vector<unsigned> Size;
+  std::vector<unsigned> Pointee;
+
+  unsigned newClass() {
+    Rep.push_back(Rep.size());
+    Size.push_back(1);
+    Pointee.push_back(NoClass);
+    return Rep.size() - 1;
+  }
+
+public:
+  explicit MemoryClasses(unsigned NumNodes) {
+    for (unsigned i = 0; i != NumNodes; ++i)
+      newClass();
+  }
+
+  unsigned find(unsigned N) {
+    unsigned R = N;
+    while (Rep[R] != R)
+      R = Rep[R];
+    while (Rep[N] != R) {
+      unsigned Next = Rep[N];
+      Rep[N] = R;
+      N = Next;
+    }
+    return R;
+  }
+
+  /// pointee - Return the class of what the members of the class of N may
+  /// point to, making an empty one if there is none yet.
+  unsigned pointee(unsigned N) {
+    N = find(N);
+    if (Pointee[N] == NoClass) {
+      unsigned P = newClass();
+      Pointee[N] = P;
+    }
+    return find(Pointee[N]);
+  }
+
+  /// join - Merge the classes of A and B, and then their pointee classes.
+  void join(unsigned A, unsigned B) {
+    std::vector<std::pair<unsigned, unsigned> > Pending;
+    Pending.push_back(std::make_pair(A, B));
+    while (!Pending.empty()) {
+      A = find(Pending.back().first);
+      B = find(Pending.back().second);
+      Pending.pop_back();
+      if (A == B)
+        continue;
+      if (Size[A] < Size[B])
+        std::swap(A, B);
+      Rep[B] = A;
+      Size[A] += Size[B];
+      if (Pointee[A] == NoClass)
+        Pointee[A] = Pointee[B];
+      else if (Pointee[B] != NoClass)
+        Pending.push_back(std::make_pair(Pointee[A], Pointee[B]));
+    }
+  }
+};
+}
+
+/// FindMemoryClasses - Put the nodes into MemoryClasses, the fields of an
+/// object in the class of the object.  Returns in ClassOf the class of every
+/// node, and in Through the class of the memory each load and store of
+/// Constraints goes through; other constraints get NoClass.
+void Andersens::FindMemoryClasses(std::vector<unsigned> &Through,
+                                  std::vector<unsigned> &ClassOf) {
+  unsigned NumNodes = GraphNodes.size();
+  MemoryClasses Classes(NumNodes);
+  for (unsigned i = 0, e = Constraints.size(); i != e; ++i) {
+    Constraint &C = Constraints[i];
+    switch (C.Type) {
+    case Constraint::AddressOf: {
+      Classes.join(Classes.pointee(C.Dest), C.Src);
+      unsigned End = C.Src + std::max(getMaxK(C.Src), 1U);
+      for (unsigned j = C.Src + 1; j < End && j < NumNodes; ++j)
+        Classes.join(C.Src, j);
+      break;
+    }
+    case Constraint::Copy:
+      Classes.join(Classes.pointee(C.Dest), Classes.pointee(C.Src));
+      break;
+    case Constraint::Load:
+      Classes.join(Classes.pointee(C.Dest),
+                   Classes.pointee(Classes.pointee(C.Src)));
+      break;
+    case Constraint::Store:
+      Classes.join(Classes.pointee(Classes.pointee(C.Dest)),
+                   Classes.pointee(C.Src));
+      break;
+    }
+  }
+
+  Through.assign(Constraints.size(), NoClass);
+  for (unsigned i = 0, e = Constraints.size(); i != e; ++i) {
+    Constraint &C = Constraints[i];
+    if (C.Type == Constraint::Load)
+      Through[i] = Classes.pointee(C.Src);
+    else if (C.Type == Constraint::Store)
+      Through[i] = Classes.pointee(C.Dest);
+  }
+  ClassOf.resize(NumNodes);
+  for (unsigned i = 0; i != NumNodes; ++i)
+    ClassOf[i] = Classes.find(i);
+}
+
+/// FindMemoryNodes - Mark the nodes that live in memory: the objects whose
+/// address is taken, and the fields loads and stores can reach from them.
+void Andersens::FindMemoryNodes(std::vector<bool> &InMemory) {
+  unsigned NumNodes = GraphNodes.size();
+  InMemory.assign(NumNodes, false);
+  for (unsigned i = 0, e = Constraints.size(); i != e; ++i) {
+    Constraint &C = Constraints[i];
+    if (C.Type != Constraint::AddressOf)
+      continue;
+#if !FULL_UNIVERSAL
+    // Nothing is ever stored into the special nodes.
+    if (C.Src < NumberSpecialNodes)
+      continue;
+#endif
+    // Loads, stores and offset copies may reach the MaxK nodes from the
+    // object on.
+    unsigned End = C.Src + std::max(getMaxK(C.Src), 1U);
+    for (unsigned j = C.Src; j < End && j < NumNodes; ++j)
+      InMemory[j] = true;
+  }
+}
+
+/// SliceConstraints - Drop the constraints the lock operands do not depend
+/// on, and mark the nodes whose points-to sets stay complete.  Returns false,
+/// leaving the constraints alone, if the slice is over budget.
+bool Andersens::SliceConstraints(Module &M) {
+  unsigned NumNodes = GraphNodes.size();
+  std::vector<std::vector<unsigned> > DefinedBy(NumNodes);
+  std::vector<bool> InMemory;
+  std::vector<unsigned> Through, ClassOf;
+
+  FindMemoryNodes(InMemory);
+  FindMemoryClasses(Through, ClassOf);
+  // The memory nodes and the stores of every class.  Classes are numbered
+  // by their representative nodes, or past the nodes for the classes made
+  // by the unification.
+  DenseMap<unsigned, std::vector<unsigned> > ClassNodes, ClassStores;
+  for (unsigned i = 0; i != NumNodes; ++i)
+    if (InMemory[i])
+      ClassNodes[ClassOf[i]].push_back(i);
+  for (unsigned i = 0, e = Constraints.size(); i != e; ++i) {
+    Constraint &C = Constraints[i];
+    if (C.Type == Constraint::Store)
+      ClassStores[Through[i]].push_back(i);
+    else
+      DefinedBy[C.Dest].push_back(i);
+  }
+
+  std::vector<bool> Needed(NumNodes, false);
+  std::vector<unsigned> WorkList;
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+    for (inst_iterator II = inst_begin(F), IE = inst_end(F); II != IE; ++II) {
+      if (!isa<CallInst>(&*II) && !isa<InvokeInst>(&*II))
+        continue;
+      CallSite CS(&*II);
+      if (!isLockFunction(CS.getCalledFunction()))
+        continue;
+      // The operands of a lock wrapper are also asked about in its clones.
+      std::map<Function *, LockWrapper>::iterator W = LockWrappers.find(F);
+      for (CallSite::arg_iterator AI = CS.arg_begin(), AE = CS.arg_end();
+           AI != AE; ++AI)
+        if (isa<PointerType>((*AI)->getType())) {
+          unsigned N = getNode(*AI);
+          NeedNode(N, Needed, WorkList);
+          if (W != LockWrappers.end())
+            for (unsigned c = 0, ce = W->second.Clones.size(); c != ce; ++c)
+              NeedNode(getCloneNode(N, W->second, W->second.Clones[c]),
+                       Needed, WorkList);
+        }
+    }
+  unsigned NumRoots = WorkList.size();
+
+  DenseSet<unsigned> NeededClasses;
+  std::vector<unsigned> Reads;
+  while (!WorkList.empty()) {
+    unsigned N = WorkList.back();
+    WorkList.pop_back();
+
+    Reads.clear();
+    if (InMemory[N])
+      Reads.push_back(ClassOf[N]);
+    for (unsigned i = 0, e = DefinedBy[N].size(); i != e; ++i) {
+      unsigned Index = DefinedBy[N][i];
+      Constraint &C = Constraints[Index];
+      if (C.Type == Constraint::AddressOf)
+        continue;
+      NeedNode(C.Src, Needed, WorkList);
+      if (C.Type == Constraint::Load)
+        Reads.push_back(Through[Index]);
+    }
+
+    for (unsigned r = 0, re = Reads.size(); r != re; ++r) {
+      if (NeededClasses.count(Reads[r]))
+        continue;
+      NeededClasses.insert(Reads[r]);
+      std::vector<unsigned> &Nodes = ClassNodes[Reads[r]];
+      for (unsigned j = 0, je = Nodes.size(); j != je; ++j)
+        NeedNode(Nodes[j], Needed, WorkList);
+      std::vector<unsigned> &Stores = ClassStores[Reads[r]];
+      for (unsigned j = 0, je = Stores.size(); j != je; ++j) {
+        NeedNode(Constraints[Stores[j]].Dest, Needed, WorkList);
+        NeedNode(Constraints[Stores[j]].Src, Needed, WorkList);
+      }
+    }
+  }
+
+  std::vector<Constraint> Slice;
+  for (unsigned i = 0, e = Constraints.size(); i != e; ++i) {
+    Constraint &C = Constraints[i];
+    if (C.Type == Constraint::Store ? NeededClasses.count(Through[i]) != 0
+                                    : Needed[C.Dest])
+      Slice.push_back(C);
+  }
+
+  DEBUG(errs() << "Demand slice: " << NumRoots << " roots, " << Slice.size()
+               << " of " << Constraints.size() << " constraints, "
+               << NeededClasses.size() << " memory classes\n");
+  if ((uint64_t) Slice.size() * 100
+      > (uint64_t) Constraints.size() * AndersDemandBudget)
+    return false;
+
+  for (unsigned i = 0; i != NumNodes; ++i)
+    GraphNodes[i].Demanded = Needed[i];
+  Constraints.swap(Slice);
+  return true;
+}
+
+/// ResetAnalysis - Throw away the nodes, constraints and solution so that the
+/// program can be analyzed again from scratch.
+void Andersens::ResetAnalysis() {
+  for (unsigned i = 0; i < GraphNodes.size(); ++i)
+    if (!SharingPointsTo)
+      delete GraphNodes[i].PointsTo;
+  GraphNodes.clear();
+  ValueNodes.clear();
+  ObjectNodes.clear();
+  ReturnNodes.clear();
+  VarargNodes.clear();
+  Constraints.clear();
+  MaxK.clear();
+  ClumpedFrom.clear();
+  ClumpedTo.clear();
+  ScopeDefs.clear();
+  ScopeStores.clear();
+  LockWrappers.clear();
+  CallClones.clear();
+  FieldAddresses.clear();
+  FieldUnsafeTypes.clear();
+  FunctionModels.clear();
+  AllocWrappers.clear();
+  LockObjects.clear();
+  std::vector<unsigned>().swap(LockBegin);
+  std::vector<unsigned>().swap(LockMembers);
+  LockOnly.clear();
+  LockProjected = false;
+  std::vector<unsigned>().swap(PointerEquivLabels);
+  PointsToSets.clear();
+  SharingPointsTo = false;
+}
+
+//===----------------------------------------------------------------------===//
+//                           Incremental Solving
+//===----------------------------------------------------------------------===//
+//
+// A snapshot of an earlier run of the same program records, for every
+// function, a hash of its IR and the nodes its constraints defined.  When
+// only some functions changed, the solution of a node can only change if the
+// node is reachable from what the changed functions define, before or after
+// the change:
+//   - every node of a changed function,
+//   - every node the old or the new constraints of a changed function define,
+//   - all of memory if the old or the new version of a changed function
+//     stores anything,
+// and from there along copy and load edges, with stores feeding all of
+// memory and all of memory feeding every load, as in the demand-driven
+// slice.  Every other node keeps its old solution, so its constraints are
+// replaced by address-of constraints for the old points-to set, and only the
+// affected part of the graph is really solved.  The answer is the least
+// solution, which is also what a full solve gives, unless the offline passes
+// of the full solve merge a load through a pointer to nothing with a node
+// that points to something and so leave it a larger set.
+//
+// The globals and the list of functions must not have changed; if they
+// have, the whole program is solved.
+
+/// ApplyBaseline - Replace the constraints of the nodes the changes since the
+/// snapshot cannot reach with their old solution.  Returns false and sets
+/// Error, leaving the constraints alone, if the snapshot cannot be used.
+bool Andersens::ApplyBaseline(std::string &Error) {
+  SnapshotFile File;
+  if (!File.open(SnapshotPath, Error))
+    return false;
+
+  ValueSlots Slots(program);
+  const std::vector<std::string> &Scopes = Slots.getScopes();
+  if (File.Header->NumScopes != Scopes.size()
+      || File.Scopes[0].Hash != Slots.getScopeHash(0)) {
+    Error = "the globals or the functions of the module changed";
+    return false;
+  }
+  for (unsigned i = 1, e = Scopes.size(); i != e; ++i)
+    if (Scopes[i] != File.getScopeName(i)) {
+      Error = "the functions of the module changed";
+      return false;
+    }
+
+  unsigned NumNodes = GraphNodes.size();
+  std::vector<bool> Affected(NumNodes, false);
+  std::vector<unsigned> WorkList;
+  bool MemoryAffected = false;
+
+  std::vector<bool> Changed(Scopes.size(), false);
+  unsigned NumChanged = 0;
+  for (unsigned i = 1, e = Scopes.size(); i != e; ++i) {
+    const SnapshotScope &Scope = File.Scopes[i];
+    if (Scope.Hash == Slots.getScopeHash(i))
+      continue;
+    if (!(Scope.Flags & ScopeDefsKnown)) {
+      Error = std::string("the definitions of ") + File.getScopeName(i)
+        + " are not known";
+      return false;
+    }
+    Changed[i] = true;
+    ++NumChanged;
+
+    if ((Scope.Flags & ScopeHasStores) || ScopeStores[i])
+      MemoryAffected = true;
+    for (unsigned j = Scope.DefBegin; j < Scope.DefEnd; ++j) {
+      unsigned Def;
+      // An old definition in the changed function itself may be gone; all
+      // of its nodes are affected anyway.
+      if (File.Keys[File.Defs[j]].Scope == i)
+        continue;
+      if (!getNodeForKey(File, Slots, File.Defs[j], Def)) {
+        Error = std::string("a node ") + File.getScopeName(i)
+          + " defined is gone";
+        return false;
+      }
+      NeedNode(Def, Affected, WorkList);
+    }
+    for (unsigned j = 0, je = ScopeDefs[i].size(); j != je; ++j)
+      NeedNode(ScopeDefs[i][j], Affected, WorkList);
+  }
+
+  // Find the old solution of every node.  Nodes of changed functions, nodes
+  // the snapshot has no solution for, and nodes whose old solution holds a
+  // pointee this run cannot name are affected.
+  std::vector<unsigned> OldSet(NumNodes, NoSet);
+  std::vector<std::pair<SnapshotKey, unsigned> > Keys;
+  CollectNodeKeys(Slots, Keys);
+  for (unsigned i = 0, e = Keys.size(); i != e; ++i) {
+    const SnapshotKey &Key = Keys[i].first;
+    if (Keys[i].second < NumberSpecialNodes || Changed[Key.Scope])
+      continue;
+    unsigned Index = File.findKey(Key);
+    if (Index != ~0U && File.Keys[Index].Set < File.Header->NumSets)
+      OldSet[Keys[i].second] = File.Keys[Index].Set;
+  }
+  std::vector<bool> SetNamed(File.Header->NumSets, false);
+  std::vector<bool> SetChecked(File.Header->NumSets, false);
+  unsigned NumUnnamed = 0;
+  for (unsigned i = NumberSpecialNodes; i != NumNodes; ++i) {
+    unsigned Set = OldSet[i];
+    if (Set != NoSet && !SetChecked[Set]) {
+      SetChecked[Set] = true;
+      SetNamed[Set] = true;
+      for (unsigned j = File.SetBegin[Set], je = File.SetBegin[Set + 1];
+           j < je && SetNamed[Set]; ++j) {
+        unsigned Member;
+        SetNamed[Set] = getNodeForKey(File, Slots, File.Members[j], Member);
+      }
+    }
+    if (Set != NoSet && !SetNamed[Set]) {
+      OldSet[i] = NoSet;
+      ++NumUnnamed;
+    }
+    if (OldSet[i] == NoSet)
+      NeedNode(i, Affected, WorkList);
+  }
 
+  // Follow the edges out of the affected nodes.
+  std::vector<bool> InMemory;
+  std::vector<std::vector<unsigned> > Uses(NumNodes);
+  std::vector<unsigned> Loads;
+  FindMemoryNodes(InMemory);
+  for (unsigned i = 0, e = Constraints.size(); i != e; ++i) {
+    Constraint &C = Constraints[i];
+    if (C.Type == Constraint::AddressOf)
+      continue;
+    Uses[C.Src].push_back(i);
+    if (C.Type == Constraint::Store)
+      Uses[C.Dest].push_back(i);
+    else if (C.Type == Constraint::Load)
+      Loads.push_back(C.Dest);
+  }
 
+  bool MemoryDone = false;
+  while (true) {
+    if (MemoryAffected && !MemoryDone) {
+      MemoryDone = true;
+      for (unsigned j = 0; j != NumNodes; ++j)
+        if (InMemory[j])
+          NeedNode(j, Affected, WorkList);
+      for (unsigned j = 0, je = Loads.size(); j != je; ++j)
+        NeedNode(Loads[j], Affected, WorkList);
+    }
+    if (WorkList.empty())
+      break;
+
+    unsigned N = WorkList.back();
+    WorkList.pop_back();
+    if (InMemory[N])
+      MemoryAffected = true;
+    for (unsigned i = 0, e = Uses[N].size(); i != e; ++i) {
+      Constraint &C = Constraints[Uses[N][i]];
+      if (C.Type == Constraint::Store)
+        MemoryAffected = true;
+      else
+        NeedNode(C.Dest, Affected, WorkList);
+    }
+  }
 
+  // Keep the constraints of the affected nodes, and pin down the rest.
+  // The special nodes are never affected but keep their own constraints.
+  std::vector<Constraint> Kept;
+  unsigned NumAffected = 0;
+  for (unsigned i = 0, e = Constraints.size(); i != e; ++i) {
+    Constraint &C = Constraints[i];
+    if (C.Type == Constraint::Store ? MemoryAffected
+        : Affected[C.Dest] || C.Dest < NumberSpecialNodes)
+      Kept.push_back(C);
+  }
+  for (unsigned i = NumberSpecialNodes; i != NumNodes; ++i) {
+    if (Affected[i]) {
+      ++NumAffected;
+      continue;
+    }
+    for (unsigned j = File.SetBegin[OldSet[i]],
+         je = File.SetBegin[OldSet[i] + 1]; j < je; ++j) {
+      unsigned Member;
+      getNodeForKey(File, Slots, File.Members[j], Member);
+      Kept.push_back(Constraint(Constraint::AddressOf, i, Member));
+    }
+  }
 
+  DEBUG(errs() << "Incremental solve: " << NumChanged << " changed functions, "
+               << NumAffected << " of " << NumNodes << " nodes affected"
+               << (MemoryAffected ? ", including memory" : "") << ", "
+               << NumUnnamed << " for unnamed pointees, "
+               << Kept.size() << " constraints\n");
+  Constraints.swap(Kept);
+  return true;
+}
 
 //===----------------------------------------------------------------------===//
 //                     Constraint Identification Phase
 //===----------------------------------------------------------------------===//
 
+/// FunctionConstraints - Collects the constraints of functions into a vector
+/// of its own.  The node maps of the Andersens instance are only read, and
+/// the values of the nodes of a function are only set by its collector, so
+/// different functions can be collected in parallel.
+class Andersens::FunctionConstraints
+  : public InstVisitor<Andersens::FunctionConstraints> {
+  Andersens &A;
+  std::vector<Constraint> &Constraints;
+
+  void AddConstraintsForNonInternalLinkage(Function *F);
+  void AddConstraintsForCall(CallSite CS, Function *F);
+  bool AddConstraintsForExternalCall(CallSite CS, Function *F);
+
+  //===--------------------------------------------------------------------===//
+  // Instruction visitation methods for adding constraints
+  //
+  friend class InstVisitor<FunctionConstraints>;
+  void visitReturnInst(ReturnInst &RI);
+  void visitExtractValueInst(ExtractValueInst &EEI);
+  void visitInsertValueInst(InsertValueInst &IVI);
+  void visitInvokeInst(InvokeInst &II) { visitCallSite(CallSite(&II)); }
+  void visitCallInst(CallInst &CI) { visitCallSite(CallSite(&CI)); }
+  void visitCallSite(CallSite CS);
+  void visitAllocaInst(AllocaInst &AI);
+  void visitLoadInst(LoadInst &LI);
+  void visitStoreInst(StoreInst &SI);
+  void visitGetElementPtrInst(GetElementPtrInst &GEP);
+  void visitPHINode(PHINode &PN);
+  void visitCastInst(CastInst &CI);
+  void visitICmpInst(ICmpInst &ICI) {} // NOOP!
+  void visitFCmpInst(FCmpInst &ICI) {} // NOOP!
+  void visitSelectInst(SelectInst &SI);
+  void visitVAArg(VAArgInst &I);
+  void visitInstruction(Instruction &I);
+
+public:
+  FunctionConstraints(Andersens &a, std::vector<Constraint> &c)
+    : A(a), Constraints(c) {}
+
+  void collect(Function *F);
+};
+
 /// getNodeForConstantPointer - Return the node corresponding to the constant
 /// pointer itself.
 unsigned Andersens::getNodeForConstantPointer(Constant *C) {
@@ -212,8 +1943,13 @@ unsigned Andersens::getNodeForConstantPointer(Constant *C) {
     return getNode(GV);
   else if (ConstantExpr *CE = dyn_cast<ConstantExpr>(C)) {
     switch (CE->getOpcode()) {
-    case Instruction::GetElementPtr:
+    case Instruction::GetElementPtr: {
+      // The addresses of fields past the first have nodes of their own.
+      DenseMap<Value*, unsigned>::iterator I = ValueNodes.find(CE);
+      if (I != ValueNodes.end())
+        return I->second;
       return getNodeForConstantPointer(CE->getOperand(0));
+    }
     case Instruction::IntToPtr:
       return UniversalSet;
     case Instruction::BitCast:
@@ -233,14 +1969,15 @@ unsigned Andersens::getNodeForConstantPointer(Constant *C) {
 unsigned Andersens::getNodeForConstantPointerTarget(Constant *C) {
   assert(isa<PointerType>(C->getType()) && "Not a constant pointer!");
 
-  if (isa<ConstantPointerNull>(C))
+  if (isa<ConstantPointerNull>(C) || isa<UndefValue>(C))
     return NullObject;
   else if (GlobalValue *GV = dyn_cast<GlobalValue>(C))
     return getObject(GV);
   else if (ConstantExpr *CE = dyn_cast<ConstantExpr>(C)) {
     switch (CE->getOpcode()) {
     case Instruction::GetElementPtr:
-      return getNodeForConstantPointerTarget(CE->getOperand(0));
+      return getFieldNode(getNodeForConstantPointerTarget(CE->getOperand(0)),
+                          getFieldOffset(CE));
     case Instruction::IntToPtr:
       return UniversalSet;
     case Instruction::BitCast:
@@ -264,124 +2001,109 @@ void Andersens::AddGlobalInitializerConstraints(unsigned NodeIndex,
       Constraints.push_back(Constraint(Constraint::Copy, NodeIndex,
                                        getNodeForConstantPointer(C)));
   } else if (C->isNullValue()) {
-    Constraints.push_back(Constraint(Constraint::Copy, NodeIndex,
-                                     NullObject));
+    unsigned Fields = std::min(getNumFields(C->getType()),
+                               std::max(getMaxK(NodeIndex), 1U));
+    for (unsigned i = 0; i != Fields; ++i)
+      Constraints.push_back(Constraint(Constraint::Copy, NodeIndex + i,
+                                       NullObject));
     return;
   } else if (!isa<UndefValue>(C)) {
     // If this is an array or struct, include constraints for each element.
+    // The elements of a struct start at fields of their own, those of an
+    // array share them.
     assert(isa<ConstantArray>(C) || isa<ConstantStruct>(C));
-    for (unsigned i = 0, e = C->getNumOperands(); i != e; ++i)
-      AddGlobalInitializerConstraints(NodeIndex,
-                                      cast<Constant>(C->getOperand(i)));
+    unsigned Field = NodeIndex;
+    for (unsigned i = 0, e = C->getNumOperands(); i != e; ++i) {
+      Constant *Element = cast<Constant>(C->getOperand(i));
+      AddGlobalInitializerConstraints(Field, Element);
+      if (isa<ConstantStruct>(C))
+        Field = getFieldNode(Field, getNumFields(Element->getType()));
+    }
   }
 }
 
 /// AddConstraintsForNonInternalLinkage - If this function does not have
 /// internal linkage, realize that we can't trust anything passed into or
 /// returned by this function.
-void Andersens::AddConstraintsForNonInternalLinkage(Function *F) {
+void Andersens::FunctionConstraints::AddConstraintsForNonInternalLinkage(
+    Function *F) {
   for (Function::arg_iterator I = F->arg_begin(), E = F->arg_end(); I != E; ++I)
     if (isa<PointerType>(I->getType()))
       // If this is an argument of an externally accessible function, the
       // incoming pointer might point to anything.
-      Constraints.push_back(Constraint(Constraint::Copy, getNode(I),
+      Constraints.push_back(Constraint(Constraint::Copy, A.getNode(I),
                                        UniversalSet));
 }
 
-/// AddConstraintsForCall - If this is a call to a "known" function, add the
-/// constraints and return true.  If this is a call to an unknown function,
-/// return false.
-bool Andersens::AddConstraintsForExternalCall(CallSite CS, Function *F) {
+/// AddConstraintsForExternalCall - If F has a model, add the constraints of
+/// the call CS to it and return true.  Calls to functions without a model are
+/// ignored too, unless -anders-strict-externals is given; so are calls whose
+/// arguments do not fit the model.
+bool Andersens::FunctionConstraints::AddConstraintsForExternalCall(CallSite CS,
+                                                                  Function *F) {
   assert(F->isDeclaration() && "Not an external function!");
- return true;
-  // These functions don't induce any points-to constraints.
-  if (F->getName() == "atoi" || F->getName() == "atof" ||
-      F->getName() == "atol" || F->getName() == "atoll" ||
-      F->getName() == "remove" || F->getName() == "unlink" ||
-      F->getName() == "rename" || F->getName() == "memcmp" ||
-      F->getName() == "llvm.memset" ||
-      F->getName() == "strcmp" || F->getName() == "strncmp" ||
-      F->getName() == "execl" || F->getName() == "execlp" ||
-      F->getName() == "execle" || F->getName() == "execv" ||
-      F->getName() == "execvp" || F->getName() == "chmod" ||
-      F->getName() == "puts" || F->getName() == "write" ||
-      F->getName() == "open" || F->getName() == "create" ||
-      F->getName() == "truncate" || F->getName() == "chdir" ||
-      F->getName() == "mkdir" || F->getName() == "rmdir" ||
-      F->getName() == "read" || F->getName() == "pipe" ||
-      F->getName() == "wait" || F->getName() == "time" ||
-      F->getName() == "stat" || F->getName() == "fstat" ||
-      F->getName() == "lstat" || F->getName() == "strtod" ||
-      F->getName() == "strtof" || F->getName() == "strtold" ||
-      F->getName() == "fopen" || F->getName() == "fdopen" ||
-      F->getName() == "freopen" ||
-      F->getName() == "fflush" || F->getName() == "feof" ||
-      F->getName() == "fileno" || F->getName() == "clearerr" ||
-      F->getName() == "rewind" || F->getName() == "ftell" ||
-      F->getName() == "ferror" || F->getName() == "fgetc" ||
-      F->getName() == "fgetc" || F->getName() == "_IO_getc" ||
-      F->getName() == "fwrite" || F->getName() == "fread" ||
-      F->getName() == "fgets" || F->getName() == "ungetc" ||
-      F->getName() == "fputc" ||
-      F->getName() == "fputs" || F->getName() == "putc" ||
-      F->getName() == "ftell" || F->getName() == "rewind" ||
-      F->getName() == "_IO_putc" || F->getName() == "fseek" ||
-      F->getName() == "fgetpos" || F->getName() == "fsetpos" ||
-      F->getName() == "printf" || F->getName() == "fprintf" ||
-      F->getName() == "sprintf" || F->getName() == "vprintf" ||
-      F->getName() == "vfprintf" || F->getName() == "vsprintf" ||
-      F->getName() == "scanf" || F->getName() == "fscanf" ||
-      F->getName() == "sscanf" || F->getName() == "__assert_fail" ||
-      F->getName() == "modf" || F->getName().find("pthread") != StringRef::npos)
+  const ExternalModel *Model = A.getModel(F);
+  if (Model == NULL)
+    return !AndersStrictExternals;
+  if (!Model->fits(CS))
+    return false;
+
+  Instruction *Call = CS.getInstruction();
+  bool PointerResult = isa<PointerType>(CS.getType());
+  switch (Model->Effect) {
+  case ExternalModel::NoEffect:
     return true;
 
+  case ExternalModel::ReturnsArg:
+    // Result = Arg0
+    if (PointerResult)
+      Constraints.push_back(Constraint(Constraint::Copy, A.getNode(Call),
+                                       A.getNode(CS.getArgument(Model->Arg0))));
+    return true;
 
-  // These functions do induce points-to edges.
-  if (F->getName() == "llvm.memcpy" ||
-      F->getName() == "llvm.memmove" ||
-      F->getName() == "memmove") {
-
-    const FunctionType *FTy = F->getFunctionType();
-    if (FTy->getNumParams() > 1 &&
-        isa<PointerType>(FTy->getParamType(0)) &&
-        isa<PointerType>(FTy->getParamType(1))) {
-
-      // *Dest = *Src, which requires an artificial graph node to represent the
-      // constraint.  It is broken up into *Dest = temp, temp = *Src
-      unsigned FirstArg = getNode(CS.getArgument(0));
-      unsigned SecondArg = getNode(CS.getArgument(1));
-      unsigned TempArg = GraphNodes.size();
-      GraphNodes.push_back(Node());
-      Constraints.push_back(Constraint(Constraint::Store,
-                                       FirstArg, TempArg));
-      Constraints.push_back(Constraint(Constraint::Load,
-                                       TempArg, SecondArg));
-      // In addition, Dest = Src
-      Constraints.push_back(Constraint(Constraint::Copy,
-                                       FirstArg, SecondArg));
-      return true;
+  case ExternalModel::CopiesThrough: {
+    // *Dest = *Src, which requires an artificial graph node to represent the
+    // constraint.  It is broken up into *Dest = temp, temp = *Src, once for
+    // every field a copy may cover.  The fields past the end of an object
+    // fall on the node the argument points to, so a struct copied into a
+    // buffer of one node keeps all of them.
+    unsigned Dest = A.getNode(CS.getArgument(Model->Arg0));
+    unsigned Src = A.getNode(CS.getArgument(Model->Arg1));
+    unsigned Temp = A.getObject(Call);
+    for (unsigned i = 0; i != A.MaxFields; ++i) {
+      Constraints.push_back(Constraint(Constraint::Store, Dest, Temp + i, i));
+      Constraints.push_back(Constraint(Constraint::Load, Temp + i, Src, i));
     }
+    // In addition, Dest = Src
+    Constraints.push_back(Constraint(Constraint::Copy, Dest, Src));
+    if (PointerResult)
+      Constraints.push_back(Constraint(Constraint::Copy, A.getNode(Call),
+                                       Dest));
+    return true;
   }
 
-  // Result = Arg0
-  if (F->getName() == "realloc" || F->getName() == "strchr" ||
-      F->getName() == "strrchr" || F->getName() == "strstr" ||
-      F->getName() == "strtok") {
-    const FunctionType *FTy = F->getFunctionType();
-    if (FTy->getNumParams() > 0 &&
-        isa<PointerType>(FTy->getParamType(0))) {
-      Constraints.push_back(Constraint(Constraint::Copy,
-                                       getNode(CS.getInstruction()),
-                                       getNode(CS.getArgument(0))));
-      return true;
+  case ExternalModel::Allocates:
+    // Result = &Object, a new object for every call.
+    if (PointerResult)
+      Constraints.push_back(Constraint(Constraint::AddressOf, A.getNode(Call),
+                                       A.getObject(Call)));
+    return true;
+
+  case ExternalModel::SavesArg:
+  case ExternalModel::ReturnsSaved:
+    // <saved> = Arg0, and Result = <saved>, all calls sharing the object.
+    if (Model->Effect == ExternalModel::SavesArg) {
+      unsigned Saved = A.getNode(CS.getArgument(Model->Arg0));
+      Constraints.push_back(Constraint(Constraint::Copy, SavedObject, Saved));
     }
+    if (PointerResult)
+      Constraints.push_back(Constraint(Constraint::Copy, A.getNode(Call),
+                                       SavedObject));
+    return true;
   }
-
   return false;
 }
 
-
-
 /// AnalyzeUsesOfFunction - Look at all of the users of the specified function.
 /// If this is used by anything complex (i.e., the address escapes), return
 /// true.
@@ -427,6 +2149,23 @@ bool Andersens::AnalyzeUsesOfFunction(Value *V) {
   return false;
 }
 
+struct Andersens::CollectTask : public ThreadPool::Task {
+  Andersens &A;
+  const std::vector<Function *> &Functions;
+  std::vector<std::vector<Constraint> > &Out;
+
+  CollectTask(Andersens &a, const std::vector<Function *> &f,
+              std::vector<std::vector<Constraint> > &o)
+    : A(a), Functions(f), Out(o) {}
+
+  void run(unsigned Chunk, unsigned Begin, unsigned End) {
+    for (unsigned i = Begin; i != End; ++i) {
+      FunctionConstraints Collector(A, Out[i]);
+      Collector.collect(Functions[i]);
+    }
+  }
+};
+
 /// CollectConstraints - This stage scans the program, adding a constraint to
 /// the Constraints list for each instruction in the program that induces a
 /// constraint, and setting up the initial points-to graph.
@@ -437,6 +2176,9 @@ void Andersens::CollectConstraints(Module &M) {
                                    UniversalSet));
   Constraints.push_back(Constraint(Constraint::Store, UniversalSet,
                                    UniversalSet));
+  for (unsigned i = 1; i < MaxFields; ++i)
+    Constraints.push_back(Constraint(Constraint::Store, UniversalSet,
+                                     UniversalSet, i));
 
   // Next, the null pointer points to the null object.
   Constraints.push_back(Constraint(Constraint::AddressOf, NullPtr, NullObject));
@@ -457,75 +2199,141 @@ void Andersens::CollectConstraints(Module &M) {
     } else {
       // If it doesn't have an initializer (i.e. it's defined in another
       // translation unit), it points to the universal set.
-      Constraints.push_back(Constraint(Constraint::Copy, ObjectIndex,
-                                       UniversalSet));
+      for (unsigned i = 0, e = std::max(getMaxK(ObjectIndex), 1U); i != e; ++i)
+        Constraints.push_back(Constraint(Constraint::Copy, ObjectIndex + i,
+                                         UniversalSet));
     }
   }
 
-  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F) {
-    // Set up the return value node.
+  // The constant address of a field points to the field.
+  for (unsigned i = 0, e = FieldAddresses.size(); i != e; ++i)
+    Constraints.push_back(Constraint(Constraint::AddressOf,
+                                     getNodeValue(*FieldAddresses[i]),
+                                     getNodeForConstantPointerTarget(
+                                       FieldAddresses[i])));
+  RecordScopeConstraints(0, 0);
+
+  // The functions are collected in parallel with -anders-parallel-collect,
+  // each into its own vector, and the vectors are appended in module order,
+  // so the constraints are the same as when collecting sequentially.
+  std::vector<Function *> Functions;
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+    Functions.push_back(F);
+  std::vector<std::vector<Constraint> > PerFunction(Functions.size());
+  {
+    ThreadPool Pool(AndersParallelCollect ? AndersThreads : 1);
+    CollectTask Collect(*this, Functions, PerFunction);
+    Pool.run(Collect, Functions.size(), CollectChunkSize);
+  }
+
+  for (unsigned i = 0, e = Functions.size(); i != e; ++i) {
+    unsigned Begin = Constraints.size();
+    Constraints.insert(Constraints.end(), PerFunction[i].begin(),
+                       PerFunction[i].end());
+
+    // The clones of a lock wrapper get copies of its constraints.
+    std::map<Function *, LockWrapper>::iterator W =
+      LockWrappers.find(Functions[i]);
+    if (W != LockWrappers.end())
+      for (unsigned c = 0, ce = W->second.Clones.size(); c != ce; ++c)
+        for (unsigned j = 0, je = PerFunction[i].size(); j != je; ++j) {
+          Constraint C = PerFunction[i][j];
+          C.Dest = getCloneNode(C.Dest, W->second, W->second.Clones[c]);
+          C.Src = getCloneNode(C.Src, W->second, W->second.Clones[c]);
+          Constraints.push_back(C);
+        }
+    std::vector<Constraint>().swap(PerFunction[i]);
+    RecordScopeConstraints(i + 1, Begin);
+  }
+}
+
+/// collect - Add the constraints of the arguments and the body of F.  The
+/// nodes of F are only read, apart from recording their values, so the
+/// functions can be collected in parallel.
+void Andersens::FunctionConstraints::collect(Function *F) {
+  // Set up the return value node.
+  if (isa<PointerType>(F->getFunctionType()->getReturnType()))
+    A.GraphNodes[A.getReturnNode(F)].setValue(F);
+  if (F->getFunctionType()->isVarArg())
+    A.GraphNodes[A.getVarargNode(F)].setValue(F);
+
+  // Set up incoming argument nodes.
+  for (Function::arg_iterator I = F->arg_begin(), E = F->arg_end();
+       I != E; ++I)
+    if (isa<PointerType>(I->getType()))
+      A.getNodeValue(*I);
+
+  // At some point we should just add constraints for the escaping functions
+  // at solve time, but this slows down solving. For now, we simply mark
+  // address taken functions as escaping and treat them as external.
+  if (!F->hasLocalLinkage() || A.AnalyzeUsesOfFunction(F))
+    AddConstraintsForNonInternalLinkage(F);
+
+  if (!F->isDeclaration()) {
+    // Scan the function body, creating a memory object for each heap/stack
+    // allocation in the body of the function and a node to represent all
+    // pointer values defined by instructions and used as operands.
+    visit(F);
+  } else {
+    // External functions that return pointers return the universal set.
     if (isa<PointerType>(F->getFunctionType()->getReturnType()))
-      GraphNodes[getReturnNode(F)].setValue(F);
-    if (F->getFunctionType()->isVarArg())
-      GraphNodes[getVarargNode(F)].setValue(F);
+      Constraints.push_back(Constraint(Constraint::Copy,
+                                       A.getReturnNode(F),
+                                       UniversalSet));
 
-    // Set up incoming argument nodes.
+    // Any pointers that are passed into the function have the universal set
+    // stored into them.
     for (Function::arg_iterator I = F->arg_begin(), E = F->arg_end();
          I != E; ++I)
-      if (isa<PointerType>(I->getType()))
-        getNodeValue(*I);
-
-    // At some point we should just add constraints for the escaping functions
-    // at solve time, but this slows down solving. For now, we simply mark
-    // address taken functions as escaping and treat them as external.
-    if (!F->hasLocalLinkage() || AnalyzeUsesOfFunction(F))
-      AddConstraintsForNonInternalLinkage(F);
-
-    if (!F->isDeclaration()) {
-      // Scan the function body, creating a memory object for each heap/stack
-      // allocation in the body of the function and a node to represent all
-      // pointer values defined by instructions and used as operands.
-      visit(F);
-    } else {
-      // External functions that return pointers return the universal set.
-      if (isa<PointerType>(F->getFunctionType()->getReturnType()))
-        Constraints.push_back(Constraint(Constraint::Copy,
-                                         getReturnNode(F),
+      if (isa<PointerType>(I->getType())) {
+        // Pointers passed into external functions could have anything stored
+        // through them.
+        Constraints.push_back(Constraint(Constraint::Store, A.getNode(I),
                                          UniversalSet));
-
-      // Any pointers that are passed into the function have the universal set
-      // stored into them.
-      for (Function::arg_iterator I = F->arg_begin(), E = F->arg_end();
-           I != E; ++I)
-        if (isa<PointerType>(I->getType())) {
-          // Pointers passed into external functions could have anything stored
-          // through them.
-          Constraints.push_back(Constraint(Constraint::Store, getNode(I),
-                                           UniversalSet));
-          // Memory objects passed into external function calls can have the
-          // universal set point to them.
+        // Memory objects passed into external function calls can have the
+        // universal set point to them.
 #if FULL_UNIVERSAL
-          Constraints.push_back(Constraint(Constraint::Copy,
-                                           UniversalSet,
-                                           getNode(I)));
+        Constraints.push_back(Constraint(Constraint::Copy,
+                                         UniversalSet,
+                                         A.getNode(I)));
 #else
-          Constraints.push_back(Constraint(Constraint::Copy,
-                                           getNode(I),
-                                           UniversalSet));
+        Constraints.push_back(Constraint(Constraint::Copy,
+                                         A.getNode(I),
+                                         UniversalSet));
 #endif
-        }
+      }
 
-      // If this is an external varargs function, it can also store pointers
-      // into any pointers passed through the varargs section.
-      if (F->getFunctionType()->isVarArg())
-        Constraints.push_back(Constraint(Constraint::Store, getVarargNode(F),
-                                         UniversalSet));
-    }
+    // If this is an external varargs function, it can also store pointers
+    // into any pointers passed through the varargs section.
+    if (F->getFunctionType()->isVarArg())
+      Constraints.push_back(Constraint(Constraint::Store, A.getVarargNode(F),
+                                       UniversalSet));
+  }
+}
+
+/// RecordScopeConstraints - Remember which nodes the constraints from Begin
+/// on define, and whether they store anything, for snapshot scope Scope.
+void Andersens::RecordScopeConstraints(unsigned Scope, unsigned Begin) {
+  if (SnapshotPath.empty())
+    return;
+  if (ScopeDefs.size() <= Scope) {
+    ScopeDefs.resize(Scope + 1);
+    ScopeStores.resize(Scope + 1, false);
+  }
+
+  std::vector<unsigned> &Defs = ScopeDefs[Scope];
+  for (unsigned i = Begin, e = Constraints.size(); i != e; ++i) {
+    if (Constraints[i].Type == Constraint::Store)
+      ScopeStores[Scope] = true;
+    else
+      Defs.push_back(Constraints[i].Dest);
   }
+  std::sort(Defs.begin(), Defs.end());
+  Defs.erase(std::unique(Defs.begin(), Defs.end()), Defs.end());
 }
 
 
-void Andersens::visitInstruction(Instruction &I) {
+void Andersens::FunctionConstraints::visitInstruction(Instruction &I) {
 #ifdef NDEBUG
   return;          // This function is just a big assert.
 #endif
@@ -548,66 +2356,72 @@ void Andersens::visitInstruction(Instruction &I) {
   }
 }
 
-void Andersens::visitAllocaInst(AllocaInst &AI) {
-  unsigned ObjectIndex = getObject(&AI);
-  GraphNodes[ObjectIndex].setValue(&AI);
-  Constraints.push_back(Constraint(Constraint::AddressOf, getNodeValue(AI),
+void Andersens::FunctionConstraints::visitAllocaInst(AllocaInst &AI) {
+  unsigned ObjectIndex = A.getObject(&AI);
+  A.GraphNodes[ObjectIndex].setValue(&AI);
+  Constraints.push_back(Constraint(Constraint::AddressOf, A.getNodeValue(AI),
                                    ObjectIndex));
 }
 
-void Andersens::visitReturnInst(ReturnInst &RI) {
+void Andersens::FunctionConstraints::visitReturnInst(ReturnInst &RI) {
   if (RI.getNumOperands() && isa<PointerType>(RI.getOperand(0)->getType()))
     // return V   -->   <Copy/retval{F}/v>
     Constraints.push_back(Constraint(Constraint::Copy,
-                                     getReturnNode(RI.getParent()->getParent()),
-                                     getNode(RI.getOperand(0))));
+                                   A.getReturnNode(RI.getParent()->getParent()),
+                                     A.getNode(RI.getOperand(0))));
 }
 
-void Andersens::visitLoadInst(LoadInst &LI) {
+void Andersens::FunctionConstraints::visitLoadInst(LoadInst &LI) {
   if (isa<PointerType>(LI.getType()))
     // P1 = load P2  -->  <Load/P1/P2>
-    Constraints.push_back(Constraint(Constraint::Load, getNodeValue(LI),
-                                     getNode(LI.getOperand(0))));
+    Constraints.push_back(Constraint(Constraint::Load, A.getNodeValue(LI),
+                                     A.getNode(LI.getOperand(0))));
 }
 
-void Andersens::visitStoreInst(StoreInst &SI) {
+void Andersens::FunctionConstraints::visitStoreInst(StoreInst &SI) {
   if (isa<PointerType>(SI.getOperand(0)->getType()))
     // store P1, P2  -->  <Store/P2/P1>
     Constraints.push_back(Constraint(Constraint::Store,
-                                     getNode(SI.getOperand(1)),
-                                     getNode(SI.getOperand(0))));
+                                     A.getNode(SI.getOperand(1)),
+                                     A.getNode(SI.getOperand(0))));
 }
 
-void Andersens::visitGetElementPtrInst(GetElementPtrInst &GEP) {
-  // P1 = getelementptr P2, ... --> <Copy/P1/P2>
-  Constraints.push_back(Constraint(Constraint::Copy, getNodeValue(GEP),
-                                   getNode(GEP.getOperand(0))));
+void Andersens::FunctionConstraints::visitGetElementPtrInst(
+    GetElementPtrInst &GEP) {
+  // P1 = getelementptr P2, ... --> <Copy/P1/P2+K>, where K is the field the
+  // indices select.  No object has K fields past one when K is MaxFields or
+  // more, which makes it a plain copy.
+  unsigned K = A.MaxFields > 1 ? getFieldOffset(&GEP) : 0;
+  if (K >= A.MaxFields)
+    K = 0;
+  Constraints.push_back(Constraint(Constraint::Copy, A.getNodeValue(GEP),
+                                   A.getNode(GEP.getOperand(0)), K));
 }
 
-void Andersens::visitPHINode(PHINode &PN) {
+void Andersens::FunctionConstraints::visitPHINode(PHINode &PN) {
   if (isa<PointerType>(PN.getType())) {
-    unsigned PNN = getNodeValue(PN);
+    unsigned PNN = A.getNodeValue(PN);
     for (unsigned i = 0, e = PN.getNumIncomingValues(); i != e; ++i)
       // P1 = phi P2, P3  -->  <Copy/P1/P2>, <Copy/P1/P3>, ...
       Constraints.push_back(Constraint(Constraint::Copy, PNN,
-                                       getNode(PN.getIncomingValue(i))));
+                                       A.getNode(PN.getIncomingValue(i))));
   }
 }
 
-void Andersens::visitCastInst(CastInst &CI) {
+void Andersens::FunctionConstraints::visitCastInst(CastInst &CI) {
   Value *Op = CI.getOperand(0);
   if (isa<PointerType>(CI.getType())) {
     if (isa<PointerType>(Op->getType())) {
       // P1 = cast P2  --> <Copy/P1/P2>
-      Constraints.push_back(Constraint(Constraint::Copy, getNodeValue(CI),
-                                       getNode(CI.getOperand(0))));
+      Constraints.push_back(Constraint(Constraint::Copy, A.getNodeValue(CI),
+                                       A.getNode(CI.getOperand(0))));
     } else {
       // P1 = cast int --> <Copy/P1/Univ>
 #if 0
-      Constraints.push_back(Constraint(Constraint::Copy, getNodeValue(CI),
+      Constraints.push_back(Constraint(Constraint::Copy, A.getNodeValue(CI),
                                        UniversalSet));
 #else
-      getNodeValue(CI);
+      A.getNodeValue(CI);
 #endif
     }
   } else if (isa<PointerType>(Op->getType())) {
@@ -615,40 +2429,42 @@ void Andersens::visitCastInst(CastInst &CI) {
 #if 0
     Constraints.push_back(Constraint(Constraint::Copy,
                                      UniversalSet,
-                                     getNode(CI.getOperand(0))));
+                                     A.getNode(CI.getOperand(0))));
 #else
-    getNode(CI.getOperand(0));
+    A.getNode(CI.getOperand(0));
 #endif
   }
 }
 
-void Andersens::visitSelectInst(SelectInst &SI) {
+void Andersens::FunctionConstraints::visitSelectInst(SelectInst &SI) {
   if (isa<PointerType>(SI.getType())) {
-    unsigned SIN = getNodeValue(SI);
+    unsigned SIN = A.getNodeValue(SI);
     // P1 = select C, P2, P3   ---> <Copy/P1/P2>, <Copy/P1/P3>
     Constraints.push_back(Constraint(Constraint::Copy, SIN,
-                                     getNode(SI.getOperand(1))));
+                                     A.getNode(SI.getOperand(1))));
     Constraints.push_back(Constraint(Constraint::Copy, SIN,
-                                     getNode(SI.getOperand(2))));
+                                     A.getNode(SI.getOperand(2))));
   }
 }
 
-void Andersens::visitExtractValueInst(ExtractValueInst &EVI) {
+void Andersens::FunctionConstraints::visitExtractValueInst(
+    ExtractValueInst &EVI) {
 	return;
 	  if (isa<PointerType>(EVI.getType())) {
-	    unsigned EVIN = getNodeValue(EVI);
+	    unsigned EVIN = A.getNodeValue(EVI);
 	    // P1 = select C, P2, P3   ---> <Copy/P1/P2>, <Copy/P1/P3>
 	    errs() << EVI;
 	    Constraints.push_back(Constraint(Constraint::Copy, EVIN,
-	                                     getNode(EVI.getOperand(0))));
+	                                     A.getNode(EVI.getOperand(0))));
 	  }
 }
 
-void Andersens::visitInsertValueInst(InsertValueInst &IVI) {
+void Andersens::FunctionConstraints::visitInsertValueInst(
+    InsertValueInst &IVI) {
 	return;
 }
 
-void Andersens::visitVAArg(VAArgInst &I) {
+void Andersens::FunctionConstraints::visitVAArg(VAArgInst &I) {
   llvm_unreachable("vaarg not handled yet!");
 }
 
@@ -657,9 +2473,18 @@ void Andersens::visitVAArg(VAArgInst &I) {
 /// arguments might not match up in the case where this is an indirect call and
 /// the function pointer has been casted.  If this is the case, do something
 /// reasonable.
-void Andersens::AddConstraintsForCall(CallSite CS, Function *F) {
+void Andersens::FunctionConstraints::AddConstraintsForCall(CallSite CS,
+                                                          Function *F) {
   Value *CallValue = CS.getCalledValue();
   bool IsDeref = F == NULL;
+  // A call with a clone of its wrapper is bound to the clone as well, and
+  // takes its result from the clone only.
+  unsigned CloneBase = 0;
+  const LockWrapper *Clone =
+    F ? A.findCallClone(CS.getInstruction(), CloneBase) : NULL;
+  // A call of an allocation wrapper points to a heap object of its own,
+  // which holds what the objects the wrapper returns hold.
+  bool HeapClone = F && A.AllocWrappers.count(F);
 
   // If this is a call to an external function, try to handle it directly to get
   // some taste of context sensitivity.
@@ -667,14 +2492,30 @@ void Andersens::AddConstraintsForCall(CallSite CS, Function *F) {
     return;
 
   if (isa<PointerType>(CS.getType())) {
-    unsigned CSN = getNode(CS.getInstruction());
+    unsigned CSN = A.getNode(CS.getInstruction());
     if (!F || isa<PointerType>(F->getFunctionType()->getReturnType())) {
-      if (IsDeref)
+      if (IsDeref) {
         Constraints.push_back(Constraint(Constraint::Load, CSN,
-                                         getNode(CallValue), CallReturnPos));
-      else
+                                         A.getNode(CallValue), CallReturnPos));
+      } else if (HeapClone) {
+        unsigned Object = A.getObject(CS.getInstruction());
+        unsigned Return = A.getNode(CallValue) + CallReturnPos;
+        if (Clone)
+          Return = getCloneNode(Return, *Clone, CloneBase);
+        Constraints.push_back(Constraint(Constraint::AddressOf, CSN, Object));
+        // The object has a single node, which holds every field.
+        for (unsigned i = 0; i != A.MaxFields; ++i)
+          Constraints.push_back(Constraint(Constraint::Load, Object, Return,
+                                           i));
+      } else if (Clone) {
+        Constraints.push_back(Constraint(Constraint::Copy, CSN,
+                                         getCloneNode(A.getNode(CallValue)
+                                                      + CallReturnPos,
+                                                      *Clone, CloneBase)));
+      } else {
         Constraints.push_back(Constraint(Constraint::Copy, CSN,
-                                         getNode(CallValue) + CallReturnPos));
+                                         A.getNode(CallValue) + CallReturnPos));
+      }
     } else {
       // If the function returns a non-pointer value, handle this just like we
       // treat a nonpointer cast to pointer.
@@ -685,10 +2526,10 @@ void Andersens::AddConstraintsForCall(CallSite CS, Function *F) {
 #if FULL_UNIVERSAL
     Constraints.push_back(Constraint(Constraint::Copy,
                                      UniversalSet,
-                                     getNode(CallValue) + CallReturnPos));
+                                     A.getNode(CallValue) + CallReturnPos));
 #else
     Constraints.push_back(Constraint(Constraint::Copy,
-                                      getNode(CallValue) + CallReturnPos,
+                                      A.getNode(CallValue) + CallReturnPos,
                                       UniversalSet));
 #endif
 
@@ -709,27 +2550,32 @@ void Andersens::AddConstraintsForCall(CallSite CS, Function *F) {
             // escaping, as can everything it points to. The second portion of
             // this should be taken care of by universal = *universal
             Constraints.push_back(Constraint(Constraint::Copy,
-                                             getNode(*ArgI),
+                                             A.getNode(*ArgI),
                                              UniversalSet));
           }
 #endif
         if (isa<PointerType>(AI->getType())) {
           if (isa<PointerType>((*ArgI)->getType())) {
             // Copy the actual argument into the formal argument.
-            Constraints.push_back(Constraint(Constraint::Copy, getNode(AI),
-                                             getNode(*ArgI)));
+            Constraints.push_back(Constraint(Constraint::Copy, A.getNode(AI),
+                                             A.getNode(*ArgI)));
           } else {
-            Constraints.push_back(Constraint(Constraint::Copy, getNode(AI),
+            Constraints.push_back(Constraint(Constraint::Copy, A.getNode(AI),
                                              UniversalSet));
           }
+          if (Clone)
+            Constraints.push_back(Constraint(Constraint::Copy,
+                                             getCloneNode(A.getNode(AI),
+                                                          *Clone, CloneBase),
+                                             Constraints.back().Src));
         } else if (isa<PointerType>((*ArgI)->getType())) {
 #if FULL_UNIVERSAL
           Constraints.push_back(Constraint(Constraint::Copy,
                                            UniversalSet,
-                                           getNode(*ArgI)));
+                                           A.getNode(*ArgI)));
 #else
           Constraints.push_back(Constraint(Constraint::Copy,
-                                           getNode(*ArgI),
+                                           A.getNode(*ArgI),
                                            UniversalSet));
 #endif
         }
@@ -741,11 +2587,11 @@ void Andersens::AddConstraintsForCall(CallSite CS, Function *F) {
       if (isa<PointerType>((*ArgI)->getType())) {
         // Copy the actual argument into the formal argument.
         Constraints.push_back(Constraint(Constraint::Store,
-                                         getNode(CallValue),
-                                         getNode(*ArgI), ArgPos++));
+                                         A.getNode(CallValue),
+                                         A.getNode(*ArgI), ArgPos++));
       } else {
         Constraints.push_back(Constraint(Constraint::Store,
-                                         getNode (CallValue),
+                                         A.getNode(CallValue),
                                          UniversalSet, ArgPos++));
       }
     }
@@ -753,15 +2599,21 @@ void Andersens::AddConstraintsForCall(CallSite CS, Function *F) {
   // Copy all pointers passed through the varargs section to the varargs node.
   if (F && F->getFunctionType()->isVarArg())
     for (; ArgI != ArgE; ++ArgI)
-      if (isa<PointerType>((*ArgI)->getType()))
-        Constraints.push_back(Constraint(Constraint::Copy, getVarargNode(F),
-                                         getNode(*ArgI)));
+      if (isa<PointerType>((*ArgI)->getType())) {
+        Constraints.push_back(Constraint(Constraint::Copy, A.getVarargNode(F),
+                                         A.getNode(*ArgI)));
+        if (Clone)
+          Constraints.push_back(Constraint(Constraint::Copy,
+                                           getCloneNode(A.getVarargNode(F),
+                                                        *Clone, CloneBase),
+                                           A.getNode(*ArgI)));
+      }
   // If more arguments are passed in than we track, just drop them on the floor.
 }
 
-void Andersens::visitCallSite(CallSite CS) {
+void Andersens::FunctionConstraints::visitCallSite(CallSite CS) {
   if (isa<PointerType>(CS.getType()))
-    getNodeValue(*CS.getInstruction());
+    A.getNodeValue(*CS.getInstruction());
 
   if (Function *F = CS.getCalledFunction()) {
     AddConstraintsForCall(CS, F);
@@ -787,20 +2639,17 @@ bool Andersens::Node::intersectsIgnoring(Node *N, unsigned Ignoring) const {
   // TODO: If we are only going to call this with the same value for Ignoring,
   // we should move the special values out of the points-to bitmap.
 
-  bool WeHadIt = PointsTo->test(Ignoring);
-  bool NHadIt = N->PointsTo->test(Ignoring);
-  bool Result = false;
-  if (WeHadIt)
-    PointsTo->reset(Ignoring);
-  if (NHadIt)
-    N->PointsTo->reset(Ignoring);
-  Result = PointsTo->intersects(N->PointsTo);
-  if (WeHadIt)
-    PointsTo->set(Ignoring);
-  if (NHadIt)
-    N->PointsTo->set(Ignoring);
+  // The sets may be shared with other nodes, so they are not modified here.
+  if (!PointsTo->intersects(N->PointsTo))
+    return false;
+  if (!PointsTo->test(Ignoring) || !N->PointsTo->test(Ignoring))
+    return true;
+  PointsToSet Common(*PointsTo);
+  Common &= *(N->PointsTo);
+  Common.reset(Ignoring);
+  bool Result = !Common.empty();
 /*
-for (SparseBitVector<>::iterator bi = PointsTo->begin();
+for (PointsToSet::iterator bi = PointsTo->begin();
            bi != PointsTo->end();
            ++bi) {
 
@@ -809,7 +2658,7 @@ for (SparseBitVector<>::iterator bi = PointsTo->begin();
 
       }
 
-      for (SparseBitVector<>::iterator bi = N->PointsTo->begin();
+      for (PointsToSet::iterator bi = N->PointsTo->begin();
            bi != N->PointsTo->end();
            ++bi) {
 
@@ -892,6 +2741,31 @@ void Andersens::ClumpAddressTaken() {
     C.Dest = Translate[C.Dest];
   }
 
+  for (unsigned i = 0; i < ScopeDefs.size(); ++i)
+    for (unsigned j = 0; j < ScopeDefs[i].size(); ++j)
+      ScopeDefs[i][j] = Translate[ScopeDefs[i][j]];
+
+  // The nodes of a MaxK range are all address taken, so the range stays in
+  // one piece.
+  std::map<unsigned, unsigned> NewMaxK;
+  for (std::map<unsigned, unsigned>::iterator Iter = MaxK.begin();
+       Iter != MaxK.end();
+       ++Iter)
+    NewMaxK[Translate[Iter->first]] = Iter->second;
+  MaxK.swap(NewMaxK);
+
+  if (!LockObjects.empty()) {
+    std::vector<bool> NewLockObjects(LockObjects.size(), false);
+    for (unsigned i = 0; i < LockObjects.size(); ++i)
+      NewLockObjects[Translate[i]] = LockObjects[i];
+    LockObjects.swap(NewLockObjects);
+  }
+
+  ClumpedFrom.assign(Translate.size(), 0);
+  for (unsigned i = 0; i < Translate.size(); ++i)
+    ClumpedFrom[Translate[i]] = i;
+  ClumpedTo.swap(Translate);
+
   GraphNodes.swap(NewGraphNodes);
 #undef DEBUG_TYPE
 #define DEBUG_TYPE "anders-aa"
@@ -948,21 +2822,21 @@ void Andersens::HVN() {
 
       // Dest = &src edge
       unsigned AdrNode = C.Src + FirstAdrNode;
-      if (!GraphNodes[C.Dest].PredEdges)
-        GraphNodes[C.Dest].PredEdges = new SparseBitVector<>;
-      GraphNodes[C.Dest].PredEdges->set(AdrNode);
+      if (!OfflineNodes[C.Dest].PredEdges)
+        OfflineNodes[C.Dest].PredEdges = new SparseBitVector<>;
+      OfflineNodes[C.Dest].PredEdges->set(AdrNode);
 
       // *Dest = src edge
       unsigned RefNode = C.Dest + FirstRefNode;
-      if (!GraphNodes[RefNode].ImplicitPredEdges)
-        GraphNodes[RefNode].ImplicitPredEdges = new SparseBitVector<>;
-      GraphNodes[RefNode].ImplicitPredEdges->set(C.Src);
+      if (!OfflineNodes[RefNode].ImplicitPredEdges)
+        OfflineNodes[RefNode].ImplicitPredEdges = new SparseBitVector<>;
+      OfflineNodes[RefNode].ImplicitPredEdges->set(C.Src);
     } else if (C.Type == Constraint::Load) {
       if (C.Offset == 0) {
         // dest = *src edge
-        if (!GraphNodes[C.Dest].PredEdges)
-          GraphNodes[C.Dest].PredEdges = new SparseBitVector<>;
-        GraphNodes[C.Dest].PredEdges->set(C.Src + FirstRefNode);
+        if (!OfflineNodes[C.Dest].PredEdges)
+          OfflineNodes[C.Dest].PredEdges = new SparseBitVector<>;
+        OfflineNodes[C.Dest].PredEdges->set(C.Src + FirstRefNode);
       } else {
         GraphNodes[C.Dest].Direct = false;
       }
@@ -970,19 +2844,22 @@ void Andersens::HVN() {
       if (C.Offset == 0) {
         // *dest = src edge
         unsigned RefNode = C.Dest + FirstRefNode;
-        if (!GraphNodes[RefNode].PredEdges)
-          GraphNodes[RefNode].PredEdges = new SparseBitVector<>;
-        GraphNodes[RefNode].PredEdges->set(C.Src);
+        if (!OfflineNodes[RefNode].PredEdges)
+          OfflineNodes[RefNode].PredEdges = new SparseBitVector<>;
+        OfflineNodes[RefNode].PredEdges->set(C.Src);
       }
+    } else if (C.Offset != 0) {
+      // Dest = Src + K points to other fields than Src does.
+      GraphNodes[C.Dest].Direct = false;
     } else {
       // Dest = Src edge and *Dest = *Src edge
-      if (!GraphNodes[C.Dest].PredEdges)
-        GraphNodes[C.Dest].PredEdges = new SparseBitVector<>;
-      GraphNodes[C.Dest].PredEdges->set(C.Src);
+      if (!OfflineNodes[C.Dest].PredEdges)
+        OfflineNodes[C.Dest].PredEdges = new SparseBitVector<>;
+      OfflineNodes[C.Dest].PredEdges->set(C.Src);
       unsigned RefNode = C.Dest + FirstRefNode;
-      if (!GraphNodes[RefNode].ImplicitPredEdges)
-        GraphNodes[RefNode].ImplicitPredEdges = new SparseBitVector<>;
-      GraphNodes[RefNode].ImplicitPredEdges->set(C.Src + FirstRefNode);
+      if (!OfflineNodes[RefNode].ImplicitPredEdges)
+        OfflineNodes[RefNode].ImplicitPredEdges = new SparseBitVector<>;
+      OfflineNodes[RefNode].ImplicitPredEdges->set(C.Src + FirstRefNode);
     }
   }
   PEClass = 1;
@@ -993,6 +2870,10 @@ void Andersens::HVN() {
   Node2Visited.insert(Node2Visited.begin(), GraphNodes.size(), false);
 
   for (unsigned i = 0; i < FirstRefNode; ++i) {
+    // Stop early once out of the budget; OptimizeConstraints drops what
+    // the pass found.
+    if (i % BudgetCheckInterval == 0 && OutOfBudget())
+      break;
     unsigned Node = VSSCCRep[i];
     if (!Node2Visited[Node])
       HVNValNum(Node);
@@ -1010,63 +2891,85 @@ void Andersens::HVN() {
 }
 
 /// This is the workhorse of HVN value numbering. We combine SCC finding at the
-/// same time because it's easy.
-void Andersens::HVNValNum(unsigned NodeIndex) {
-  unsigned MyDFS = DFSNumber++;
-  Node *N = &GraphNodes[NodeIndex];
-  Node2Visited[NodeIndex] = true;
-  Node2DFS[NodeIndex] = MyDFS;
+/// same time because it's easy.  The depth-first search keeps its own stack
+/// of frames, so long chains of predecessors cannot overflow the call stack.
+void Andersens::HVNValNum(unsigned Root) {
+  std::vector<DFSFrame> Frames;
+  Node2Visited[Root] = true;
+  Node2DFS[Root] = DFSNumber;
+  Frames.push_back(DFSFrame(Root, DFSNumber++,
+                            edgesOrNone(OfflineNodes[Root].PredEdges)));
+
+  while (!Frames.empty()) {
+    DFSFrame &F = Frames.back();
+    unsigned NodeIndex = F.Node;
+    if (F.Child != NoChild) {
+      if (Node2DFS[NodeIndex] > Node2DFS[F.Child])
+        Node2DFS[NodeIndex] = Node2DFS[F.Child];
+      F.Child = NoChild;
+    }
 
-  // First process all our explicit edges
-  if (N->PredEdges)
-    for (SparseBitVector<>::iterator Iter = N->PredEdges->begin();
-         Iter != N->PredEdges->end();
-         ++Iter) {
-      unsigned j = VSSCCRep[*Iter];
-      if (!Node2Deleted[j]) {
-        if (!Node2Visited[j])
-          HVNValNum(j);
-        if (Node2DFS[NodeIndex] > Node2DFS[j])
-          Node2DFS[NodeIndex] = Node2DFS[j];
+    // First process all our explicit edges, then all the implicit edges.
+    bool Descended = false;
+    while (true) {
+      if (F.It == F.Edges->end()) {
+        if (F.Implicit)
+          break;
+        F.Implicit = true;
+        F.Edges = edgesOrNone(OfflineNodes[NodeIndex].ImplicitPredEdges);
+        F.It = F.Edges->begin();
+        continue;
+      }
+      unsigned j = VSSCCRep[*F.It];
+      ++F.It;
+      if (Node2Deleted[j])
+        continue;
+      if (!Node2Visited[j]) {
+        F.Child = j;
+        Node2Visited[j] = true;
+        Node2DFS[j] = DFSNumber;
+        Frames.push_back(DFSFrame(j, DFSNumber++,
+                                  edgesOrNone(OfflineNodes[j].PredEdges)));
+        Descended = true;
+        break;
       }
+      if (Node2DFS[NodeIndex] > Node2DFS[j])
+        Node2DFS[NodeIndex] = Node2DFS[j];
     }
+    if (Descended)
+      continue;
 
-  // Now process all the implicit edges
-  if (N->ImplicitPredEdges)
-    for (SparseBitVector<>::iterator Iter = N->ImplicitPredEdges->begin();
-         Iter != N->ImplicitPredEdges->end();
-         ++Iter) {
-      unsigned j = VSSCCRep[*Iter];
-      if (!Node2Deleted[j]) {
-        if (!Node2Visited[j])
-          HVNValNum(j);
-        if (Node2DFS[NodeIndex] > Node2DFS[j])
-          Node2DFS[NodeIndex] = Node2DFS[j];
-      }
+    unsigned MyDFS = F.DFS;
+    Frames.pop_back();
+    if (MyDFS != Node2DFS[NodeIndex]) {
+      SCCStack.push(NodeIndex);
+      continue;
     }
 
-  // See if we found any cycles
-  if (MyDFS == Node2DFS[NodeIndex]) {
+    // We found a cycle, or at least its root.
+    Node *N = &GraphNodes[NodeIndex];
+    OfflineNode *ON = &OfflineNodes[NodeIndex];
     while (!SCCStack.empty() && Node2DFS[SCCStack.top()] >= MyDFS) {
       unsigned CycleNodeIndex = SCCStack.top();
       Node *CycleNode = &GraphNodes[CycleNodeIndex];
+      OfflineNode *CycleOffline = &OfflineNodes[CycleNodeIndex];
       VSSCCRep[CycleNodeIndex] = NodeIndex;
       // Unify the nodes
       N->Direct &= CycleNode->Direct;
 
-      if (CycleNode->PredEdges) {
-        if (!N->PredEdges)
-          N->PredEdges = new SparseBitVector<>;
-        *(N->PredEdges) |= CycleNode->PredEdges;
-        delete CycleNode->PredEdges;
-        CycleNode->PredEdges = NULL;
+      if (CycleOffline->PredEdges) {
+        if (!ON->PredEdges)
+          ON->PredEdges = new SparseBitVector<>;
+        *(ON->PredEdges) |= CycleOffline->PredEdges;
+        delete CycleOffline->PredEdges;
+        CycleOffline->PredEdges = NULL;
       }
-      if (CycleNode->ImplicitPredEdges) {
-        if (!N->ImplicitPredEdges)
-          N->ImplicitPredEdges = new SparseBitVector<>;
-        *(N->ImplicitPredEdges) |= CycleNode->ImplicitPredEdges;
-        delete CycleNode->ImplicitPredEdges;
-        CycleNode->ImplicitPredEdges = NULL;
+      if (CycleOffline->ImplicitPredEdges) {
+        if (!ON->ImplicitPredEdges)
+          ON->ImplicitPredEdges = new SparseBitVector<>;
+        *(ON->ImplicitPredEdges) |= CycleOffline->ImplicitPredEdges;
+        delete CycleOffline->ImplicitPredEdges;
+        CycleOffline->ImplicitPredEdges = NULL;
       }
 
       SCCStack.pop();
@@ -1075,22 +2978,22 @@ void Andersens::HVNValNum(unsigned NodeIndex) {
     Node2Deleted[NodeIndex] = true;
 
     if (!N->Direct) {
-      GraphNodes[NodeIndex].PointerEquivLabel = PEClass++;
-      return;
+      ON->PointerEquivLabel = PEClass++;
+      continue;
     }
 
     // Collect labels of successor nodes
     bool AllSame = true;
     unsigned First = ~0;
-    SparseBitVector<> *Labels = new SparseBitVector<>;
+    PointsToSet *Labels = new PointsToSet;
     bool Used = false;
 
-    if (N->PredEdges)
-      for (SparseBitVector<>::iterator Iter = N->PredEdges->begin();
-           Iter != N->PredEdges->end();
+    if (ON->PredEdges)
+      for (SparseBitVector<>::iterator Iter = ON->PredEdges->begin();
+           Iter != ON->PredEdges->end();
          ++Iter) {
         unsigned j = VSSCCRep[*Iter];
-        unsigned Label = GraphNodes[j].PointerEquivLabel;
+        unsigned Label = OfflineNodes[j].PointerEquivLabel;
         // Ignore labels that are equal to us or non-pointers
         if (j == NodeIndex || Label == 0)
           continue;
@@ -1104,22 +3007,20 @@ void Andersens::HVNValNum(unsigned NodeIndex) {
     // We either have a non-pointer, a copy of an existing node, or a new node.
     // Assign the appropriate pointer equivalence label.
     if (Labels->empty()) {
-      GraphNodes[NodeIndex].PointerEquivLabel = 0;
+      ON->PointerEquivLabel = 0;
     } else if (AllSame) {
-      GraphNodes[NodeIndex].PointerEquivLabel = First;
+      ON->PointerEquivLabel = First;
     } else {
-      GraphNodes[NodeIndex].PointerEquivLabel = Set2PEClass[Labels];
-      if (GraphNodes[NodeIndex].PointerEquivLabel == 0) {
+      ON->PointerEquivLabel = Set2PEClass[Labels];
+      if (ON->PointerEquivLabel == 0) {
         unsigned EquivClass = PEClass++;
         Set2PEClass[Labels] = EquivClass;
-        GraphNodes[NodeIndex].PointerEquivLabel = EquivClass;
+        ON->PointerEquivLabel = EquivClass;
         Used = true;
       }
     }
     if (!Used)
       delete Labels;
-  } else {
-    SCCStack.push(NodeIndex);
   }
 }
 
@@ -1144,16 +3045,15 @@ void Andersens::HU() {
       GraphNodes[C.Dest].PointsTo->set(C.Src);
       // *Dest = src edge
       unsigned RefNode = C.Dest + FirstRefNode;
-      if (!GraphNodes[RefNode].ImplicitPredEdges)
-        GraphNodes[RefNode].ImplicitPredEdges = new SparseBitVector<>;
-      GraphNodes[RefNode].ImplicitPredEdges->set(C.Src);
-      GraphNodes[C.Src].PointedToBy->set(C.Dest);
+      if (!OfflineNodes[RefNode].ImplicitPredEdges)
+        OfflineNodes[RefNode].ImplicitPredEdges = new SparseBitVector<>;
+      OfflineNodes[RefNode].ImplicitPredEdges->set(C.Src);
     } else if (C.Type == Constraint::Load) {
       if (C.Offset == 0) {
         // dest = *src edge
-        if (!GraphNodes[C.Dest].PredEdges)
-          GraphNodes[C.Dest].PredEdges = new SparseBitVector<>;
-        GraphNodes[C.Dest].PredEdges->set(C.Src + FirstRefNode);
+        if (!OfflineNodes[C.Dest].PredEdges)
+          OfflineNodes[C.Dest].PredEdges = new SparseBitVector<>;
+        OfflineNodes[C.Dest].PredEdges->set(C.Src + FirstRefNode);
       } else {
         GraphNodes[C.Dest].Direct = false;
       }
@@ -1161,19 +3061,22 @@ void Andersens::HU() {
       if (C.Offset == 0) {
         // *dest = src edge
         unsigned RefNode = C.Dest + FirstRefNode;
-        if (!GraphNodes[RefNode].PredEdges)
-          GraphNodes[RefNode].PredEdges = new SparseBitVector<>;
-        GraphNodes[RefNode].PredEdges->set(C.Src);
+        if (!OfflineNodes[RefNode].PredEdges)
+          OfflineNodes[RefNode].PredEdges = new SparseBitVector<>;
+        OfflineNodes[RefNode].PredEdges->set(C.Src);
       }
+    } else if (C.Offset != 0) {
+      // Dest = Src + K points to other fields than Src does.
+      GraphNodes[C.Dest].Direct = false;
     } else {
       // Dest = Src edge and *Dest = *Src edg
-      if (!GraphNodes[C.Dest].PredEdges)
-        GraphNodes[C.Dest].PredEdges = new SparseBitVector<>;
-      GraphNodes[C.Dest].PredEdges->set(C.Src);
+      if (!OfflineNodes[C.Dest].PredEdges)
+        OfflineNodes[C.Dest].PredEdges = new SparseBitVector<>;
+      OfflineNodes[C.Dest].PredEdges->set(C.Src);
       unsigned RefNode = C.Dest + FirstRefNode;
-      if (!GraphNodes[RefNode].ImplicitPredEdges)
-        GraphNodes[RefNode].ImplicitPredEdges = new SparseBitVector<>;
-      GraphNodes[RefNode].ImplicitPredEdges->set(C.Src + FirstRefNode);
+      if (!OfflineNodes[RefNode].ImplicitPredEdges)
+        OfflineNodes[RefNode].ImplicitPredEdges = new SparseBitVector<>;
+      OfflineNodes[RefNode].ImplicitPredEdges->set(C.Src + FirstRefNode);
     }
   }
   PEClass = 1;
@@ -1184,6 +3087,10 @@ void Andersens::HU() {
   Node2Visited.insert(Node2Visited.begin(), GraphNodes.size(), false);
 
   for (unsigned i = 0; i < FirstRefNode; ++i) {
+    // Stop early once out of the budget; OptimizeConstraints drops what
+    // the pass found.
+    if (i % BudgetCheckInterval == 0 && OutOfBudget())
+      break;
     if (FindNode(i) == i) {
       unsigned Node = VSSCCRep[i];
       if (!Node2Visited[Node])
@@ -1199,8 +3106,12 @@ void Andersens::HU() {
   Set2PEClass.resize(GraphNodes.size());
 
   // Visit the condensed graph and generate pointer equivalence labels.
+  // Node2Deleted marks the nodes that have got their label.
   Node2Visited.insert(Node2Visited.begin(), GraphNodes.size(), false);
+  Node2Deleted.insert(Node2Deleted.begin(), GraphNodes.size(), false);
   for (unsigned i = 0; i < FirstRefNode; ++i) {
+    if (i % BudgetCheckInterval == 0 && OutOfBudget())
+      break;
     if (FindNode(i) == i) {
       unsigned Node = VSSCCRep[i];
       if (!Node2Visited[Node])
@@ -1209,50 +3120,74 @@ void Andersens::HU() {
   }
   // PEClass nodes will be deleted by the deleting of N->PointsTo in our caller.
   Set2PEClass.clear();
+  Node2Visited.clear();
+  Node2Deleted.clear();
   //DOUT << "Finished HU\n";
 }
 
 
-/// Implementation of standard Tarjan SCC algorithm as modified by Nuutilla.
-void Andersens::Condense(unsigned NodeIndex) {
-  unsigned MyDFS = DFSNumber++;
-  Node *N = &GraphNodes[NodeIndex];
-  Node2Visited[NodeIndex] = true;
-  Node2DFS[NodeIndex] = MyDFS;
+/// Implementation of standard Tarjan SCC algorithm as modified by Nuutilla,
+/// with an explicit stack of frames.
+void Andersens::Condense(unsigned Root) {
+  std::vector<DFSFrame> Frames;
+  Node2Visited[Root] = true;
+  Node2DFS[Root] = DFSNumber;
+  Frames.push_back(DFSFrame(Root, DFSNumber++,
+                            edgesOrNone(OfflineNodes[Root].PredEdges)));
+
+  while (!Frames.empty()) {
+    DFSFrame &F = Frames.back();
+    unsigned NodeIndex = F.Node;
+    if (F.Child != NoChild) {
+      if (Node2DFS[NodeIndex] > Node2DFS[F.Child])
+        Node2DFS[NodeIndex] = Node2DFS[F.Child];
+      F.Child = NoChild;
+    }
 
-  // First process all our explicit edges
-  if (N->PredEdges)
-    for (SparseBitVector<>::iterator Iter = N->PredEdges->begin();
-         Iter != N->PredEdges->end();
-         ++Iter) {
-      unsigned j = VSSCCRep[*Iter];
-      if (!Node2Deleted[j]) {
-        if (!Node2Visited[j])
-          Condense(j);
-        if (Node2DFS[NodeIndex] > Node2DFS[j])
-          Node2DFS[NodeIndex] = Node2DFS[j];
+    // First process all our explicit edges, then all the implicit edges.
+    bool Descended = false;
+    while (true) {
+      if (F.It == F.Edges->end()) {
+        if (F.Implicit)
+          break;
+        F.Implicit = true;
+        F.Edges = edgesOrNone(OfflineNodes[NodeIndex].ImplicitPredEdges);
+        F.It = F.Edges->begin();
+        continue;
+      }
+      unsigned j = VSSCCRep[*F.It];
+      ++F.It;
+      if (Node2Deleted[j])
+        continue;
+      if (!Node2Visited[j]) {
+        F.Child = j;
+        Node2Visited[j] = true;
+        Node2DFS[j] = DFSNumber;
+        Frames.push_back(DFSFrame(j, DFSNumber++,
+                                  edgesOrNone(OfflineNodes[j].PredEdges)));
+        Descended = true;
+        break;
       }
+      if (Node2DFS[NodeIndex] > Node2DFS[j])
+        Node2DFS[NodeIndex] = Node2DFS[j];
     }
+    if (Descended)
+      continue;
 
-  // Now process all the implicit edges
-  if (N->ImplicitPredEdges)
-    for (SparseBitVector<>::iterator Iter = N->ImplicitPredEdges->begin();
-         Iter != N->ImplicitPredEdges->end();
-         ++Iter) {
-      unsigned j = VSSCCRep[*Iter];
-      if (!Node2Deleted[j]) {
-        if (!Node2Visited[j])
-          Condense(j);
-        if (Node2DFS[NodeIndex] > Node2DFS[j])
-          Node2DFS[NodeIndex] = Node2DFS[j];
-      }
+    unsigned MyDFS = F.DFS;
+    Frames.pop_back();
+    if (MyDFS != Node2DFS[NodeIndex]) {
+      SCCStack.push(NodeIndex);
+      continue;
     }
 
-  // See if we found any cycles
-  if (MyDFS == Node2DFS[NodeIndex]) {
+    // See if we found any cycles
+    Node *N = &GraphNodes[NodeIndex];
+    OfflineNode *ON = &OfflineNodes[NodeIndex];
     while (!SCCStack.empty() && Node2DFS[SCCStack.top()] >= MyDFS) {
       unsigned CycleNodeIndex = SCCStack.top();
       Node *CycleNode = &GraphNodes[CycleNodeIndex];
+      OfflineNode *CycleOffline = &OfflineNodes[CycleNodeIndex];
       VSSCCRep[CycleNodeIndex] = NodeIndex;
       // Unify the nodes
       N->Direct &= CycleNode->Direct;
@@ -1260,19 +3195,19 @@ void Andersens::Condense(unsigned NodeIndex) {
       *(N->PointsTo) |= CycleNode->PointsTo;
       delete CycleNode->PointsTo;
       CycleNode->PointsTo = NULL;
-      if (CycleNode->PredEdges) {
-        if (!N->PredEdges)
-          N->PredEdges = new SparseBitVector<>;
-        *(N->PredEdges) |= CycleNode->PredEdges;
-        delete CycleNode->PredEdges;
-        CycleNode->PredEdges = NULL;
+      if (CycleOffline->PredEdges) {
+        if (!ON->PredEdges)
+          ON->PredEdges = new SparseBitVector<>;
+        *(ON->PredEdges) |= CycleOffline->PredEdges;
+        delete CycleOffline->PredEdges;
+        CycleOffline->PredEdges = NULL;
       }
-      if (CycleNode->ImplicitPredEdges) {
-        if (!N->ImplicitPredEdges)
-          N->ImplicitPredEdges = new SparseBitVector<>;
-        *(N->ImplicitPredEdges) |= CycleNode->ImplicitPredEdges;
-        delete CycleNode->ImplicitPredEdges;
-        CycleNode->ImplicitPredEdges = NULL;
+      if (CycleOffline->ImplicitPredEdges) {
+        if (!ON->ImplicitPredEdges)
+          ON->ImplicitPredEdges = new SparseBitVector<>;
+        *(ON->ImplicitPredEdges) |= CycleOffline->ImplicitPredEdges;
+        delete CycleOffline->ImplicitPredEdges;
+        CycleOffline->ImplicitPredEdges = NULL;
       }
       SCCStack.pop();
     }
@@ -1280,83 +3215,120 @@ void Andersens::Condense(unsigned NodeIndex) {
     Node2Deleted[NodeIndex] = true;
 
     // Set up number of incoming edges for other nodes
-    if (N->PredEdges)
-      for (SparseBitVector<>::iterator Iter = N->PredEdges->begin();
-           Iter != N->PredEdges->end();
+    if (ON->PredEdges)
+      for (SparseBitVector<>::iterator Iter = ON->PredEdges->begin();
+           Iter != ON->PredEdges->end();
            ++Iter)
-        ++GraphNodes[VSSCCRep[*Iter]].NumInEdges;
-  } else {
-    SCCStack.push(NodeIndex);
+        ++OfflineNodes[VSSCCRep[*Iter]].NumInEdges;
   }
 }
 
-void Andersens::HUValNum(unsigned NodeIndex) {
-  Node *N = &GraphNodes[NodeIndex];
+/// HUVisit - Mark the specified node visited by HUValNum.  Returns false if
+/// there is nothing to number because the node is the dereference of a
+/// non-pointer.
+bool Andersens::HUVisit(unsigned NodeIndex) {
   Node2Visited[NodeIndex] = true;
 
   // Eliminate dereferences of non-pointers for those non-pointers we have
   // already identified.  These are ref nodes whose non-ref node:
-  // 1. Has already been visited determined to point to nothing (and thus, a
-  // dereference of it must point to nothing)
+  // 1. Has already been numbered and determined to point to nothing (and
+  // thus, a dereference of it must point to nothing).  A node still being
+  // numbered has no label yet, and may well be a pointer.
   // 2. Any direct node with no predecessor edges in our graph and with no
   // points-to set (since it can't point to anything either, being that it
   // receives no points-to sets and has none).
   if (NodeIndex >= FirstRefNode) {
     unsigned j = VSSCCRep[FindNode(NodeIndex - FirstRefNode)];
-    if ((Node2Visited[j] && !GraphNodes[j].PointerEquivLabel)
-        || (GraphNodes[j].Direct && !GraphNodes[j].PredEdges
+    if ((Node2Deleted[j] && !OfflineNodes[j].PointerEquivLabel)
+        || (GraphNodes[j].Direct && !OfflineNodes[j].PredEdges
             && GraphNodes[j].PointsTo->empty())){
-      return;
+      return false;
     }
   }
-    // Process all our explicit edges
-  if (N->PredEdges)
-    for (SparseBitVector<>::iterator Iter = N->PredEdges->begin();
-         Iter != N->PredEdges->end();
-         ++Iter) {
-      unsigned j = VSSCCRep[*Iter];
-      if (!Node2Visited[j])
-        HUValNum(j);
-
-      // If this edge turned out to be the same as us, or got no pointer
-      // equivalence label (and thus points to nothing) , just decrement our
-      // incoming edges and continue.
-      if (j == NodeIndex || GraphNodes[j].PointerEquivLabel == 0) {
-        --GraphNodes[j].NumInEdges;
-        continue;
-      }
+  return true;
+}
 
-      *(N->PointsTo) |= GraphNodes[j].PointsTo;
+/// HUMergePred - Take the points-to set of the numbered predecessor Pred of
+/// the specified node into its own.
+void Andersens::HUMergePred(unsigned NodeIndex, unsigned Pred) {
+  unsigned j = Pred;
 
-      // If we didn't end up storing this in the hash, and we're done with all
-      // the edges, we don't need the points-to set anymore.
-      --GraphNodes[j].NumInEdges;
-      if (!GraphNodes[j].NumInEdges && !GraphNodes[j].StoredInHash) {
-        delete GraphNodes[j].PointsTo;
-        GraphNodes[j].PointsTo = NULL;
-      }
-    }
-  // If this isn't a direct node, generate a fresh variable.
-  if (!N->Direct) {
-    N->PointsTo->set(FirstRefNode + NodeIndex);
+  // If this edge turned out to be the same as us, or got no pointer
+  // equivalence label (and thus points to nothing) , just decrement our
+  // incoming edges and continue.
+  if (j == NodeIndex || OfflineNodes[j].PointerEquivLabel == 0) {
+    --OfflineNodes[j].NumInEdges;
+    return;
   }
 
-  // See If we have something equivalent to us, if not, generate a new
-  // equivalence class.
-  if (N->PointsTo->empty()) {
-    delete N->PointsTo;
-    N->PointsTo = NULL;
-  } else {
-    if (N->Direct) {
-      N->PointerEquivLabel = Set2PEClass[N->PointsTo];
-      if (N->PointerEquivLabel == 0) {
-        unsigned EquivClass = PEClass++;
-        N->StoredInHash = true;
-        Set2PEClass[N->PointsTo] = EquivClass;
-        N->PointerEquivLabel = EquivClass;
+  *(GraphNodes[NodeIndex].PointsTo) |= GraphNodes[j].PointsTo;
+
+  // If we didn't end up storing this in the hash, and we're done with all
+  // the edges, we don't need the points-to set anymore.
+  --OfflineNodes[j].NumInEdges;
+  if (!OfflineNodes[j].NumInEdges && !OfflineNodes[j].StoredInHash) {
+    delete GraphNodes[j].PointsTo;
+    GraphNodes[j].PointsTo = NULL;
+  }
+}
+
+void Andersens::HUValNum(unsigned Root) {
+  std::vector<DFSFrame> Frames;
+  if (HUVisit(Root))
+    Frames.push_back(DFSFrame(Root, 0,
+                              edgesOrNone(OfflineNodes[Root].PredEdges)));
+
+  while (!Frames.empty()) {
+    DFSFrame &F = Frames.back();
+    unsigned NodeIndex = F.Node;
+    if (F.Child != NoChild) {
+      HUMergePred(NodeIndex, F.Child);
+      F.Child = NoChild;
+    }
+
+    // Process all our explicit edges
+    bool Descended = false;
+    while (F.It != F.Edges->end()) {
+      unsigned j = VSSCCRep[*F.It];
+      ++F.It;
+      if (!Node2Visited[j] && HUVisit(j)) {
+        F.Child = j;
+        Frames.push_back(DFSFrame(j, 0,
+                                  edgesOrNone(OfflineNodes[j].PredEdges)));
+        Descended = true;
+        break;
       }
+      HUMergePred(NodeIndex, j);
+    }
+    if (Descended)
+      continue;
+    Frames.pop_back();
+
+    Node *N = &GraphNodes[NodeIndex];
+    OfflineNode *ON = &OfflineNodes[NodeIndex];
+    Node2Deleted[NodeIndex] = true;
+    // If this isn't a direct node, generate a fresh variable.
+    if (!N->Direct) {
+      N->PointsTo->set(FirstRefNode + NodeIndex);
+    }
+
+    // See If we have something equivalent to us, if not, generate a new
+    // equivalence class.
+    if (N->PointsTo->empty()) {
+      delete N->PointsTo;
+      N->PointsTo = NULL;
     } else {
-      N->PointerEquivLabel = PEClass++;
+      if (N->Direct) {
+        ON->PointerEquivLabel = Set2PEClass[N->PointsTo];
+        if (ON->PointerEquivLabel == 0) {
+          unsigned EquivClass = PEClass++;
+          ON->StoredInHash = true;
+          Set2PEClass[N->PointsTo] = EquivClass;
+          ON->PointerEquivLabel = EquivClass;
+        }
+      } else {
+        ON->PointerEquivLabel = PEClass++;
+      }
     }
   }
 }
@@ -1380,8 +3352,8 @@ void Andersens::RewriteConstraints() {
     Constraint &C = Constraints[i];
     unsigned RHSNode = FindNode(C.Src);
     unsigned LHSNode = FindNode(C.Dest);
-    unsigned RHSLabel = GraphNodes[VSSCCRep[RHSNode]].PointerEquivLabel;
-    unsigned LHSLabel = GraphNodes[VSSCCRep[LHSNode]].PointerEquivLabel;
+    unsigned RHSLabel = OfflineNodes[VSSCCRep[RHSNode]].PointerEquivLabel;
+    unsigned LHSLabel = OfflineNodes[VSSCCRep[LHSNode]].PointerEquivLabel;
 
     // First we try to eliminate constraints for things we can prove don't point
     // to anything.
@@ -1397,12 +3369,12 @@ void Andersens::RewriteConstraints() {
     }
     // This constraint may be useless, and it may become useless as we translate
     // it.
-    if (C.Src == C.Dest && C.Type == Constraint::Copy)
+    if (C.Src == C.Dest && C.Type == Constraint::Copy && C.Offset == 0)
       continue;
 
     C.Src = FindEquivalentNode(RHSNode, RHSLabel);
     C.Dest = FindEquivalentNode(FindNode(LHSNode), LHSLabel);
-    if ((C.Src == C.Dest && C.Type == Constraint::Copy)
+    if ((C.Src == C.Dest && C.Type == Constraint::Copy && C.Offset == 0)
         || Seen.count(C))
       continue;
 
@@ -1449,7 +3421,7 @@ void Andersens::PrintLabels() const {
       //DOUT <<")";
     }
 
-    //DOUT << " has pointer label " << GraphNodes[i].PointerEquivLabel
+    //DOUT << " has pointer label " << OfflineNodes[i].PointerEquivLabel
   //       << " and SCC rep " << VSSCCRep[i]
     //     << " and is " << (GraphNodes[i].Direct ? "Direct" : "Not direct")
       //   << "\n";
@@ -1485,7 +3457,7 @@ void Andersens::HCD() {
     } else if (C.Type == Constraint::Store) {
       if( C.Offset == 0 )
         GraphNodes[C.Dest + FirstRefNode].Edges->set(C.Src);
-    } else {
+    } else if (C.Offset == 0) {
       GraphNodes[C.Dest].Edges->set(C.Src);
     }
   }
@@ -1497,6 +3469,10 @@ void Andersens::HCD() {
 
   DFSNumber = 0;
   for (unsigned i = 0; i < GraphNodes.size(); ++i) {
+    // Stop early once out of the budget; OptimizeConstraints drops what
+    // the pass found.
+    if (i % BudgetCheckInterval == 0 && OutOfBudget())
+      break;
     unsigned Node = HCDSCCRep[i];
     if (!Node2Deleted[Node])
       Search(Node);
@@ -1522,67 +3498,186 @@ void Andersens::HCD() {
 // Use Nuutila's variant of Tarjan's algorithm to detect
 // Strongly-Connected Components (SCCs). For non-trivial SCCs
 // containing ref nodes, insert the appropriate information in SDT.
-void Andersens::Search(unsigned Node) {
-  unsigned MyDFS = DFSNumber++;
-
-  Node2Visited[Node] = true;
-  Node2DFS[Node] = MyDFS;
+void Andersens::Search(unsigned Root) {
+  std::vector<DFSFrame> Frames;
+  Node2Visited[Root] = true;
+  Node2DFS[Root] = DFSNumber;
+  Frames.push_back(DFSFrame(Root, DFSNumber++, GraphNodes[Root].Edges));
+
+  while (!Frames.empty()) {
+    DFSFrame &F = Frames.back();
+    unsigned Node = F.Node;
+    if (F.Child != NoChild) {
+      if (Node2DFS[Node] > Node2DFS[F.Child])
+        Node2DFS[Node] = Node2DFS[F.Child];
+      F.Child = NoChild;
+    }
 
-  for (SparseBitVector<>::iterator Iter = GraphNodes[Node].Edges->begin(),
-                                   End  = GraphNodes[Node].Edges->end();
-       Iter != End;
-       ++Iter) {
-    unsigned J = HCDSCCRep[*Iter];
-    assert(GraphNodes[J].isRep() && "Debug check; must be representative");
-    if (!Node2Deleted[J]) {
-      if (!Node2Visited[J])
-        Search(J);
+    bool Descended = false;
+    while (F.It != F.Edges->end()) {
+      unsigned J = HCDSCCRep[*F.It];
+      ++F.It;
+      assert(GraphNodes[J].isRep() && "Debug check; must be representative");
+      if (Node2Deleted[J])
+        continue;
+      if (!Node2Visited[J]) {
+        F.Child = J;
+        Node2Visited[J] = true;
+        Node2DFS[J] = DFSNumber;
+        Frames.push_back(DFSFrame(J, DFSNumber++, GraphNodes[J].Edges));
+        Descended = true;
+        break;
+      }
       if (Node2DFS[Node] > Node2DFS[J])
         Node2DFS[Node] = Node2DFS[J];
     }
-  }
+    if (Descended)
+      continue;
 
-  if( MyDFS != Node2DFS[Node] ) {
-    SCCStack.push(Node);
-    return;
-  }
+    unsigned MyDFS = F.DFS;
+    Frames.pop_back();
+    if( MyDFS != Node2DFS[Node] ) {
+      SCCStack.push(Node);
+      continue;
+    }
 
-  // This node is the root of a SCC, so process it.
-  //
-  // If the SCC is "non-trivial" (not a singleton) and contains a reference
-  // node, we place this SCC into SDT.  We unite the nodes in any case.
-  if (!SCCStack.empty() && Node2DFS[SCCStack.top()] >= MyDFS) {
-    SparseBitVector<> SCC;
+    // This node is the root of a SCC, so process it.  It is done with even
+    // if the SCC is a singleton: a node searched later must not take its
+    // DFS number, or the SCCs on the stack would run together.
+    //
+    // If the SCC is "non-trivial" (not a singleton) and contains a reference
+    // node, we place this SCC into SDT.  We unite the nodes in any case.
+    Node2Deleted[Node] = true;
+    if (!SCCStack.empty() && Node2DFS[SCCStack.top()] >= MyDFS) {
+      SparseBitVector<> SCC;
 
-    SCC.set(Node);
+      SCC.set(Node);
 
-    bool Ref = (Node >= FirstRefNode);
+      bool Ref = (Node >= FirstRefNode);
 
-    Node2Deleted[Node] = true;
+      do {
+        unsigned P = SCCStack.top(); SCCStack.pop();
+        Ref |= (P >= FirstRefNode);
+        SCC.set(P);
+        HCDSCCRep[P] = Node;
+      } while (!SCCStack.empty() && Node2DFS[SCCStack.top()] >= MyDFS);
+
+      if (Ref) {
+        unsigned Rep = SCC.find_first();
+        assert(Rep < FirstRefNode && "The SCC didn't have a non-Ref node!");
 
-    do {
-      unsigned P = SCCStack.top(); SCCStack.pop();
-      Ref |= (P >= FirstRefNode);
-      SCC.set(P);
-      HCDSCCRep[P] = Node;
-    } while (!SCCStack.empty() && Node2DFS[SCCStack.top()] >= MyDFS);
+        SparseBitVector<>::iterator i = SCC.begin();
 
-    if (Ref) {
-      unsigned Rep = SCC.find_first();
-      assert(Rep < FirstRefNode && "The SCC didn't have a non-Ref node!");
+        // Skip over the non-ref nodes
+        while( *i < FirstRefNode )
+          ++i;
+
+        while( i != SCC.end() )
+          SDT[ (*i++) - FirstRefNode ] = Rep;
+      }
+    }
+  }
+}
 
-      SparseBitVector<>::iterator i = SCC.begin();
 
-      // Skip over the non-ref nodes
-      while( *i < FirstRefNode )
-        ++i;
+/// FreeOfflineNodes - Release the offline data of all the nodes, keeping
+/// their pointer equivalence labels in PointerEquivLabels.
+void Andersens::FreeOfflineNodes() {
+  PointerEquivLabels.resize(OfflineNodes.size());
+  for (unsigned i = 0, e = OfflineNodes.size(); i != e; ++i) {
+    delete OfflineNodes[i].PredEdges;
+    delete OfflineNodes[i].ImplicitPredEdges;
+    PointerEquivLabels[i] = OfflineNodes[i].PointerEquivLabel;
+  }
+  std::vector<OfflineNode>().swap(OfflineNodes);
+}
 
-      while( i != SCC.end() )
-        SDT[ (*i++) - FirstRefNode ] = Rep;
+/// ChooseOfflinePasses - Return the OfflinePass bits of the passes to run on
+/// the clumped constraint graph, and record in the telemetry the statistics
+/// of the graph and the estimates of every pass.
+///
+/// The estimates count constraint visits.  Solving visits a copy edge about
+/// log2(N) times on a graph of N nodes, each time uniting points-to sets of
+/// up to A / 64 words for A address-taken nodes.  HVN walks an offline graph
+/// of 3N nodes once, HU one of 2N nodes carrying points-to sets, and HCD one
+/// of 2N nodes.  HVN and HU are expected to remove their yield of the copies
+/// left to them, and HCD to spare the solver its yield of the complex
+/// constraints.  With -anders-offline=adaptive a pass runs when it is
+/// expected to save more than it costs; the yields can be fitted to the
+/// trials of -anders-offline=benchmark.
+unsigned Andersens::ChooseOfflinePasses() {
+  unsigned Nodes = CountRepNodes();
+  unsigned Copies = 0, Complex = 0, AddressTaken = 0;
+  for (unsigned i = 0, e = Constraints.size(); i != e; ++i) {
+    const Constraint &C = Constraints[i];
+    if (C.Type == Constraint::Copy && C.Offset == 0)
+      ++Copies;
+    else if (C.Type != Constraint::AddressOf)
+      ++Complex;
+  }
+  for (unsigned i = 0; i < GraphNodes.size(); ++i)
+    if (GraphNodes[i].isRep() && GraphNodes[i].AddressTaken)
+      ++AddressTaken;
+
+  double N = Nodes;
+  double C = Constraints.size();
+  double Words = 1 + AddressTaken / 64.0;
+  double PerCopy = Words * (Log2_32_Ceil(Nodes + 1) + 1);
+  OfflineDecision Decisions[3] = {
+    { "HVN", false, 3 * N + C, Copies * PerCopy * AndersHVNYield },
+    { "HU", false, (2 * N + C) * Words, 0 },
+    { "HCD", false, 2 * N + C, Complex * PerCopy * AndersHCDYield }
+  };
+
+  unsigned Passes = TrialPasses != ~0U ? TrialPasses : PassChoice;
+  bool Adaptive = Passes == ~0U && AndersOffline != AllOffline;
+  if (Passes == ~0U)
+    Passes = AndersHCD ? AllOfflinePasses : OfflineHVN | OfflineHU;
+  for (unsigned i = 0; i != 3; ++i) {
+    OfflineDecision &D = Decisions[i];
+    if (i == 1) {
+      double Left = Passes & OfflineHVN ? 1 - AndersHVNYield : 1;
+      D.Benefit = Copies * Left * PerCopy * AndersHUYield;
     }
+    if (Adaptive && D.Benefit <= D.Cost)
+      Passes &= ~(1U << i);
+    D.Run = Passes & (1U << i);
   }
+
+  Telemetry.ComplexRatio = C ? Complex / C : 0;
+  Telemetry.AddressTakenRatio = Nodes ? AddressTaken / N : 0;
+  Telemetry.Decisions.assign(Decisions, Decisions + 3);
+  DEBUG(errs() << "Offline passes: HVN " << Decisions[0].Run << ", HU "
+               << Decisions[1].Run << ", HCD " << Decisions[2].Run << "\n");
+  return Passes;
 }
 
+/// RunOfflineTrials - Analyze the program with every combination of the
+/// offline passes in turn, keeping only what each trial cost.
+void Andersens::RunOfflineTrials() {
+  std::vector<OfflineTrial> Trials;
+  for (unsigned Passes = 0; Passes <= AllOfflinePasses; ++Passes) {
+    Telemetry.clear();
+    DemandDriven = AndersDemand;
+    TrialPasses = Passes;
+    Analyze();
+    OfflineTrial T;
+    T.Passes = Passes;
+    T.OfflineTime = Telemetry.OfflineTime;
+    T.TotalTime = 0;
+    for (unsigned i = 0, e = Telemetry.Phases.size(); i != e; ++i)
+      T.TotalTime += Telemetry.Phases[i].WallTime;
+    T.NumPops = Telemetry.NumPops;
+    Trials.push_back(T);
+    ResetAnalysis();
+    delete Fallback;
+    Fallback = 0;
+  }
+  TrialPasses = ~0U;
+  DemandDriven = AndersDemand;
+  Telemetry.clear();
+  Telemetry.Trials.swap(Trials);
+}
 
 /// Optimize the constraints by performing offline variable substitution and
 /// other optimizations.
@@ -1591,8 +3686,8 @@ void Andersens::OptimizeConstraints() {
 
   SDTActive = false;
 
-  // Function related nodes need to stay in the same relative position and can't
-  // be location equivalent.
+  // Function related nodes, and the fields of an object, need to stay in the
+  // same relative position and can't be location equivalent.
   for (std::map<unsigned, unsigned>::iterator Iter = MaxK.begin();
        Iter != MaxK.end();
        ++Iter) {
@@ -1604,66 +3699,96 @@ void Andersens::OptimizeConstraints() {
     }
   }
 
+  unsigned FirstPhase = Telemetry.Phases.size();
+  BeginPhase("ClumpAddressTaken");
   ClumpAddressTaken();
+  EndPhase();
+  if (OutOfBudget())
+    return;
+  unsigned Passes = ChooseOfflinePasses();
   FirstRefNode = GraphNodes.size();
   FirstAdrNode = FirstRefNode + GraphNodes.size();
-  GraphNodes.insert(GraphNodes.end(), 2 * GraphNodes.size(),
+  GraphNodes.insert(GraphNodes.end(),
+                    (Passes & OfflineHVN ? 2 : 1) * GraphNodes.size(),
                     Node(false));
   VSSCCRep.resize(GraphNodes.size());
-  for (unsigned i = 0; i < GraphNodes.size(); ++i) {
-    VSSCCRep[i] = i;
-  }
-  HVN();
-  for (unsigned i = 0; i < GraphNodes.size(); ++i) {
-    Node *N = &GraphNodes[i];
-    delete N->PredEdges;
-    N->PredEdges = NULL;
-    delete N->ImplicitPredEdges;
-    N->ImplicitPredEdges = NULL;
-  }
+  if (Passes & OfflineHVN) {
+    BeginPhase("HVN");
+    OfflineNodes.resize(GraphNodes.size());
+    for (unsigned i = 0; i < GraphNodes.size(); ++i) {
+      VSSCCRep[i] = i;
+    }
+    HVN();
+    EndPhase();
+    if (OutOfBudget()) {
+      FreeOfflineNodes();
+      return;
+    }
+    for (unsigned i = 0; i < OfflineNodes.size(); ++i) {
+      OfflineNode *ON = &OfflineNodes[i];
+      delete ON->PredEdges;
+      ON->PredEdges = NULL;
+      delete ON->ImplicitPredEdges;
+      ON->ImplicitPredEdges = NULL;
+    }
 #undef DEBUG_TYPE
 #define DEBUG_TYPE "anders-aa-labels"
-  DEBUG(PrintLabels());
+    DEBUG(PrintLabels());
 #undef DEBUG_TYPE
 #define DEBUG_TYPE "anders-aa"
-  RewriteConstraints();
-  // Delete the adr nodes.
-  GraphNodes.resize(FirstRefNode * 2);
+    BeginPhase("RewriteConstraints");
+    RewriteConstraints();
+    EndPhase();
+    FreeOfflineNodes();
+    // Delete the adr nodes.
+    GraphNodes.resize(FirstRefNode * 2);
+  }
 
-  // Now perform HU
-  for (unsigned i = 0; i < GraphNodes.size(); ++i) {
-    Node *N = &GraphNodes[i];
-    if (FindNode(i) == i) {
-      N->PointsTo = new SparseBitVector<>;
-      N->PointedToBy = new SparseBitVector<>;
-      // Reset our labels
+  // Now perform HU, with fresh offline data and labels.
+  if (Passes & OfflineHU) {
+    BeginPhase("HU");
+    OfflineNodes.resize(GraphNodes.size());
+    for (unsigned i = 0; i < GraphNodes.size(); ++i) {
+      if (FindNode(i) == i)
+        GraphNodes[i].PointsTo = new PointsToSet;
+      VSSCCRep[i] = i;
+    }
+    HU();
+    EndPhase();
+    if (OutOfBudget()) {
+      FreeOfflineNodes();
+      return;
     }
-    VSSCCRep[i] = i;
-    N->PointerEquivLabel = 0;
-  }
-  HU();
 #undef DEBUG_TYPE
 #define DEBUG_TYPE "anders-aa-labels"
-  DEBUG(PrintLabels());
+    DEBUG(PrintLabels());
 #undef DEBUG_TYPE
 #define DEBUG_TYPE "anders-aa"
-  RewriteConstraints();
-  for (unsigned i = 0; i < GraphNodes.size(); ++i) {
-    if (FindNode(i) == i) {
-      Node *N = &GraphNodes[i];
-      delete N->PointsTo;
-      N->PointsTo = NULL;
-      delete N->PredEdges;
-      N->PredEdges = NULL;
-      delete N->ImplicitPredEdges;
-      N->ImplicitPredEdges = NULL;
-      delete N->PointedToBy;
-      N->PointedToBy = NULL;
+    BeginPhase("RewriteConstraints");
+    RewriteConstraints();
+    EndPhase();
+    for (unsigned i = 0; i < GraphNodes.size(); ++i) {
+      if (FindNode(i) == i) {
+        Node *N = &GraphNodes[i];
+        delete N->PointsTo;
+        N->PointsTo = NULL;
+      }
     }
+    FreeOfflineNodes();
   }
 
   // perform Hybrid Cycle Detection (HCD)
-  HCD();
+  if (Passes & OfflineHCD) {
+    BeginPhase("HCD");
+    HCD();
+    EndPhase();
+    if (OutOfBudget())
+      return;
+  } else
+    SDT.insert(SDT.begin(), FirstRefNode, -1);
+  Telemetry.OfflineTime = 0;
+  for (unsigned i = FirstPhase; i < Telemetry.Phases.size(); ++i)
+    Telemetry.OfflineTime += Telemetry.Phases[i].WallTime;
   SDTActive = true;
 
   // No longer any need for the upper half of GraphNodes (for ref nodes).
@@ -1680,16 +3805,19 @@ void Andersens::OptimizeConstraints() {
 /// graph is built.
 void Andersens::UnitePointerEquivalences() {
   //DOUT << "Uniting remaining pointer equivalences\n";
-  for (unsigned i = 0; i < GraphNodes.size(); ++i) {
+  unsigned E = std::min((unsigned) GraphNodes.size(),
+                        (unsigned) PointerEquivLabels.size());
+  for (unsigned i = 0; i < E; ++i) {
     if (GraphNodes[i].AddressTaken && GraphNodes[i].isRep()) {
-      unsigned Label = GraphNodes[i].PointerEquivLabel;
+      unsigned Label = PointerEquivLabels[i];
 
       if (Label && PENLEClass2Node[Label] != -1)
-        UniteNodes(i, PENLEClass2Node[Label]);
+        UniteNodes(i, FindNode(PENLEClass2Node[Label]));
     }
   }
   //DOUT << "Finished remaining pointer equivalences\n";
   PENLEClass2Node.clear();
+  std::vector<unsigned>().swap(PointerEquivLabels);
 }
 
 /// Create the constraint graph used for solving points-to analysis.
@@ -1701,80 +3829,215 @@ void Andersens::CreateConstraintGraph() {
     if (C.Type == Constraint::AddressOf)
       GraphNodes[C.Dest].PointsTo->set(C.Src);
     else if (C.Type == Constraint::Load)
-      GraphNodes[C.Src].Constraints.push_back(C);
+      AddComplexConstraint(C.Src, C);
     else if (C.Type == Constraint::Store)
-      GraphNodes[C.Dest].Constraints.push_back(C);
+      AddComplexConstraint(C.Dest, C);
     else if (C.Offset != 0)
-      GraphNodes[C.Src].Constraints.push_back(C);
+      AddComplexConstraint(C.Src, C);
     else
       GraphNodes[C.Src].Edges->set(C.Dest);
   }
 }
 
-// Perform DFS and cycle detection.
-bool Andersens::QueryNode(unsigned Node) {
-  assert(GraphNodes[Node].isRep() && "Querying a non-rep node");
-  unsigned OurDFS = ++DFSNumber;
-  SparseBitVector<> ToErase;
-  SparseBitVector<> NewEdges;
-  Tarjan2DFS[Node] = OurDFS;
+/// AddComplexConstraint - Append C to the complex constraints of the
+/// specified node.
+void Andersens::AddComplexConstraint(unsigned NodeIndex, const Constraint &C) {
+  Node *N = &GraphNodes[NodeIndex];
+  unsigned Index = ComplexConstraints.size();
+  ComplexConstraints.push_back(C);
+  ComplexNext.push_back(NoComplex);
+  if (N->ComplexTail == NoComplex)
+    N->ComplexHead = Index;
+  else
+    ComplexNext[N->ComplexTail] = Index;
+  N->ComplexTail = Index;
+}
+
+/// EraseComplexConstraint - Unlink complex constraint Index, which follows
+/// Prev (or is the first if Prev is NoComplex), from the list of N.  Returns
+/// the constraint that followed it.
+unsigned Andersens::EraseComplexConstraint(Node *N, unsigned Prev,
+                                           unsigned Index) {
+  unsigned Next = ComplexNext[Index];
+  if (Prev == NoComplex)
+    N->ComplexHead = Next;
+  else
+    ComplexNext[Prev] = Next;
+  if (N->ComplexTail == Index)
+    N->ComplexTail = Prev;
+  return Next;
+}
 
-  // Changed denotes a change from a recursive call that we will bubble up.
-  // Merged is set if we actually merge a node ourselves.
-  bool Changed = false, Merged = false;
+/// SpliceComplexConstraints - Move the complex constraints of Second to the
+/// front of the list of First.
+void Andersens::SpliceComplexConstraints(Node *First, Node *Second) {
+  if (Second->ComplexHead == NoComplex)
+    return;
+  ComplexNext[Second->ComplexTail] = First->ComplexHead;
+  if (First->ComplexTail == NoComplex)
+    First->ComplexTail = Second->ComplexTail;
+  First->ComplexHead = Second->ComplexHead;
+  Second->ComplexHead = Second->ComplexTail = NoComplex;
+}
 
-  for (SparseBitVector<>::iterator bi = GraphNodes[Node].Edges->begin();
-       bi != GraphNodes[Node].Edges->end();
-       ++bi) {
-    unsigned RepNode = FindNode(*bi);
-    // If this edge points to a non-representative node but we are
-    // already planning to add an edge to its representative, we have no
-    // need for this edge anymore.
-    if (RepNode != *bi && NewEdges.test(RepNode)){
-      ToErase.set(*bi);
-      continue;
+// Perform DFS and cycle detection.  The search keeps its own stack of frames,
+// so long copy chains cannot overflow the call stack.  The cycles found are
+// only united once the search is over: uniting two nodes also unites the
+// nodes HCD tied to them, which may be on the search stack.  Returns true if
+// it united any nodes.
+bool Andersens::QueryNode(unsigned Root) {
+  assert(GraphNodes[Root].isRep() && "Querying a non-rep node");
+  std::vector<DFSFrame> Frames;
+  std::vector<std::pair<unsigned, unsigned> > Cycles;
+  tarjanDFS(Root) = ++DFSNumber;
+  Frames.push_back(EdgeFrame(Root, DFSNumber));
+
+  while (!Frames.empty()) {
+    DFSFrame &F = Frames.back();
+    unsigned Node = F.Node;
+    if (F.Child != NoChild) {
+      // The child may have been united with other nodes.
+      unsigned RepNode = FindNode(F.Child);
+      if (tarjanDFS(RepNode) < tarjanDFS(Node))
+        tarjanDFS(Node) = tarjanDFS(RepNode);
+      F.Child = NoChild;
     }
 
-    // Continue about our DFS.
-    if (!Tarjan2Deleted[RepNode]){
-      if (Tarjan2DFS[RepNode] == 0) {
-        Changed |= QueryNode(RepNode);
-        // May have been changed by QueryNode
-        RepNode = FindNode(RepNode);
+    bool Descended = false;
+    unsigned Succ;
+    while (F.next(Succ)) {
+      unsigned RepNode = FindNode(Succ);
+      if (tarjanDeleted(RepNode))
+        continue;
+      if (tarjanDFS(RepNode) == 0) {
+        F.Child = RepNode;
+        tarjanDFS(RepNode) = ++DFSNumber;
+        Frames.push_back(EdgeFrame(RepNode, DFSNumber));
+        Descended = true;
+        break;
       }
-      if (Tarjan2DFS[RepNode] < Tarjan2DFS[Node])
-        Tarjan2DFS[Node] = Tarjan2DFS[RepNode];
+      if (tarjanDFS(RepNode) < tarjanDFS(Node))
+        tarjanDFS(Node) = tarjanDFS(RepNode);
     }
+    if (Descended)
+      continue;
 
-    // We may have just discovered that this node is part of a cycle, in
-    // which case we can also erase it.
-    if (RepNode != *bi) {
-      ToErase.set(*bi);
-      NewEdges.set(RepNode);
+    unsigned OurDFS = F.DFS;
+    Frames.pop_back();
+
+    // Rewrite the edges that now point into a cycle, or into a cycle found
+    // earlier, to its representative.
+    CanonicalizeEdges(Node);
+
+    // If this node is a root of a non-trivial SCC, remember its members to
+    // unite with it.
+    if (OurDFS == tarjanDFS(Node)) {
+      while (!SCCStack.empty() && tarjanDFS(SCCStack.top()) >= OurDFS) {
+        tarjanDeleted(SCCStack.top()) = true;
+        Cycles.push_back(std::make_pair(Node, SCCStack.top()));
+        SCCStack.pop();
+      }
+      tarjanDeleted(Node) = true;
+    } else {
+      SCCStack.push(Node);
     }
   }
 
-  GraphNodes[Node].Edges->intersectWithComplement(ToErase);
-  GraphNodes[Node].Edges |= NewEdges;
+  // Unite the cycles and place them on our worklist to be processed.
+  for (unsigned i = 0, e = Cycles.size(); i != e; ++i) {
+    UniteNodes(FindNode(Cycles[i].first), FindNode(Cycles[i].second));
+    ++NumLCDUnited;
+  }
+  for (unsigned i = 0, e = Cycles.size(); i != e; ++i)
+    NextWL->insert(&GraphNodes[FindNode(Cycles[i].first)]);
+  return !Cycles.empty();
+}
+
+/// clearTarjan - Forget the state of the previous lazy cycle searches.
+void Andersens::clearTarjan() {
+  if (++TarjanEpoch == 0) {
+    std::fill(Tarjan2Epoch.begin(), Tarjan2Epoch.end(), 0);
+    TarjanEpoch = 1;
+  }
+}
 
-  // If this node is a root of a non-trivial SCC, place it on our
-  // worklist to be processed.
-  if (OurDFS == Tarjan2DFS[Node]) {
-    while (!SCCStack.empty() && Tarjan2DFS[SCCStack.top()] >= OurDFS) {
-      Node = UniteNodes(Node, SCCStack.top());
+/// CollapseLazyCycles - Search for cycles from the lazy cycle detection
+/// candidates in TarjanWL, collapsing the ones found.
+void Andersens::CollapseLazyCycles(std::queue<unsigned> &TarjanWL) {
+  DFSNumber = 0;
 
-      SCCStack.pop();
-      Merged = true;
+  clearTarjan();
+  while (!TarjanWL.empty()) {
+    unsigned int ToTarjan = TarjanWL.front();
+    TarjanWL.pop();
+    if (!tarjanDeleted(ToTarjan)
+        && GraphNodes[ToTarjan].isRep()
+        && tarjanDFS(ToTarjan) == 0) {
+      ++NumLCDSearches;
+      QueryNode(ToTarjan);
     }
-    Tarjan2Deleted[Node] = true;
+  }
+}
 
-    if (Merged)
-      NextWL->insert(&GraphNodes[Node]);
-  } else {
-    SCCStack.push(Node);
+/// EdgeFrame - Return the search frame walking the copy edges of the
+/// specified node: its frozen row, then the edges added since.
+Andersens::DFSFrame Andersens::EdgeFrame(unsigned NodeIndex,
+                                         unsigned DFS) const {
+  DFSFrame F(NodeIndex, DFS, edgesOrNone(GraphNodes[NodeIndex].Edges));
+  if (!EdgeTargets.empty()) {
+    F.Row = &EdgeTargets[0] + EdgeBegin[NodeIndex];
+    F.RowEnd = &EdgeTargets[0] + EdgeEnd[NodeIndex];
+  }
+  return F;
+}
+
+/// FoldEdges - Freeze the copy edges of every representative, its row and
+/// the edges added to Node::Edges since, into new rows.  The rows are
+/// canonical and sorted, and Node::Edges is left empty.
+void Andersens::FoldEdges() {
+  unsigned NumNodes = GraphNodes.size();
+  std::vector<unsigned> Begin(NumNodes, 0), End(NumNodes, 0), Targets;
+  Targets.reserve(EdgeTargets.size() + NumOverflowEdges);
+  std::vector<unsigned> Row;
+  for (unsigned i = 0; i < NumNodes; ++i) {
+    Node *N = &GraphNodes[i];
+    Begin[i] = Targets.size();
+    if (N->isRep() && N->Edges) {
+      Row.clear();
+      if (!EdgeBegin.empty())
+        for (unsigned j = EdgeBegin[i], je = EdgeEnd[i]; j != je; ++j)
+          Row.push_back(FindNode(EdgeTargets[j]));
+      for (SparseBitVector<>::iterator bi = N->Edges->begin();
+           bi != N->Edges->end(); ++bi)
+        Row.push_back(FindNode(*bi));
+      N->Edges->clear();
+      std::sort(Row.begin(), Row.end());
+      Row.erase(std::unique(Row.begin(), Row.end()), Row.end());
+      for (unsigned j = 0, je = Row.size(); j != je; ++j)
+        if (Row[j] != i)
+          Targets.push_back(Row[j]);
+    }
+    End[i] = Targets.size();
   }
+  EdgeBegin.swap(Begin);
+  EdgeEnd.swap(End);
+  EdgeTargets.swap(Targets);
+  NumOverflowEdges = 0;
+}
 
-  return(Changed | Merged);
+/// ReleaseEdgeRows - Move the frozen rows back into Node::Edges and free
+/// them.
+void Andersens::ReleaseEdgeRows() {
+  if (EdgeBegin.empty())
+    return;
+  for (unsigned i = 0; i < GraphNodes.size(); ++i)
+    if (GraphNodes[i].Edges)
+      for (unsigned j = EdgeBegin[i], je = EdgeEnd[i]; j != je; ++j)
+        GraphNodes[i].Edges->set(EdgeTargets[j]);
+  std::vector<unsigned>().swap(EdgeBegin);
+  std::vector<unsigned>().swap(EdgeEnd);
+  std::vector<unsigned>().swap(EdgeTargets);
+  NumOverflowEdges = 0;
 }
 
 /// SolveConstraints - This stage iteratively processes the constraints list
@@ -1793,10 +4056,17 @@ bool Andersens::QueryNode(unsigned Node) {
 /// cycle detect them all at the same time to do this more cheaply.  This
 /// catches cycles slightly later than the original technique did, but does it
 /// make significantly cheaper.
+/// -anders-lcd=eager checks the candidates of every node as soon as the node
+/// has been processed, as the paper does, and -anders-lcd=off only relies on
+/// the cycles HCD found offline.
 
 void Andersens::SolveConstraints() {
-  CurrWL = &w1;
-  NextWL = &w2;
+  if (AndersWorkList == SweepWorkListKind) {
+    CurrWL = NextWL = &Sweep;
+  } else {
+    CurrWL = &w1;
+    NextWL = &w2;
+  }
 
   OptimizeConstraints();
 #undef DEBUG_TYPE
@@ -1804,32 +4074,167 @@ void Andersens::SolveConstraints() {
       DEBUG(PrintConstraints());
 #undef DEBUG_TYPE
 #define DEBUG_TYPE "anders-aa"
+  if (OutOfBudget()) {
+    SDT.clear();
+    FirstRefNode = 0;
+    FirstAdrNode = 0;
+    return;
+  }
 
+  BeginPhase("CreateConstraintGraph");
   for (unsigned i = 0; i < GraphNodes.size(); ++i) {
     Node *N = &GraphNodes[i];
-    N->PointsTo = new SparseBitVector<>;
-    N->OldPointsTo = new SparseBitVector<>;
+    N->PointsTo = new PointsToSet;
+    N->OldPointsTo = new PointsToSet;
     N->Edges = new SparseBitVector<>;
   }
   CreateConstraintGraph();
   UnitePointerEquivalences();
+  EndPhase();
   assert(SCCStack.empty() && "SCC Stack should be empty by now!");
-  Node2DFS.clear();
-  Node2Deleted.clear();
-  Node2DFS.insert(Node2DFS.begin(), GraphNodes.size(), 0);
-  Node2Deleted.insert(Node2Deleted.begin(), GraphNodes.size(), false);
+
+  bool Wave = SolverChoice == ~0U ? AndersSolver == WaveSolver
+                                  : SolverChoice != 0;
+  if (Wave) {
+    BeginPhase("SolveWave");
+    if (AndersSharedSets)
+      SharePointsToSets();
+    SolveWave();
+  } else {
+    BeginPhase("SolveWorkList");
+    if (AndersSharedSets)
+      SharePointsToSets();
+    SolveWorkList();
+  }
+  EndPhase();
+  for (unsigned i = 0; i < GraphNodes.size(); ++i)
+    if (GraphNodes[i].isRep() && GraphNodes[i].PointsTo)
+      Telemetry.PointsToBits += GraphNodes[i].PointsTo->count();
+  FindSingletons();
+  if (SharingPointsTo) {
+    Telemetry.PoolPeakSets = PointsToSets.getPeakSets();
+    Telemetry.PoolPeakBits = PointsToSets.getPeakBits();
+    Telemetry.PoolSets = PointsToSets.getNumSets();
+    Telemetry.PoolBits = PointsToSets.getNumBits();
+    Telemetry.PoolCompactions = PointsToSets.getNumCompactions();
+  }
+  DEBUG(if (SharingPointsTo)
+          errs() << "Shared points-to sets: " << PointsToSets.getNumSets()
+                 << " sets, " << PointsToSets.getNumUnions() << " unions, "
+                 << PointsToSets.getNumUnionHits() << " union hits, "
+                 << PointsToSets.getNumFreedSets() << " sets freed\n");
+
+  std::vector<unsigned>().swap(Tarjan2DFS);
+  std::vector<bool>().swap(Tarjan2Deleted);
+  std::vector<unsigned>().swap(Tarjan2Epoch);
+  for (unsigned i = 0; i < GraphNodes.size(); ++i) {
+    Node *N = &GraphNodes[i];
+    if (!SharingPointsTo)
+      delete N->OldPointsTo;
+    N->OldPointsTo = NULL;
+    delete N->Edges;
+  }
+  std::vector<Constraint>().swap(ComplexConstraints);
+  std::vector<unsigned>().swap(ComplexNext);
+  SDTActive = false;
+  SDT.clear();
+}
+
+/// FindSingletons - Record in every representative the only object its
+/// points-to set names, if there is just one besides the null object.
+void Andersens::FindSingletons() {
+  for (unsigned i = 0; i < GraphNodes.size(); ++i) {
+    Node *N = &GraphNodes[i];
+    N->Singleton = NoSingleton;
+    if (!N->isRep() || !N->PointsTo)
+      continue;
+    unsigned Count = 0, Object = NoSingleton;
+    for (PointsToSet::iterator bi = N->PointsTo->begin(),
+         be = N->PointsTo->end(); bi != be && Count < 2; ++bi)
+      if (*bi != NullObject) {
+        Object = *bi;
+        ++Count;
+      }
+    if (Count == 1)
+      N->Singleton = Object;
+  }
+}
+
+/// ProjectLocks - Cut the points-to set of every representative down to its
+/// lock objects, and free the sets.
+void Andersens::ProjectLocks() {
+  unsigned NumNodes = GraphNodes.size();
+  LockBegin.assign(NumNodes + 1, 0);
+  LockOnly.assign(NumNodes, true);
+  LockMembers.clear();
+  for (unsigned i = 0; i < NumNodes; ++i) {
+    Node *N = &GraphNodes[i];
+    LockBegin[i] = LockMembers.size();
+    if (N->isRep() && N->PointsTo)
+      for (PointsToSet::iterator bi = N->PointsTo->begin(),
+           be = N->PointsTo->end(); bi != be; ++bi)
+        if (LockObjects[*bi])
+          LockMembers.push_back(*bi);
+        else if (*bi != NullObject)
+          LockOnly[i] = false;
+    if (!SharingPointsTo)
+      delete N->PointsTo;
+    N->PointsTo = NULL;
+  }
+  LockBegin[NumNodes] = LockMembers.size();
+  PointsToSets.clear();
+  SharingPointsTo = false;
+  LockProjected = true;
+  DEBUG(errs() << "Lock projection: " << LockMembers.size() << " members\n");
+}
+
+/// locksIntersect - Return true if the projected points-to sets of the
+/// representatives N1 and N2 have a lock object in common.
+bool Andersens::locksIntersect(unsigned N1, unsigned N2) const {
+  unsigned I1 = LockBegin[N1], E1 = LockBegin[N1 + 1];
+  unsigned I2 = LockBegin[N2], E2 = LockBegin[N2 + 1];
+  while (I1 != E1 && I2 != E2) {
+    if (LockMembers[I1] == LockMembers[I2])
+      return true;
+    if (LockMembers[I1] < LockMembers[I2])
+      ++I1;
+    else
+      ++I2;
+  }
+  return false;
+}
+
+/// SolveWorkList - Run the sequential solver: pop nodes off the work lists
+/// in timestamp order, or in sweeps over the graph with -anders-worklist=topo,
+/// process their complex constraints and propagate their new points-to bits
+/// along their copy edges until nothing changes.
+void Andersens::SolveWorkList() {
+  Tarjan2DFS.assign(GraphNodes.size(), 0);
+  Tarjan2Deleted.assign(GraphNodes.size(), false);
+  Tarjan2Epoch.assign(GraphNodes.size(), 0);
+  TarjanEpoch = 0;
   DFSNumber = 0;
   DenseSet<Constraint, ConstraintKeyInfo> Seen;
   DenseSet<std::pair<unsigned,unsigned>, PairKeyInfo> EdgesChecked;
+  NumHCDUnited = NumLCDSearches = NumLCDUnited = 0;
+  NumRounds = 0;
+  w1.clearCounters();
+  w2.clearCounters();
+  Sweep.clearCounters();
+  Sweep.init(&GraphNodes[0], GraphNodes.size());
+  if (AndersCSREdges)
+    FoldEdges();
 
   // Order graph and add initial nodes to work list.
   for (unsigned i = 0; i < GraphNodes.size(); ++i) {
     Node *INode = &GraphNodes[i];
 
     // Add to work list if it's a representative and can contribute to the
-    // calculation right now.
+    // calculation right now.  Only representatives keep their edges.
     if (INode->isRep() && !INode->PointsTo->empty()
-        && (!INode->Edges->empty() || !INode->Constraints.empty())) {
+        && (!INode->Edges->empty()
+            || (!EdgeBegin.empty() && EdgeBegin[i] != EdgeEnd[i])
+            || INode->ComplexHead != NoComplex)) {
       INode->Stamp();
       CurrWL->insert(INode);
     }
@@ -1840,10 +4245,14 @@ void Andersens::SolveConstraints() {
   // results when !FULL_UNIVERSAL, we need to treat the special variables in
   // the same way that the !FULL_UNIVERSAL tweak does throughout the rest of
   // the analysis - it's ok to add edges from the special nodes, but never
-  // *to* the special nodes.
+  // *to* the special nodes.  Rep is only in RSV once some real object was
+  // united with it: before that, the loads and stores through the node
+  // reach the special variables alone.
   std::vector<unsigned int> RSV;
 #endif
-  while( !CurrWL->empty() ) {
+  std::vector<unsigned> Targets;
+  unsigned Pops = 0;
+  while( !CurrWL->empty() && !OverBudget ) {
     //DOUT << "Starting iteration #" << ++NumIters << "\n";
 
     Node* CurrNode;
@@ -1851,40 +4260,38 @@ void Andersens::SolveConstraints() {
 
     // Actual cycle checking code.  We cycle check all of the lazy cycle
     // candidates from the last iteration in one go.
-    if (!TarjanWL.empty()) {
-      DFSNumber = 0;
-
-      Tarjan2DFS.clear();
-      Tarjan2Deleted.clear();
-      while (!TarjanWL.empty()) {
-        unsigned int ToTarjan = TarjanWL.front();
-        TarjanWL.pop();
-        if (!Tarjan2Deleted[ToTarjan]
-            && GraphNodes[ToTarjan].isRep()
-            && Tarjan2DFS[ToTarjan] == 0)
-          QueryNode(ToTarjan);
-      }
-    }
+    if (!TarjanWL.empty())
+      CollapseLazyCycles(TarjanWL);
+
+    ++NumRounds;
+    if (CurrWL == &Sweep)
+      OrderSweep();
 
     // Add to work list if it's a representative and can contribute to the
     // calculation right now.
     while( (CurrNode = CurrWL->pop()) != NULL ) {
+      if (++Pops % BudgetCheckInterval == 0 && OutOfBudget())
+        break;
       CurrNodeIndex = CurrNode - &GraphNodes[0];
       CurrNode->Stamp();
 
 
       // Figure out the changed points to bits
-      SparseBitVector<> CurrPointsTo;
+      PointsToSet CurrPointsTo;
       CurrPointsTo.intersectWithComplement(CurrNode->PointsTo,
                                            CurrNode->OldPointsTo);
       if (CurrPointsTo.empty())
         continue;
 
-      *(CurrNode->OldPointsTo) |= CurrPointsTo;
+      MarkPropagated(CurrNode, CurrPointsTo);
+      ++Telemetry.NumPropagations;
 
       // Check the offline-computed equivalencies from HCD.
       bool SCC = false;
       unsigned Rep;
+#if !FULL_UNIVERSAL
+      bool HasObject = false;
+#endif
 
       if (SDT[CurrNodeIndex] >= 0) {
         SCC = true;
@@ -1893,7 +4300,7 @@ void Andersens::SolveConstraints() {
 #if !FULL_UNIVERSAL
         RSV.clear();
 #endif
-        for (SparseBitVector<>::iterator bi = CurrPointsTo.begin();
+        for (PointsToSet::iterator bi = CurrPointsTo.begin();
              bi != CurrPointsTo.end(); ++bi) {
           unsigned Node = FindNode(*bi);
 #if !FULL_UNIVERSAL
@@ -1901,11 +4308,15 @@ void Andersens::SolveConstraints() {
             RSV.push_back(Node);
             continue;
           }
+          HasObject = true;
 #endif
+          if (Node != Rep)
+            ++NumHCDUnited;
           Rep = UniteNodes(Rep,Node);
         }
 #if !FULL_UNIVERSAL
-        RSV.push_back(Rep);
+        if (HasObject)
+          RSV.push_back(Rep);
 #endif
 
         NextWL->insert(&GraphNodes[Rep]);
@@ -1917,16 +4328,15 @@ void Andersens::SolveConstraints() {
       Seen.clear();
 
       /* Now process the constraints for this node.  */
-      for (std::list<Constraint>::iterator li = CurrNode->Constraints.begin();
-           li != CurrNode->Constraints.end(); ) {
+      unsigned Prev = NoComplex;
+      for (unsigned Index = CurrNode->ComplexHead; Index != NoComplex; ) {
+        Constraint *li = &ComplexConstraints[Index];
         li->Src = FindNode(li->Src);
         li->Dest = FindNode(li->Dest);
 
         // Delete redundant constraints
         if( Seen.count(*li) ) {
-          std::list<Constraint>::iterator lk = li; li++;
-
-          CurrNode->Constraints.erase(lk);
+          Index = EraseComplexConstraint(CurrNode, Prev, Index);
           continue;
         }
         Seen.insert(*li);
@@ -1951,8 +4361,25 @@ void Andersens::SolveConstraints() {
           Src = &li->Src;
           Dest = &CurrMember;
         } else {
-          // TODO Handle offseted copy constraint
-          li++;
+          // Dest = Src + K: the new members of our solution, each moved K
+          // fields on, are in the solution of Dest.
+          unsigned DestIndex = FindNode(li->Dest);
+#if !FULL_UNIVERSAL
+          if (DestIndex >= NumberSpecialNodes)
+#endif
+          {
+            PointsToSet Fields;
+            for (PointsToSet::iterator bi = CurrPointsTo.begin();
+                 bi != CurrPointsTo.end(); ++bi)
+              Fields.set(getFieldNode(*bi, K));
+            Node *DestNode = &GraphNodes[DestIndex];
+            if (AddToPointsTo(DestNode, Fields,
+                              SharingPointsTo ? PointsToSets.intern(Fields)
+                                              : 0))
+              NextWL->insert(DestNode);
+          }
+          Prev = Index;
+          Index = ComplexNext[Index];
           continue;
         }
 
@@ -1963,25 +4390,31 @@ void Andersens::SolveConstraints() {
 #if FULL_UNIVERSAL
           CurrMember = Rep;
 
-          if (GraphNodes[*Src].Edges->test_and_set(*Dest))
-            if (GraphNodes[*Dest].PointsTo |= *(GraphNodes[*Src].PointsTo))
+          if (GraphNodes[*Src].Edges->test_and_set(*Dest)) {
+            ++NumOverflowEdges;
+            if (AddToPointsTo(&GraphNodes[*Dest], *(GraphNodes[*Src].PointsTo),
+                              GraphNodes[*Src].PointsToID))
               NextWL->insert(&GraphNodes[*Dest]);
+          }
 #else
           for (unsigned i=0; i < RSV.size(); ++i) {
             CurrMember = RSV[i];
 
             if (*Dest < NumberSpecialNodes)
               continue;
-            if (GraphNodes[*Src].Edges->test_and_set(*Dest))
-              if (GraphNodes[*Dest].PointsTo |= *(GraphNodes[*Src].PointsTo))
+            if (GraphNodes[*Src].Edges->test_and_set(*Dest)) {
+              ++NumOverflowEdges;
+              if (AddToPointsTo(&GraphNodes[*Dest],
+                                *(GraphNodes[*Src].PointsTo),
+                                GraphNodes[*Src].PointsToID))
                 NextWL->insert(&GraphNodes[*Dest]);
+            }
           }
 #endif
           // since all future elements of the points-to set will be
           // equivalent to the current ones, the complex constraints
           // become redundant.
           //
-          std::list<Constraint>::iterator lk = li; li++;
 #if !FULL_UNIVERSAL
           // In this case, we can still erase the constraints when the
           // elements of the points-to sets are referenced by *Dest,
@@ -1989,26 +4422,28 @@ void Andersens::SolveConstraints() {
           // constraint). This is because if another special variable is
           // put into the points-to set later, we still need to add the
           // new edge from that special variable.
-          if( lk->Type != Constraint::Load)
+          // Nor can we erase a store that only reached special variables.
+          if( li->Type == Constraint::Load || !HasObject) {
+            Prev = Index;
+            Index = ComplexNext[Index];
+            continue;
+          }
 #endif
-          GraphNodes[CurrNodeIndex].Constraints.erase(lk);
+          Index = EraseComplexConstraint(CurrNode, Prev, Index);
         } else {
-          const SparseBitVector<> &Solution = CurrPointsTo;
+          const PointsToSet &Solution = CurrPointsTo;
 
-          for (SparseBitVector<>::iterator bi = Solution.begin();
+          for (PointsToSet::iterator bi = Solution.begin();
                bi != Solution.end();
                ++bi) {
             CurrMember = *bi;
 
             // Need to increment the member by K since that is where we are
-            // supposed to copy to/from.  Note that in positive weight cycles,
-            // which occur in address taking of fields, K can go past
-            // MaxK[CurrMember] elements, even though that is all it could point
-            // to.
-            if (K > 0 && K > MaxK[CurrMember])
-              continue;
-            else
-              CurrMember = FindNode(CurrMember + K);
+            // supposed to copy to/from.  The loads and stores with an offset
+            // copy memory field by field, as memcpy does, and K may go past
+            // the fields of a smaller object; those fields are all in the
+            // member's own node, as they are for offset copies.
+            CurrMember = FindNode(getFieldNode(CurrMember, K));
 
             // Add an edge to the graph, so we can just do regular
             // bitmap ior next time.  It may also let us notice a cycle.
@@ -2016,76 +4451,939 @@ void Andersens::SolveConstraints() {
             if (*Dest < NumberSpecialNodes)
               continue;
 #endif
-            if (GraphNodes[*Src].Edges->test_and_set(*Dest))
-              if (GraphNodes[*Dest].PointsTo |= *(GraphNodes[*Src].PointsTo))
+            if (GraphNodes[*Src].Edges->test_and_set(*Dest)) {
+              ++NumOverflowEdges;
+              if (AddToPointsTo(&GraphNodes[*Dest],
+                                *(GraphNodes[*Src].PointsTo),
+                                GraphNodes[*Src].PointsToID))
                 NextWL->insert(&GraphNodes[*Dest]);
-
+            }
           }
-          li++;
+          Prev = Index;
+          Index = ComplexNext[Index];
         }
       }
-      SparseBitVector<> NewEdges;
-      SparseBitVector<> ToErase;
-
       // Now all we have left to do is propagate points-to info along the
-      // edges, erasing the redundant edges.
+      // edges, once they are rewritten to the representatives other than
+      // this node.  The frozen row is read in order.
+      CanonicalizeEdges(CurrNodeIndex);
+      Targets.clear();
+      if (!EdgeBegin.empty())
+        Targets.insert(Targets.end(),
+                       EdgeTargets.begin() + EdgeBegin[CurrNodeIndex],
+                       EdgeTargets.begin() + EdgeEnd[CurrNodeIndex]);
       for (SparseBitVector<>::iterator bi = CurrNode->Edges->begin();
-           bi != CurrNode->Edges->end();
-           ++bi) {
-
-        unsigned DestVar = *bi;
-        unsigned Rep = FindNode(DestVar);
-
-        // If we ended up with this node as our destination, or we've already
-        // got an edge for the representative, delete the current edge.
-        if (Rep == CurrNodeIndex ||
-            (Rep != DestVar && NewEdges.test(Rep))) {
-            ToErase.set(DestVar);
-            continue;
-        }
+           bi != CurrNode->Edges->end(); ++bi)
+        Targets.push_back(*bi);
 
+      for (unsigned i = 0, e = Targets.size(); i != e; ++i) {
+        unsigned Rep = Targets[i];
         std::pair<unsigned,unsigned> edge(CurrNodeIndex,Rep);
 
         // This is where we do lazy cycle detection.
         // If this is a cycle candidate (equal points-to sets and this
         // particular edge has not been cycle-checked previously), add to the
-        // list to check for cycles on the next iteration.
-        if (!EdgesChecked.count(edge) &&
-            *(GraphNodes[Rep].PointsTo) == *(CurrNode->PointsTo)) {
-          EdgesChecked.insert(edge);
-          TarjanWL.push(Rep);
+        // list to check for cycles.
+        if (AndersLCD != NoLCD && !EdgesChecked.count(edge)) {
+          bool SameSet = SharingPointsTo
+            ? GraphNodes[Rep].PointsToID == CurrNode->PointsToID
+            : *(GraphNodes[Rep].PointsTo) == *(CurrNode->PointsTo);
+          if (SameSet) {
+            EdgesChecked.insert(edge);
+            TarjanWL.push(Rep);
+          }
         }
-        // Union the points-to sets into the dest
+        // Union the points-to sets into the dest.  Shared sets take the
+        // whole set of the node rather than just the new bits: the result is
+        // the same, and the union of two interned sets is remembered.
 #if !FULL_UNIVERSAL
         if (Rep >= NumberSpecialNodes)
 #endif
-        if (GraphNodes[Rep].PointsTo |= CurrPointsTo) {
+        if (SharingPointsTo
+            ? AddToPointsTo(&GraphNodes[Rep], *(CurrNode->PointsTo),
+                            CurrNode->PointsToID)
+            : (GraphNodes[Rep].PointsTo |= CurrPointsTo)) {
           NextWL->insert(&GraphNodes[Rep]);
         }
-        // If this edge's destination was collapsed, rewrite the edge.
-        if (Rep != DestVar) {
-          ToErase.set(DestVar);
-          NewEdges.set(Rep);
-        }
       }
-      CurrNode->Edges->intersectWithComplement(ToErase);
-      CurrNode->Edges |= NewEdges;
+
+      // Eager lazy cycle detection does not wait for the end of the round.
+      // The nodes it collapses go on the next work list.
+      if (AndersLCD == EagerLCD && !TarjanWL.empty())
+        CollapseLazyCycles(TarjanWL);
     }
 
+    // Fold the edges the round added into the rows once they are a good
+    // part of the graph.
+    if (!EdgeBegin.empty() && (uint64_t) NumOverflowEdges * 100
+        > (uint64_t) EdgeTargets.size() * FoldEdgesPercent)
+      FoldEdges();
+
+    // Free the shared sets the round left behind.
+    CompactPointsToSets();
+
     // Switch to other work list.
     WorkList* t = CurrWL; CurrWL = NextWL; NextWL = t;
   }
+  ReleaseEdgeRows();
+  Telemetry.NumRounds += NumRounds;
+  Telemetry.NumPops += CurrWL == &Sweep ? Sweep.Pops : w1.Pops + w2.Pops;
+
+  DEBUG(errs() << "Cycle detection: " << NumHCDUnited
+               << " nodes united by HCD, " << NumLCDSearches
+               << " lazy searches uniting " << NumLCDUnited << " nodes\n");
+  DEBUG(if (CurrWL == &Sweep)
+          errs() << "Work list topo: " << Sweep.Pops << " pops, "
+                 << Sweep.StalePops << " stale pops, " << NumRounds
+                 << " rounds\n";
+        else
+          errs() << "Work list lrf: " << w1.Pops + w2.Pops << " pops, "
+                 << w1.StalePops + w2.StalePops << " stale pops, "
+                 << NumRounds << " rounds\n");
+}
 
+/// OrderSweep - Give the sweep work list the representatives in topological
+/// order of the condensed copy-edge graph for its next sweep.  The nodes of
+/// a cycle are swept one after the other.
+void Andersens::OrderSweep() {
+  unsigned NumNodes = GraphNodes.size();
+  for (unsigned i = 0; i < NumNodes; ++i)
+    if (GraphNodes[i].isRep())
+      CanonicalizeEdges(i);
+
+  std::vector<unsigned> Roots;
+  std::vector<std::vector<unsigned> > Cycles;
+  FindComponents(Roots, Cycles);
+
+  // The root of a component is the last of its members.
+  std::vector<unsigned> CycleOf(NumNodes, ~0U);
+  for (unsigned i = 0, e = Cycles.size(); i != e; ++i)
+    CycleOf[Cycles[i].back()] = i;
+
+  std::vector<unsigned> Order;
+  for (unsigned i = Roots.size(); i != 0; --i) {
+    unsigned Root = Roots[i - 1];
+    if (CycleOf[Root] == ~0U)
+      Order.push_back(Root);
+    else
+      Order.insert(Order.end(), Cycles[CycleOf[Root]].begin(),
+                   Cycles[CycleOf[Root]].end());
+  }
+  Sweep.setOrder(Order);
+}
 
-  Node2DFS.clear();
-  Node2Deleted.clear();
+//===----------------------------------------------------------------------===//
+//                      Wave Propagation Solver
+//===----------------------------------------------------------------------===//
+//
+// The technique used here is described in "Wave Propagation and Deep
+// Propagation for Pointer Analysis. In Code Generation and Optimization (CGO),
+// March 2009."  Instead of firing one node at a time, every round of the
+// solver
+//   1. collapses the cycles of the copy-edge graph and orders it
+//      topologically,
+//   2. pushes the new points-to bits of every node along its copy edges in
+//      topological order, so each set is only propagated once per round, and
+//   3. resolves the load and store constraints against those new bits, which
+//      adds copy edges for the next round.
+// Steps 2 and 3 run on a thread pool.  In step 2, nodes are grouped by their
+// depth in the acyclic graph; nodes of the same depth have no edges between
+// them, so each one can pull the new bits of its predecessors independently.
+// In step 3, the new edges are only collected by the threads and added to the
+// graph afterwards, one chunk at a time in a fixed order.
+//
+// Both solvers compute the least solution of the same constraint set, so they
+// produce the same points-to set for every value.
+
+/// getMaxK - Read-only version of MaxK[NodeIndex], safe to use from several
+/// threads at once.
+unsigned Andersens::getMaxK(unsigned NodeIndex) const {
+  std::map<unsigned, unsigned>::const_iterator I = MaxK.find(NodeIndex);
+  return I == MaxK.end() ? 0 : I->second;
+}
+
+/// CanonicalizeEdges - Rewrite the copy edges of the specified representative
+/// node so that they only point to representatives other than itself.
+void Andersens::CanonicalizeEdges(unsigned NodeIndex) {
+  if (!EdgeBegin.empty()) {
+    unsigned Out = EdgeBegin[NodeIndex];
+    for (unsigned i = Out, e = EdgeEnd[NodeIndex]; i != e; ++i) {
+      unsigned Rep = FindNode(EdgeTargets[i]);
+      if (Rep != NodeIndex)
+        EdgeTargets[Out++] = Rep;
+    }
+    EdgeEnd[NodeIndex] = Out;
+  }
+
+  SparseBitVector<> *Edges = GraphNodes[NodeIndex].Edges;
+  SparseBitVector<> NewEdges;
+  SparseBitVector<> ToErase;
+
+  for (SparseBitVector<>::iterator bi = Edges->begin(); bi != Edges->end();
+       ++bi) {
+    unsigned Rep = FindNode(*bi);
+    if (Rep == *bi && Rep != NodeIndex)
+      continue;
+    ToErase.set(*bi);
+    if (Rep != NodeIndex)
+      NewEdges.set(Rep);
+  }
+  Edges->intersectWithComplement(ToErase);
+  *Edges |= NewEdges;
+}
+
+/// FindComponents - Find the strongly connected components of the copy edges
+/// between representative nodes, whose edges must be canonical.  Roots gets
+/// the root of every component in the order they were completed (that is,
+/// reverse topological order), and Cycles the members of the non-trivial
+/// ones.
+void Andersens::FindComponents(std::vector<unsigned> &Roots,
+                               std::vector<std::vector<unsigned> > &Cycles) {
+  unsigned NumNodes = GraphNodes.size();
+
+  // Iterative Tarjan.  DFS numbers start at 1 so that 0 means unvisited.
+  std::vector<unsigned> DFS(NumNodes, 0);
+  std::vector<unsigned> Low(NumNodes, 0);
+  std::vector<bool> OnStack(NumNodes, false);
+  std::vector<unsigned> Stack;
+  std::vector<DFSFrame> Frames;
+  unsigned Counter = 0;
+
+  for (unsigned Root = 0; Root < NumNodes; ++Root) {
+    if (!GraphNodes[Root].isRep() || DFS[Root] != 0)
+      continue;
+
+    DFS[Root] = Low[Root] = ++Counter;
+    Stack.push_back(Root);
+    OnStack[Root] = true;
+    Frames.push_back(EdgeFrame(Root, Counter));
+
+    while (!Frames.empty()) {
+      unsigned N = Frames.back().Node;
+      unsigned Succ;
+
+      if (Frames.back().next(Succ)) {
+#if !FULL_UNIVERSAL
+        // Nothing is ever propagated into the special nodes, so edges to
+        // them cannot be part of a cycle that matters.
+        if (Succ < NumberSpecialNodes)
+          continue;
+#endif
+        if (DFS[Succ] == 0) {
+          DFS[Succ] = Low[Succ] = ++Counter;
+          Stack.push_back(Succ);
+          OnStack[Succ] = true;
+          Frames.push_back(EdgeFrame(Succ, Counter));
+        } else if (OnStack[Succ] && DFS[Succ] < Low[N]) {
+          Low[N] = DFS[Succ];
+        }
+        continue;
+      }
+
+      Frames.pop_back();
+      if (!Frames.empty() && Low[N] < Low[Frames.back().Node])
+        Low[Frames.back().Node] = Low[N];
+
+      if (Low[N] != DFS[N])
+        continue;
+
+      // N is the root of a component; pop its members.
+      std::vector<unsigned> Members;
+      unsigned Member;
+      do {
+        Member = Stack.back();
+        Stack.pop_back();
+        OnStack[Member] = false;
+        Members.push_back(Member);
+      } while (Member != N);
+
+      Roots.push_back(N);
+      if (Members.size() > 1)
+        Cycles.push_back(Members);
+    }
+  }
+}
+
+/// CollapseCyclesWave - Find the strongly connected components of the copy
+/// edges between representative nodes, unite the nodes of each cycle, and
+/// fill Topo with the remaining representatives in topological order.
+void Andersens::CollapseCyclesWave(std::vector<unsigned> &Topo) {
+  unsigned NumNodes = GraphNodes.size();
+
+  for (unsigned i = 0; i < NumNodes; ++i)
+    if (GraphNodes[i].isRep())
+      CanonicalizeEdges(i);
+
+  std::vector<unsigned> Roots;
+  std::vector<std::vector<unsigned> > Cycles;
+  FindComponents(Roots, Cycles);
+
+  for (unsigned i = 0, e = Cycles.size(); i != e; ++i) {
+    std::vector<unsigned> &Members = Cycles[i];
+    // Uniting an earlier cycle may have united these members too, with the
+    // nodes HCD tied to it.
+    unsigned Rep = FindNode(Members[0]);
+    for (unsigned j = 1, je = Members.size(); j != je; ++j)
+      Rep = UniteNodes(Rep, FindNode(Members[j]));
+  }
+
+  Topo.clear();
+  for (unsigned i = Roots.size(); i != 0; --i)
+    Topo.push_back(FindNode(Roots[i - 1]));
+
+  // Uniting nodes merged their edges, so rewrite them once more.
+  if (!Cycles.empty())
+    for (unsigned i = 0, e = Topo.size(); i != e; ++i)
+      CanonicalizeEdges(Topo[i]);
+}
+
+/// PropagateWave - Pull the new points-to bits of all predecessors of the
+/// specified node into its points-to set, then record which bits are new to
+/// this node.  Only touches the node itself, so nodes of the same depth can
+/// be processed concurrently.  Shared sets cannot change here, as the pool is
+/// not safe for threads; the new bits are only gathered, and CommitWave adds
+/// them to the set of the node once the wave is over.
+void Andersens::PropagateWave(unsigned NodeIndex,
+                              const std::vector<std::vector<unsigned> > &Preds,
+                              std::vector<PointsToSet > &Delta) {
+  Node *N = &GraphNodes[NodeIndex];
+  const std::vector<unsigned> &P = Preds[NodeIndex];
+
+  if (SharingPointsTo) {
+    PointsToSet &D = Delta[NodeIndex];
+    D.clear();
+    D.intersectWithComplement(N->PointsTo, N->OldPointsTo);
+#if !FULL_UNIVERSAL
+    if (NodeIndex >= NumberSpecialNodes)
+#endif
+    for (unsigned i = 0, e = P.size(); i != e; ++i)
+      D |= Delta[P[i]];
+    D.intersectWithComplement(*(N->OldPointsTo));
+    return;
+  }
+
+#if !FULL_UNIVERSAL
+  if (NodeIndex >= NumberSpecialNodes)
+#endif
+  for (unsigned i = 0, e = P.size(); i != e; ++i)
+    *(N->PointsTo) |= Delta[P[i]];
+
+  Delta[NodeIndex].clear();
+  Delta[NodeIndex].intersectWithComplement(N->PointsTo, N->OldPointsTo);
+  *(N->OldPointsTo) |= Delta[NodeIndex];
+}
+
+/// CommitWave - Add the new bits PropagateWave gathered for the specified
+/// node to its shared points-to set, and mark them propagated.
+void Andersens::CommitWave(unsigned NodeIndex, const PointsToSet &Delta) {
+  Node *N = &GraphNodes[NodeIndex];
+  PointsToSet Solution(*(N->PointsTo));
+  Solution |= Delta;
+  N->PointsToID = PointsToSets.intern(Solution);
+  N->PointsTo = PointsToSets.get(N->PointsToID);
+  MarkPropagated(N, Delta);
+}
+
+/// ResolveComplexWave - Resolve the complex constraints of the specified
+/// node against its new points-to bits, appending the copy edges loads and
+/// stores induce to NewEdges, and the (node, member) pairs offset copies add
+/// to NewMembers.  Does not modify the graph.
+void Andersens::ResolveComplexWave(unsigned NodeIndex,
+                                   const PointsToSet &Delta,
+                                   std::vector<std::pair<unsigned,
+                                                         unsigned> > &NewEdges,
+                                   std::vector<std::pair<unsigned,
+                                                       unsigned> > &NewMembers)
+                                   const {
+  const Node *N = &GraphNodes[NodeIndex];
+
+  for (unsigned Index = N->ComplexHead; Index != NoComplex;
+       Index = ComplexNext[Index]) {
+    const Constraint *li = &ComplexConstraints[Index];
+    unsigned K = li->Offset;
+
+    if (li->Type == Constraint::Copy) {
+      unsigned Dest = FindNode(li->Dest);
+#if !FULL_UNIVERSAL
+      if (Dest < NumberSpecialNodes)
+        continue;
+#endif
+      for (PointsToSet::iterator bi = Delta.begin(); bi != Delta.end();
+           ++bi)
+        NewMembers.push_back(std::make_pair(Dest, getFieldNode(*bi, K)));
+      continue;
+    }
+
+    unsigned Other = FindNode(li->Type == Constraint::Load ? li->Dest
+                                                           : li->Src);
+
+    for (PointsToSet::iterator bi = Delta.begin(); bi != Delta.end();
+         ++bi) {
+      unsigned CurrMember = FindNode(getFieldNode(*bi, K));
+
+      unsigned Src = li->Type == Constraint::Load ? CurrMember : Other;
+      unsigned Dest = li->Type == Constraint::Load ? Other : CurrMember;
+#if !FULL_UNIVERSAL
+      if (Dest < NumberSpecialNodes)
+        continue;
+#endif
+      NewEdges.push_back(std::make_pair(Src, Dest));
+    }
+  }
+}
+
+struct Andersens::WavePropagateTask : public ThreadPool::Task {
+  Andersens &A;
+  const std::vector<unsigned> &Nodes;
+  const std::vector<std::vector<unsigned> > &Preds;
+  std::vector<PointsToSet > &Delta;
+
+  WavePropagateTask(Andersens &a, const std::vector<unsigned> &n,
+                    const std::vector<std::vector<unsigned> > &p,
+                    std::vector<PointsToSet > &d)
+    : A(a), Nodes(n), Preds(p), Delta(d) {}
+
+  void run(unsigned Chunk, unsigned Begin, unsigned End) {
+    for (unsigned i = Begin; i != End; ++i)
+      A.PropagateWave(Nodes[i], Preds, Delta);
+  }
+};
+
+struct Andersens::WaveComplexTask : public ThreadPool::Task {
+  const Andersens &A;
+  const std::vector<unsigned> &Nodes;
+  const std::vector<PointsToSet > &Delta;
+  std::vector<std::vector<std::pair<unsigned, unsigned> > > &ChunkEdges;
+  std::vector<std::vector<std::pair<unsigned, unsigned> > > &ChunkMembers;
+
+  WaveComplexTask(const Andersens &a, const std::vector<unsigned> &n,
+                  const std::vector<PointsToSet > &d,
+                  std::vector<std::vector<std::pair<unsigned,
+                                                    unsigned> > > &c,
+                  std::vector<std::vector<std::pair<unsigned,
+                                                    unsigned> > > &m)
+    : A(a), Nodes(n), Delta(d), ChunkEdges(c), ChunkMembers(m) {}
+
+  void run(unsigned Chunk, unsigned Begin, unsigned End) {
+    for (unsigned i = Begin; i != End; ++i)
+      A.ResolveComplexWave(Nodes[i], Delta[Nodes[i]], ChunkEdges[Chunk],
+                           ChunkMembers[Chunk]);
+  }
+};
+
+/// SolveWave - Solve the constraint graph with the wave propagation solver.
+void Andersens::SolveWave() {
+  ThreadPool Pool(AndersThreads);
+  unsigned NumNodes = GraphNodes.size();
+  std::vector<PointsToSet > Delta(NumNodes);
+  std::vector<std::vector<unsigned> > Preds(NumNodes);
+  std::vector<unsigned> Depth(NumNodes, 0);
+  std::vector<unsigned> Topo;
+  bool Changed = true;
+
+  // Cycles are found by every round, so the offline HCD results are not
+  // needed; keep UniteNodes from merging anything outside the cycles found.
+  SDTActive = false;
+
+  while (Changed && !OutOfBudget()) {
+    ++Telemetry.NumRounds;
+    CollapseCyclesWave(Topo);
+
+    // Group the nodes by their depth in the now acyclic graph.
+    unsigned MaxDepth = 0;
+    for (unsigned i = 0, e = Topo.size(); i != e; ++i) {
+      unsigned N = Topo[i];
+      Preds[N].clear();
+      Depth[N] = 0;
+    }
+    for (unsigned i = 0, e = Topo.size(); i != e; ++i) {
+      unsigned N = Topo[i];
+      SparseBitVector<> *Edges = GraphNodes[N].Edges;
+      for (SparseBitVector<>::iterator bi = Edges->begin();
+           bi != Edges->end(); ++bi) {
+#if !FULL_UNIVERSAL
+        if (*bi < NumberSpecialNodes)
+          continue;
+#endif
+        Preds[*bi].push_back(N);
+        if (Depth[*bi] < Depth[N] + 1)
+          Depth[*bi] = Depth[N] + 1;
+      }
+      if (MaxDepth < Depth[N])
+        MaxDepth = Depth[N];
+    }
+    std::vector<std::vector<unsigned> > Levels(MaxDepth + 1);
+    for (unsigned i = 0, e = Topo.size(); i != e; ++i)
+      Levels[Depth[Topo[i]]].push_back(Topo[i]);
+
+    // Propagate the new points-to bits, one depth at a time.
+    for (unsigned i = 0; i <= MaxDepth; ++i) {
+      WavePropagateTask Propagate(*this, Levels[i], Preds, Delta);
+      Pool.run(Propagate, Levels[i].size(), WaveChunkSize);
+    }
+    if (SharingPointsTo)
+      for (unsigned i = 0, e = Topo.size(); i != e; ++i)
+        if (!Delta[Topo[i]].empty())
+          CommitWave(Topo[i], Delta[Topo[i]]);
+
+    // Resolve the complex constraints against the new bits.
+    std::vector<unsigned> Complex;
+    for (unsigned i = 0, e = Topo.size(); i != e; ++i) {
+      if (Delta[Topo[i]].empty())
+        continue;
+      ++Telemetry.NumPropagations;
+      if (GraphNodes[Topo[i]].ComplexHead != NoComplex)
+        Complex.push_back(Topo[i]);
+    }
+
+    unsigned NumChunks = ThreadPool::getNumChunks(Complex.size(),
+                                                  WaveChunkSize);
+    std::vector<std::vector<std::pair<unsigned, unsigned> > >
+      ChunkEdges(NumChunks), ChunkMembers(NumChunks);
+    WaveComplexTask Resolve(*this, Complex, Delta, ChunkEdges, ChunkMembers);
+    Pool.run(Resolve, Complex.size(), WaveChunkSize);
+
+    // Add the new edges in chunk order, so the result does not depend on
+    // which thread ran which chunk.  Each new edge carries the whole
+    // points-to set of its source; later bits follow it in the next rounds.
+    Changed = false;
+    for (unsigned c = 0, ce = ChunkEdges.size(); c != ce; ++c) {
+      std::vector<std::pair<unsigned, unsigned> > &Edges = ChunkEdges[c];
+      for (unsigned i = 0, e = Edges.size(); i != e; ++i) {
+        unsigned Src = FindNode(Edges[i].first);
+        unsigned Dest = FindNode(Edges[i].second);
+        if (GraphNodes[Src].Edges->test_and_set(Dest))
+          if (AddToPointsTo(&GraphNodes[Dest], *(GraphNodes[Src].PointsTo),
+                            GraphNodes[Src].PointsToID))
+            Changed = true;
+      }
+      // The members offset copies add are the next rounds' new bits.
+      std::vector<std::pair<unsigned, unsigned> > &Members = ChunkMembers[c];
+      for (unsigned i = 0, e = Members.size(); i != e; ++i) {
+        Node *Dest = &GraphNodes[FindNode(Members[i].first)];
+        if (!SharingPointsTo) {
+          if (Dest->PointsTo->test_and_set(Members[i].second))
+            Changed = true;
+        } else if (!Dest->PointsTo->test(Members[i].second)) {
+          PointsToSet Member;
+          Member.set(Members[i].second);
+          AddToPointsTo(Dest, Member, PointsToSets.intern(Member));
+          Changed = true;
+        }
+      }
+    }
+
+    for (unsigned i = 0, e = Topo.size(); i != e; ++i)
+      Delta[Topo[i]].clear();
+
+    // Free the shared sets the round left behind.
+    CompactPointsToSets();
+  }
+}
+
+//===----------------------------------------------------------------------===//
+//                         Shared Points-To Sets
+//===----------------------------------------------------------------------===//
+//
+// Many nodes end up with equal points-to sets, and the solver keeps forming
+// the same unions over and over.  With -anders-shared-sets, every points-to
+// set is interned in a PointsToSetPool once the solver starts: equal sets are
+// stored once, comparing two sets is comparing two IDs, and a repeated union
+// is a hash lookup.  The sets of the nodes then only change through the
+// helpers below, which work on both private and shared sets.
+//
+// Every union makes a new set, and the node that held the old one moves on,
+// so the pool would otherwise keep every intermediate set of the solve.  Both
+// solvers compact it between rounds once it has doubled since the last
+// compaction.
+
+// Sets the pool may grow by beyond twice its size after the last compaction
+// before it is compacted again.
+static const unsigned PoolCompactSlack = 1024;
+
+PointsToSetPool::PointsToSetPool()
+  : UnionHits(0), Bits(0), PeakBits(0), PeakSets(0), FreedSets(0),
+    FreedBits(0), Compactions(0) {
+  PointsToSet Empty;
+  intern(Empty);
+}
+
+PointsToSetPool::~PointsToSetPool() {
+  for (unsigned i = 0, e = Sets.size(); i != e; ++i)
+    delete Sets[i];
+}
+
+void PointsToSetPool::clear() {
+  for (unsigned i = 1, e = Sets.size(); i < e; ++i)
+    delete Sets[i];
+  Sets.resize(1);
+  IDs.clear();
+  IDs[Sets[0]] = 0;
+  Unions.clear();
+  UnionHits = 0;
+  Bits = PeakBits = FreedSets = FreedBits = 0;
+  PeakSets = 1;
+  Compactions = 0;
+}
+
+void PointsToSetPool::compact(const std::vector<bool> &Live,
+                              std::vector<unsigned> &Remap) {
+  Remap.assign(Sets.size(), ~0U);
+  unsigned Kept = 0;
+  for (unsigned i = 0, e = Sets.size(); i != e; ++i) {
+    if (i != 0 && !Live[i]) {
+      unsigned Count = Sets[i]->count();
+      Bits -= Count;
+      FreedBits += Count;
+      ++FreedSets;
+      delete Sets[i];
+      continue;
+    }
+    Remap[i] = Kept;
+    Sets[Kept++] = Sets[i];
+  }
+  Sets.resize(Kept);
+  IDs.clear();
+  for (unsigned i = 0; i != Kept; ++i)
+    IDs[Sets[i]] = i;
+
+  DenseMap<std::pair<unsigned, unsigned>, unsigned, UnionKeyInfo> Kept2;
+  for (DenseMap<std::pair<unsigned, unsigned>, unsigned,
+                UnionKeyInfo>::iterator I = Unions.begin(), E = Unions.end();
+       I != E; ++I) {
+    unsigned A = Remap[I->first.first], B = Remap[I->first.second];
+    unsigned C = Remap[I->second];
+    if (A != ~0U && B != ~0U && C != ~0U)
+      Kept2[std::make_pair(A, B)] = C;
+  }
+  Unions.swap(Kept2);
+  ++Compactions;
+}
+
+unsigned PointsToSetPool::intern(const PointsToSet &S) {
+  DenseMap<PointsToSet *, unsigned, BitmapKeyInfo>::iterator I =
+    IDs.find(const_cast<PointsToSet *>(&S));
+  if (I != IDs.end())
+    return I->second;
+
+  unsigned ID = Sets.size();
+  PointsToSet *Copy = new PointsToSet(S);
+  Sets.push_back(Copy);
+  IDs[Copy] = ID;
+  Bits += Copy->count();
+  PeakBits = std::max(PeakBits, Bits);
+  PeakSets = std::max(PeakSets, (unsigned) Sets.size());
+  return ID;
+}
+
+unsigned PointsToSetPool::getUnion(unsigned A, unsigned B) {
+  if (A == B || B == 0)
+    return A;
+  if (A == 0)
+    return B;
+
+  // Union is commutative, so only remember one order of the operands.
+  std::pair<unsigned, unsigned> Key = A < B ? std::make_pair(A, B)
+                                            : std::make_pair(B, A);
+  DenseMap<std::pair<unsigned, unsigned>, unsigned, UnionKeyInfo>::iterator I =
+    Unions.find(Key);
+  if (I != Unions.end()) {
+    ++UnionHits;
+    return I->second;
+  }
+
+  PointsToSet Result(*Sets[A]);
+  Result |= *Sets[B];
+  unsigned ID = intern(Result);
+  Unions[Key] = ID;
+  return ID;
+}
+
+/// SharePointsToSets - Move the points-to sets of all nodes into the pool.
+/// From here on the sets of the nodes are owned by PointsToSets.
+void Andersens::SharePointsToSets() {
+  for (unsigned i = 0; i < GraphNodes.size(); ++i) {
+    Node *N = &GraphNodes[i];
+    if (N->PointsTo) {
+      N->PointsToID = PointsToSets.intern(*(N->PointsTo));
+      delete N->PointsTo;
+      N->PointsTo = PointsToSets.get(N->PointsToID);
+    }
+    if (N->OldPointsTo) {
+      delete N->OldPointsTo;
+      N->OldPointsToID = 0;
+      N->OldPointsTo = PointsToSets.get(0);
+    }
+  }
+  SharingPointsTo = true;
+  PoolLiveSets = PointsToSets.getNumSets();
+}
+
+/// CompactPointsToSets - Free the pooled sets no node holds any longer, if
+/// the pool has doubled since it was last compacted.  Nothing may hold a
+/// set ID other than the nodes while this runs.
+void Andersens::CompactPointsToSets() {
+  if (!SharingPointsTo
+      || PointsToSets.getNumSets() < 2 * PoolLiveSets + PoolCompactSlack)
+    return;
+  std::vector<bool> Live(PointsToSets.getNumSets(), false);
+  for (unsigned i = 0; i < GraphNodes.size(); ++i) {
+    Node *N = &GraphNodes[i];
+    if (N->PointsTo)
+      Live[N->PointsToID] = true;
+    if (N->OldPointsTo)
+      Live[N->OldPointsToID] = true;
+  }
+  std::vector<unsigned> Remap;
+  PointsToSets.compact(Live, Remap);
   for (unsigned i = 0; i < GraphNodes.size(); ++i) {
     Node *N = &GraphNodes[i];
+    if (N->PointsTo)
+      N->PointsToID = Remap[N->PointsToID];
+    if (N->OldPointsTo)
+      N->OldPointsToID = Remap[N->OldPointsToID];
+  }
+  PoolLiveSets = PointsToSets.getNumSets();
+}
+
+/// AddToPointsTo - Add Bits to the points-to set of N, returning true if it
+/// changed.  BitsID is the ID of Bits in the pool, and is only used when the
+/// sets are shared.
+bool Andersens::AddToPointsTo(Node *N, const PointsToSet &Bits,
+                              unsigned BitsID) {
+  if (!SharingPointsTo)
+    return *(N->PointsTo) |= Bits;
+
+  unsigned ID = PointsToSets.getUnion(N->PointsToID, BitsID);
+  if (ID == N->PointsToID)
+    return false;
+  N->PointsToID = ID;
+  N->PointsTo = PointsToSets.get(ID);
+  return true;
+}
+
+/// MarkPropagated - Record that Bits, the new part of the points-to set of N,
+/// has been processed.
+void Andersens::MarkPropagated(Node *N, const PointsToSet &Bits) {
+  if (!SharingPointsTo) {
+    *(N->OldPointsTo) |= Bits;
+    return;
+  }
+  // OldPointsTo is always a subset of PointsTo, and Bits is the rest of it.
+  N->OldPointsToID = N->PointsToID;
+  N->OldPointsTo = N->PointsTo;
+}
+
+/// ResetOldPointsTo - Forget which part of the points-to set of N has been
+/// processed, so the whole set is propagated again.
+void Andersens::ResetOldPointsTo(Node *N) {
+  if (!SharingPointsTo) {
     delete N->OldPointsTo;
-    delete N->Edges;
+    N->OldPointsTo = new PointsToSet;
+    return;
   }
-  SDTActive = false;
-  SDT.clear();
+  N->OldPointsToID = 0;
+  N->OldPointsTo = PointsToSets.get(0);
+}
+
+/// ReleasePointsTo - Drop the points-to sets of N after it has been merged
+/// into another node.
+void Andersens::ReleasePointsTo(Node *N) {
+  if (!SharingPointsTo) {
+    delete N->OldPointsTo;
+    delete N->PointsTo;
+  }
+  N->PointsTo = NULL;
+  N->OldPointsTo = NULL;
+  N->PointsToID = 0;
+  N->OldPointsToID = 0;
+}
+
+//===----------------------------------------------------------------------===//
+//                              Telemetry
+//===----------------------------------------------------------------------===//
+//
+// Every phase of the pipeline is bracketed by BeginPhase and EndPhase, which
+// record its wall time, how much it grew the peak resident set, and how many
+// nodes and constraints it left.  The solvers add their own totals.
+
+static double getWallTime() {
+  struct timeval TV;
+  gettimeofday(&TV, 0);
+  return TV.tv_sec + TV.tv_usec / 1e6;
+}
+
+/// getPeakMemory - Return the peak resident set size of the process, in
+/// kilobytes.
+static long getPeakMemory() {
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage) != 0)
+    return 0;
+  return Usage.ru_maxrss;
+}
+
+void SolverTelemetry::clear() {
+  Phases.clear();
+  NumUnions = NumPropagations = NumPops = NumRounds = PointsToBits = 0;
+  ComplexRatio = AddressTakenRatio = OfflineTime = 0;
+  Decisions.clear();
+  Trials.clear();
+  PoolPeakSets = PoolSets = PoolCompactions = 0;
+  PoolPeakBits = PoolBits = 0;
+}
+
+/// getOfflinePassNames - Return the names of the OfflinePass bits of Passes,
+/// joined by '+'.
+static std::string getOfflinePassNames(unsigned Passes) {
+  static const char *const Names[] = { "HVN", "HU", "HCD" };
+  std::string Result;
+  for (unsigned i = 0; i != 3; ++i)
+    if (Passes & (1U << i)) {
+      if (!Result.empty())
+        Result += '+';
+      Result += Names[i];
+    }
+  return Result.empty() ? "none" : Result;
+}
+
+void SolverTelemetry::print(raw_ostream &OS) const {
+  // format takes at most five values, and no string literals.
+  OS << "Phase                  Wall (s)  Peak (KB)  Nodes in Nodes out"
+        "   Constr in  Constr out    Unions\n";
+  double Total = 0;
+  for (unsigned i = 0, e = Phases.size(); i != e; ++i) {
+    const SolverPhase &P = Phases[i];
+    OS << format("%-20s %10.3f %10ld %9u", P.Name, P.WallTime, P.PeakMemory,
+                 P.NodesBefore)
+       << format(" %9u %11u %11u %9u\n", P.NodesAfter, P.ConstraintsBefore,
+                 P.ConstraintsAfter, P.Unions);
+    Total += P.WallTime;
+  }
+  OS << "Total                " << format("%10.3f\n", Total);
+  OS << "Points-to sets: " << PointsToSetName << ", unions: " << NumUnions
+     << ", propagations: " << NumPropagations
+     << ", work list pops: " << NumPops << ", rounds: " << NumRounds
+     << ", points-to bits: " << PointsToBits << "\n";
+  if (PoolPeakSets)
+    OS << "Shared sets: " << PoolPeakSets << " sets of " << PoolPeakBits
+       << " bits at peak, " << PoolSets << " sets of " << PoolBits
+       << " bits at the end, " << PoolCompactions << " compactions\n";
+  if (!Decisions.empty()) {
+    OS << format("Offline passes (%.1f%% complex constraints, %.1f%% "
+                 "address-taken nodes, %.3f s):", ComplexRatio * 100,
+                 AddressTakenRatio * 100, OfflineTime);
+    for (unsigned i = 0, e = Decisions.size(); i != e; ++i) {
+      const OfflineDecision &D = Decisions[i];
+      OS << format("%s %s %s (cost %.3g, benefit %.3g)", i ? "," : "",
+                   D.Pass, D.Run ? "ran" : "skipped", D.Cost, D.Benefit);
+    }
+    OS << "\n";
+  }
+  if (!Trials.empty()) {
+    OS << "Offline trial        Offline (s)  Total (s)           Pops\n";
+    for (unsigned i = 0, e = Trials.size(); i != e; ++i) {
+      const OfflineTrial &T = Trials[i];
+      OS << format("%-20s %11.3f %10.3f %14llu\n",
+                   getOfflinePassNames(T.Passes).c_str(), T.OfflineTime,
+                   T.TotalTime, (unsigned long long)T.NumPops);
+    }
+  }
+}
+
+void SolverTelemetry::printJSON(raw_ostream &OS) const {
+  OS << "{\n  \"phases\": [";
+  for (unsigned i = 0, e = Phases.size(); i != e; ++i) {
+    const SolverPhase &P = Phases[i];
+    OS << (i ? ",\n" : "\n") << "    {\"name\": \"" << P.Name << "\", "
+       << "\"wall_time\": " << format("%.6f", P.WallTime) << ", "
+       << "\"peak_memory_kb\": " << P.PeakMemory << ", "
+       << "\"nodes_before\": " << P.NodesBefore << ", "
+       << "\"nodes_after\": " << P.NodesAfter << ", "
+       << "\"constraints_before\": " << P.ConstraintsBefore << ", "
+       << "\"constraints_after\": " << P.ConstraintsAfter << ", "
+       << "\"unions\": " << P.Unions << "}";
+  }
+  OS << "\n  ],\n"
+     << "  \"complex_ratio\": " << format("%.6f", ComplexRatio) << ",\n"
+     << "  \"address_taken_ratio\": " << format("%.6f", AddressTakenRatio)
+     << ",\n  \"offline_time\": " << format("%.6f", OfflineTime) << ",\n"
+     << "  \"offline_passes\": [";
+  for (unsigned i = 0, e = Decisions.size(); i != e; ++i) {
+    const OfflineDecision &D = Decisions[i];
+    OS << (i ? ",\n" : "\n") << "    {\"name\": \"" << D.Pass << "\", "
+       << "\"run\": " << (D.Run ? "true" : "false") << ", "
+       << "\"cost\": " << format("%.6g", D.Cost) << ", "
+       << "\"benefit\": " << format("%.6g", D.Benefit) << "}";
+  }
+  OS << "\n  ],\n  \"offline_trials\": [";
+  for (unsigned i = 0, e = Trials.size(); i != e; ++i) {
+    const OfflineTrial &T = Trials[i];
+    OS << (i ? ",\n" : "\n") << "    {\"passes\": \""
+       << getOfflinePassNames(T.Passes) << "\", "
+       << "\"offline_time\": " << format("%.6f", T.OfflineTime) << ", "
+       << "\"total_time\": " << format("%.6f", T.TotalTime) << ", "
+       << "\"worklist_pops\": " << T.NumPops << "}";
+  }
+  OS << "\n  ],\n"
+     << "  \"points_to_sets\": \"" << PointsToSetName << "\",\n"
+     << "  \"unions\": " << NumUnions << ",\n"
+     << "  \"propagations\": " << NumPropagations << ",\n"
+     << "  \"worklist_pops\": " << NumPops << ",\n"
+     << "  \"rounds\": " << NumRounds << ",\n"
+     << "  \"points_to_bits\": " << PointsToBits << ",\n"
+     << "  \"pool_peak_sets\": " << PoolPeakSets << ",\n"
+     << "  \"pool_peak_bits\": " << PoolPeakBits << ",\n"
+     << "  \"pool_sets\": " << PoolSets << ",\n"
+     << "  \"pool_bits\": " << PoolBits << ",\n"
+     << "  \"pool_compactions\": " << PoolCompactions << "\n}\n";
+}
+
+/// CountRepNodes - Return the number of representative nodes, leaving out
+/// the ref and adr nodes of the offline phases.
+unsigned Andersens::CountRepNodes() const {
+  unsigned E = FirstRefNode ? FirstRefNode : GraphNodes.size();
+  unsigned Count = 0;
+  for (unsigned i = 0; i < E; ++i)
+    if (GraphNodes[i].isRep())
+      ++Count;
+  return Count;
+}
+
+void Andersens::BeginPhase(const char *Name) {
+  SolverPhase P;
+  P.Name = Name;
+  P.WallTime = 0;
+  P.PeakMemory = 0;
+  P.NodesBefore = CountRepNodes();
+  P.NodesAfter = 0;
+  P.ConstraintsBefore = Constraints.size();
+  P.ConstraintsAfter = 0;
+  P.Unions = 0;
+  Telemetry.Phases.push_back(P);
+  PhaseStartUnions = Telemetry.NumUnions;
+  PhaseStartMemory = getPeakMemory();
+  PhaseStartTime = getWallTime();
+}
+
+void Andersens::EndPhase() {
+  SolverPhase &P = Telemetry.Phases.back();
+  P.WallTime = getWallTime() - PhaseStartTime;
+  P.PeakMemory = getPeakMemory() - PhaseStartMemory;
+  P.NodesAfter = CountRepNodes();
+  P.ConstraintsAfter = Constraints.size();
+  P.Unions = Telemetry.NumUnions - PhaseStartUnions;
+}
+
+/// OutOfBudget - Return true if Analyze has run for longer, or the process
+/// has grown larger, than the budget allows.  Once it has returned true it
+/// keeps doing so until the next run.
+bool Andersens::OutOfBudget() {
+  if (!OverBudget)
+    OverBudget = (AndersTimeBudget &&
+                  getWallTime() - BudgetStartTime > AndersTimeBudget) ||
+                 (AndersMemoryBudget &&
+                  getPeakMemory() > AndersMemoryBudget * 1024L);
+  return OverBudget;
 }
 
 //===----------------------------------------------------------------------===//
@@ -2106,6 +5404,7 @@ unsigned Andersens::UniteNodes(unsigned First, unsigned Second,
           "Trying to unite two non-representative nodes!");
   if (First == Second)
     return First;
+  ++Telemetry.NumUnions;
 
   if (UnionByRank) {
     int RankFirst  = (int) FirstNode ->NodeRep;
@@ -2126,24 +5425,25 @@ unsigned Andersens::UniteNodes(unsigned First, unsigned Second,
   if (First >= NumberSpecialNodes)
 #endif
   if (FirstNode->PointsTo && SecondNode->PointsTo)
-    FirstNode->PointsTo |= *(SecondNode->PointsTo);
+    AddToPointsTo(FirstNode, *(SecondNode->PointsTo), SecondNode->PointsToID);
   if (FirstNode->Edges && SecondNode->Edges)
     FirstNode->Edges |= *(SecondNode->Edges);
-  if (!SecondNode->Constraints.empty())
-    FirstNode->Constraints.splice(FirstNode->Constraints.begin(),
-                                  SecondNode->Constraints);
-  if (FirstNode->OldPointsTo) {
-    delete FirstNode->OldPointsTo;
-    FirstNode->OldPointsTo = new SparseBitVector<>;
+  // The frozen row of Second joins the edges First gained while solving.
+  if (!EdgeBegin.empty()) {
+    if (FirstNode->Edges)
+      for (unsigned i = EdgeBegin[Second], e = EdgeEnd[Second]; i != e; ++i)
+        FirstNode->Edges->set(EdgeTargets[i]);
+    NumOverflowEdges += EdgeEnd[Second] - EdgeBegin[Second];
+    EdgeEnd[Second] = EdgeBegin[Second];
   }
+  SpliceComplexConstraints(FirstNode, SecondNode);
+  if (FirstNode->OldPointsTo)
+    ResetOldPointsTo(FirstNode);
 
   // Destroy interesting parts of the merged-from node.
-  delete SecondNode->OldPointsTo;
   delete SecondNode->Edges;
-  delete SecondNode->PointsTo;
   SecondNode->Edges = NULL;
-  SecondNode->PointsTo = NULL;
-  SecondNode->OldPointsTo = NULL;
+  ReleasePointsTo(SecondNode);
 
   //DOUT << "Unified Node ";
   DEBUG(PrintNode(FirstNode));
@@ -2202,6 +5502,9 @@ void Andersens::PrintNode(const Node *N) const {
   } else if (N == &GraphNodes[NullObject]) {
     errs() << "<null>";
     return;
+  } else if (N == &GraphNodes[getSavedNode()]) {
+    errs() << "<saved>";
+    return;
   }
   if (!N->getValue()) {
     errs() << "artificial" << (intptr_t) N;
@@ -2283,7 +5586,7 @@ void Andersens::PrintPointsToGraph() const {
       errs() << "\t--> ";
 
       bool first = true;
-      for (SparseBitVector<>::iterator bi = N->PointsTo->begin();
+      for (PointsToSet::iterator bi = N->PointsTo->begin();
            bi != N->PointsTo->end();
            ++bi) {
         if (!first)
@@ -0,0 +1,120 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// The table of models of external functions used by Andersens.
+
+#include "../../include/ExternalModels.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/DerivedTypes.h"
+#include <fstream>
+
+/// isPointerArgument - Return true if CS has a pointer argument number Arg.
+static bool isPointerArgument(CallSite CS, unsigned Arg) {
+  return Arg < CS.arg_size() &&
+         isa<PointerType>(CS.getArgument(Arg)->getType());
+}
+
+bool ExternalModel::fits(CallSite CS) const {
+  switch (Effect) {
+  case ReturnsArg:
+  case SavesArg:
+    return isPointerArgument(CS, Arg0);
+  case CopiesThrough:
+    return isPointerArgument(CS, Arg0) && isPointerArgument(CS, Arg1);
+  default:
+    return true;
+  }
+}
+
+void ExternalModels::addBuiltins() {
+#define EXTERNAL_MODEL(Name, Effect, Arg0, Arg1) \
+  add(Name, ExternalModel(ExternalModel::Effect, Arg0, Arg1));
+#include "../../include/ExternalModels.def"
+}
+
+void ExternalModels::add(StringRef Name, const ExternalModel &Model) {
+  if (Name.endswith("*"))
+    Prefixes.push_back(std::make_pair(Name.substr(0, Name.size() - 1).str(),
+                                      Model));
+  else
+    Exact[Name] = Model;
+}
+
+/// parseEffect - Set Effect to the effect named Name, returning false if
+/// there is none.
+static bool parseEffect(StringRef Name, ExternalModel::EffectKind &Effect) {
+  if (Name == "no-effect")
+    Effect = ExternalModel::NoEffect;
+  else if (Name == "returns-arg")
+    Effect = ExternalModel::ReturnsArg;
+  else if (Name == "copies-through")
+    Effect = ExternalModel::CopiesThrough;
+  else if (Name == "allocates")
+    Effect = ExternalModel::Allocates;
+  else if (Name == "saves-arg")
+    Effect = ExternalModel::SavesArg;
+  else if (Name == "returns-saved")
+    Effect = ExternalModel::ReturnsSaved;
+  else
+    return false;
+  return true;
+}
+
+/// load - Each line of the file is empty, a comment starting with '#', or
+/// "name effect [arg0 [arg1]]", the effect being one of no-effect,
+/// returns-arg, copies-through, allocates, saves-arg and returns-saved.
+bool ExternalModels::load(const std::string &Path, std::string &Error) {
+  std::ifstream Input(Path.c_str());
+  if (!Input) {
+    Error = "cannot open " + Path;
+    return false;
+  }
+
+  std::string Line;
+  for (unsigned LineNo = 1; std::getline(Input, Line); ++LineNo) {
+    StringRef Text = StringRef(Line).split('#').first;
+    SmallVector<StringRef, 4> Fields;
+    SplitString(Text, Fields, " \t\r");
+    if (Fields.empty())
+      continue;
+
+    ExternalModel Model;
+    unsigned Args[2] = { 0, 0 };
+    bool Valid = Fields.size() >= 2 && Fields.size() <= 4
+        && parseEffect(Fields[1], Model.Effect);
+    for (unsigned i = 2; Valid && i < Fields.size(); ++i)
+      Valid = !Fields[i].getAsInteger(10, Args[i - 2]);
+    if (!Valid) {
+      Error = Path + ":" + utostr(LineNo) + ": malformed model";
+      return false;
+    }
+    Model.Arg0 = Args[0];
+    Model.Arg1 = Args[1];
+    add(Fields[0], Model);
+  }
+  return true;
+}
+
+const ExternalModel *ExternalModels::lookup(StringRef Name) const {
+  StringMap<ExternalModel>::const_iterator I = Exact.find(Name);
+  if (I != Exact.end())
+    return &I->second;
+  for (unsigned i = Prefixes.size(); i != 0; --i)
+    if (Name.startswith(Prefixes[i - 1].first))
+      return &Prefixes[i - 1].second;
+  return NULL;
+}
@@ -0,0 +1,436 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+#include "../../include/PointsToSet.h"
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+//                          Chunk Operations
+//===----------------------------------------------------------------------===//
+//
+// A chunk is 256 bits: one AVX2 register, two SSE2 registers, or four words.
+
+/// orChunk - Dst |= Src.  Returns true if Dst changed.
+static inline bool orChunk(uint64_t *Dst, const uint64_t *Src) {
+#if defined(__AVX2__)
+  __m256i D = _mm256_loadu_si256((const __m256i *) Dst);
+  __m256i R = _mm256_or_si256(D, _mm256_loadu_si256((const __m256i *) Src));
+  _mm256_storeu_si256((__m256i *) Dst, R);
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi8(R, D)) != -1;
+#elif defined(__SSE2__)
+  __m128i D0 = _mm_loadu_si128((const __m128i *) Dst);
+  __m128i D1 = _mm_loadu_si128((const __m128i *) (Dst + 2));
+  __m128i R0 = _mm_or_si128(D0, _mm_loadu_si128((const __m128i *) Src));
+  __m128i R1 = _mm_or_si128(D1, _mm_loadu_si128((const __m128i *) (Src + 2)));
+  _mm_storeu_si128((__m128i *) Dst, R0);
+  _mm_storeu_si128((__m128i *) (Dst + 2), R1);
+  return (_mm_movemask_epi8(_mm_cmpeq_epi8(R0, D0)) &
+          _mm_movemask_epi8(_mm_cmpeq_epi8(R1, D1))) != 0xFFFF;
+#else
+  uint64_t Changed = 0;
+  for (unsigned i = 0; i != HybridBitmap::ChunkWords; ++i) {
+    Changed |= Src[i] & ~Dst[i];
+    Dst[i] |= Src[i];
+  }
+  return Changed != 0;
+#endif
+}
+
+/// andChunk - Dst &= Src, or Dst &= ~Src if Complement is set.  Returns true
+/// if Dst still has bits set.
+static inline bool andChunk(uint64_t *Dst, const uint64_t *Src,
+                            bool Complement) {
+#if defined(__AVX2__)
+  __m256i D = _mm256_loadu_si256((const __m256i *) Dst);
+  __m256i S = _mm256_loadu_si256((const __m256i *) Src);
+  __m256i R = Complement ? _mm256_andnot_si256(S, D) : _mm256_and_si256(D, S);
+  _mm256_storeu_si256((__m256i *) Dst, R);
+  return !_mm256_testz_si256(R, R);
+#elif defined(__SSE2__)
+  __m128i D0 = _mm_loadu_si128((const __m128i *) Dst);
+  __m128i D1 = _mm_loadu_si128((const __m128i *) (Dst + 2));
+  __m128i S0 = _mm_loadu_si128((const __m128i *) Src);
+  __m128i S1 = _mm_loadu_si128((const __m128i *) (Src + 2));
+  __m128i R0 = Complement ? _mm_andnot_si128(S0, D0) : _mm_and_si128(D0, S0);
+  __m128i R1 = Complement ? _mm_andnot_si128(S1, D1) : _mm_and_si128(D1, S1);
+  _mm_storeu_si128((__m128i *) Dst, R0);
+  _mm_storeu_si128((__m128i *) (Dst + 2), R1);
+  __m128i Zero = _mm_setzero_si128();
+  return (_mm_movemask_epi8(_mm_cmpeq_epi8(R0, Zero)) &
+          _mm_movemask_epi8(_mm_cmpeq_epi8(R1, Zero))) != 0xFFFF;
+#else
+  uint64_t Any = 0;
+  for (unsigned i = 0; i != HybridBitmap::ChunkWords; ++i) {
+    Dst[i] &= Complement ? ~Src[i] : Src[i];
+    Any |= Dst[i];
+  }
+  return Any != 0;
+#endif
+}
+
+/// intersectsChunk - Return true if A and B have a bit in common.
+static inline bool intersectsChunk(const uint64_t *A, const uint64_t *B) {
+#if defined(__AVX2__)
+  return !_mm256_testz_si256(_mm256_loadu_si256((const __m256i *) A),
+                             _mm256_loadu_si256((const __m256i *) B));
+#else
+  uint64_t Any = 0;
+  for (unsigned i = 0; i != HybridBitmap::ChunkWords; ++i)
+    Any |= A[i] & B[i];
+  return Any != 0;
+#endif
+}
+
+static inline unsigned countChunk(const uint64_t *Words) {
+  unsigned Count = 0;
+  for (unsigned i = 0; i != HybridBitmap::ChunkWords; ++i)
+    Count += CountPopulation_64(Words[i]);
+  return Count;
+}
+
+static inline bool chunkLess(const HybridBitmap::Chunk &C, unsigned Index) {
+  return C.Index < Index;
+}
+
+//===----------------------------------------------------------------------===//
+//                             HybridBitmap
+//===----------------------------------------------------------------------===//
+
+/// findChunk - Return the position of the first chunk whose index is not
+/// less than Index.
+unsigned HybridBitmap::findChunk(unsigned Index) const {
+  return std::lower_bound(Chunks.begin(), Chunks.end(), Index, chunkLess)
+      - Chunks.begin();
+}
+
+/// toDense - Move the elements from Members into chunks.
+void HybridBitmap::toDense() {
+  Chunks.clear();
+  for (unsigned i = 0, e = Members.size(); i != e; ++i) {
+    unsigned Index = Members[i] / ChunkBits;
+    if (Chunks.empty() || Chunks.back().Index != Index) {
+      Chunk C;
+      C.Index = Index;
+      memset(C.Words, 0, sizeof(C.Words));
+      Chunks.push_back(C);
+    }
+    unsigned Bit = Members[i] % ChunkBits;
+    Chunks.back().Words[Bit / 64] |= 1ULL << (Bit % 64);
+  }
+  Members.clear();
+  Dense = true;
+}
+
+/// normalize - Move the elements of a dense set back into Members if there
+/// are few enough of them.
+void HybridBitmap::normalize() {
+  if (!Dense || Size > MaxMembers)
+    return;
+  Members.clear();
+  for (iterator I = begin(), E = end(); I != E; ++I)
+    Members.push_back(*I);
+  Chunks.clear();
+  Dense = false;
+}
+
+bool HybridBitmap::test(unsigned Idx) const {
+  if (!Dense)
+    return std::binary_search(Members.begin(), Members.end(), Idx);
+  unsigned Pos = findChunk(Idx / ChunkBits);
+  if (Pos == Chunks.size() || Chunks[Pos].Index != Idx / ChunkBits)
+    return false;
+  unsigned Bit = Idx % ChunkBits;
+  return (Chunks[Pos].Words[Bit / 64] >> (Bit % 64)) & 1;
+}
+
+void HybridBitmap::set(unsigned Idx) {
+  if (!Dense) {
+    std::vector<unsigned>::iterator I =
+      std::lower_bound(Members.begin(), Members.end(), Idx);
+    if (I != Members.end() && *I == Idx)
+      return;
+    Members.insert(I, Idx);
+    if (++Size > MaxMembers)
+      toDense();
+    return;
+  }
+
+  unsigned Pos = findChunk(Idx / ChunkBits);
+  if (Pos == Chunks.size() || Chunks[Pos].Index != Idx / ChunkBits) {
+    Chunk C;
+    C.Index = Idx / ChunkBits;
+    memset(C.Words, 0, sizeof(C.Words));
+    Chunks.insert(Chunks.begin() + Pos, C);
+  }
+  unsigned Bit = Idx % ChunkBits;
+  uint64_t &Word = Chunks[Pos].Words[Bit / 64];
+  uint64_t Mask = 1ULL << (Bit % 64);
+  if (!(Word & Mask)) {
+    Word |= Mask;
+    ++Size;
+  }
+}
+
+void HybridBitmap::reset(unsigned Idx) {
+  if (!Dense) {
+    std::vector<unsigned>::iterator I =
+      std::lower_bound(Members.begin(), Members.end(), Idx);
+    if (I != Members.end() && *I == Idx) {
+      Members.erase(I);
+      --Size;
+    }
+    return;
+  }
+
+  unsigned Pos = findChunk(Idx / ChunkBits);
+  if (Pos == Chunks.size() || Chunks[Pos].Index != Idx / ChunkBits)
+    return;
+  unsigned Bit = Idx % ChunkBits;
+  uint64_t &Word = Chunks[Pos].Words[Bit / 64];
+  uint64_t Mask = 1ULL << (Bit % 64);
+  if (!(Word & Mask))
+    return;
+  Word &= ~Mask;
+  --Size;
+  if (countChunk(Chunks[Pos].Words) == 0)
+    Chunks.erase(Chunks.begin() + Pos);
+  normalize();
+}
+
+bool HybridBitmap::operator|=(const HybridBitmap &RHS) {
+  if (this == &RHS || RHS.empty())
+    return false;
+
+  if (!RHS.Dense) {
+    bool Changed = false;
+    for (unsigned i = 0, e = RHS.Members.size(); i != e; ++i)
+      Changed |= test_and_set(RHS.Members[i]);
+    return Changed;
+  }
+
+  // A union with a dense set is dense.
+  if (!Dense)
+    toDense();
+  std::vector<Chunk> Result;
+  Result.reserve(Chunks.size() + RHS.Chunks.size());
+  bool Changed = false;
+  unsigned i = 0, j = 0;
+  Size = 0;
+  while (i != Chunks.size() || j != RHS.Chunks.size()) {
+    if (j == RHS.Chunks.size()
+        || (i != Chunks.size() && Chunks[i].Index < RHS.Chunks[j].Index)) {
+      Result.push_back(Chunks[i++]);
+    } else if (i == Chunks.size() || RHS.Chunks[j].Index < Chunks[i].Index) {
+      Result.push_back(RHS.Chunks[j++]);
+      Changed = true;
+    } else {
+      Result.push_back(Chunks[i++]);
+      Changed |= orChunk(Result.back().Words, RHS.Chunks[j++].Words);
+    }
+    Size += countChunk(Result.back().Words);
+  }
+  Chunks.swap(Result);
+  return Changed;
+}
+
+bool HybridBitmap::operator&=(const HybridBitmap &RHS) {
+  if (this == &RHS)
+    return false;
+  unsigned OldSize = Size;
+
+  if (!Dense || !RHS.Dense) {
+    // The result is no larger than the smaller set, which is an array.
+    const HybridBitmap &Small = Dense ? RHS : *this;
+    const HybridBitmap &Other = Dense ? *this : RHS;
+    std::vector<unsigned> Result;
+    for (unsigned i = 0, e = Small.Members.size(); i != e; ++i)
+      if (Other.test(Small.Members[i]))
+        Result.push_back(Small.Members[i]);
+    Members.swap(Result);
+    Chunks.clear();
+    Dense = false;
+    Size = Members.size();
+    return Size != OldSize;
+  }
+
+  std::vector<Chunk> Result;
+  unsigned i = 0, j = 0;
+  Size = 0;
+  while (i != Chunks.size() && j != RHS.Chunks.size()) {
+    if (Chunks[i].Index < RHS.Chunks[j].Index) {
+      ++i;
+    } else if (RHS.Chunks[j].Index < Chunks[i].Index) {
+      ++j;
+    } else {
+      Chunk C = Chunks[i++];
+      if (andChunk(C.Words, RHS.Chunks[j].Words, false)) {
+        Size += countChunk(C.Words);
+        Result.push_back(C);
+      }
+      ++j;
+    }
+  }
+  Chunks.swap(Result);
+  normalize();
+  return Size != OldSize;
+}
+
+/// subtract - Remove the elements of RHS, returning true if this changed.
+bool HybridBitmap::subtract(const HybridBitmap &RHS) {
+  unsigned OldSize = Size;
+  if (this == &RHS) {
+    clear();
+    return OldSize != 0;
+  }
+
+  if (!Dense) {
+    std::vector<unsigned> Result;
+    for (unsigned i = 0, e = Members.size(); i != e; ++i)
+      if (!RHS.test(Members[i]))
+        Result.push_back(Members[i]);
+    Members.swap(Result);
+    Size = Members.size();
+    return Size != OldSize;
+  }
+
+  if (!RHS.Dense) {
+    for (unsigned i = 0, e = RHS.Members.size(); i != e && Dense; ++i)
+      reset(RHS.Members[i]);
+    if (!Dense)
+      subtract(RHS);
+    return Size != OldSize;
+  }
+
+  std::vector<Chunk> Result;
+  Result.reserve(Chunks.size());
+  unsigned j = 0;
+  Size = 0;
+  for (unsigned i = 0, e = Chunks.size(); i != e; ++i) {
+    while (j != RHS.Chunks.size() && RHS.Chunks[j].Index < Chunks[i].Index)
+      ++j;
+    Chunk C = Chunks[i];
+    if (j != RHS.Chunks.size() && RHS.Chunks[j].Index == C.Index
+        && !andChunk(C.Words, RHS.Chunks[j].Words, true))
+      continue;
+    Size += countChunk(C.Words);
+    Result.push_back(C);
+  }
+  Chunks.swap(Result);
+  normalize();
+  return Size != OldSize;
+}
+
+void HybridBitmap::intersectWithComplement(const HybridBitmap &RHS1,
+                                           const HybridBitmap &RHS2) {
+  if (&RHS2 == this) {
+    HybridBitmap Copy(RHS2);
+    intersectWithComplement(RHS1, Copy);
+    return;
+  }
+  if (&RHS1 != this)
+    *this = RHS1;
+  subtract(RHS2);
+}
+
+bool HybridBitmap::intersects(const HybridBitmap &RHS) const {
+  if (empty() || RHS.empty())
+    return false;
+  if (!Dense || !RHS.Dense) {
+    const HybridBitmap &Small = Dense ? RHS : *this;
+    const HybridBitmap &Other = Dense ? *this : RHS;
+    for (unsigned i = 0, e = Small.Members.size(); i != e; ++i)
+      if (Other.test(Small.Members[i]))
+        return true;
+    return false;
+  }
+
+  unsigned i = 0, j = 0;
+  while (i != Chunks.size() && j != RHS.Chunks.size()) {
+    if (Chunks[i].Index < RHS.Chunks[j].Index)
+      ++i;
+    else if (RHS.Chunks[j].Index < Chunks[i].Index)
+      ++j;
+    else if (intersectsChunk(Chunks[i++].Words, RHS.Chunks[j++].Words))
+      return true;
+  }
+  return false;
+}
+
+bool HybridBitmap::operator==(const HybridBitmap &RHS) const {
+  if (Size != RHS.Size || Dense != RHS.Dense)
+    return false;
+  if (!Dense)
+    return Members == RHS.Members;
+  if (Chunks.size() != RHS.Chunks.size())
+    return false;
+  for (unsigned i = 0, e = Chunks.size(); i != e; ++i)
+    if (Chunks[i].Index != RHS.Chunks[i].Index
+        || memcmp(Chunks[i].Words, RHS.Chunks[i].Words,
+                  sizeof(Chunks[i].Words)) != 0)
+      return false;
+  return true;
+}
+
+unsigned HybridBitmap::getHashValue() const {
+  unsigned Hash = Size;
+  if (!Dense) {
+    for (unsigned i = 0, e = Members.size(); i != e; ++i)
+      Hash = Hash * 37U + Members[i];
+    return Hash;
+  }
+  for (unsigned i = 0, e = Chunks.size(); i != e; ++i) {
+    Hash = Hash * 37U + Chunks[i].Index;
+    for (unsigned w = 0; w != ChunkWords; ++w)
+      Hash = Hash * 37U + (unsigned) (Chunks[i].Words[w] ^
+                                      (Chunks[i].Words[w] >> 32));
+  }
+  return Hash;
+}
+
+/// advance - Move to the first element at or after the current position.
+void HybridBitmap::iterator::advance() {
+  if (!Set->Dense) {
+    if (Pos < Set->Members.size())
+      Value = Set->Members[Pos];
+    else
+      AtEnd = true;
+    return;
+  }
+
+  for (; Pos < Set->Chunks.size(); ++Pos, Bit = 0) {
+    const Chunk &C = Set->Chunks[Pos];
+    for (unsigned w = Bit / 64; w < ChunkWords; ++w) {
+      uint64_t Word = C.Words[w];
+      if (w == Bit / 64)
+        Word &= ~0ULL << (Bit % 64);
+      if (Word) {
+        Bit = w * 64 + CountTrailingZeros_64(Word);
+        Value = C.Index * ChunkBits + Bit;
+        return;
+      }
+    }
+  }
+  AtEnd = true;
+}
@@ -0,0 +1,434 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// This file implements Steensgaard's unification-based points-to analysis
+// described in Steens.h.
+//
+// Every pointer value V has a target class, the class of what V points to.
+// The statements of the program become unifications of target classes:
+//   p = &o           target(p) ~ o
+//   p = q            target(p) ~ target(q)
+//   p = *q           target(p) ~ pointee(target(q))
+//   *p = q           pointee(target(p)) ~ target(q)
+// A function is a location whose class has a signature: the classes its
+// return value and its arguments point to.  Calls unify the targets of the
+// actual arguments and of the result with the slots of the signature of what
+// the callee points to, so indirect calls need no special treatment.
+
+#define DEBUG_TYPE "steens-aa"
+#include "../../include/Steens.h"
+#include "llvm/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+const unsigned Steensgaard::None;
+
+//===----------------------------------------------------------------------===//
+//                              Union-Find
+//===----------------------------------------------------------------------===//
+
+unsigned Steensgaard::makeClass() {
+  Classes.push_back(Class());
+  return Classes.size() - 1;
+}
+
+unsigned Steensgaard::find(unsigned C) {
+  unsigned Root = C;
+  while (Classes[Root].Parent != None)
+    Root = Classes[Root].Parent;
+  while (C != Root) {
+    unsigned Next = Classes[C].Parent;
+    Classes[C].Parent = Root;
+    C = Next;
+  }
+  return Root;
+}
+
+/// unify - Merge C1 and C2, and then what they point to and their
+/// signatures, until the classes are consistent again.
+void Steensgaard::unify(unsigned C1, unsigned C2) {
+  if (C1 == None || C2 == None)
+    return;
+  Pending.push_back(std::make_pair(C1, C2));
+  while (!Pending.empty()) {
+    unsigned A = find(Pending.back().first);
+    unsigned B = find(Pending.back().second);
+    Pending.pop_back();
+    if (A == B)
+      continue;
+
+    if (Classes[A].Rank < Classes[B].Rank)
+      std::swap(A, B);
+    else if (Classes[A].Rank == Classes[B].Rank)
+      ++Classes[A].Rank;
+    Class &Rep = Classes[A];
+    Class &Other = Classes[B];
+    Other.Parent = A;
+    Rep.HasObjects |= Other.HasObjects;
+
+    if (Rep.Pointee == None)
+      Rep.Pointee = Other.Pointee;
+    else if (Other.Pointee != None)
+      Pending.push_back(std::make_pair(Rep.Pointee, Other.Pointee));
+
+    if (Rep.Signature == None) {
+      Rep.Signature = Other.Signature;
+    } else if (Other.Signature != None) {
+      std::vector<unsigned> &Slots = Signatures[Rep.Signature];
+      std::vector<unsigned> &OtherSlots = Signatures[Other.Signature];
+      if (Slots.size() < OtherSlots.size())
+        Slots.resize(OtherSlots.size(), None);
+      for (unsigned i = 0, e = OtherSlots.size(); i != e; ++i) {
+        if (Slots[i] == None)
+          Slots[i] = OtherSlots[i];
+        else if (OtherSlots[i] != None)
+          Pending.push_back(std::make_pair(Slots[i], OtherSlots[i]));
+      }
+      std::vector<unsigned>().swap(OtherSlots);
+    }
+  }
+}
+
+/// getPointee - Return the class the locations of C point to, making one if
+/// they do not point anywhere yet.
+unsigned Steensgaard::getPointee(unsigned C) {
+  if (C == None)
+    return None;
+  C = find(C);
+  if (Classes[C].Pointee == None) {
+    unsigned Pointee = makeClass();
+    Classes[C].Pointee = Pointee;
+  }
+  return Classes[C].Pointee;
+}
+
+/// getSlot - Return the class slot Slot of the signature of C points to:
+/// the return value for slot 0, and argument Slot - 1 otherwise.
+unsigned Steensgaard::getSlot(unsigned C, unsigned Slot) {
+  if (C == None)
+    return None;
+  C = find(C);
+  if (Classes[C].Signature == None) {
+    Classes[C].Signature = Signatures.size();
+    Signatures.push_back(std::vector<unsigned>());
+  }
+  unsigned Signature = Classes[C].Signature;
+  if (Signatures[Signature].size() <= Slot)
+    Signatures[Signature].resize(Slot + 1, None);
+  if (Signatures[Signature][Slot] == None) {
+    unsigned Target = makeClass();
+    Signatures[Signature][Slot] = Target;
+  }
+  return Signatures[Signature][Slot];
+}
+
+//===----------------------------------------------------------------------===//
+//                              Locations
+//===----------------------------------------------------------------------===//
+
+/// getObject - Return the class of the memory of the global, function or
+/// alloca V.
+unsigned Steensgaard::getObject(const Value *V) {
+  DenseMap<const Value *, unsigned>::iterator I = Objects.find(V);
+  if (I != Objects.end())
+    return I->second;
+  unsigned C = makeClass();
+  Classes[C].HasObjects = true;
+  Objects[V] = C;
+  return C;
+}
+
+/// getTarget - Return the class of what the pointer V points to, or None if
+/// it points nowhere.
+unsigned Steensgaard::getTarget(Value *V) {
+  if (Constant *C = dyn_cast<Constant>(V))
+    return getConstantTarget(C);
+
+  DenseMap<const Value *, unsigned>::iterator I = Targets.find(V);
+  if (I != Targets.end())
+    return I->second;
+  unsigned C = makeClass();
+  Targets[V] = C;
+  return C;
+}
+
+/// getConstantTarget - Return the class of what the constant pointer C
+/// points to, or None for the null pointer.
+unsigned Steensgaard::getConstantTarget(Constant *C) {
+  if (isa<ConstantPointerNull>(C) || isa<UndefValue>(C))
+    return None;
+  if (GlobalValue *GV = dyn_cast<GlobalValue>(C))
+    return getObject(GV);
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(C))
+    if (CE->getOpcode() == Instruction::GetElementPtr ||
+        CE->getOpcode() == Instruction::BitCast)
+      return getConstantTarget(CE->getOperand(0));
+  // Integers cast to pointers, and anything stranger, may point anywhere.
+  return Universal;
+}
+
+/// findTarget - Look up the class of what V points to, without adding one
+/// for a value other than a constant.  Returns false if V is a value the
+/// analysis has not seen.
+bool Steensgaard::findTarget(const Value *V, unsigned &C) {
+  if (const Constant *CV = dyn_cast<Constant>(V)) {
+    C = getConstantTarget(const_cast<Constant *>(CV));
+    return true;
+  }
+  DenseMap<const Value *, unsigned>::iterator I = Targets.find(V);
+  if (I == Targets.end())
+    return false;
+  C = I->second;
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+//                           Program Statements
+//===----------------------------------------------------------------------===//
+
+/// addInitializer - Unify what the memory Object points to with the
+/// pointers in its initializer C.
+void Steensgaard::addInitializer(unsigned Object, Constant *C) {
+  if (C->getType()->isSingleValueType()) {
+    if (isa<PointerType>(C->getType()))
+      unify(getPointee(Object), getConstantTarget(C));
+  } else if (!C->isNullValue() && !isa<UndefValue>(C)) {
+    for (unsigned i = 0, e = C->getNumOperands(); i != e; ++i)
+      addInitializer(Object, cast<Constant>(C->getOperand(i)));
+  }
+}
+
+/// addFunction - Tie the arguments of F to the slots of its signature, and
+/// unify the statements of its body.
+void Steensgaard::addFunction(Function *F) {
+  unsigned Object = getObject(F);
+  if (F->isDeclaration()) {
+    // External functions that return pointers return the universal class.
+    if (isa<PointerType>(F->getFunctionType()->getReturnType()))
+      unify(getSlot(Object, 0), Universal);
+    return;
+  }
+
+  // The arguments of a function that can be called from outside may point
+  // anywhere.
+  bool Escapes = !F->hasLocalLinkage() || F->hasAddressTaken();
+  unsigned Slot = 1;
+  for (Function::arg_iterator I = F->arg_begin(), E = F->arg_end(); I != E;
+       ++I, ++Slot)
+    if (isa<PointerType>(I->getType())) {
+      unsigned Target = getTarget(I);
+      unify(getSlot(Object, Slot), Target);
+      if (Escapes)
+        unify(Target, Universal);
+    }
+
+  visit(F);
+}
+
+/// addCall - Unify the actual arguments and the result of CS with the
+/// signature of what it calls.  Calls to external functions are ignored, as
+/// Andersens ignores them.
+void Steensgaard::addCall(CallSite CS) {
+  Function *F = CS.getCalledFunction();
+  if (F && F->isDeclaration()) {
+    const ExternalModel *Model = Models ? Models->lookup(F->getName()) : NULL;
+    if (Model && Model->fits(CS))
+      addExternalCall(CS, *Model);
+    return;
+  }
+
+  unsigned Callee = F ? getObject(F) : getTarget(CS.getCalledValue());
+  if (isa<PointerType>(CS.getType())) {
+    unsigned Result = getTarget(CS.getInstruction());
+    if (F && !isa<PointerType>(F->getFunctionType()->getReturnType()))
+      unify(Result, Universal);
+    else
+      unify(Result, getSlot(Callee, 0));
+  }
+
+  // Arguments beyond those of a direct callee are dropped on the floor.
+  unsigned NumSlots = F ? F->arg_size() : CS.arg_size();
+  unsigned Slot = 1;
+  for (CallSite::arg_iterator I = CS.arg_begin(), E = CS.arg_end();
+       I != E && Slot <= NumSlots; ++I, ++Slot)
+    if (isa<PointerType>((*I)->getType()))
+      unify(getSlot(Callee, Slot), getTarget(*I));
+}
+
+/// addExternalCall - Unify the classes the model of the external callee of CS
+/// connects.
+void Steensgaard::addExternalCall(CallSite CS, const ExternalModel &Model) {
+  Instruction *Call = CS.getInstruction();
+  bool PointerResult = isa<PointerType>(CS.getType());
+  switch (Model.Effect) {
+  case ExternalModel::NoEffect:
+    break;
+  case ExternalModel::ReturnsArg:
+    if (PointerResult)
+      unify(getTarget(Call), getTarget(CS.getArgument(Model.Arg0)));
+    break;
+  case ExternalModel::CopiesThrough: {
+    // Andersens also copies the source pointer into the destination, which
+    // unifies what they point to as well.
+    unsigned Dest = getTarget(CS.getArgument(Model.Arg0));
+    unify(Dest, getTarget(CS.getArgument(Model.Arg1)));
+    if (PointerResult)
+      unify(getTarget(Call), Dest);
+    break;
+  }
+  case ExternalModel::Allocates:
+    if (PointerResult)
+      unify(getTarget(Call), getObject(Call));
+    break;
+  case ExternalModel::SavesArg:
+    unify(getTarget(CS.getArgument(Model.Arg0)), Universal);
+    if (PointerResult)
+      unify(getTarget(Call), Universal);
+    break;
+  case ExternalModel::ReturnsSaved:
+    if (PointerResult)
+      unify(getTarget(Call), Universal);
+    break;
+  }
+}
+
+void Steensgaard::visitAllocaInst(AllocaInst &AI) {
+  unify(getTarget(&AI), getObject(&AI));
+}
+
+void Steensgaard::visitLoadInst(LoadInst &LI) {
+  if (isa<PointerType>(LI.getType()))
+    unify(getTarget(&LI), getPointee(getTarget(LI.getOperand(0))));
+}
+
+void Steensgaard::visitStoreInst(StoreInst &SI) {
+  if (isa<PointerType>(SI.getOperand(0)->getType()))
+    unify(getPointee(getTarget(SI.getOperand(1))),
+          getTarget(SI.getOperand(0)));
+}
+
+void Steensgaard::visitGetElementPtrInst(GetElementPtrInst &GEP) {
+  unify(getTarget(&GEP), getTarget(GEP.getOperand(0)));
+}
+
+void Steensgaard::visitPHINode(PHINode &PN) {
+  if (isa<PointerType>(PN.getType())) {
+    unsigned Target = getTarget(&PN);
+    for (unsigned i = 0, e = PN.getNumIncomingValues(); i != e; ++i)
+      unify(Target, getTarget(PN.getIncomingValue(i)));
+  }
+}
+
+void Steensgaard::visitCastInst(CastInst &CI) {
+  // Integers cast to pointers point nowhere, as in Andersens.
+  if (isa<PointerType>(CI.getType())) {
+    unsigned Target = getTarget(&CI);
+    if (isa<PointerType>(CI.getOperand(0)->getType()))
+      unify(Target, getTarget(CI.getOperand(0)));
+  }
+}
+
+void Steensgaard::visitSelectInst(SelectInst &SI) {
+  if (isa<PointerType>(SI.getType())) {
+    unsigned Target = getTarget(&SI);
+    unify(Target, getTarget(SI.getOperand(1)));
+    unify(Target, getTarget(SI.getOperand(2)));
+  }
+}
+
+void Steensgaard::visitReturnInst(ReturnInst &RI) {
+  if (RI.getNumOperands() && isa<PointerType>(RI.getOperand(0)->getType()))
+    unify(getSlot(getObject(RI.getParent()->getParent()), 0),
+          getTarget(RI.getOperand(0)));
+}
+
+// The analysis does not follow pointers through variable arguments or
+// aggregate values, so a pointer read from them may point anywhere, and a
+// pointer put into an aggregate may end up anywhere.
+void Steensgaard::visitVAArgInst(VAArgInst &VI) {
+  if (isa<PointerType>(VI.getType()))
+    unify(getTarget(&VI), Universal);
+}
+
+void Steensgaard::visitExtractValueInst(ExtractValueInst &EVI) {
+  if (isa<PointerType>(EVI.getType()))
+    unify(getTarget(&EVI), Universal);
+}
+
+void Steensgaard::visitInsertValueInst(InsertValueInst &IVI) {
+  Value *Inserted = IVI.getInsertedValueOperand();
+  if (isa<PointerType>(Inserted->getType()))
+    unify(getTarget(Inserted), Universal);
+}
+
+//===----------------------------------------------------------------------===//
+//                       AliasAnalysis Interface
+//===----------------------------------------------------------------------===//
+
+void Steensgaard::runOnModule() {
+  Classes.clear();
+  Signatures.clear();
+  Targets.clear();
+  Objects.clear();
+
+  Universal = makeClass();
+  Classes[Universal].Pointee = Universal;
+  Classes[Universal].HasObjects = true;
+
+  for (Module::global_iterator I = program->global_begin(),
+       E = program->global_end(); I != E; ++I) {
+    unsigned Object = getObject(I);
+    if (I->hasDefinitiveInitializer())
+      addInitializer(Object, I->getInitializer());
+    else
+      unify(getPointee(Object), Universal);
+  }
+
+  for (Module::iterator F = program->begin(), E = program->end(); F != E; ++F)
+    addFunction(F);
+
+  DEBUG(errs() << "Steensgaard: " << getNumClasses() << " classes for "
+               << Targets.size() << " pointers\n");
+}
+
+/// alias - Two pointers may alias if they point to the same class and the
+/// class holds some memory object.  Values the analysis has not seen may
+/// alias anything.
+aliasAnalysis::aliasResult Steensgaard::alias(const Value *V1, unsigned V1Size,
+                                              const Value *V2,
+                                              unsigned V2Size) {
+  unsigned T1, T2;
+  if (findTarget(V1, T1) && findTarget(V2, T2)) {
+    if (T1 == None || T2 == None)
+      return NoAlias;
+    T1 = find(T1);
+    if (T1 != find(T2) || !Classes[T1].HasObjects)
+      return NoAlias;
+  }
+
+  if (AA)
+    return AA->alias(V1, V1Size, V2, V2Size);
+  return MayAlias;
+}
+
+unsigned Steensgaard::getNumClasses() const {
+  unsigned Count = 0;
+  for (unsigned i = 0, e = Classes.size(); i != e; ++i)
+    if (Classes[i].Parent == None)
+      ++Count;
+  return Count;
+}
@@ -0,0 +1,136 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+#include "../../include/ThreadPool.h"
+#include <unistd.h>
+
+using namespace llvm;
+
+ThreadPool::ThreadPool(unsigned NumThreads)
+  : Current(0), NumItems(0), ChunkSize(1), NumChunks(0), NextChunk(0),
+    Generation(0), Active(0), ShuttingDown(false) {
+  if (NumThreads == 0)
+    NumThreads = getHardwareConcurrency();
+
+  pthread_mutex_init(&Lock, 0);
+  pthread_cond_init(&WorkReady, 0);
+  pthread_cond_init(&WorkDone, 0);
+
+  // The calling thread is the first member of the pool.
+  for (unsigned i = 1; i < NumThreads; ++i) {
+    pthread_t Thread;
+    if (pthread_create(&Thread, 0, workerMain, this) != 0)
+      break;
+    Workers.push_back(Thread);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  pthread_mutex_lock(&Lock);
+  ShuttingDown = true;
+  pthread_cond_broadcast(&WorkReady);
+  pthread_mutex_unlock(&Lock);
+
+  for (unsigned i = 0, e = Workers.size(); i != e; ++i)
+    pthread_join(Workers[i], 0);
+
+  pthread_cond_destroy(&WorkDone);
+  pthread_cond_destroy(&WorkReady);
+  pthread_mutex_destroy(&Lock);
+}
+
+unsigned ThreadPool::getHardwareConcurrency() {
+  long N = sysconf(_SC_NPROCESSORS_ONLN);
+  return N > 0 ? (unsigned) N : 1;
+}
+
+void *ThreadPool::workerMain(void *Pool) {
+  static_cast<ThreadPool*>(Pool)->workerLoop();
+  return 0;
+}
+
+void ThreadPool::workerLoop() {
+  unsigned SeenGeneration = 0;
+
+  pthread_mutex_lock(&Lock);
+  while (true) {
+    while (!ShuttingDown && Generation == SeenGeneration)
+      pthread_cond_wait(&WorkReady, &Lock);
+    if (ShuttingDown)
+      break;
+    SeenGeneration = Generation;
+    pthread_mutex_unlock(&Lock);
+
+    drain();
+
+    pthread_mutex_lock(&Lock);
+    if (--Active == 0)
+      pthread_cond_signal(&WorkDone);
+  }
+  pthread_mutex_unlock(&Lock);
+}
+
+/// drain - Claim and run chunks of the current loop until none are left.
+void ThreadPool::drain() {
+  while (true) {
+    unsigned Chunk = sys::AtomicIncrement(&NextChunk) - 1;
+    if (Chunk >= NumChunks)
+      return;
+    unsigned Begin = Chunk * ChunkSize;
+    unsigned End = Begin + ChunkSize;
+    if (End > NumItems)
+      End = NumItems;
+    Current->run(Chunk, Begin, End);
+  }
+}
+
+void ThreadPool::run(Task &T, unsigned Items, unsigned Size) {
+  if (Items == 0)
+    return;
+  if (Size == 0)
+    Size = 1;
+
+  unsigned Chunks = getNumChunks(Items, Size);
+
+  // Small loops are not worth waking anybody up for.
+  if (Workers.empty() || Chunks == 1) {
+    for (unsigned Chunk = 0; Chunk != Chunks; ++Chunk) {
+      unsigned Begin = Chunk * Size;
+      unsigned End = Begin + Size;
+      T.run(Chunk, Begin, End > Items ? Items : End);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&Lock);
+  Current = &T;
+  NumItems = Items;
+  ChunkSize = Size;
+  NumChunks = Chunks;
+  NextChunk = 0;
+  Active = Workers.size();
+  ++Generation;
+  pthread_cond_broadcast(&WorkReady);
+  pthread_mutex_unlock(&Lock);
+
+  drain();
+
+  pthread_mutex_lock(&Lock);
+  while (Active != 0)
+    pthread_cond_wait(&WorkDone, &Lock);
+  Current = 0;
+  pthread_mutex_unlock(&Lock);
+}
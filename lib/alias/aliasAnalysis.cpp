@@ -15,6 +15,12 @@
 // Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
 
 #include "../../include/aliasAnalysis.h"
+#include "llvm/Constants.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/Instructions.h"
+#include "llvm/Support/CallSite.h"
+#include <algorithm>
 
 
 aliasAnalysis::~aliasAnalysis() {}
@@ -23,3 +29,143 @@ void aliasAnalysis::runOnModule(){}
 
 aliasAnalysis::aliasResult aliasAnalysis::alias(const Value *V1, unsigned V1Size,
         const Value *V2, unsigned V2Size){return MayAlias;}
+
+aliasAnalysis::aliasResult aliasAnalysis::contextAlias(const Value *V1,
+        const Instruction *Context1, const Value *V2,
+        const Instruction *Context2){return alias(V1, V2);}
+
+void aliasAnalysis::contextAliasBatch(const Value *V1,
+        const Instruction *Context1, const std::vector<const Value*> &V2,
+        const Instruction *Context2, std::vector<aliasResult> &Results){
+  Results.resize(V2.size());
+  for (unsigned i = 0, e = V2.size(); i != e; ++i)
+    Results[i] = contextAlias(V1, Context1, V2[i], Context2);
+}
+
+bool aliasAnalysis::getPointsTo(const Value *V, const Instruction *Context,
+        std::vector<unsigned> &Objects){return false;}
+
+const Value *getAddressPath(const Value *V, std::vector<int64_t> &Path,
+                            const Instruction *Context) {
+  if (Context && !isa<CallInst>(Context) && !isa<InvokeInst>(Context))
+    Context = NULL;
+  Path.clear();
+  while (true) {
+    while (!Path.empty() && Path.back() == 0)
+      Path.pop_back();
+
+    const User *U = dyn_cast<User>(V);
+    unsigned Opcode = 0;
+    if (const Instruction *I = dyn_cast<Instruction>(V))
+      Opcode = I->getOpcode();
+    else if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(V))
+      Opcode = CE->getOpcode();
+
+    if (Opcode == Instruction::BitCast) {
+      // A cast below a getelementptr changes what its indices step over.
+      if (!Path.empty())
+        return NULL;
+      V = U->getOperand(0);
+    } else if (Opcode == Instruction::GetElementPtr) {
+      std::vector<int64_t> Indices;
+      for (unsigned i = 1, e = U->getNumOperands(); i != e; ++i) {
+        const ConstantInt *CI = dyn_cast<ConstantInt>(U->getOperand(i));
+        if (CI == NULL)
+          return NULL;
+        Indices.push_back(CI->getSExtValue());
+      }
+      // The first index of the outer getelementptr must not step past the
+      // object the inner one selects.
+      if (!Path.empty() && !Indices.empty()) {
+        if (Path[0] != 0)
+          return NULL;
+        Indices.insert(Indices.end(), Path.begin() + 1, Path.end());
+      } else if (Indices.empty()) {
+        Indices.swap(Path);
+      }
+      Path.swap(Indices);
+      V = U->getOperand(0);
+    } else if (Context && isa<Argument>(V)) {
+      CallSite CS(const_cast<Instruction*>(Context));
+      const Argument *A = cast<Argument>(V);
+      if (CS.getCalledFunction() != A->getParent())
+        return V;
+      Function::const_arg_iterator AI = A->getParent()->arg_begin();
+      CallSite::arg_iterator ArgI = CS.arg_begin();
+      for (; &*AI != A; ++AI)
+        ++ArgI;
+      // The value passed belongs to the caller, whose own arguments the
+      // call says nothing about.
+      V = *ArgI;
+      Context = NULL;
+    } else {
+      return V;
+    }
+  }
+}
+
+bool isPerInstanceObject(const Value *V) {
+  if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(V))
+    return GV->isThreadLocal();
+  return isa<AllocaInst>(V);
+}
+
+/// isPathInBounds - Return true if every index of Path after the first,
+/// which steps over whole objects, selects a field or an element within the
+/// bounds of an object of type T.  An index past the end of an array may
+/// land in whatever follows it.
+static bool isPathInBounds(const Type *T, const std::vector<int64_t> &Path) {
+  for (unsigned i = 1, e = Path.size(); i != e; ++i) {
+    if (const StructType *ST = dyn_cast<StructType>(T)) {
+      T = ST->getElementType(Path[i]);
+      continue;
+    }
+    uint64_t Size;
+    if (const ArrayType *AT = dyn_cast<ArrayType>(T))
+      Size = AT->getNumElements();
+    else if (const VectorType *VT = dyn_cast<VectorType>(T))
+      Size = VT->getNumElements();
+    else
+      return false;
+    if (Path[i] < 0 || (uint64_t) Path[i] >= Size)
+      return false;
+    T = cast<SequentialType>(T)->getElementType();
+  }
+  return true;
+}
+
+bool getPathAlias(const Value *V1, const Instruction *Context1,
+                  const Value *V2, const Instruction *Context2,
+                  aliasAnalysis::aliasResult &Result) {
+  std::vector<int64_t> Path1, Path2;
+  const Value *Base1 = getAddressPath(V1, Path1, Context1);
+  const Value *Base2 = getAddressPath(V2, Path2, Context2);
+  if (Base1 == NULL || Base2 == NULL)
+    return false;
+  if (!isa<GlobalVariable>(Base1) && !isa<AllocaInst>(Base1))
+    return false;
+  if (!isa<GlobalVariable>(Base2) && !isa<AllocaInst>(Base2))
+    return false;
+  if (Base1 != Base2) {
+    Result = aliasAnalysis::NoAlias;
+    return true;
+  }
+
+  if (Path1 == Path2) {
+    if (isPerInstanceObject(Base1))
+      return false;
+    Result = aliasAnalysis::MustAlias;
+    return true;
+  }
+  const Type *T = cast<PointerType>(Base1->getType())->getElementType();
+  if (Path1.empty() || Path2.empty() || Path1[0] != Path2[0]
+      || !isPathInBounds(T, Path1) || !isPathInBounds(T, Path2))
+    return false;
+  // One path may lead into the part the other one names.
+  for (unsigned i = 1, e = std::min(Path1.size(), Path2.size()); i != e; ++i)
+    if (Path1[i] != Path2[i]) {
+      Result = aliasAnalysis::NoAlias;
+      return true;
+    }
+  return false;
+}
@@ -15,12 +15,102 @@
 // Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
 
 #include "AliasAnalyzer.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
 #include <fstream>
 
 using namespace esp;
 
+#ifndef USE_ALIAS_FILE
+namespace {
+cl::opt<string>
+AliasSnapshot("alias-snapshot",
+              cl::desc("Read the points-to results from this snapshot, or "
+                       "re-solve from it and rewrite it if it is stale"),
+              cl::value_desc("file"), cl::init(""));
+
+enum StatsFormat{
+  NoStats, TableStats, JSONStats
+};
+
+cl::opt<StatsFormat>
+AliasStats("alias-stats",
+           cl::desc("Print what each phase of the Andersens solver cost:"),
+           cl::init(NoStats),
+           cl::values(
+             clEnumValN(NoStats, "none", "Nothing (default)"),
+             clEnumValN(TableStats, "table", "A table"),
+             clEnumValN(JSONStats, "json", "A JSON object"),
+             clEnumValEnd));
+
+cl::opt<string>
+AliasStatsFile("alias-stats-file",
+               cl::desc("Write -alias-stats to this file instead of standard "
+                        "error"),
+               cl::value_desc("file"), cl::init(""));
+
+cl::opt<unsigned>
+AliasCacheSize("alias-cache-size",
+               cl::desc("Largest number of alias answers to remember; "
+                        "beyond it, new answers replace old ones (0 = no "
+                        "limit)"),
+               cl::init(0));
+}
+
+static void printTelemetry(const SolverTelemetry &telemetry){
+  if(AliasStats == NoStats)
+    return;
+
+  raw_ostream *os = &errs();
+  raw_fd_ostream *file = NULL;
+  if(AliasStatsFile != ""){
+    string error;
+    file = new raw_fd_ostream(AliasStatsFile.c_str(), error);
+    if(!error.empty()){
+      cout<<"Alias statistics not written: "<<error<<endl;
+      delete file;
+      return;
+    }
+    os = file;
+  }
+
+  if(AliasStats == JSONStats)
+    telemetry.printJSON(*os);
+  else
+    telemetry.print(*os);
+  delete file;
+}
+#endif
+
+#ifndef USE_ALIAS_FILE
+static AliasResult toAliasResult(aliasAnalysis::aliasResult result){
+  switch(result){
+  case 0:    return NoAlias;
+  case 1:    return MayAlias;
+  case 2:    return MustAlias;
+  default:   return NoResult;
+  }
+}
+#endif
+
+#ifndef USE_ALIAS_FILE
+/*
+ * Answer the query of va and vb, vb taken in the call callb, by the path
+ * rule of getPathAlias, which the alias analyses follow too.  Returns
+ * NoResult if the rule tells nothing.
+ */
+static AliasResult prefilterAlias(const Value *va, const Value *vb,
+                                  Instruction *callb){
+  aliasAnalysis::aliasResult result;
+  if(!getPathAlias(va, NULL, vb, callb, result))
+    return NoResult;
+  return toAliasResult(result);
+}
+#endif
+
 AliasResult AliasSet::isAlias(Value *va, Value *vb, Function *fa, Function *fb){
   bool inA = false, inB = false;
   for(set<AliasValue*>::iterator it = aliasValues.begin();
@@ -67,14 +157,31 @@ void AliasSet::printAliasSet(){
 }
 #endif
 
-AliasAnalyzer::AliasAnalyzer(){ allTheSame = true; }
+AliasAnalyzer::AliasAnalyzer(){
+  allTheSame = true;
+#ifndef USE_ALIAS_FILE
+  aa = NULL;
+  pthread_mutex_init(&cacheLock, 0);
+  cacheHits = cacheMisses = prefilterHits = cacheEvictions = 0;
+  cacheHand = 0;
+#endif
+}
 
-AliasAnalyzer::AliasAnalyzer(bool isAllTheSame){ allTheSame = isAllTheSame; }
+AliasAnalyzer::AliasAnalyzer(bool isAllTheSame){
+  allTheSame = isAllTheSame;
+#ifndef USE_ALIAS_FILE
+  aa = NULL;
+  pthread_mutex_init(&cacheLock, 0);
+  cacheHits = cacheMisses = prefilterHits = cacheEvictions = 0;
+  cacheHand = 0;
+#endif
+}
 
 AliasAnalyzer::~AliasAnalyzer(){
 #ifndef USE_ALIAS_FILE
   delete aa;
   aa = NULL;
+  pthread_mutex_destroy(&cacheLock);
 #endif
 }
 
@@ -87,8 +194,37 @@ void AliasAnalyzer::run(string filePath){
 
 #else
 void AliasAnalyzer::run(Module *module){
-  aa = new Andersens(module);
-  aa->runOnModule();
+  aa = createAliasAnalysis(module);
+  clearCache();
+  lockOperands.clear();
+  lockIndex.clear();
+  unindexedLocks.clear();
+}
+
+aliasAnalysis *AliasAnalyzer::createAliasAnalysis(Module *module){
+  string error;
+  if(AliasSnapshot != ""){
+    SnapshotAA *snapshot = new SnapshotAA(module);
+    if(snapshot->open(AliasSnapshot, error))
+      return snapshot;
+    delete snapshot;
+    cout<<"Alias snapshot not used: "<<error<<endl;
+  }
+
+  Andersens *andersens = new Andersens(module);
+  if(AliasSnapshot != "")
+    andersens->setSnapshot(AliasSnapshot);
+  andersens->runOnModule();
+  if(AliasSnapshot != "" && andersens->getSnapshotError() != "")
+    cout<<"Alias snapshot not solved from, solving the whole program: "
+        <<andersens->getSnapshotError()<<endl;
+  printTelemetry(andersens->getTelemetry());
+  if(andersens->ranOutOfBudget())
+    cout<<"Andersens ran out of its budget, using Steensgaard's analysis"<<endl;
+
+  if(AliasSnapshot != "" && !andersens->writeSnapshot(AliasSnapshot, error))
+    cout<<"Alias snapshot not written: "<<error<<endl;
+  return andersens;
 }
 #endif
 
@@ -110,14 +246,248 @@ AliasResult AliasAnalyzer::isAlias(Value *va, Value *vb, Function *fa, Function
 #else
   if(va == NULL || vb == NULL )
     return NoResult;
-  aliasAnalysis::aliasResult result = aa->alias(va, vb);
-  switch(result){
-  case 0:    return NoAlias;
-  case 1:    return MayAlias;
-  case 2:    return MustAlias;
-  default:   return NoResult;
+  return cachedAlias(va, vb, NULL);
+
+#endif
+}
+
+AliasResult AliasAnalyzer::isAlias(Value *va, Value *vb, Function *fa,
+                                   Function *fb, Instruction *callb){
+#ifdef USE_ALIAS_FILE
+  return isAlias(va, vb, fa, fb);
+#else
+  if(va == NULL || vb == NULL )
+    return NoResult;
+  return cachedAlias(va, vb, callb);
+#endif
+}
+
+#ifndef USE_ALIAS_FILE
+/*
+ * The cache key of a query.  Without a call, the values are put in address
+ * order, as the answer does not depend on it.
+ */
+AliasAnalyzer::AliasQuery AliasAnalyzer::makeQuery(Value *va, Value *vb,
+                                                   Instruction *callb){
+  if(callb == NULL && vb < va)
+    std::swap(va, vb);
+  return AliasQuery(make_pair(va, vb), callb);
+}
+
+/*
+ * Set result to the cached answer of query and return true, or return
+ * false if it is not in the cache.  The caller holds cacheLock.
+ */
+bool AliasAnalyzer::lookup(const AliasQuery &query, AliasResult &result){
+  DenseMap<AliasQuery, unsigned>::iterator it = aliasCache.find(query);
+  if(it == aliasCache.end())
+    return false;
+  CacheEntry &entry = cacheEntries[it->second];
+  entry.referenced = true;
+  result = entry.result;
+  return true;
+}
+
+/*
+ * Add the answer of a query to the cache.  A query already there, as one
+ * asked twice in a batch is, keeps its slot.  If the cache is full, the
+ * answer replaces the first one the clock hand finds unread since its last
+ * pass.  The caller holds cacheLock.
+ */
+void AliasAnalyzer::remember(const AliasQuery &query, AliasResult result){
+  DenseMap<AliasQuery, unsigned>::iterator it = aliasCache.find(query);
+  if(it != aliasCache.end()){
+    cacheEntries[it->second].result = result;
+    return;
   }
 
+  unsigned slot;
+  if(AliasCacheSize == 0 || cacheEntries.size() < AliasCacheSize){
+    slot = cacheEntries.size();
+    cacheEntries.push_back(CacheEntry());
+  }else{
+    while(cacheEntries[cacheHand].referenced){
+      cacheEntries[cacheHand].referenced = false;
+      cacheHand = (cacheHand + 1) % cacheEntries.size();
+    }
+    slot = cacheHand;
+    cacheHand = (cacheHand + 1) % cacheEntries.size();
+    aliasCache.erase(cacheEntries[slot].query);
+    cacheEvictions++;
+  }
+  CacheEntry &entry = cacheEntries[slot];
+  entry.query = query;
+  entry.result = result;
+  entry.referenced = false;
+  aliasCache[query] = slot;
+}
+
+/*
+ * Forget every cached answer.
+ */
+void AliasAnalyzer::clearCache(){
+  aliasCache.clear();
+  vector<CacheEntry>().swap(cacheEntries);
+  cacheHand = 0;
+}
+
+AliasResult AliasAnalyzer::cachedAlias(Value *va, Value *vb,
+                                       Instruction *callb){
+  AliasQuery query = makeQuery(va, vb, callb);
+
+  pthread_mutex_lock(&cacheLock);
+  AliasResult result;
+  if(lookup(query, result)){
+    cacheHits++;
+  }else{
+    result = prefilterAlias(va, vb, callb);
+    if(result != NoResult)
+      prefilterHits++;
+    else if(callb == NULL){
+      cacheMisses++;
+      result = toAliasResult(aa->alias(va, vb));
+    }else{
+      cacheMisses++;
+      result = toAliasResult(aa->contextAlias(va, NULL, vb, callb));
+    }
+    remember(query, result);
+  }
+  pthread_mutex_unlock(&cacheLock);
+  return result;
+}
+#endif
+
+void AliasAnalyzer::isAliasBatch(Value *va, const vector<Value*> &vbs,
+                                 Function *fa, Function *fb,
+                                 Instruction *callb,
+                                 vector<AliasResult> &results){
+  results.assign(vbs.size(), NoResult);
+#ifdef USE_ALIAS_FILE
+  for(unsigned i = 0; i < vbs.size(); i++)
+    results[i] = isAlias(va, vbs[i], fa, fb, callb);
+#else
+  if(va == NULL)
+    return;
+
+  // The prefilter only answers for two paths into globals or allocas, so
+  // it is skipped for the whole batch unless va is one
+  vector<int64_t> path;
+  const Value *base = getAddressPath(va, path);
+  bool prefilter = base != NULL
+    && (isa<GlobalVariable>(base) || isa<AllocaInst>(base));
+
+  // The queries missing from the cache, and where their answers go
+  vector<const Value*> missed;
+  vector<unsigned> positions;
+  pthread_mutex_lock(&cacheLock);
+  for(unsigned i = 0; i < vbs.size(); i++){
+    if(vbs[i] == NULL)
+      continue;
+    if(lookup(makeQuery(va, vbs[i], callb), results[i])){
+      cacheHits++;
+    }else if(prefilter
+             && (results[i] = prefilterAlias(va, vbs[i], callb))
+             != NoResult){
+      prefilterHits++;
+      remember(makeQuery(va, vbs[i], callb), results[i]);
+    }else{
+      missed.push_back(vbs[i]);
+      positions.push_back(i);
+    }
+  }
+
+  if(!missed.empty()){
+    vector<aliasAnalysis::aliasResult> answers;
+    aa->contextAliasBatch(va, NULL, missed, callb, answers);
+    cacheMisses += missed.size();
+    for(unsigned i = 0; i < positions.size(); i++){
+      unsigned position = positions[i];
+      results[position] = toAliasResult(answers[i]);
+      remember(makeQuery(va, vbs[position], callb), results[position]);
+    }
+  }
+  pthread_mutex_unlock(&cacheLock);
+#endif
+}
+
+void AliasAnalyzer::addLockOperand(Value *v, Instruction *callb){
+  if(v == NULL)
+    return;
+#ifdef USE_ALIAS_FILE
+  lockOperands[callb].insert(v);
+#else
+  pthread_mutex_lock(&cacheLock);
+  if(lockOperands[callb].insert(v).second){
+    vector<unsigned> objects;
+    if(aa->getPointsTo(v, callb, objects)){
+      for(vector<unsigned>::iterator it = objects.begin();
+          it != objects.end(); it++)
+        lockIndex[make_pair(callb, *it)].push_back(v);
+    }else
+      unindexedLocks[callb].push_back(v);
+  }
+  pthread_mutex_unlock(&cacheLock);
+#endif
+}
+
+void AliasAnalyzer::getLockAliases(Value *va, Function *fa, Function *fb,
+                                   Instruction *callb, AliasResult accuracy,
+                                   set<Value*> &aliases){
+  if(va == NULL)
+    return;
+
+  vector<Value*> candidates;
+  vector<unsigned> objects;
+#ifndef USE_ALIAS_FILE
+  pthread_mutex_lock(&cacheLock);
+#endif
+  map<Instruction*, set<Value*> >::iterator operands =
+    lockOperands.find(callb);
+  if(operands != lockOperands.end()){
+#ifndef USE_ALIAS_FILE
+    if(accuracy > NoAlias && aa->getPointsTo(va, NULL, objects)){
+      for(vector<unsigned>::iterator it = objects.begin();
+          it != objects.end(); it++){
+        DenseMap<pair<Instruction*, unsigned>, vector<Value*> >::iterator
+          entry = lockIndex.find(make_pair(callb, *it));
+        if(entry != lockIndex.end())
+          candidates.insert(candidates.end(), entry->second.begin(),
+                            entry->second.end());
+      }
+      map<Instruction*, vector<Value*> >::iterator unindexed =
+        unindexedLocks.find(callb);
+      if(unindexed != unindexedLocks.end())
+        candidates.insert(candidates.end(), unindexed->second.begin(),
+                          unindexed->second.end());
+    }else
+#endif
+      candidates.assign(operands->second.begin(), operands->second.end());
+  }
+#ifndef USE_ALIAS_FILE
+  pthread_mutex_unlock(&cacheLock);
+#endif
+
+  // An operand pointing to several objects of va is a candidate only once
+  sort(candidates.begin(), candidates.end());
+  candidates.erase(unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+  vector<AliasResult> results;
+  isAliasBatch(va, candidates, fa, fb, callb, results);
+  for(unsigned i = 0; i < candidates.size(); i++)
+    if(results[i] >= accuracy)
+      aliases.insert(candidates[i]);
+}
+
+void AliasAnalyzer::printCacheStats(){
+#ifndef USE_ALIAS_FILE
+  if(AliasStats == NoStats)
+    return;
+  pthread_mutex_lock(&cacheLock);
+  cout<<"Alias queries: "<<cacheHits<<" from the cache, "<<prefilterHits
+      <<" by the prefilter, "<<cacheMisses<<" by the analysis, "
+      <<aliasCache.size()<<" answers kept, "<<cacheEvictions<<" evicted"
+      <<endl;
+  pthread_mutex_unlock(&cacheLock);
 #endif
 }
 
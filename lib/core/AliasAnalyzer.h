@@ -22,10 +22,15 @@
 
 #include "aliasAnalysis.h"
 #include "Anders.h"
+#include "AliasSnapshot.h"
 #include "llvm/Value.h"
 #include "llvm/Function.h"
+#include "llvm/ADT/DenseMap.h"
+#include <pthread.h>
+#include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 using namespace llvm;
 using namespace std;
@@ -68,6 +73,21 @@ private:
 
   bool allTheSame;
 
+  /*
+   * Lock operands added with addLockOperand, by the call they are taken in,
+   * or NULL.
+   */
+  map<Instruction*, set<Value*> > lockOperands;
+
+  /*
+   * The inverted index of the lock operands: for a call and an abstract
+   * object, the operands taken in the call that may point to the object.
+   * Operands the analysis cannot describe by their objects are kept in
+   * unindexedLocks instead and always checked.
+   */
+  DenseMap<pair<Instruction*, unsigned>, vector<Value*> > lockIndex;
+  map<Instruction*, vector<Value*> > unindexedLocks;
+
 #ifdef USE_ALIAS_FILE
 
   set<AliasSet*> aliasSets;
@@ -78,6 +98,45 @@ private:
 
   aliasAnalysis *aa;
 
+  /*
+   * Answers of the queries asked so far, by the two values and the call the
+   * second one is taken in.  Queries without a call are stored with the
+   * lower address first, as their answer does not depend on the order.
+   * cacheLock guards the cache, its counters, the lock operand index and
+   * aa, so that the executors of different functions can share one
+   * analyzer.
+   *
+   * The answers are kept in cacheEntries, and aliasCache maps each query to
+   * its entry.  Once -alias-cache-size answers are kept, a new one takes the
+   * entry of an old one chosen by the clock algorithm: cacheHand goes round
+   * the entries, clearing the referenced mark of those read since it last
+   * passed them and stopping at the first without one.
+   */
+  typedef pair<pair<const Value*, const Value*>, const Instruction*>
+    AliasQuery;
+  struct CacheEntry{
+    AliasQuery query;
+    AliasResult result;
+    bool referenced;
+  };
+  DenseMap<AliasQuery, unsigned> aliasCache;
+  vector<CacheEntry> cacheEntries;
+  unsigned cacheHand;
+  pthread_mutex_t cacheLock;
+  unsigned long cacheHits;
+  unsigned long cacheMisses;
+  // Answers dropped to make room for newer ones
+  unsigned long cacheEvictions;
+  // Queries missing from the cache that the casts and constant
+  // getelementptrs of the two values answered, without the analysis
+  unsigned long prefilterHits;
+
+  AliasResult cachedAlias(Value *va, Value *vb, Instruction *callb);
+  static AliasQuery makeQuery(Value *va, Value *vb, Instruction *callb);
+  bool lookup(const AliasQuery &query, AliasResult &result);
+  void remember(const AliasQuery &query, AliasResult result);
+  void clearCache();
+
 #endif
 
 public:
@@ -96,8 +155,59 @@ public:
 
   AliasResult isAlias(Value *va, Value*vb, Function *fa, Function *fb);
 
+  /*
+   * Like isAlias, but vb is only considered in the call callb to fb, which
+   * tells the calls of a lock wrapper apart when Andersens clones them.
+   */
+  AliasResult isAlias(Value *va, Value*vb, Function *fa, Function *fb,
+                      Instruction *callb);
+
+  /*
+   * Set results[i] to isAlias(va, vbs[i], fa, fb, callb) for every value of
+   * vbs.  The address path of va is taken once for the prefilter, and the
+   * queries not in the cache go to the alias analysis together, which looks
+   * va up only once.
+   */
+  void isAliasBatch(Value *va, const vector<Value*> &vbs, Function *fa,
+                    Function *fb, Instruction *callb,
+                    vector<AliasResult> &results);
+
+  /*
+   * Add the lock operand v, taken in the call callb if it is not NULL, to
+   * the operands getLockAliases looks among.  Adding it again does nothing.
+   */
+  void addLockOperand(Value *v, Instruction *callb);
+
+  /*
+   * Insert into aliases the lock operands added for callb whose isAlias
+   * result with va, the operands being values of fb, is at least accuracy.
+   * Only the operands that point to an object va points to are checked, so
+   * the cost follows the size of the answer rather than the number of
+   * operands.
+   */
+  void getLockAliases(Value *va, Function *fa, Function *fb,
+                      Instruction *callb, AliasResult accuracy,
+                      set<Value*> &aliases);
+
+  /*
+   * Print how many queries were answered from the cache, by the prefilter
+   * and by the analysis, and how many answers the cache dropped, if
+   * -alias-stats is set.
+   */
+  void printCacheStats();
+
 #ifdef USE_ALIAS_FILE
   void printAliasSets();
+#else
+  /*
+   * Create the alias analysis of module. If -alias-snapshot names a snapshot
+   * taken from this module it is used as is, otherwise Andersens is run and
+   * its result is saved to that snapshot.  -alias-stats prints what each
+   * phase of Andersens cost.  If Andersens runs out of its
+   * -anders-time-budget or -anders-memory-budget, the queries are answered
+   * by Steensgaard's analysis instead and no snapshot is saved.
+   */
+  static aliasAnalysis *createAliasAnalysis(Module *module);
 #endif
 
 };
@@ -1059,56 +1059,57 @@ void esp::Executor::findLockPattern(Function *function){
   assert(cdg != NULL);
   cdg->printCDG();
 
-  // Get lock instruction
+  // Get lock and unlock instruction
   set<CallInst*> lockCalls;
+  vector<CallInst*> unlockCalls;
+  vector<Value*> unlockVariables;
   for(set<Instruction*>::iterator it = returnValues.begin();
       it != returnValues.end(); it++){
     CallInst *callInst = dyn_cast<CallInst>(*it);
     if(callInst->getCalledFunction()->getNameStr() == "pthread_mutex_lock"){
       lockCalls.insert(callInst);
+    }else if(callInst->getCalledFunction()->getNameStr()
+             == "pthread_mutex_unlock"){
+      unlockCalls.push_back(callInst);
+      unlockVariables.push_back(callInst->getOperand(1));
     }
   }
   cout<<"lock call size: "<<lockCalls.size()<<endl;
 
   // Begin to find lock pattern
+  vector<AliasResult> results;
   for(set<CallInst*>::iterator it = lockCalls.begin();
       it != lockCalls.end(); it++){
     CallInst *lockInst = *it;
+    Value *lockVariable = lockInst->getOperand(1);
 
-    for(set<Instruction*>::iterator itt = returnValues.begin();
-        itt != returnValues.end(); itt++){
+    // Each lock variable is checked against every unlock variable at once
+    aliasAnalyzer.isAliasBatch(lockVariable, unlockVariables, function,
+                               function, NULL, results);
 
-      CallInst *unlockInst = dyn_cast<CallInst>(*itt);
+    for(unsigned i = 0; i < unlockCalls.size(); i++){
+      CallInst *unlockInst = unlockCalls[i];
 
-      // Find unlock instruction
-      if(unlockInst->getCalledFunction()->getNameStr() == "pthread_mutex_unlock"){
+      // Pattern should only exist within a pair of lock and unlock instruction
+      // with the same lock variable
+      if(results[i] == ALIAS_ACCURACY){
 
-        Value *lockVariable = lockInst->getOperand(1);
-        Value *unlockVariable = unlockInst->getOperand(1);
+        // Compute the control dependency node of the two instructions
+        BasicBlock *lockDependency = cdg->dependences[lockInst->getParent()];
+        BasicBlock *unlockDependency = cdg->dependences[unlockInst->getParent()];
 
-        // Pattern should only exist within a pair of lock and unlock instruction
-        // with the same lock variable
-        if(aliasAnalyzer.isAlias(lockVariable, unlockVariable, function, function)
-            == ALIAS_ACCURACY){
-
-          // Compute the control dependency node of the two instructions
-          BasicBlock *lockDependency = cdg->dependences[lockInst->getParent()];
-          BasicBlock *unlockDependency = cdg->dependences[unlockInst->getParent()];
-
-          if(lockInst->getParent() == unlockInst->getParent()){ // lock..unlock pattern
-            statistic.getLocal()->directLockNumber ++;
-          }
-          else if( lockDependency == unlockDependency ){  // lock..unlock pattern
-            statistic.getLocal()->directLockNumber ++;
-          }
-          else if(lockDependency != unlockDependency){ // if..lock..if..unlock pattern
-            statistic.getLocal()->ifLockNumber ++;
-          }
-          else{
-            cout<<"haha"<<endl;
-          }
+        if(lockInst->getParent() == unlockInst->getParent()){ // lock..unlock pattern
+          statistic.getLocal()->directLockNumber ++;
+        }
+        else if( lockDependency == unlockDependency ){  // lock..unlock pattern
+          statistic.getLocal()->directLockNumber ++;
+        }
+        else if(lockDependency != unlockDependency){ // if..lock..if..unlock pattern
+          statistic.getLocal()->ifLockNumber ++;
+        }
+        else{
+          cout<<"haha"<<endl;
         }
-
       }
     }
   }
@@ -136,6 +136,22 @@ void IntraExecutor::run() {
       fs->localLockNumber++;
   }
 
+  // Index the lock operands of the callees in each call to them
+  for (set<Instruction*>::iterator rit = returnValues.begin();
+      rit != returnValues.end(); rit++) {
+    CallInst *callInst = (CallInst*) (*rit);
+    string name = callInst->getCalledFunction()->getNameStr();
+    if (name == "pthread_mutex_lock" || name == "pthread_mutex_unlock")
+      continue;
+    FunctionStatistic *callS =
+        ms->functionStatistics[callInst->getCalledFunction()];
+    if (callS == NULL)
+      continue;
+    for (map<Value*, LockData*>::iterator vit = callS->locks.begin();
+        vit != callS->locks.end(); vit++)
+      aa->addLockOperand((*vit).first, callInst);
+  }
+
   for (set<Value*>::iterator lit = locks.begin(); lit != locks.end(); lit++) {
     if ((*lit) != NULL) {
       currentLock = (*lit);
@@ -159,10 +175,14 @@ void IntraExecutor::run() {
         if (name != "pthread_mutex_lock" && name != "pthread_mutex_unlock") {
           FunctionStatistic *callS =
               ms->functionStatistics[callInst->getCalledFunction()];
-          for (map<Value*, LockData*>::iterator vit = callS->locks.begin();
-              vit != callS->locks.end(); vit++) {
-            if (aa->isAlias(currentLock, (*vit).first, function,
-                callInst->getCalledFunction()) >= INTER_ALIAS_ACCURACY) {
+          set<Value*> aliases;
+          aa->getLockAliases(currentLock, function,
+              callInst->getCalledFunction(), NULL, INTER_ALIAS_ACCURACY,
+              aliases);
+          for (set<Value*>::iterator ait = aliases.begin();
+              ait != aliases.end(); ait++) {
+            map<Value*, LockData*>::iterator vit = callS->locks.find(*ait);
+            if (vit != callS->locks.end()) {
               isInter = true;
               if (maxDeep < (*vit).second->callDeep) {
                 maxDeep = (*vit).second->callDeep;
@@ -264,9 +284,12 @@ void IntraExecutor::buildUDChains() {
     //The first operand is the name of the function
     //printDebugMsg("insert lock: "+callinst->getOperand(0)->getNameStr());
     bool shouldInsert = true;
-    for (set<Value*>::iterator itt = locks.begin(); itt != locks.end(); itt++) {
-      if (aa->isAlias((*itt), callinst->getOperand(0), function,
-          function) >= INTER_ALIAS_ACCURACY) {
+    set<Value*> aliases;
+    aa->getLockAliases(callinst->getOperand(0), function, function, NULL,
+        INTER_ALIAS_ACCURACY, aliases);
+    for (set<Value*>::iterator itt = aliases.begin(); itt != aliases.end();
+        itt++) {
+      if (locks.find(*itt) != locks.end()) {
         shouldInsert = false;
         if (callinst->getNameStr() == "pthread_mutex_lock") {
           lockNumbers[(*itt)]++;
@@ -288,6 +311,7 @@ void IntraExecutor::buildUDChains() {
         lockNumbers[callinst->getOperand(0)] = 0;
       }
       locks.insert(callinst->getOperand(0));
+      aa->addLockOperand(callinst->getOperand(0), NULL);
 
       // Get look type
       Value *parent = (*it);
@@ -382,13 +406,16 @@ void IntraExecutor::findLockPattern() {
             if (!ms->functionStatistics[callInst->getCalledFunction()]->isUnlockWrapper()) {
               FunctionStatistic *callS =
                   ms->functionStatistics[callInst->getCalledFunction()];
+              set<Value*> aliases;
+              aa->getLockAliases(currentLock, function,
+                  callInst->getCalledFunction(), callInst,
+                  INTER_ALIAS_ACCURACY, aliases);
               Value *lockVariable;
-              for (map<Value*, LockData*>::iterator iul = callS->locks.begin();
-                  iul != callS->locks.end(); iul++) {
-                lockVariable = (*iul).first;
+              for (set<Value*>::iterator iul = aliases.begin();
+                  iul != aliases.end(); iul++) {
+                lockVariable = (*iul);
                 // Consider lock wrapper function only
-                if (aa->isAlias(currentLock, lockVariable, function,
-                    callInst->getCalledFunction()) >= INTER_ALIAS_ACCURACY
+                if (callS->locks.find(lockVariable) != callS->locks.end()
                     && callS->locks[lockVariable]->isLockWrapper) {
                   lastLockCall = callInst;
                   lockInsts.push(callInst);
@@ -528,15 +555,18 @@ void IntraExecutor::findLockPattern() {
 
             FunctionStatistic *callS =
                 ms->functionStatistics[callInst->getCalledFunction()];
+            set<Value*> aliases;
+            aa->getLockAliases(currentLock, function,
+                callInst->getCalledFunction(), callInst,
+                INTER_ALIAS_ACCURACY, aliases);
             Value *unlockVariable;
-            for (map<Value*, LockData*>::iterator iul = callS->locks.begin();
-                iul != callS->locks.end(); iul++) {
-              unlockVariable = (*iul).first;
+            for (set<Value*>::iterator iul = aliases.begin();
+                iul != aliases.end(); iul++) {
+              unlockVariable = (*iul);
               // Pattern should only exist within a pair of lock and unlock instruction
               // with the same lock variable
               // Here consider unlock wrapper function only
-              if (aa->isAlias(currentLock, unlockVariable, function,
-                  callInst->getCalledFunction()) >= INTER_ALIAS_ACCURACY
+              if (callS->locks.find(unlockVariable) != callS->locks.end()
                   && callS->locks[unlockVariable]->isUnlockWrapper) {
                 bool isOtherPattern = true;
 
@@ -781,6 +811,7 @@ void InterExecutor::run(Module *module) {
     intraExecutor.run();
     workList.pop_back();
   }
+  aliasAnalyzer->printCacheStats();
 
   // Output the result
   statistic->printStatistic();
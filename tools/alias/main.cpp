@@ -116,8 +116,7 @@ int main(int argc, char ** argv) {
 		} else {
 			// TODO: do something here
 
-			aliasAnalysis * AA = new Andersens(mainModule);
-			AA->runOnModule();
+			aliasAnalysis * AA = AliasAnalyzer::createAliasAnalysis(mainModule);
 
 
 			errs() << "Commencing Module************" << "\n";
@@ -0,0 +1,65 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// The benchmarks of anders-bench.  Each one reads its own options and
+// prints a table of its timings; it returns the exit status of the tool.
+
+#ifndef ANDERSBENCH_BENCH_H_
+#define ANDERSBENCH_BENCH_H_
+
+#include <stdint.h>
+#include <sys/time.h>
+
+/// runSCCBench - Time the cycle searches of HVN, HU, HCD and the lazy cycle
+/// detection of Andersens on generated modules with deep copy chains, on a
+/// small stack.
+int runSCCBench();
+
+/// runSetBench - Time the set operations of the solver and the alias
+/// queries on SparseBitVector and HybridBitmap, on generated sets.
+int runSetBench();
+
+/// runSolveBench - Time the solve of a module, and alias queries on it,
+/// with the points-to sets the tree was built with.
+int runSolveBench();
+
+/// getWallTime - Return the wall clock time, in seconds.
+inline double getWallTime() {
+	struct timeval TV;
+	gettimeofday(&TV, 0);
+	return TV.tv_sec + TV.tv_usec / 1e6;
+}
+
+/// BenchRandom - A small deterministic generator, so that every run of a
+/// benchmark sees the same inputs for the same seed.
+class BenchRandom {
+	uint64_t State;
+
+public:
+	explicit BenchRandom(uint64_t Seed) :
+			State(Seed * 2862933555777941757ULL + 3037000493ULL) {
+	}
+
+	/// next - Return a number below Bound.
+	unsigned next(unsigned Bound) {
+		State ^= State << 13;
+		State ^= State >> 7;
+		State ^= State << 17;
+		return (unsigned) ((State >> 11) % Bound);
+	}
+};
+
+#endif /* ANDERSBENCH_BENCH_H_ */
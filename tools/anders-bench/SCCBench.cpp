@@ -0,0 +1,189 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// The cycle searches of Andersens, run on modules with deep copy chains.
+//
+// HVN, HU, HCD's Search and the lazy cycle detection's QueryNode are depth
+// first searches of the constraint graph, and each walks a chain of copies
+// as deep as the chain.  Every generated module is one function whose
+// values %v0 to %vN copy each other in a chain that a load and a store
+// through @g close into a cycle: offline the cycle runs through the node of
+// *@g, which HCD finds, and online through the object of @g, which the lazy
+// cycle detection finds.  Andersens analyzes each module once with only HVN,
+// only HU, only HCD, and no offline pass, so that each search sees the
+// whole chain, and the time of the phase that runs it is printed.  The
+// analysis runs on a thread with a -scc-stack kilobyte stack, far less than
+// a recursive search of these chains needs: a search that recursed would
+// overflow it and kill the benchmark.
+
+#include "Bench.h"
+#include "../../include/Anders.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#include "llvm/ValueSymbolTable.h"
+#include "llvm/Assembly/Parser.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstring>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+cl::list<unsigned>
+SCCChains("scc-chains", cl::CommaSeparated,
+		cl::desc("Lengths of the copy chains of the generated modules "
+				"(default 100000,1000000)"));
+
+cl::opt<unsigned>
+SCCStack("scc-stack", cl::init(512),
+		cl::desc("Stack of the analysis, in kilobytes"));
+
+/// SearchRun - The offline passes of one analysis, and the phase that runs
+/// the search it times.
+struct SearchRun {
+	const char *Name;
+	unsigned Passes;
+	const char *Phase;
+};
+
+const SearchRun SearchRuns[] = {
+	{ "HVN", OfflineHVN, "HVN" },
+	{ "HU", OfflineHU, "HU" },
+	{ "HCD", OfflineHCD, "HCD" },
+	{ "LCD", 0, "SolveWorkList" } };
+
+/// AnalysisRun - The arguments and the results of an analysis run on its
+/// own thread.
+struct AnalysisRun {
+	Module *M;
+	std::string Last;
+	unsigned Passes;
+	const char *Phase;
+	double PhaseTime;
+	double TotalTime;
+	// Objects the last value of the chain points to.
+	std::vector<unsigned> PointsTo;
+};
+}
+
+/// getLastValue - Return the name of the last value of a copy chain of
+/// Length values.
+static std::string getLastValue(unsigned Length) {
+	std::string Name;
+	raw_string_ostream OS(Name);
+	OS << "v" << (Length ? Length - 1 : 0);
+	return OS.str();
+}
+
+/// buildModule - Return the text of a module whose copy chain has Length
+/// values.
+static std::string buildModule(unsigned Length) {
+	std::string Text;
+	raw_string_ostream OS(Text);
+	OS << "declare i8* @malloc(i64)\n" << "@g = global i8* null\n"
+			<< "define void @chain() {\n" << "entry:\n"
+			<< "  %m = call i8* @malloc(i64 8)\n"
+			<< "  store i8* %m, i8** @g\n" << "  %v0 = load i8** @g\n";
+	for (unsigned i = 1; i < Length; ++i)
+		OS << "  %v" << i << " = bitcast i8* %v" << i - 1 << " to i8*\n";
+	OS << "  store i8* %" << getLastValue(Length) << ", i8** @g\n"
+			<< "  ret void\n" << "}\n";
+	return OS.str();
+}
+
+static void *runAnalysis(void *Arg) {
+	AnalysisRun *Run = (AnalysisRun *) Arg;
+	Andersens *AA = new Andersens(Run->M);
+	AA->setOfflinePasses(Run->Passes);
+	AA->setWaveSolver(false);
+	AA->runOnModule();
+	const SolverTelemetry &T = AA->getTelemetry();
+	for (unsigned i = 0, e = T.Phases.size(); i != e; ++i) {
+		const SolverPhase &P = T.Phases[i];
+		Run->TotalTime += P.WallTime;
+		if (!strcmp(P.Name, Run->Phase))
+			Run->PhaseTime += P.WallTime;
+	}
+	Function *F = Run->M->getFunction("chain");
+	AA->getPointsTo(F->getValueSymbolTable().lookup(Run->Last), 0,
+			Run->PointsTo);
+	delete AA;
+	return NULL;
+}
+
+/// runOnSmallStack - Analyze the module of Run on a thread with a stack of
+/// -scc-stack kilobytes.  Returns false if the thread could not be made.
+static bool runOnSmallStack(AnalysisRun &Run) {
+	pthread_attr_t Attr;
+	pthread_t Thread;
+	pthread_attr_init(&Attr);
+	pthread_attr_setstacksize(&Attr, (size_t) SCCStack << 10);
+	bool Started = pthread_create(&Thread, &Attr, runAnalysis, &Run) == 0;
+	pthread_attr_destroy(&Attr);
+	if (Started)
+		pthread_join(Thread, NULL);
+	return Started;
+}
+
+int runSCCBench() {
+	std::vector<unsigned> Lengths(SCCChains.begin(), SCCChains.end());
+	if (Lengths.empty()) {
+		Lengths.push_back(100000);
+		Lengths.push_back(1000000);
+	}
+
+	outs() << "Chain      Search         Phase   Phase (s)   Total (s)\n";
+	int Status = 0;
+	unsigned NumRuns = sizeof(SearchRuns) / sizeof(SearchRuns[0]);
+	for (unsigned i = 0, e = Lengths.size(); i != e; ++i) {
+		std::string Text = buildModule(Lengths[i]);
+		SMDiagnostic Err;
+		Module *M = ParseAssemblyString(Text.c_str(), 0, Err,
+				getGlobalContext());
+		if (!M) {
+			Err.Print("anders-bench", errs());
+			return 1;
+		}
+		for (unsigned r = 0; r != NumRuns; ++r) {
+			AnalysisRun Run = { M, getLastValue(Lengths[i]),
+					SearchRuns[r].Passes, SearchRuns[r].Phase, 0, 0,
+					std::vector<unsigned>() };
+			if (!runOnSmallStack(Run)) {
+				errs() << "anders-bench: cannot start a thread with a "
+						<< SCCStack << " KB stack\n";
+				delete M;
+				return 1;
+			}
+			outs() << format("%-10u %-6s %13s %11.3f %11.3f\n", Lengths[i],
+					SearchRuns[r].Name, SearchRuns[r].Phase, Run.PhaseTime,
+					Run.TotalTime);
+			// Whatever the searches united, the chain holds the malloc alone.
+			if (Run.PointsTo.size() != 1) {
+				errs() << "anders-bench: with " << SearchRuns[r].Name
+						<< " the chain points to " << Run.PointsTo.size()
+						<< " objects\n";
+				Status = 1;
+			}
+		}
+		delete M;
+	}
+	return Status;
+}
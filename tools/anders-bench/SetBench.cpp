@@ -0,0 +1,160 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// The operations the solver and the alias queries spend their time in, on
+// both points-to set backends.
+//
+// HybridBitmap is built whichever type PointsToSet is, so one binary times
+// both.  For every shape of set, -set-count random sets are made, once per
+// backend, and each operation runs over consecutive pairs of them: union
+// into a copy (a propagation), intersects (an alias query),
+// intersectWithComplement (the new bits of a node), membership tests, and
+// a walk of the elements.  A checksum of the results must come out the same
+// for both backends.
+
+#include "Bench.h"
+#include "../../include/PointsToSet.h"
+#include "llvm/ADT/SparseBitVector.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+cl::opt<unsigned>
+SetCount("set-count", cl::init(1000),
+		cl::desc("Sets of every shape in the set benchmark"));
+
+cl::opt<unsigned>
+SetRepeat("set-repeat", cl::init(10),
+		cl::desc("Passes of every operation over the sets"));
+
+cl::opt<unsigned>
+SetSeed("set-seed", cl::init(1), cl::desc("Seed of the generated sets"));
+}
+
+namespace {
+/// SetShape - How the members of the generated sets are drawn: Members of
+/// them, from a range of Universe elements starting at a random multiple of
+/// Universe.  A small universe makes dense sets.
+struct SetShape {
+	const char *Name;
+	unsigned Members;
+	unsigned Universe;
+};
+
+const SetShape Shapes[] = { { "small", 4, 1 << 20 }, { "medium", 64, 1 << 16 },
+		{ "dense", 1500, 4096 }, { "large", 5000, 1 << 20 } };
+
+enum SetOperation {
+	UnionOp, IntersectsOp, DifferenceOp, TestOp, IterateOp, NumOperations
+};
+
+const char *const OperationNames[NumOperations] = { "union", "intersects",
+		"difference", "test", "iterate" };
+
+/// SetTimes - The time each operation took, in nanoseconds per pair of sets,
+/// and the checksum of the results.
+struct SetTimes {
+	double Time[NumOperations];
+	uint64_t Checksum;
+};
+}
+
+/// makeMembers - Fill Members with the members of -set-count sets of
+/// shape S.
+static void makeMembers(const SetShape &S,
+		std::vector<std::vector<unsigned> > &Members) {
+	BenchRandom Random(SetSeed);
+	Members.assign(SetCount, std::vector<unsigned>());
+	for (unsigned i = 0; i != SetCount; ++i) {
+		unsigned Base = Random.next(16) * S.Universe;
+		for (unsigned j = 0; j != S.Members; ++j)
+			Members[i].push_back(Base + Random.next(S.Universe));
+	}
+}
+
+/// timeSets - Time the operations on sets of type Set with the given
+/// members.
+template<typename Set>
+static SetTimes timeSets(const std::vector<std::vector<unsigned> > &Members) {
+	unsigned N = Members.size();
+	std::vector<Set> Sets(N);
+	for (unsigned i = 0; i != N; ++i)
+		for (unsigned j = 0, e = Members[i].size(); j != e; ++j)
+			Sets[i].set(Members[i][j]);
+
+	SetTimes Times;
+	Times.Checksum = 0;
+	for (unsigned Op = 0; Op != NumOperations; ++Op) {
+		double Start = getWallTime();
+		for (unsigned r = 0; r != SetRepeat; ++r)
+			for (unsigned i = 0; i != N; ++i) {
+				const Set &A = Sets[i];
+				const Set &B = Sets[(i + r + 1) % N];
+				switch (Op) {
+				case UnionOp: {
+					Set Copy(A);
+					Times.Checksum += (Copy |= B);
+					break;
+				}
+				case IntersectsOp:
+					Times.Checksum += A.intersects(B);
+					break;
+				case DifferenceOp: {
+					Set Diff;
+					Diff.intersectWithComplement(A, B);
+					Times.Checksum += Diff.count();
+					break;
+				}
+				case TestOp:
+					for (unsigned j = 0, e = Members[i].size(); j != e; ++j)
+						Times.Checksum += B.test(Members[i][j]);
+					break;
+				case IterateOp:
+					for (typename Set::iterator I = A.begin(), E = A.end();
+							I != E; ++I)
+						Times.Checksum += *I;
+					break;
+				}
+			}
+		Times.Time[Op] = (getWallTime() - Start) * 1e9 / (SetRepeat * N);
+	}
+	return Times;
+}
+
+int runSetBench() {
+	outs() << "Shape      Operation   Sparse (ns)  Hybrid (ns)  Speedup\n";
+	int Status = 0;
+	for (unsigned s = 0; s != sizeof(Shapes) / sizeof(Shapes[0]); ++s) {
+		std::vector<std::vector<unsigned> > Members;
+		makeMembers(Shapes[s], Members);
+		SetTimes Sparse = timeSets<SparseBitVector<> >(Members);
+		SetTimes Hybrid = timeSets<HybridBitmap>(Members);
+		for (unsigned Op = 0; Op != NumOperations; ++Op)
+			outs() << format("%-10s %-12s", Shapes[s].Name, OperationNames[Op])
+					<< format(" %11.0f %12.0f %8.2fx\n", Sparse.Time[Op],
+							Hybrid.Time[Op], Sparse.Time[Op] / Hybrid.Time[Op]);
+		if (Sparse.Checksum != Hybrid.Checksum) {
+			errs() << "anders-bench: the backends disagree on the "
+					<< Shapes[s].Name << " sets\n";
+			Status = 1;
+		}
+	}
+	return Status;
+}
@@ -0,0 +1,179 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// The whole analysis on a module: the time of the solve, and the throughput
+// of alias queries on its answers, for the points-to set backend the tree
+// was built with (HYBRID_POINTS_TO).  Comparing the backends takes a build
+// of each, run on the same module.
+//
+// The queries are the pairs of pointer operands of the lock calls, as the
+// lock alias sets are built, asked one at a time and then as one batch per
+// operand, and random pairs of pointer values of the module, drawn with
+// -solve-seed.
+
+#include "Bench.h"
+#include "../../include/Anders.h"
+#include "../../include/PointsToSet.h"
+#include "llvm/Module.h"
+#include "llvm/Instructions.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InstIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+cl::opt<std::string>
+SolveInput("solve-input", cl::desc("Bitcode of the solve benchmark"),
+		cl::value_desc("filename"));
+
+cl::opt<unsigned>
+SolveRuns("solve-runs", cl::init(3),
+		cl::desc("Solves of the module, the fastest is reported"));
+
+cl::opt<unsigned>
+SolveQueries("solve-queries", cl::init(1000000),
+		cl::desc("Random alias queries after the solve"));
+
+cl::opt<unsigned>
+SolveSeed("solve-seed", cl::init(1), cl::desc("Seed of the random queries"));
+}
+
+/// collectPointers - Fill Pointers with the pointer values of M, and Locks
+/// with the pointer operands of its calls of pthread_mutex_lock and
+/// pthread_mutex_unlock.
+static void collectPointers(Module &M, std::vector<const Value*> &Pointers,
+		std::vector<const Value*> &Locks) {
+	for (Module::global_iterator I = M.global_begin(), E = M.global_end();
+			I != E; ++I)
+		Pointers.push_back(I);
+	for (Module::iterator F = M.begin(), FE = M.end(); F != FE; ++F) {
+		for (Function::arg_iterator I = F->arg_begin(), E = F->arg_end();
+				I != E; ++I)
+			if (isa<PointerType>(I->getType()))
+				Pointers.push_back(I);
+		for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+			if (isa<PointerType>(I->getType()))
+				Pointers.push_back(&*I);
+			if (!isa<CallInst>(&*I) && !isa<InvokeInst>(&*I))
+				continue;
+			CallSite CS(&*I);
+			Function *Callee = CS.getCalledFunction();
+			if (!Callee || CS.arg_size() == 0
+					|| !isa<PointerType>(CS.getArgument(0)->getType()))
+				continue;
+			if (Callee->getName() == "pthread_mutex_lock"
+					|| Callee->getName() == "pthread_mutex_unlock")
+				Locks.push_back(CS.getArgument(0));
+		}
+	}
+}
+
+int runSolveBench() {
+	if (SolveInput.empty()) {
+		errs() << "anders-bench: -bench=solve needs -solve-input\n";
+		return 1;
+	}
+	std::string ErrorMsg;
+	Module *M = 0;
+	MemoryBuffer *Buffer = MemoryBuffer::getFileOrSTDIN(SolveInput, &ErrorMsg);
+	if (Buffer) {
+		M = getLazyBitcodeModule(Buffer, getGlobalContext(), &ErrorMsg);
+		if (!M)
+			delete Buffer;
+	}
+	if (M && M->MaterializeAllPermanently(&ErrorMsg)) {
+		delete M;
+		M = 0;
+	}
+	if (!M) {
+		errs() << "anders-bench: " << SolveInput << ": " << ErrorMsg << "\n";
+		return 1;
+	}
+
+	double SolveTime = 0;
+	Andersens *AA = 0;
+	for (unsigned r = 0; r != SolveRuns; ++r) {
+		delete AA;
+		AA = new Andersens(M);
+		double Start = getWallTime();
+		AA->runOnModule();
+		double Time = getWallTime() - Start;
+		if (r == 0 || Time < SolveTime)
+			SolveTime = Time;
+	}
+
+	std::vector<const Value*> Pointers, Locks;
+	collectPointers(*M, Pointers, Locks);
+
+	// The lock operands, each against every other, as the lock alias sets
+	// are built.
+	unsigned LockAliases = 0, LockQueries = 0;
+	double Start = getWallTime();
+	for (unsigned i = 0, e = Locks.size(); i != e; ++i)
+		for (unsigned j = i + 1; j != e; ++j, ++LockQueries)
+			LockAliases += AA->alias(Locks[i], Locks[j])
+					!= aliasAnalysis::NoAlias;
+	double LockTime = getWallTime() - Start;
+
+	// The same pairs again, each operand against all the later ones at once.
+	unsigned BatchAliases = 0;
+	std::vector<aliasAnalysis::aliasResult> Results;
+	Start = getWallTime();
+	for (unsigned i = 0, e = Locks.size(); i != e; ++i) {
+		std::vector<const Value*> Others(Locks.begin() + i + 1, Locks.end());
+		AA->contextAliasBatch(Locks[i], 0, Others, 0, Results);
+		for (unsigned j = 0, je = Results.size(); j != je; ++j)
+			BatchAliases += Results[j] != aliasAnalysis::NoAlias;
+	}
+	double BatchTime = getWallTime() - Start;
+
+	unsigned Aliases = LockAliases;
+	unsigned Queries = Pointers.empty() ? 0 : SolveQueries;
+	BenchRandom Random(SolveSeed);
+	std::vector<unsigned> Pairs(2 * Queries);
+	for (unsigned i = 0, e = Pairs.size(); i != e; ++i)
+		Pairs[i] = Random.next(Pointers.size());
+	Start = getWallTime();
+	for (unsigned i = 0; i != Queries; ++i)
+		Aliases += AA->alias(Pointers[Pairs[2 * i]], Pointers[Pairs[2 * i + 1]])
+				!= aliasAnalysis::NoAlias;
+	double QueryTime = getWallTime() - Start;
+
+	outs() << "Points-to sets: " << PointsToSetName << "\n";
+	outs() << format("Solve: %.4f s (fastest of %u)\n", SolveTime,
+			(unsigned) SolveRuns);
+	outs() << format("Lock queries: %u in %.4f s, %.0f/s\n", LockQueries,
+			LockTime, LockTime > 0 ? LockQueries / LockTime : 0.0);
+	outs() << format("Lock queries in batches: %u in %.4f s, %.0f/s\n",
+			LockQueries, BatchTime,
+			BatchTime > 0 ? LockQueries / BatchTime : 0.0);
+	if (BatchAliases != LockAliases)
+		outs() << "Batches disagree: " << BatchAliases << " may alias, not "
+				<< LockAliases << "\n";
+	outs() << format("Random queries: %u in %.4f s, %.0f/s\n", Queries,
+			QueryTime, QueryTime > 0 ? Queries / QueryTime : 0.0);
+	outs() << "May alias: " << Aliases << "\n";
+	delete AA;
+	delete M;
+	return 0;
+}
@@ -0,0 +1,64 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// anders-bench - Benchmarks of the parts of the Andersens analysis that are
+// worth timing on their own, on generated inputs.
+//
+//   anders-bench -bench=scc     cycle searches of the offline passes and
+//                               of the solver on deep copy chains
+//   anders-bench -bench=sets    set operations of both points-to set
+//                               backends
+//   anders-bench -bench=solve -solve-input=<bitcode>
+//                               solve time and alias query throughput of
+//                               the backend the tree was built with
+
+#include "Bench.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+
+using namespace llvm;
+
+namespace {
+enum BenchKind {
+	SCCBench, SetBench, SolveBench
+};
+
+cl::opt<BenchKind>
+Bench("bench", cl::desc("Choose the benchmark:"), cl::Required,
+		cl::values(
+				clEnumValN(SCCBench, "scc",
+						"Cycle searches on modules with deep chains"),
+				clEnumValN(SetBench, "sets",
+						"Set operations of both points-to set backends"),
+				clEnumValN(SolveBench, "solve",
+						"Solve and alias queries on a module"),
+				clEnumValEnd));
+}
+
+int main(int argc, char **argv) {
+	llvm_shutdown_obj Shutdown;
+	cl::ParseCommandLineOptions(argc, argv, " Andersens benchmarks\n");
+
+	switch (Bench) {
+	case SCCBench:
+		return runSCCBench();
+	case SetBench:
+		return runSetBench();
+	case SolveBench:
+		return runSolveBench();
+	}
+	return 1;
+}
@@ -0,0 +1,64 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// The checks of anders-check.  Each one reads its own options, reports what
+// it found and returns 0 if everything held, 1 otherwise.
+
+#ifndef ANDERSCHECK_CHECK_H_
+#define ANDERSCHECK_CHECK_H_
+
+#include <stdint.h>
+
+/// runSetCheck - Check HybridBitmap against SparseBitVector on random
+/// operations.
+int runSetCheck();
+
+/// runFieldCheck - Check that the field-sensitive analysis does not lose
+/// what memory copies and pointer arithmetic move between fields.
+int runFieldCheck();
+
+/// runPathCheck - Check the address path rule of the alias cache, and that
+/// the analysis agrees with it.
+int runPathCheck();
+
+/// runModelCheck - Check that the models of external functions do not lose
+/// what the calls return.
+int runModelCheck();
+
+/// runSolverCheck - Check that the wave solver gives every pointer of random
+/// modules the points-to set the work list solver gives it.
+int runSolverCheck();
+
+/// CheckRandom - A small deterministic generator, so that a failure can be
+/// replayed from its seed.
+class CheckRandom {
+	uint64_t State;
+
+public:
+	explicit CheckRandom(uint64_t Seed) :
+			State(Seed * 2862933555777941757ULL + 3037000493ULL) {
+	}
+
+	/// next - Return a number below Bound.
+	unsigned next(unsigned Bound) {
+		State ^= State << 13;
+		State ^= State >> 7;
+		State ^= State << 17;
+		return (unsigned) ((State >> 11) % Bound);
+	}
+};
+
+#endif /* ANDERSCHECK_CHECK_H_ */
@@ -0,0 +1,170 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// Checks of the field-sensitive analysis.
+//
+// Each case is a small module whose function @test returns a pointer, to be
+// compared with @expected, a global or a value of @test.  The module is
+// solved with -anders-field-sensitive, which anders-check always passes.
+// The soundness cases return a pointer that may point to @expected, and the
+// analysis must not answer NoAlias for the two; the precision cases return
+// the address of another field of the object @expected points into, and
+// the analysis must answer NoAlias.
+
+#include "Check.h"
+#include "../../include/Anders.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#include "llvm/Instructions.h"
+#include "llvm/ValueSymbolTable.h"
+#include "llvm/Assembly/Parser.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace {
+/// FieldCase - A module to solve, and what it checks.
+struct FieldCase {
+	const char *Name;
+	bool MayAlias;
+	const char *Assembly;
+};
+
+const FieldCase FieldCases[] = {
+// memcpy of a struct into a heap buffer of one node: the second field must
+// reach the buffer.
+{ "memcpy of a struct into an untyped buffer", true,
+		"%struct.pair = type { i32*, i32* }\n"
+		"@other = global i32 0\n"
+		"@expected = global i32 0\n"
+		"define i32* @test() {\n"
+		"entry:\n"
+		"  %s = alloca %struct.pair\n"
+		"  %first = getelementptr %struct.pair* %s, i32 0, i32 0\n"
+		"  store i32* @other, i32** %first\n"
+		"  %second = getelementptr %struct.pair* %s, i32 0, i32 1\n"
+		"  store i32* @expected, i32** %second\n"
+		"  %buf = call i8* @malloc(i64 16)\n"
+		"  %src = bitcast %struct.pair* %s to i8*\n"
+		"  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %buf, i8* %src, i64 16,"
+		" i32 8, i1 false)\n"
+		"  %copy = bitcast i8* %buf to %struct.pair*\n"
+		"  %field = getelementptr %struct.pair* %copy, i32 0, i32 1\n"
+		"  %result = load i32** %field\n"
+		"  ret i32* %result\n"
+		"}\n"
+		"declare i8* @malloc(i64)\n"
+		"declare void @llvm.memcpy.p0i8.p0i8.i64(i8*, i8*, i64, i32, i1)\n" },
+// A field read through a byte pointer moved off the start of the struct.
+{ "byte arithmetic into a struct", true,
+		"%struct.pair = type { i32*, i32* }\n"
+		"@expected = global i32 0\n"
+		"define i32* @test() {\n"
+		"entry:\n"
+		"  %s = alloca %struct.pair\n"
+		"  %second = getelementptr %struct.pair* %s, i32 0, i32 1\n"
+		"  store i32* @expected, i32** %second\n"
+		"  %bytes = bitcast %struct.pair* %s to i8*\n"
+		"  %at = getelementptr i8* %bytes, i64 8\n"
+		"  %slot = bitcast i8* %at to i32**\n"
+		"  %result = load i32** %slot\n"
+		"  ret i32* %result\n"
+		"}\n" },
+// container_of: from the address of a member back to the struct holding
+// it, and on to another field of that struct.
+{ "container_of from a member to its struct", true,
+		"%struct.link = type { %struct.link* }\n"
+		"%struct.node = type { i32*, %struct.link }\n"
+		"@expected = global i32 0\n"
+		"define i32* @test() {\n"
+		"entry:\n"
+		"  %n = alloca %struct.node\n"
+		"  %data = getelementptr %struct.node* %n, i32 0, i32 0\n"
+		"  store i32* @expected, i32** %data\n"
+		"  %link = getelementptr %struct.node* %n, i32 0, i32 1\n"
+		"  %bytes = bitcast %struct.link* %link to i8*\n"
+		"  %start = getelementptr i8* %bytes, i64 -8\n"
+		"  %owner = bitcast i8* %start to %struct.node*\n"
+		"  %field = getelementptr %struct.node* %owner, i32 0, i32 0\n"
+		"  %result = load i32** %field\n"
+		"  ret i32* %result\n"
+		"}\n" },
+// Two locks embedded in one heap struct, as in conn->rd and conn->wr: each
+// field is a node of its own, so the locks must be told apart.
+{ "locks in two fields of one struct", false,
+		"%union.pthread_mutex_t = type { i64, i64, i64, i64, i64 }\n"
+		"%struct.conn = type { i32, %union.pthread_mutex_t,"
+		" %union.pthread_mutex_t }\n"
+		"define %union.pthread_mutex_t* @test() {\n"
+		"entry:\n"
+		"  %mem = call i8* @malloc(i64 88)\n"
+		"  %conn = bitcast i8* %mem to %struct.conn*\n"
+		"  %rd = getelementptr %struct.conn* %conn, i32 0, i32 1\n"
+		"  %expected = getelementptr %struct.conn* %conn, i32 0, i32 2\n"
+		"  call i32 @pthread_mutex_lock(%union.pthread_mutex_t* %rd)\n"
+		"  call i32 @pthread_mutex_lock(%union.pthread_mutex_t* %expected)\n"
+		"  call i32 @pthread_mutex_unlock(%union.pthread_mutex_t* %expected)\n"
+		"  call i32 @pthread_mutex_unlock(%union.pthread_mutex_t* %rd)\n"
+		"  ret %union.pthread_mutex_t* %rd\n"
+		"}\n"
+		"declare i8* @malloc(i64)\n"
+		"declare i32 @pthread_mutex_lock(%union.pthread_mutex_t*)\n"
+		"declare i32 @pthread_mutex_unlock(%union.pthread_mutex_t*)\n" } };
+}
+
+/// checkFieldCase - Solve the module of C and return true if the analysis
+/// answers as C expects for the result of @test and @expected.
+static bool checkFieldCase(const FieldCase &C) {
+	SMDiagnostic Err;
+	Module *M = ParseAssemblyString(C.Assembly, 0, Err, getGlobalContext());
+	if (!M) {
+		Err.Print("anders-check", errs());
+		return false;
+	}
+
+	const Value *Result = 0;
+	Function *Test = M->getFunction("test");
+	for (Function::iterator BB = Test->begin(), E = Test->end(); BB != E; ++BB)
+		if (ReturnInst *RI = dyn_cast<ReturnInst>(BB->getTerminator()))
+			Result = RI->getReturnValue();
+
+	const Value *Expected = M->getNamedGlobal("expected");
+	if (!Expected)
+		Expected = Test->getValueSymbolTable().lookup("expected");
+
+	Andersens *AA = new Andersens(M);
+	AA->runOnModule();
+	bool MayAlias = AA->alias(Result, Expected) != aliasAnalysis::NoAlias;
+	delete AA;
+	delete M;
+	return MayAlias == C.MayAlias;
+}
+
+int runFieldCheck() {
+	unsigned Failures = 0;
+	unsigned NumCases = sizeof(FieldCases) / sizeof(FieldCases[0]);
+	for (unsigned i = 0; i != NumCases; ++i)
+		if (!checkFieldCase(FieldCases[i])) {
+			errs() << "anders-check: "
+					<< (FieldCases[i].MayAlias ? "NoAlias" : "MayAlias")
+					<< " for the " << FieldCases[i].Name << "\n";
+			++Failures;
+		}
+	outs() << "fields: " << NumCases << " cases, " << Failures
+			<< " failures\n";
+	return Failures != 0;
+}
@@ -0,0 +1,110 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// Soundness checks of the built-in models of external functions.
+//
+// Each case is a small module whose function @test returns what a modelled
+// call returns, which may point to the global @expected, and the analysis
+// must not answer NoAlias for the two.
+
+#include "Check.h"
+#include "../../include/Anders.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#include "llvm/Instructions.h"
+#include "llvm/Assembly/Parser.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace {
+/// ModelCase - A module to solve, and what it checks.
+struct ModelCase {
+	const char *Name;
+	const char *Assembly;
+};
+
+const ModelCase ModelCases[] = {
+// The value of a thread-specific key, read back in another function.
+{ "pthread_getspecific of a value set before",
+		"@expected = global i32 0\n"
+		"define void @set(i32 %key) {\n"
+		"entry:\n"
+		"  %value = bitcast i32* @expected to i8*\n"
+		"  %r = call i32 @pthread_setspecific(i32 %key, i8* %value)\n"
+		"  ret void\n"
+		"}\n"
+		"define i8* @test(i32 %key) {\n"
+		"entry:\n"
+		"  %result = call i8* @pthread_getspecific(i32 %key)\n"
+		"  ret i8* %result\n"
+		"}\n"
+		"declare i32 @pthread_setspecific(i32, i8*)\n"
+		"declare i8* @pthread_getspecific(i32)\n" },
+// strtok given NULL goes on in the string of an earlier call.
+{ "strtok of NULL after a string",
+		"@expected = global [8 x i8] zeroinitializer\n"
+		"@delim = global [2 x i8] zeroinitializer\n"
+		"define i8* @test() {\n"
+		"entry:\n"
+		"  %s = getelementptr [8 x i8]* @expected, i32 0, i32 0\n"
+		"  %d = getelementptr [2 x i8]* @delim, i32 0, i32 0\n"
+		"  %first = call i8* @strtok(i8* %s, i8* %d)\n"
+		"  %result = call i8* @strtok(i8* null, i8* %d)\n"
+		"  ret i8* %result\n"
+		"}\n"
+		"declare i8* @strtok(i8*, i8*)\n" } };
+}
+
+/// checkModelCase - Solve the module of C and return true if the result of
+/// @test may alias @expected.
+static bool checkModelCase(const ModelCase &C) {
+	SMDiagnostic Err;
+	Module *M = ParseAssemblyString(C.Assembly, 0, Err, getGlobalContext());
+	if (!M) {
+		Err.Print("anders-check", errs());
+		return false;
+	}
+
+	const Value *Result = 0;
+	Function *Test = M->getFunction("test");
+	for (Function::iterator BB = Test->begin(), E = Test->end(); BB != E; ++BB)
+		if (ReturnInst *RI = dyn_cast<ReturnInst>(BB->getTerminator()))
+			Result = RI->getReturnValue();
+
+	Andersens *AA = new Andersens(M);
+	AA->runOnModule();
+	bool Sound = AA->alias(Result, M->getNamedGlobal("expected"))
+			!= aliasAnalysis::NoAlias;
+	delete AA;
+	delete M;
+	return Sound;
+}
+
+int runModelCheck() {
+	unsigned Failures = 0;
+	unsigned NumCases = sizeof(ModelCases) / sizeof(ModelCases[0]);
+	for (unsigned i = 0; i != NumCases; ++i)
+		if (!checkModelCase(ModelCases[i])) {
+			errs() << "anders-check: NoAlias for the " << ModelCases[i].Name
+					<< "\n";
+			++Failures;
+		}
+	outs() << "models: " << NumCases << " cases, " << Failures
+			<< " failures\n";
+	return Failures != 0;
+}
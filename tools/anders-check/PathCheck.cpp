@@ -0,0 +1,162 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// Checks of the address path rule, getPathAlias, which the alias cache
+// answers queries on globals and allocas by before asking the analysis.
+//
+// Every case is a pair of values of one module, each taken in the call
+// named with it, if any.  The rule must give the answer the case expects,
+// or none, and the Andersens analysis must agree with it: give the same
+// answer, or, where the rule tells nothing, not MustAlias.
+
+#include "Check.h"
+#include "../../include/Anders.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#include "llvm/Instructions.h"
+#include "llvm/ValueSymbolTable.h"
+#include "llvm/Assembly/Parser.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace {
+const char PathModule[] =
+		"%struct.triple = type { i32, i32, i32 }\n"
+		"@g = global %struct.triple zeroinitializer\n"
+		"@tls = thread_local global %struct.triple zeroinitializer\n"
+		"define i32 @lock(%struct.triple* %p) {\n"
+		"entry:\n"
+		"  %p.second = getelementptr %struct.triple* %p, i32 0, i32 1\n"
+		"  %p.third = getelementptr %struct.triple* %p, i32 0, i32 2\n"
+		"  ret i32 0\n"
+		"}\n"
+		"define void @test() {\n"
+		"entry:\n"
+		"  %a = alloca %struct.triple\n"
+		"  %a.whole = bitcast %struct.triple* %a to i32*\n"
+		"  %a.first = getelementptr %struct.triple* %a, i32 0, i32 0\n"
+		"  %a.second = getelementptr %struct.triple* %a, i32 0, i32 1\n"
+		"  %a.third = getelementptr %struct.triple* %a, i32 0, i32 2\n"
+		"  %g.whole = bitcast %struct.triple* @g to i32*\n"
+		"  %g.first = getelementptr %struct.triple* @g, i32 0, i32 0\n"
+		"  %g.second = getelementptr %struct.triple* @g, i32 0, i32 1\n"
+		"  %tls.whole = bitcast %struct.triple* @tls to i32*\n"
+		"  %tls.first = getelementptr %struct.triple* @tls, i32 0, i32 0\n"
+		"  %call.g = call i32 @lock(%struct.triple* @g)\n"
+		"  %call.a = call i32 @lock(%struct.triple* %a)\n"
+		"  ret void\n"
+		"}\n";
+
+/// PathCase - Two values to compare, each in the call named with it, or in
+/// no call if that is empty, and the answer the rule must give, if any.
+struct PathCase {
+	const char *Name;
+	const char *V1, *Context1;
+	const char *V2, *Context2;
+	bool Answered;
+	aliasAnalysis::aliasResult Result;
+};
+
+const PathCase PathCases[] = {
+	{ "equal paths into a global", "g.whole", "", "g.first", "", true,
+			aliasAnalysis::MustAlias },
+	{ "equal paths into an alloca", "a.whole", "", "a.first", "", false,
+			aliasAnalysis::MayAlias },
+	{ "equal paths into a thread-local global", "tls.whole", "",
+			"tls.first", "", false, aliasAnalysis::MayAlias },
+	{ "two fields of an alloca", "a.second", "", "a.third", "", true,
+			aliasAnalysis::NoAlias },
+	{ "an alloca and a global", "a.first", "", "g.whole", "", true,
+			aliasAnalysis::NoAlias },
+	{ "a global passed to a call", "g.second", "", "p.second", "call.g",
+			true, aliasAnalysis::MustAlias },
+	{ "another field of a global passed to a call", "g.second", "",
+			"p.third", "call.g", true, aliasAnalysis::NoAlias },
+	{ "an alloca passed to a call", "a.second", "", "p.second", "call.a",
+			false, aliasAnalysis::MayAlias } };
+}
+
+/// findValue - Return the global or the value of a function of M named
+/// Name.
+static Value *findValue(Module *M, const char *Name) {
+	if (GlobalVariable *GV = M->getNamedGlobal(Name))
+		return GV;
+	for (Module::iterator F = M->begin(), E = M->end(); F != E; ++F)
+		if (!F->isDeclaration())
+			if (Value *V = F->getValueSymbolTable().lookup(Name))
+				return V;
+	return 0;
+}
+
+/// printAnswer - Print the answer the rule gave, if any.
+static void printAnswer(raw_ostream &OS, bool Answered,
+		aliasAnalysis::aliasResult Result) {
+	if (!Answered)
+		OS << "no answer";
+	else if (Result == aliasAnalysis::NoAlias)
+		OS << "NoAlias";
+	else if (Result == aliasAnalysis::MustAlias)
+		OS << "MustAlias";
+	else
+		OS << "MayAlias";
+}
+
+int runPathCheck() {
+	SMDiagnostic Err;
+	Module *M = ParseAssemblyString(PathModule, 0, Err, getGlobalContext());
+	if (!M) {
+		Err.Print("anders-check", errs());
+		return 1;
+	}
+	Andersens *AA = new Andersens(M);
+	AA->runOnModule();
+
+	unsigned Failures = 0;
+	unsigned NumCases = sizeof(PathCases) / sizeof(PathCases[0]);
+	for (unsigned i = 0; i != NumCases; ++i) {
+		const PathCase &C = PathCases[i];
+		const Value *V1 = findValue(M, C.V1);
+		const Value *V2 = findValue(M, C.V2);
+		const Instruction *Context1 =
+				*C.Context1 ? cast<Instruction>(findValue(M, C.Context1)) : 0;
+		const Instruction *Context2 =
+				*C.Context2 ? cast<Instruction>(findValue(M, C.Context2)) : 0;
+
+		aliasAnalysis::aliasResult Result = aliasAnalysis::MayAlias;
+		bool Answered = getPathAlias(V1, Context1, V2, Context2, Result);
+		aliasAnalysis::aliasResult Analysis =
+				AA->contextAlias(V1, Context1, V2, Context2);
+		if (Answered != C.Answered || (Answered && Result != C.Result)) {
+			errs() << "anders-check: the path rule gave ";
+			printAnswer(errs(), Answered, Result);
+			errs() << " for " << C.Name << "\n";
+			++Failures;
+		} else if (Answered ? Analysis != Result
+				: Analysis == aliasAnalysis::MustAlias) {
+			errs() << "anders-check: the analysis gave ";
+			printAnswer(errs(), true, Analysis);
+			errs() << " against the path rule for " << C.Name << "\n";
+			++Failures;
+		}
+	}
+	delete AA;
+	delete M;
+	outs() << "paths: " << NumCases << " cases, " << Failures
+			<< " failures\n";
+	return Failures != 0;
+}
@@ -0,0 +1,187 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// Randomized check of HybridBitmap against SparseBitVector.
+//
+// HybridBitmap is always built, whichever type PointsToSet is, so it is
+// checked in every build.  A handful of pairs of sets, one of each type,
+// go through the same random operations, and after each one the pair it
+// touched must hold the same elements, and the HybridBitmap must be in the
+// one form its elements call for.  The elements are drawn so that sets
+// often cross MaxMembers, and the chunk boundaries, in both directions.
+
+#include "Check.h"
+#include "../../include/PointsToSet.h"
+#include "llvm/ADT/SparseBitVector.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+cl::opt<unsigned>
+SetOps("set-ops", cl::init(200000),
+		cl::desc("Random operations of the set check"));
+
+cl::opt<unsigned>
+SetSeed("set-seed", cl::init(1), cl::desc("Seed of the set check"));
+}
+
+namespace {
+/// SetPair - A HybridBitmap and the SparseBitVector it must agree with.
+struct SetPair {
+	HybridBitmap Hybrid;
+	SparseBitVector<> Sparse;
+};
+
+enum SetOp {
+	OpSet, OpReset, OpTestAndSet, OpTest, OpUnion, OpIntersect, OpSubtract,
+	OpSubtractInto, OpIntersects, OpEqual, OpClear, OpCopy, NumSetOps
+};
+
+const char *const SetOpNames[NumSetOps] = { "set", "reset", "test_and_set",
+		"test", "|=", "&=", "intersectWithComplement",
+		"intersectWithComplement (3 sets)", "intersects", "==", "clear",
+		"copy" };
+}
+
+/// randomElement - Return an element near the start, near a chunk boundary
+/// or anywhere in a large range, so that sets are small and large, and
+/// sparse and dense.
+static unsigned randomElement(CheckRandom &Random) {
+	switch (Random.next(4)) {
+	case 0:
+		return Random.next(2 * HybridBitmap::MaxMembers);
+	case 1:
+		return Random.next(64) * HybridBitmap::ChunkBits + Random.next(5) - 2
+				+ HybridBitmap::ChunkBits;
+	case 2:
+		return Random.next(4 * HybridBitmap::ChunkBits);
+	default:
+		return Random.next(1 << 20);
+	}
+}
+
+/// sameSets - Return true if the two sets of P hold the same elements, in
+/// the same order, and agree on their size, and if the HybridBitmap is equal
+/// to, and hashes like, one built from scratch with its elements.  Equal
+/// sets must have equal representations, whatever operations made them.
+static bool sameSets(const SetPair &P) {
+	HybridBitmap Fresh;
+	HybridBitmap::iterator HI = P.Hybrid.begin(), HE = P.Hybrid.end();
+	SparseBitVector<>::iterator SI = P.Sparse.begin(), SE = P.Sparse.end();
+	for (; HI != HE && SI != SE; ++HI, ++SI) {
+		if (*HI != *SI)
+			return false;
+		Fresh.set(*SI);
+	}
+	return HI == HE && SI == SE && P.Hybrid.count() == P.Sparse.count()
+			&& P.Hybrid.empty() == P.Sparse.empty() && Fresh == P.Hybrid
+			&& Fresh.getHashValue() == P.Hybrid.getHashValue();
+}
+
+int runSetCheck() {
+	static const unsigned NumPairs = 6;
+	std::vector<SetPair> Pairs(NumPairs);
+	CheckRandom Random(SetSeed);
+	unsigned Failures = 0;
+
+	for (unsigned Step = 0; Step != SetOps; ++Step) {
+		SetOp Op = (SetOp) Random.next(NumSetOps);
+		// Element operations come up more often, so that sets grow.
+		if (Random.next(2))
+			Op = (SetOp) Random.next(OpTest + 1);
+		SetPair &A = Pairs[Random.next(NumPairs)];
+		SetPair &B = Pairs[Random.next(NumPairs)];
+		SetPair &C = Pairs[Random.next(NumPairs)];
+		unsigned Element = randomElement(Random);
+		bool Agree = true;
+
+		switch (Op) {
+		case OpSet:
+			A.Hybrid.set(Element);
+			A.Sparse.set(Element);
+			break;
+		case OpReset:
+			// Reset members as often as not.
+			if (!A.Sparse.empty() && Random.next(2)) {
+				SparseBitVector<>::iterator I = A.Sparse.begin();
+				for (unsigned n = Random.next(A.Sparse.count()); n; --n)
+					++I;
+				Element = *I;
+			}
+			A.Hybrid.reset(Element);
+			A.Sparse.reset(Element);
+			break;
+		case OpTestAndSet:
+			Agree = A.Hybrid.test_and_set(Element)
+					== A.Sparse.test_and_set(Element);
+			break;
+		case OpTest:
+			Agree = A.Hybrid.test(Element) == A.Sparse.test(Element);
+			break;
+		case OpUnion:
+			Agree = (A.Hybrid |= B.Hybrid) == (A.Sparse |= B.Sparse);
+			break;
+		case OpIntersect:
+			Agree = (A.Hybrid &= B.Hybrid) == (A.Sparse &= B.Sparse);
+			break;
+		case OpSubtract:
+			Agree = A.Hybrid.intersectWithComplement(B.Hybrid)
+					== A.Sparse.intersectWithComplement(B.Sparse);
+			break;
+		case OpSubtractInto:
+			A.Hybrid.intersectWithComplement(B.Hybrid, C.Hybrid);
+			A.Sparse.intersectWithComplement(B.Sparse, C.Sparse);
+			break;
+		case OpIntersects:
+			Agree = A.Hybrid.intersects(B.Hybrid)
+					== A.Sparse.intersects(B.Sparse);
+			break;
+		case OpEqual:
+			Agree = (A.Hybrid == B.Hybrid) == (A.Sparse == B.Sparse);
+			// Equal sets must hash alike, or the pool would keep both.
+			if (A.Hybrid == B.Hybrid)
+				Agree &= A.Hybrid.getHashValue() == B.Hybrid.getHashValue();
+			break;
+		case OpClear:
+			A.Hybrid.clear();
+			A.Sparse.clear();
+			break;
+		case OpCopy:
+			A.Hybrid = B.Hybrid;
+			A.Sparse = B.Sparse;
+			break;
+		default:
+			break;
+		}
+
+		if (!Agree || !sameSets(A)) {
+			errs() << "anders-check: sets differ after " << SetOpNames[Op]
+					<< " at step " << Step << " with -set-seed=" << SetSeed
+					<< "\n";
+			if (++Failures == 10)
+				break;
+			A.Hybrid.clear();
+			A.Sparse.clear();
+		}
+	}
+
+	outs() << "sets: " << SetOps << " operations, " << Failures
+			<< " failures\n";
+	return Failures != 0;
+}
@@ -0,0 +1,199 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// Differential check of the wave propagation solver against the work list
+// solver.
+//
+// Both solvers compute the least solution of the same constraints, so they
+// must give every pointer the same points-to set.  Random modules are built
+// from mallocs, globals, loads, stores, struct fields, selects, direct calls
+// and calls through pointers, which reach every kind of constraint and give
+// the cycles the solvers collapse.  Each module is analyzed once with each
+// solver, and every pointer the module defines is compared.
+
+#include "Check.h"
+#include "../../include/Anders.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#include "llvm/Assembly/Parser.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+cl::opt<unsigned>
+SolverModules("solver-modules", cl::init(200),
+		cl::desc("Random modules of the solver check"));
+
+cl::opt<unsigned>
+SolverSeed("solver-seed", cl::init(1),
+		cl::desc("Seed of the solver check"));
+
+const unsigned NumGlobals = 8;
+const unsigned NumFunctions = 6;
+const unsigned NumStatements = 40;
+}
+
+/// pickValue - Return the name of one of the first Count values of the
+/// function being built.
+static std::string pickValue(CheckRandom &Random, unsigned Count) {
+	std::string Name;
+	raw_string_ostream OS(Name);
+	OS << "%v" << Random.next(Count);
+	return OS.str();
+}
+
+/// buildModule - Return the text of a random module.  Every function takes
+/// two pointers and defines %v0 to %vN, each an i8*, from the values before
+/// it.
+static std::string buildModule(CheckRandom &Random) {
+	std::string Text;
+	raw_string_ostream OS(Text);
+	OS << "%struct.triple = type { i8*, i8*, i8* }\n"
+			<< "declare i8* @malloc(i64)\n";
+	for (unsigned g = 0; g != NumGlobals; ++g)
+		OS << "@g" << g << " = global i8* null\n";
+
+	for (unsigned f = 0; f != NumFunctions; ++f) {
+		OS << "define " << (f ? "internal " : "") << "i8* @f" << f
+				<< "(i8* %a, i8* %b) {\n" << "entry:\n"
+				<< "  %v0 = bitcast i8* %a to i8*\n"
+				<< "  %v1 = bitcast i8* %b to i8*\n";
+		unsigned Count = 2;
+		for (unsigned i = 0; i != NumStatements; ++i, ++Count) {
+			std::string X = pickValue(Random, Count);
+			std::string Y = pickValue(Random, Count);
+			OS << "  ";
+			switch (Random.next(10)) {
+			case 0:
+				OS << "%v" << Count << " = call i8* @malloc(i64 24)\n";
+				break;
+			case 1:
+				OS << "%v" << Count << " = bitcast i8** @g"
+						<< Random.next(NumGlobals) << " to i8*\n";
+				break;
+			case 2:
+				OS << "%s" << Count << " = bitcast i8* " << X << " to i8**\n"
+						<< "  store i8* " << Y << ", i8** %s" << Count << "\n"
+						<< "  %v" << Count << " = bitcast i8* " << Y
+						<< " to i8*\n";
+				break;
+			case 3:
+			case 4:
+				OS << "%s" << Count << " = bitcast i8* " << X << " to i8**\n"
+						<< "  %v" << Count << " = load i8** %s" << Count << "\n";
+				break;
+			case 5:
+				OS << "%s" << Count << " = bitcast i8* " << X
+						<< " to %struct.triple*\n" << "  %t" << Count
+						<< " = getelementptr %struct.triple* %s" << Count
+						<< ", i32 0, i32 " << Random.next(3) << "\n" << "  %v"
+						<< Count << " = bitcast i8** %t" << Count << " to i8*\n";
+				break;
+			case 6:
+				OS << "%v" << Count << " = select i1 true, i8* " << X
+						<< ", i8* " << Y << "\n";
+				break;
+			case 7:
+				OS << "%v" << Count << " = call i8* @f"
+						<< Random.next(NumFunctions) << "(i8* " << X << ", i8* "
+						<< Y << ")\n";
+				break;
+			case 8:
+				OS << "%v" << Count << " = bitcast i8* (i8*, i8*)* @f"
+						<< Random.next(NumFunctions) << " to i8*\n";
+				break;
+			default:
+				OS << "%c" << Count << " = bitcast i8* " << X
+						<< " to i8* (i8*, i8*)*\n" << "  %v" << Count
+						<< " = call i8* %c" << Count << "(i8* " << Y << ", i8* "
+						<< pickValue(Random, Count) << ")\n";
+				break;
+			}
+		}
+		OS << "  ret i8* " << pickValue(Random, Count) << "\n" << "}\n";
+	}
+	return OS.str();
+}
+
+/// getSolution - Set Sets to the sorted points-to set of every pointer of
+/// M, as the analysis solved with the given solver sees it.
+static void getSolution(Module *M, bool Wave,
+		std::vector<std::vector<unsigned> > &Sets) {
+	Andersens *AA = new Andersens(M);
+	AA->setWaveSolver(Wave);
+	AA->runOnModule();
+	std::vector<const Value*> Pointers;
+	for (Module::global_iterator G = M->global_begin(), E = M->global_end();
+			G != E; ++G)
+		Pointers.push_back(G);
+	for (Module::iterator F = M->begin(), FE = M->end(); F != FE; ++F) {
+		if (F->isDeclaration())
+			continue;
+		for (Function::arg_iterator A = F->arg_begin(), E = F->arg_end();
+				A != E; ++A)
+			Pointers.push_back(A);
+		for (Function::iterator B = F->begin(), BE = F->end(); B != BE; ++B)
+			for (BasicBlock::iterator I = B->begin(), E = B->end(); I != E; ++I)
+				if (isa<PointerType>(I->getType()))
+					Pointers.push_back(I);
+	}
+
+	Sets.assign(Pointers.size(), std::vector<unsigned>());
+	for (unsigned i = 0, e = Pointers.size(); i != e; ++i) {
+		AA->getPointsTo(Pointers[i], 0, Sets[i]);
+		std::sort(Sets[i].begin(), Sets[i].end());
+	}
+	delete AA;
+}
+
+int runSolverCheck() {
+	CheckRandom Random(SolverSeed);
+	unsigned Failures = 0;
+	for (unsigned m = 0; m != SolverModules; ++m) {
+		std::string Text = buildModule(Random);
+		SMDiagnostic Err;
+		Module *M = ParseAssemblyString(Text.c_str(), 0, Err,
+				getGlobalContext());
+		if (!M) {
+			Err.Print("anders-check", errs());
+			return 1;
+		}
+
+		std::vector<std::vector<unsigned> > WorkList, Wave;
+		getSolution(M, false, WorkList);
+		getSolution(M, true, Wave);
+		unsigned Differing = 0;
+		for (unsigned i = 0, e = WorkList.size(); i != e; ++i)
+			if (WorkList[i] != Wave[i])
+				++Differing;
+		if (Differing) {
+			errs() << "anders-check: the solvers disagree on " << Differing
+					<< " pointers of module " << m << " (seed " << SolverSeed
+					<< ")\n";
+			++Failures;
+		}
+		delete M;
+	}
+	outs() << "solvers: " << SolverModules << " modules, " << Failures
+			<< " failures\n";
+	return Failures != 0;
+}
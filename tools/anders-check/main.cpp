@@ -0,0 +1,92 @@
+// Copyright 2014 Shanghai Jiao Tong University
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Authors - Trusted Cloud Group (http://tcloud.sjtu.edu.cn)
+
+// anders-check - Self-checks of the Andersens analysis.  Runs every check,
+// or those given with -check, and exits with 1 if any of them failed.  The
+// analysis is always run with -anders-field-sensitive.
+//
+//   anders-check -check=sets     HybridBitmap against SparseBitVector
+//   anders-check -check=fields   field sensitivity on small modules
+//   anders-check -check=paths    the address path rule against the analysis
+//   anders-check -check=models   models of external functions
+//   anders-check -check=solvers  the wave solver against the work list solver
+
+#include "Check.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+enum CheckKind {
+	SetCheck, FieldCheck, PathCheck, ModelCheck, SolverCheck
+};
+
+cl::list<CheckKind>
+Checks("check", cl::desc("Run only these checks:"), cl::CommaSeparated,
+		cl::values(
+				clEnumValN(SetCheck, "sets",
+						"HybridBitmap against SparseBitVector"),
+				clEnumValN(FieldCheck, "fields",
+						"Field sensitivity on small modules"),
+				clEnumValN(PathCheck, "paths",
+						"The address path rule against the analysis"),
+				clEnumValN(ModelCheck, "models",
+						"Models of external functions"),
+				clEnumValN(SolverCheck, "solvers",
+						"The wave solver against the work list solver"),
+				clEnumValEnd));
+}
+
+int main(int argc, char **argv) {
+	llvm_shutdown_obj Shutdown;
+	std::vector<char *> Args(argv, argv + argc);
+	char FieldSensitive[] = "-anders-field-sensitive";
+	Args.insert(Args.begin() + 1, FieldSensitive);
+	cl::ParseCommandLineOptions(Args.size(), &Args[0],
+			" Andersens self-checks\n");
+
+	std::vector<CheckKind> ToRun(Checks.begin(), Checks.end());
+	if (ToRun.empty()) {
+		ToRun.push_back(SetCheck);
+		ToRun.push_back(FieldCheck);
+		ToRun.push_back(PathCheck);
+		ToRun.push_back(ModelCheck);
+		ToRun.push_back(SolverCheck);
+	}
+
+	int Status = 0;
+	for (unsigned i = 0, e = ToRun.size(); i != e; ++i)
+		switch (ToRun[i]) {
+		case SetCheck:
+			Status |= runSetCheck();
+			break;
+		case FieldCheck:
+			Status |= runFieldCheck();
+			break;
+		case PathCheck:
+			Status |= runPathCheck();
+			break;
+		case ModelCheck:
+			Status |= runModelCheck();
+			break;
+		case SolverCheck:
+			Status |= runSolverCheck();
+			break;
+		}
+	return Status;
+}